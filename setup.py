@@ -165,7 +165,18 @@ pylikwid = Extension("pylikwid.pylikwid",
                      runtime_library_dirs=[LIKWID_LIBPATH],
                      extra_compile_args=get_extra_compile_args(),
                      sources=get_sources(),
-                     py_limited_api=True,
+                     depends=["src/pylikwid/pylikwid_api.h"],
+)
+
+bench = Extension("pylikwid.bench",
+                  include_dirs=get_include_dirs(),
+                  libraries=get_libraries(),
+                  library_dirs=[LIKWID_LIBPATH],
+                  runtime_library_dirs=[LIKWID_LIBPATH],
+                  extra_compile_args=get_extra_compile_args() + ["-O3", "-pthread"],
+                  extra_link_args=["-pthread"],
+                  sources=["src/pylikwid/bench.c"],
+                  depends=["src/pylikwid/pylikwid_api.h"],
 )
 
 setup(
@@ -177,5 +188,5 @@ setup(
     license="GPLv2",
     packages=find_packages(where="src"),
     package_dir={"": "src"},
-    ext_modules=[pylikwid],
+    ext_modules=[pylikwid, bench],
 )
@@ -1,6 +1,22 @@
 import functools
 
 from .pylikwid import *
+from . import bench
+
+
+def __getattr__(name):
+    # The executor pulls in concurrent.futures, import it on first use only
+    if name in ("PinnedExecutor", "current_placement"):
+        from . import executor
+        return getattr(executor, name)
+    if name in ("PowerCapController", "LikwidPowerBackend", "SimulatedPowerBackend"):
+        from . import powercap
+        return getattr(powercap, name)
+    if name in ("sweep_frequencies", "apply_frequency_profile", "FrequencyProfile",
+                "rollback_frequency_profiles"):
+        from . import frequency
+        return getattr(frequency, name)
+    raise AttributeError(f"module {__name__!r} has no attribute {name!r}")
 
 
 def profile(_func=None, *, region_name=None):
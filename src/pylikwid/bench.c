@@ -0,0 +1,1086 @@
+#include <Python.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <likwid.h>
+
+#include "pylikwid_api.h"
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+
+#define PYSTR(str) (Py_BuildValue("s", str))
+#define PYINT(val) (Py_BuildValue("i", val))
+
+/* Every kernel works on blocks of 8 doubles (one 64 byte cache line). GCC
+ * lowers the vector type to the widest SIMD unit selected by the clone. */
+typedef double v8d __attribute__((vector_size(64)));
+#define BLOCK (sizeof(v8d) / sizeof(double))
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define BENCH_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define BENCH_CLONES
+#endif
+
+#define DEFAULT_MINTIME 0.1
+
+typedef enum {
+    KERNEL_LOAD = 0,
+    KERNEL_STORE,
+    KERNEL_COPY,
+    KERNEL_TRIAD,
+    NUM_KERNELS
+} BenchKernel;
+
+static const char* kernel_names[NUM_KERNELS] = {"load", "store", "copy", "triad"};
+static const int kernel_streams[NUM_KERNELS] = {1, 1, 2, 3};
+
+static volatile double bench_sink = 0;
+
+/* The topology, NUMA and affinity state of pylikwid.pylikwid */
+static PylikwidAPI* pylikwid_api = NULL;
+#define cputopo (*pylikwid_api->cputopo)
+#define numainfo (*pylikwid_api->numainfo)
+#define affinity (*pylikwid_api->affinity)
+
+/*
+################################################################################
+# Kernels
+################################################################################
+*/
+
+BENCH_CLONES static double
+kernel_load(const v8d* restrict a, size_t n)
+{
+    v8d s0 = {0}, s1 = {0}, s2 = {0}, s3 = {0};
+    size_t i;
+    for (i = 0; i + 3 < n; i += 4)
+    {
+        s0 += a[i];
+        s1 += a[i+1];
+        s2 += a[i+2];
+        s3 += a[i+3];
+    }
+    for (; i < n; i++)
+        s0 += a[i];
+    s0 += s1 + s2 + s3;
+    return s0[0] + s0[BLOCK-1];
+}
+
+BENCH_CLONES static void
+kernel_store(v8d* restrict a, size_t n, double s)
+{
+    v8d v = {0};
+    v += s;
+    for (size_t i = 0; i < n; i++)
+        a[i] = v;
+}
+
+BENCH_CLONES static void
+kernel_copy(v8d* restrict a, const v8d* restrict b, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        a[i] = b[i];
+}
+
+BENCH_CLONES static void
+kernel_triad(v8d* restrict a, const v8d* restrict b, const v8d* restrict c, size_t n, double s)
+{
+    for (size_t i = 0; i < n; i++)
+        a[i] = b[i] + s * c[i];
+}
+
+/* Out-of-place transpose b = a^T of an n x n matrix with row stride ld in
+ * square tiles of tile x tile elements (tile 0: untiled) */
+BENCH_CLONES static void
+kernel_transpose(double* restrict b, const double* restrict a, size_t n, size_t ld, size_t tile)
+{
+    size_t ii, jj, i, j;
+    if (tile == 0 || tile >= n)
+        tile = n;
+    for (ii = 0; ii < n; ii += tile)
+    {
+        size_t imax = (ii + tile < n ? ii + tile : n);
+        for (jj = 0; jj < n; jj += tile)
+        {
+            size_t jmax = (jj + tile < n ? jj + tile : n);
+            for (i = ii; i < imax; i++)
+                for (j = jj; j < jmax; j++)
+                    b[j * ld + i] = a[i * ld + j];
+        }
+    }
+}
+
+static double
+bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1E-9;
+}
+
+/*
+################################################################################
+# Threading
+################################################################################
+*/
+
+/* Holds the threads back until all of them are created, then lets them run
+ * (state 1) or exit (state -1) */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int state;
+} BenchGate;
+
+static int
+bench_gate_wait(BenchGate* g)
+{
+    int state;
+    pthread_mutex_lock(&g->lock);
+    while (g->state == 0)
+        pthread_cond_wait(&g->cond, &g->lock);
+    state = g->state;
+    pthread_mutex_unlock(&g->lock);
+    return state;
+}
+
+static void
+bench_gate_open(BenchGate* g, int state)
+{
+    pthread_mutex_lock(&g->lock);
+    g->state = state;
+    pthread_cond_broadcast(&g->cond);
+    pthread_mutex_unlock(&g->lock);
+}
+
+typedef struct {
+    BenchKernel kernel;
+    int cpu;
+    int node;
+    size_t size;
+    double mintime;
+    BenchGate* gate;
+    pthread_barrier_t* barrier;
+    /* results */
+    int err;
+    double time;
+    double bytes;
+} BenchThread;
+
+/* Returns NULL with errno set if the memory cannot be mapped or bound to
+ * the node, the results would not belong to the requested placement */
+static void*
+bench_alloc(size_t size, int node)
+{
+    unsigned long nodemask[16];
+    void* ptr;
+    if (node >= (int)(sizeof(nodemask) * 8))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+        return NULL;
+    if (node >= 0)
+    {
+        memset(nodemask, 0, sizeof(nodemask));
+        nodemask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+        if (syscall(SYS_mbind, ptr, size, MPOL_BIND, nodemask, sizeof(nodemask) * 8, 0) != 0)
+        {
+            int err = errno;
+            munmap(ptr, size);
+            errno = err;
+            return NULL;
+        }
+    }
+    return ptr;
+}
+
+static void*
+bench_thread(void* arg)
+{
+    BenchThread* t = (BenchThread*)arg;
+    int s, nstreams = kernel_streams[t->kernel];
+    size_t n = t->size / (nstreams * sizeof(v8d));
+    v8d* arrays[3] = {NULL, NULL, NULL};
+    double start, now, sum = 0;
+    long reps = 0;
+
+    if (n == 0)
+        n = 1;
+    if (bench_gate_wait(t->gate) < 0)
+        return NULL;
+    if (t->cpu >= 0)
+        likwid_pinThread(t->cpu);
+    /* Allocation after pinning, so the first touch places the pages near the
+     * CPU unless a node is given explicitly */
+    for (s = 0; s < nstreams; s++)
+    {
+        arrays[s] = bench_alloc(n * sizeof(v8d), t->node);
+        if (arrays[s] == NULL)
+        {
+            t->err = errno;
+            break;
+        }
+        kernel_store(arrays[s], n, 1.0);
+    }
+    pthread_barrier_wait(t->barrier);
+    if (t->err == 0)
+    {
+        start = bench_now();
+        do
+        {
+            switch (t->kernel)
+            {
+                case KERNEL_LOAD:
+                    sum += kernel_load(arrays[0], n);
+                    break;
+                case KERNEL_STORE:
+                    kernel_store(arrays[0], n, 1.0);
+                    break;
+                case KERNEL_COPY:
+                    kernel_copy(arrays[0], arrays[1], n);
+                    break;
+                case KERNEL_TRIAD:
+                    kernel_triad(arrays[0], arrays[1], arrays[2], n, 1.0);
+                    break;
+                default:
+                    break;
+            }
+            reps++;
+            now = bench_now();
+        } while (now - start < t->mintime);
+        t->time = now - start;
+        t->bytes = (double)reps * n * nstreams * sizeof(v8d);
+        bench_sink = sum;
+    }
+    for (s = 0; s < nstreams; s++)
+    {
+        if (arrays[s])
+            munmap(arrays[s], n * sizeof(v8d));
+    }
+    return NULL;
+}
+
+/* Runs the kernel on all CPUs. Returns summed bandwidth in bytes/s or a
+ * negative errno. */
+static int
+bench_run(BenchKernel kernel, int ncpus, const int* cpus, int node, size_t size,
+          double mintime, double* bandwidth, double* maxtime, double* bytes)
+{
+    int i, nstarted, err = 0;
+    pthread_barrier_t barrier;
+    BenchGate gate = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0};
+    BenchThread* threads = calloc(ncpus, sizeof(BenchThread));
+    pthread_t* tids = calloc(ncpus, sizeof(pthread_t));
+
+    if (!threads || !tids)
+    {
+        free(threads);
+        free(tids);
+        return -ENOMEM;
+    }
+    pthread_barrier_init(&barrier, NULL, ncpus);
+    for (i = 0; i < ncpus; i++)
+    {
+        threads[i].kernel = kernel;
+        threads[i].cpu = cpus[i];
+        threads[i].node = node;
+        threads[i].size = size;
+        threads[i].mintime = mintime;
+        threads[i].gate = &gate;
+        threads[i].barrier = &barrier;
+        if (pthread_create(&tids[i], NULL, bench_thread, &threads[i]) != 0)
+        {
+            err = -EAGAIN;
+            break;
+        }
+    }
+    /* The barrier needs all threads, let the started ones exit otherwise */
+    nstarted = i;
+    bench_gate_open(&gate, (err == 0 ? 1 : -1));
+    *bandwidth = 0;
+    *maxtime = 0;
+    *bytes = 0;
+    for (i = 0; i < nstarted; i++)
+    {
+        pthread_join(tids[i], NULL);
+        if (nstarted < ncpus)
+            continue;
+        if (threads[i].err)
+        {
+            err = -threads[i].err;
+            continue;
+        }
+        *bandwidth += threads[i].bytes / threads[i].time;
+        *bytes += threads[i].bytes;
+        if (threads[i].time > *maxtime)
+            *maxtime = threads[i].time;
+    }
+    pthread_barrier_destroy(&barrier);
+    free(threads);
+    free(tids);
+    return err;
+}
+
+typedef struct {
+    int cpu;
+    int node;
+    size_t size;
+    long steps;
+    double latency;
+} LatencyThread;
+
+/* Pointer chasing over a random cyclic permutation of cache lines. Stores
+ * the average latency per access in nanoseconds or a negative errno. */
+static void*
+latency_thread(void* arg)
+{
+    LatencyThread* t = (LatencyThread*)arg;
+    int cpu = t->cpu, node = t->node;
+    size_t size = t->size;
+    long steps = t->steps;
+    size_t i, nlines = size / 64;
+    size_t* lines;
+    char* buf;
+    void** p;
+    double start, stop;
+    unsigned long long seed = 88172645463325252ULL;
+
+    if (nlines < 2)
+        nlines = 2;
+    if (cpu >= 0)
+        likwid_pinThread(cpu);
+    buf = bench_alloc(nlines * 64, node);
+    if (!buf)
+    {
+        t->latency = -errno;
+        return NULL;
+    }
+    lines = malloc(nlines * sizeof(size_t));
+    if (!lines)
+    {
+        munmap(buf, nlines * 64);
+        t->latency = -ENOMEM;
+        return NULL;
+    }
+    for (i = 0; i < nlines; i++)
+        lines[i] = i;
+    for (i = nlines - 1; i > 0; i--)
+    {
+        size_t j, tmp;
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        j = seed % (i + 1);
+        tmp = lines[i];
+        lines[i] = lines[j];
+        lines[j] = tmp;
+    }
+    for (i = 0; i < nlines; i++)
+        *(void**)(buf + lines[i] * 64) = buf + lines[(i + 1) % nlines] * 64;
+    free(lines);
+
+    p = (void**)buf;
+    /* warm up, one round through the buffer */
+    for (i = 0; i < nlines; i++)
+        p = (void**)*p;
+    start = bench_now();
+    for (long s = 0; s < steps; s++)
+        p = (void**)*p;
+    stop = bench_now();
+    bench_sink = (double)(uintptr_t)p;
+    munmap(buf, nlines * 64);
+    t->latency = (stop - start) * 1E9 / steps;
+    return NULL;
+}
+
+/* The measurement runs in its own thread, so pinning does not affect the
+ * calling thread */
+static double
+bench_latency(int cpu, int node, size_t size, long steps)
+{
+    pthread_t tid;
+    LatencyThread t = {cpu, node, size, steps, -EAGAIN};
+    if (pthread_create(&tid, NULL, latency_thread, &t) != 0)
+        return -EAGAIN;
+    pthread_join(tid, NULL);
+    return t.latency;
+}
+
+typedef struct {
+    int cpu;
+    size_t n;
+    size_t ld;
+    size_t tile;
+    double mintime;
+    /* results */
+    double time;
+    long iterations;
+} TransposeThread;
+
+static void*
+transpose_thread(void* arg)
+{
+    TransposeThread* t = (TransposeThread*)arg;
+    size_t size = t->n * t->ld * sizeof(double);
+    double *a, *b;
+    double start, stop;
+    long it = 0;
+
+    if (t->cpu >= 0)
+        likwid_pinThread(t->cpu);
+    a = bench_alloc(size, -1);
+    b = bench_alloc(size, -1);
+    if (!a || !b)
+    {
+        if (a)
+            munmap(a, size);
+        if (b)
+            munmap(b, size);
+        t->time = -1;
+        return NULL;
+    }
+    for (size_t i = 0; i < t->n * t->ld; i++)
+    {
+        a[i] = (double)i;
+        b[i] = 0.0;
+    }
+    kernel_transpose(b, a, t->n, t->ld, t->tile);
+    start = bench_now();
+    do
+    {
+        kernel_transpose(b, a, t->n, t->ld, t->tile);
+        it++;
+        stop = bench_now();
+    } while (stop - start < t->mintime);
+    bench_sink = b[t->ld + 1];
+    munmap(a, size);
+    munmap(b, size);
+    t->time = (stop - start) / it;
+    t->iterations = it;
+    return NULL;
+}
+
+/* Returns the time per transpose in seconds or -1 on error */
+static double
+bench_transpose(int cpu, size_t n, size_t ld, size_t tile, double mintime)
+{
+    pthread_t tid;
+    TransposeThread t = {cpu, n, ld, tile, mintime, -1, 0};
+    if (pthread_create(&tid, NULL, transpose_thread, &t) != 0)
+        return -1;
+    pthread_join(tid, NULL);
+    return t.time;
+}
+
+/*
+################################################################################
+# Helpers
+################################################################################
+*/
+
+/* NUMA and affinity information are optional, numainfo and affinity stay
+ * NULL if they cannot be initialized */
+static int
+bench_init_topology(void)
+{
+    if (pylikwid_api->need_native_topology() < 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Cannot initialize topology module");
+        return -1;
+    }
+    if (pylikwid_api->need_numa() == 0)
+        pylikwid_api->need_affinity();
+    return 0;
+}
+
+static int
+bench_kernel_from_name(const char* name)
+{
+    int k;
+    for (k = 0; k < NUM_KERNELS; k++)
+    {
+        if (strcmp(name, kernel_names[k]) == 0)
+            return k;
+    }
+    PyErr_Format(PyExc_ValueError, "Unknown kernel '%s'", name);
+    return -1;
+}
+
+/* Convert None (current CPU), a cpu string or a sequence of ints into a
+ * malloc'ed CPU list. Returns the number of CPUs or -1 with exception set. */
+static int
+bench_cpulist(PyObject* obj, int** cpus)
+{
+    int i, n;
+    if (obj == NULL || obj == Py_None)
+    {
+        *cpus = malloc(sizeof(int));
+        if (*cpus == NULL)
+        {
+            PyErr_NoMemory();
+            return -1;
+        }
+        (*cpus)[0] = likwid_getProcessorId();
+        return 1;
+    }
+    if (PyUnicode_Check(obj))
+    {
+        const char* cpustr = PyUnicode_AsUTF8(obj);
+        if (cpustr == NULL)
+            return -1;
+        *cpus = malloc(cputopo->numHWThreads * sizeof(int));
+        if (*cpus == NULL)
+        {
+            PyErr_NoMemory();
+            return -1;
+        }
+        n = cpustr_to_cpulist(cpustr, *cpus, cputopo->numHWThreads);
+        if (n <= 0)
+        {
+            free(*cpus);
+            PyErr_Format(PyExc_ValueError, "Invalid CPU string '%s'", cpustr);
+            return -1;
+        }
+        return n;
+    }
+    PyObject* seq = PySequence_Fast(obj, "cpus must be a cpu string or a sequence of CPU IDs");
+    if (seq == NULL)
+        return -1;
+    n = (int)PySequence_Fast_GET_SIZE(seq);
+    if (n == 0)
+    {
+        Py_DECREF(seq);
+        PyErr_SetString(PyExc_ValueError, "Empty CPU list");
+        return -1;
+    }
+    *cpus = malloc(n * sizeof(int));
+    if (*cpus == NULL)
+    {
+        Py_DECREF(seq);
+        PyErr_NoMemory();
+        return -1;
+    }
+    for (i = 0; i < n; i++)
+    {
+        long c = PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+        if (c == -1 && PyErr_Occurred())
+        {
+            free(*cpus);
+            Py_DECREF(seq);
+            return -1;
+        }
+        (*cpus)[i] = (int)c;
+    }
+    Py_DECREF(seq);
+    return n;
+}
+
+/* Number of hardware threads out of cpus sharing the busiest instance of the
+ * cache level. Caches shared by at most one core are attributed per core,
+ * all others to the cache affinity domains. */
+static int
+bench_cache_sharers(CacheLevel* level, int ncpus, const int* cpus)
+{
+    int i, j, d, best = 1;
+    if (level->threads <= cputopo->numThreadsPerCore)
+    {
+        for (i = 0; i < ncpus; i++)
+        {
+            int count = 0;
+            HWThread* a = NULL;
+            for (j = 0; j < (int)cputopo->numHWThreads; j++)
+                if ((int)cputopo->threadPool[j].apicId == cpus[i])
+                    a = &cputopo->threadPool[j];
+            if (a == NULL)
+                continue;
+            for (j = 0; j < ncpus; j++)
+            {
+                for (d = 0; d < (int)cputopo->numHWThreads; d++)
+                {
+                    HWThread* b = &cputopo->threadPool[d];
+                    if ((int)b->apicId == cpus[j] && b->coreId == a->coreId && b->packageId == a->packageId)
+                        count++;
+                }
+            }
+            if (count > best)
+                best = count;
+        }
+        return best;
+    }
+    if (affinity == NULL)
+        return ncpus;
+    for (d = 0; d < (int)affinity->numberOfAffinityDomains; d++)
+    {
+        AffinityDomain* dom = &affinity->domains[d];
+        int count = 0;
+        if (dom->tag[0] != 'C')
+            continue;
+        for (i = 0; i < ncpus; i++)
+            for (j = 0; j < (int)dom->numberOfProcessors; j++)
+                if (dom->processorList[j] == cpus[i])
+                    count++;
+        if (count > best)
+            best = count;
+    }
+    return best;
+}
+
+static PyObject*
+bench_events(int gid)
+{
+    int e, m, t;
+    int nthreads = perfmon_getNumberOfThreads();
+    PyObject *d = PyDict_New(), *ev = PyDict_New(), *met = PyDict_New(), *tmp;
+
+    for (e = 0; e < perfmon_getNumberOfEvents(gid); e++)
+    {
+        double sum = 0;
+        for (t = 0; t < nthreads; t++)
+            sum += perfmon_getLastResult(gid, e, t);
+        char* name = perfmon_getEventName(gid, e);
+        if (name == NULL)
+            continue;
+        tmp = Py_BuildValue("d", sum);
+        PyDict_SetItemString(ev, name, tmp);
+        Py_DECREF(tmp);
+    }
+    for (m = 0; m < perfmon_getNumberOfMetrics(gid); m++)
+    {
+        char* name = perfmon_getMetricName(gid, m);
+        if (name == NULL)
+            continue;
+        tmp = PyList_New(nthreads);
+        for (t = 0; t < nthreads; t++)
+            PyList_SET_ITEM(tmp, t, Py_BuildValue("d", perfmon_getLastMetric(gid, m, t)));
+        PyDict_SetItemString(met, name, tmp);
+        Py_DECREF(tmp);
+    }
+    PyDict_SetItemString(d, "events", ev);
+    PyDict_SetItemString(d, "metrics", met);
+    Py_DECREF(ev);
+    Py_DECREF(met);
+    return d;
+}
+
+/*
+################################################################################
+# Python functions
+################################################################################
+*/
+
+static PyObject *
+bench_kernels(PyObject *self, PyObject *args)
+{
+    int k;
+    PyObject *t = PyTuple_New(NUM_KERNELS);
+    for (k = 0; k < NUM_KERNELS; k++)
+        PyTuple_SET_ITEM(t, k, PYSTR(kernel_names[k]));
+    return t;
+}
+
+static PyObject *
+bench_stream(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"kernel", "size", "cpus", "node", "mintime", "group", NULL};
+    const char* kname;
+    Py_ssize_t size;
+    PyObject *pycpus = Py_None;
+    int node = -1, gid = -1, kernel, ncpus, err;
+    double mintime = DEFAULT_MINTIME, bw, time, bytes;
+    int *cpus = NULL;
+    PyObject *d, *ev = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "sn|Oidi", kwlist, &kname, &size,
+                                     &pycpus, &node, &mintime, &gid))
+        return NULL;
+    if ((kernel = bench_kernel_from_name(kname)) < 0)
+        return NULL;
+    if (size <= 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "size must be greater than 0");
+        return NULL;
+    }
+    if (bench_init_topology() < 0)
+        return NULL;
+    if ((ncpus = bench_cpulist(pycpus, &cpus)) < 0)
+        return NULL;
+    if (gid >= 0)
+    {
+        if (perfmon_setupCounters(gid) < 0 || perfmon_startCounters() < 0)
+        {
+            free(cpus);
+            PyErr_Format(PyExc_RuntimeError, "Cannot start counters of group %d", gid);
+            return NULL;
+        }
+    }
+    Py_BEGIN_ALLOW_THREADS
+    err = bench_run(kernel, ncpus, cpus, node, (size_t)size, mintime, &bw, &time, &bytes);
+    Py_END_ALLOW_THREADS
+    if (gid >= 0)
+    {
+        perfmon_stopCounters();
+        ev = bench_events(gid);
+    }
+    free(cpus);
+    if (err < 0)
+    {
+        Py_XDECREF(ev);
+        errno = -err;
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    d = Py_BuildValue("{s:s,s:n,s:i,s:d,s:d,s:d}",
+                      "kernel", kname, "size", size, "threads", ncpus,
+                      "bytes", bytes, "time", time, "bandwidth", bw / 1E6);
+    if (ev)
+    {
+        PyDict_SetItemString(d, "counters", ev);
+        Py_DECREF(ev);
+    }
+    return d;
+}
+
+static PyObject *
+bench_latencyfunc(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"size", "cpu", "node", "steps", NULL};
+    Py_ssize_t size;
+    int cpu = -1, node = -1;
+    long steps = 10000000;
+    double lat;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "n|iil", kwlist, &size, &cpu, &node, &steps))
+        return NULL;
+    if (size <= 0 || steps <= 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "size and steps must be greater than 0");
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    lat = bench_latency(cpu, node, (size_t)size, steps);
+    Py_END_ALLOW_THREADS
+    if (lat < 0)
+    {
+        errno = (int)-lat;
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    return Py_BuildValue("d", lat);
+}
+
+static PyObject *
+bench_cachelevels(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"cpus", "mintime", "latency", NULL};
+    PyObject *pycpus = Py_None;
+    double mintime = DEFAULT_MINTIME;
+    int dolat = 1;
+    int *cpus = NULL;
+    int i, k, ncpus, err = 0;
+    size_t llc_total = 0, memsize;
+    PyObject *l;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|Odp", kwlist, &pycpus, &mintime, &dolat))
+        return NULL;
+    if (bench_init_topology() < 0)
+        return NULL;
+    if ((ncpus = bench_cpulist(pycpus, &cpus)) < 0)
+        return NULL;
+    l = PyList_New(0);
+    for (i = 0; i <= (int)cputopo->numCacheLevels; i++)
+    {
+        CacheLevel* level = NULL;
+        size_t ws;
+        int sharers;
+        PyObject *entry, *bws;
+
+        if (i < (int)cputopo->numCacheLevels)
+        {
+            level = &cputopo->cacheLevels[i];
+            if (level->type != DATACACHE && level->type != UNIFIEDCACHE)
+                continue;
+            /* Half of the share of one thread keeps the working set inside
+             * the level despite conflicts and the other streams */
+            sharers = bench_cache_sharers(level, ncpus, cpus);
+            ws = level->size / 2 / sharers;
+            if (i == (int)cputopo->numCacheLevels - 1)
+            {
+                int instances = 1;
+                if (level->threads > 0)
+                    instances = cputopo->numHWThreads / level->threads;
+                llc_total = (size_t)level->size * (instances > 0 ? instances : 1);
+            }
+        }
+        else
+        {
+            /* Main memory: four times all last level caches but at most a
+             * quarter of the free memory of the first node */
+            memsize = 4 * (llc_total > 0 ? llc_total : (64UL << 20));
+            if (numainfo && numainfo->numberOfNodes > 0 && numainfo->nodes[0].freeMemory > 0)
+            {
+                size_t freemem = (size_t)numainfo->nodes[0].freeMemory * 1024 / 4;
+                if (memsize > freemem)
+                    memsize = freemem;
+            }
+            ws = memsize / ncpus;
+        }
+        bws = PyDict_New();
+        for (k = 0; k < NUM_KERNELS; k++)
+        {
+            double bw, time, bytes;
+            PyObject *tmp;
+            Py_BEGIN_ALLOW_THREADS
+            err = bench_run(k, ncpus, cpus, -1, ws, mintime, &bw, &time, &bytes);
+            Py_END_ALLOW_THREADS
+            if (err < 0)
+                break;
+            tmp = Py_BuildValue("d", bw / 1E6);
+            PyDict_SetItemString(bws, kernel_names[k], tmp);
+            Py_DECREF(tmp);
+        }
+        if (err < 0)
+        {
+            Py_DECREF(bws);
+            break;
+        }
+        if (level)
+            entry = Py_BuildValue("{s:I,s:I,s:n}", "level", level->level, "size", level->size,
+                                  "workingSet", (Py_ssize_t)ws);
+        else
+            entry = Py_BuildValue("{s:s,s:n}", "level", "MEM", "workingSet", (Py_ssize_t)ws);
+        PyDict_SetItemString(entry, "bandwidth", bws);
+        Py_DECREF(bws);
+        if (dolat)
+        {
+            double lat;
+            PyObject *tmp;
+            Py_BEGIN_ALLOW_THREADS
+            lat = bench_latency(cpus[0], -1, ws, 2000000);
+            Py_END_ALLOW_THREADS
+            tmp = Py_BuildValue("d", lat);
+            PyDict_SetItemString(entry, "latency", tmp);
+            Py_DECREF(tmp);
+        }
+        PyList_Append(l, entry);
+        Py_DECREF(entry);
+    }
+    free(cpus);
+    if (err < 0)
+    {
+        Py_DECREF(l);
+        errno = -err;
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    return l;
+}
+
+static PyObject *
+bench_numamatrix(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"kernel", "size", "mintime", "threads", NULL};
+    const char* kname = "copy";
+    Py_ssize_t size = 256L << 20;
+    double mintime = DEFAULT_MINTIME;
+    int threads = 1;
+    int kernel, i, j, err = 0;
+    PyObject *m;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|sndi", kwlist, &kname, &size, &mintime, &threads))
+        return NULL;
+    if ((kernel = bench_kernel_from_name(kname)) < 0)
+        return NULL;
+    if (bench_init_topology() < 0)
+        return NULL;
+    if (numainfo == NULL)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Cannot initialize NUMA module");
+        return NULL;
+    }
+    m = PyList_New(numainfo->numberOfNodes);
+    for (i = 0; i < (int)numainfo->numberOfNodes; i++)
+    {
+        NumaNode* src = &numainfo->nodes[i];
+        int n = threads;
+        PyObject *row = PyList_New(numainfo->numberOfNodes);
+        PyList_SET_ITEM(m, i, row);
+        if (n > (int)src->numberOfProcessors)
+            n = src->numberOfProcessors;
+        for (j = 0; j < (int)numainfo->numberOfNodes; j++)
+        {
+            double bw = 0, time, bytes;
+            int* cpus = (int*)src->processors;
+            int cpulist[n > 0 ? n : 1];
+            for (int c = 0; c < n; c++)
+                cpulist[c] = cpus[c];
+            if (n > 0)
+            {
+                Py_BEGIN_ALLOW_THREADS
+                err = bench_run(kernel, n, cpulist, numainfo->nodes[j].id, (size_t)size / n, mintime, &bw, &time, &bytes);
+                Py_END_ALLOW_THREADS
+            }
+            if (err < 0)
+                break;
+            PyList_SET_ITEM(row, j, Py_BuildValue("d", bw / 1E6));
+        }
+        if (err < 0)
+            break;
+    }
+    if (err < 0)
+    {
+        Py_DECREF(m);
+        errno = -err;
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    return m;
+}
+
+static PyObject *
+bench_transposefunc(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"n", "tile", "ld", "cpu", "mintime", NULL};
+    Py_ssize_t n, tile = 0, ld = 0;
+    int cpu = -1;
+    double mintime = DEFAULT_MINTIME, time;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "n|nnid", kwlist, &n, &tile, &ld, &cpu, &mintime))
+        return NULL;
+    if (ld == 0)
+        ld = n;
+    if (n <= 0 || tile < 0 || ld < n)
+    {
+        PyErr_SetString(PyExc_ValueError, "n must be greater than 0, tile must not be negative and ld must be at least n");
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    time = bench_transpose(cpu, (size_t)n, (size_t)ld, (size_t)tile, mintime);
+    Py_END_ALLOW_THREADS
+    if (time < 0)
+        return PyErr_NoMemory();
+    /* One load and one store per element */
+    return Py_BuildValue("{s:n,s:n,s:n,s:d,s:d}", "n", n, "tile", tile, "ld", ld, "time", time,
+                         "bandwidth", 2.0 * n * n * sizeof(double) / time / 1E6);
+}
+
+/* Compare the tiles of pylikwid.cacheblocking with power-of-two tiles */
+static PyObject *
+bench_tiling(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"n", "ld", "cpu", "mintime", NULL};
+    Py_ssize_t n, ld = 0, i;
+    int cpu = -1;
+    double mintime = DEFAULT_MINTIME;
+    PyObject *mod, *advice, *tiles, *results, *ret = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "n|nid", kwlist, &n, &ld, &cpu, &mintime))
+        return NULL;
+    if (ld == 0)
+        ld = n;
+    if (n <= 0 || ld < n)
+    {
+        PyErr_SetString(PyExc_ValueError, "n must be greater than 0 and ld must be at least n");
+        return NULL;
+    }
+    mod = PyImport_ImportModule("pylikwid.pylikwid");
+    if (mod == NULL)
+        return NULL;
+    advice = PyObject_CallMethod(mod, "cacheblocking", "iiin", (int)sizeof(double), 2, 1, ld);
+    Py_DECREF(mod);
+    if (advice == NULL)
+        return NULL;
+    tiles = PyList_New(0);
+    results = PyList_New(0);
+    if (tiles == NULL || results == NULL)
+        goto out;
+    for (i = 0; i < PyList_GET_SIZE(advice); i++)
+    {
+        PyObject *adv = PyList_GET_ITEM(advice, i);
+        PyObject *t = Py_BuildValue("(ON)", PyDict_GetItemString(adv, "tile"),
+                                    PyUnicode_FromFormat("L%S", PyDict_GetItemString(adv, "level")));
+        if (t == NULL || PyList_Append(tiles, t) < 0)
+        {
+            Py_XDECREF(t);
+            goto out;
+        }
+        Py_DECREF(t);
+    }
+    for (i = 0; i <= 512; i = (i == 0 ? 8 : i * 4))
+    {
+        PyObject *t = Py_BuildValue("(ns)", i, "fixed");
+        if (t == NULL || PyList_Append(tiles, t) < 0)
+        {
+            Py_XDECREF(t);
+            goto out;
+        }
+        Py_DECREF(t);
+    }
+    for (i = 0; i < PyList_GET_SIZE(tiles); i++)
+    {
+        PyObject *t = PyList_GET_ITEM(tiles, i);
+        Py_ssize_t tile = PyLong_AsSsize_t(PyTuple_GET_ITEM(t, 0));
+        double time;
+        PyObject *r;
+        if (tile < 0 && PyErr_Occurred())
+            goto out;
+        Py_BEGIN_ALLOW_THREADS
+        time = bench_transpose(cpu, (size_t)n, (size_t)ld, (size_t)tile, mintime);
+        Py_END_ALLOW_THREADS
+        if (time < 0)
+        {
+            PyErr_NoMemory();
+            goto out;
+        }
+        r = Py_BuildValue("{s:n,s:O,s:d,s:d}", "tile", tile, "source", PyTuple_GET_ITEM(t, 1),
+                          "time", time, "bandwidth", 2.0 * n * n * sizeof(double) / time / 1E6);
+        if (r == NULL || PyList_Append(results, r) < 0)
+        {
+            Py_XDECREF(r);
+            goto out;
+        }
+        Py_DECREF(r);
+    }
+    ret = Py_BuildValue("{s:n,s:n,s:O,s:O}", "n", n, "ld", ld, "advice", advice, "results", results);
+out:
+    Py_DECREF(advice);
+    Py_XDECREF(tiles);
+    Py_XDECREF(results);
+    return ret;
+}
+
+static PyMethodDef BenchMethods[] = {
+    {"kernels", bench_kernels, METH_NOARGS, "Return the names of the available streaming kernels."},
+    {"stream", (PyCFunction)(void(*)(void))bench_stream, METH_VARARGS|METH_KEYWORDS, "Run a streaming kernel and return the bandwidth (in MB/s)."},
+    {"latency", (PyCFunction)(void(*)(void))bench_latencyfunc, METH_VARARGS|METH_KEYWORDS, "Measure the load latency (in ns) with a pointer-chasing kernel."},
+    {"cachelevels", (PyCFunction)(void(*)(void))bench_cachelevels, METH_VARARGS|METH_KEYWORDS, "Measure bandwidth and latency for all cache levels and main memory."},
+    {"numamatrix", (PyCFunction)(void(*)(void))bench_numamatrix, METH_VARARGS|METH_KEYWORDS, "Measure the bandwidth (in MB/s) between all pairs of NUMA domains."},
+    {"transpose", (PyCFunction)(void(*)(void))bench_transposefunc, METH_VARARGS|METH_KEYWORDS, "Run a blocked matrix transpose and return the time and bandwidth (in MB/s)."},
+    {"tiling", (PyCFunction)(void(*)(void))bench_tiling, METH_VARARGS|METH_KEYWORDS, "Compare the transpose with the tile sizes of pylikwid.cacheblocking and fixed tile sizes."},
+    {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef benchmodule = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "pylikwid.bench",
+    .m_doc = "Memory bandwidth and latency micro-benchmarks.",
+    .m_size = -1,
+    .m_methods = BenchMethods,
+};
+
+PyMODINIT_FUNC
+PyInit_bench(void)
+{
+        pylikwid_api = (PylikwidAPI*)PyCapsule_Import(PYLIKWID_API_NAME, 0);
+        if (pylikwid_api == NULL)
+            return NULL;
+        return PyModule_Create(&benchmodule);
+}
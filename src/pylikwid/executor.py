@@ -0,0 +1,118 @@
+import concurrent.futures
+import threading
+
+from .pylikwid import (
+    cpustr_to_cpulist,
+    getcputopology,
+    initaffinity,
+    markerthreadinit,
+    pinthread,
+    plan_placement,
+)
+
+POLICIES = ("compact", "scatter", "per-numa")
+
+_local = threading.local()
+
+
+def _order_cpus(cpus, policy, topo):
+    """Order the CPUs in ``cpus`` according to the placement ``policy``.
+
+    All policies use the physical cores before their SMT siblings.
+    ``compact`` fills one socket after the other, ``scatter`` distributes
+    round-robin over the sockets and ``per-numa`` round-robin over the NUMA
+    (memory) domains. The order comes from ``plan_placement`` with all
+    other CPUs reserved.
+    """
+    hwthreads = [entry["apicId"] for entry in topo["threadPool"].values()]
+    for cpu in cpus:
+        if cpu not in hwthreads:
+            raise ValueError(f"CPU {cpu} is not part of the system topology")
+    selected = set(cpus)
+    reserve = [c for c in hwthreads if c not in selected]
+    plan = plan_placement(len(cpus), policy, avoid_smt=False, reserve=reserve)
+    return [worker[0] for worker in plan]
+
+
+def current_placement():
+    """Return the placement dict of the calling PinnedExecutor worker thread
+    or ``None`` if called from a thread that is not a pinned worker."""
+    return getattr(_local, "placement", None)
+
+
+class PinnedExecutor(concurrent.futures.ThreadPoolExecutor):
+    """ThreadPoolExecutor whose worker threads are pinned to hardware threads.
+
+    ``cpus`` is either a CPU string in LIKWID syntax (e.g. ``"N:0-63"``) or an
+    iterable of CPU IDs. Each worker pins itself at startup with
+    ``pinthread``, registers itself with ``markerthreadinit`` and keeps its
+    position in the affinity domains (see ``current_placement()``).
+    """
+
+    def __init__(self, cpus=None, policy="compact", max_workers=None,
+                 thread_name_prefix="", initializer=None, initargs=()):
+        if policy not in POLICIES:
+            raise ValueError(f"Unknown placement policy {policy!r}, "
+                             f"valid are {', '.join(POLICIES)}")
+        affinity = initaffinity()
+        topo = getcputopology()
+        if cpus is None:
+            cpus = [c for d in affinity["domains"].values() if d["tag"] == "N"
+                    for c in d["processorList"]]
+        elif isinstance(cpus, str):
+            cpustr = cpus
+            cpus = cpustr_to_cpulist(cpustr)
+            if not cpus:
+                raise ValueError(f"Invalid CPU string {cpustr!r}")
+        else:
+            cpus = [int(c) for c in cpus]
+        if len(set(cpus)) != len(cpus):
+            raise ValueError("CPU list contains duplicates")
+        ordered = _order_cpus(cpus, policy, topo)
+        if max_workers is None:
+            max_workers = len(ordered)
+        if max_workers <= 0:
+            raise ValueError("max_workers must be greater than 0")
+        if max_workers > len(ordered):
+            raise ValueError(f"{max_workers} workers requested but only "
+                             f"{len(ordered)} CPUs available")
+
+        self._policy = policy
+        self._placement = []
+        for idx, cpu in enumerate(ordered[:max_workers]):
+            tags = [d["tag"] for d in affinity["domains"].values()
+                    if cpu in d["processorList"]]
+            self._placement.append({"worker": idx, "cpu": cpu, "domains": tags})
+        self._next_slot = 0
+        self._slot_lock = threading.Lock()
+        self._user_initializer = initializer
+        self._user_initargs = initargs
+        super().__init__(max_workers=max_workers,
+                         thread_name_prefix=thread_name_prefix,
+                         initializer=self._init_worker)
+
+    def _init_worker(self):
+        with self._slot_lock:
+            slot = self._next_slot
+            self._next_slot += 1
+        placement = self._placement[slot]
+        if not pinthread(placement["cpu"]):
+            raise RuntimeError(f"Cannot pin worker {slot} to CPU {placement['cpu']}")
+        markerthreadinit()
+        _local.placement = placement
+        if self._user_initializer is not None:
+            self._user_initializer(*self._user_initargs)
+
+    @property
+    def policy(self):
+        return self._policy
+
+    @property
+    def placement(self):
+        """List of placement dicts (``worker``, ``cpu``, ``domains``) in
+        worker start order."""
+        return [dict(p) for p in self._placement]
+
+    @property
+    def cpus(self):
+        return [p["cpu"] for p in self._placement]
@@ -0,0 +1,351 @@
+import atexit
+import os
+import signal
+import statistics
+import threading
+import time
+
+from . import pylikwid
+
+
+def _cpulist(cpus):
+    if isinstance(cpus, str):
+        cpulist = pylikwid.cpustr_to_cpulist(cpus)
+        if not cpulist:
+            raise ValueError(f"Invalid CPU string {cpus!r}")
+        return cpulist
+    return [int(c) for c in cpus]
+
+
+def _sockets(cpus):
+    """First CPU of each socket that contains one of ``cpus``"""
+    topo = pylikwid.getcputopology()
+    first = {}
+    for t in topo["threadPool"].values():
+        s = t["packageId"]
+        first[s] = min(first.get(s, t["apicId"]), t["apicId"])
+    socket_of = {t["apicId"]: t["packageId"] for t in topo["threadPool"].values()}
+    return {s: first[s] for s in sorted({socket_of[c] for c in cpus})}
+
+
+# Getter of the max, setters of min and max, unit of the setters in Hz and
+# the check of their return value (CPU setters return the frequency, the
+# Uncore setters 0 on success)
+_RANGE = {
+    "cpu": ("getcpuclockmax", "setcpuclockmin", "setcpuclockmax", 1000, lambda ret: ret != 0),
+    "uncore": ("getuncoreclockmax", "setuncoreclockmin", "setuncoreclockmax", 1000000,
+               lambda ret: ret == 0),
+}
+
+
+def _setrange(kind, target, fmin, fmax):
+    """Set the frequency range of a CPU or socket, the order of the writes
+    keeps min <= max at all times. ``None`` leaves a bound unchanged.
+    Returns False if a setter failed."""
+    getmax, setmin, setmax, scale, ok = _RANGE[kind]
+    writes = []
+    if fmin is not None:
+        writes.append((setmin, fmin))
+    if fmax is not None:
+        writes.append((setmax, fmax))
+    if fmin is not None and fmin > getattr(pylikwid, getmax)(target):
+        writes.reverse()
+    return all(ok(getattr(pylikwid, setter)(target, int(freq // scale))) for setter, freq in writes)
+
+
+class FrequencyProfile:
+    """Batch of frequency and governor settings that is applied as a whole.
+
+    ``profile`` maps CPUs (CPU string, list/tuple of CPU IDs or a single ID)
+    to a dict with the optional keys ``min`` and ``max`` (Hz) and
+    ``governor``. The key ``uncore`` maps to a dict with ``min`` and ``max``
+    (Hz) for all sockets or to a dict of socket ID to such a dict.
+
+    ``apply()`` saves the current settings of everything it touches, then
+    applies all changes and checks each result. If one fails, everything is
+    rolled back and a RuntimeError is raised. Applied profiles are rolled
+    back by ``rollback()``, at the end of a ``with`` block, at interpreter
+    exit and on SIGTERM/SIGHUP.
+    """
+
+    def __init__(self, profile):
+        self.cpus = {}
+        self.uncore = {}
+        for key, settings in profile.items():
+            if key == "uncore":
+                self._parse_uncore(settings)
+                continue
+            if isinstance(key, int):
+                cpus = [key]
+            else:
+                cpus = _cpulist(key)
+            unknown = set(settings) - {"min", "max", "governor"}
+            if unknown:
+                raise ValueError(f"Unknown CPU settings {sorted(unknown)}")
+            _checkrange(settings, f"CPUs {key}")
+            for c in cpus:
+                self.cpus.setdefault(c, {}).update(settings)
+        self._saved = None
+
+    def _parse_uncore(self, settings):
+        if set(settings) <= {"min", "max"}:
+            sockets = range(pylikwid.getcputopology()["numSockets"])
+            settings = {s: settings for s in sockets}
+        for socket, values in settings.items():
+            unknown = set(values) - {"min", "max"}
+            if unknown:
+                raise ValueError(f"Unknown Uncore settings {sorted(unknown)}")
+            _checkrange(values, f"Uncore of socket {socket}")
+            self.uncore[int(socket)] = dict(values)
+
+    @property
+    def applied(self):
+        return self._saved is not None
+
+    def apply(self):
+        if self.applied:
+            raise RuntimeError("Profile already applied")
+        saved = {"cpus": {}, "uncore": {}}
+        for c, settings in self.cpus.items():
+            saved["cpus"][c] = {"min": pylikwid.getcpuclockmin(c),
+                                "max": pylikwid.getcpuclockmax(c)}
+            if "governor" in settings:
+                saved["cpus"][c]["governor"] = pylikwid.getgovernor(c)
+        for s in self.uncore:
+            saved["uncore"][s] = {"min": pylikwid.getuncoreclockmin(s),
+                                  "max": pylikwid.getuncoreclockmax(s)}
+        self._saved = saved
+        _active.append(self)
+        _install_handlers()
+        try:
+            for c, settings in self.cpus.items():
+                gov = settings.get("governor")
+                if gov is not None and (pylikwid.setgovernor(c, gov) != 0 or
+                                        pylikwid.getgovernor(c) != gov):
+                    raise RuntimeError(f"Cannot set the governor of CPU {c} to {gov}")
+                if not _setrange("cpu", c, settings.get("min"), settings.get("max")):
+                    raise RuntimeError(f"Cannot set the frequency range of CPU {c}")
+            for s, settings in self.uncore.items():
+                if not _setrange("uncore", s, settings.get("min"), settings.get("max")):
+                    raise RuntimeError(f"Cannot set the Uncore frequency range of socket {s}")
+        except BaseException:
+            self.rollback()
+            raise
+        return self
+
+    def rollback(self):
+        """Restore the settings saved by ``apply()``. Returns False if a
+        setting could not be restored."""
+        if not self.applied:
+            return True
+        saved, self._saved = self._saved, None
+        if self in _active:
+            _active.remove(self)
+        ok = True
+        for s, settings in saved["uncore"].items():
+            ok &= _setrange("uncore", s, settings["min"], settings["max"])
+        for c, settings in saved["cpus"].items():
+            ok &= _setrange("cpu", c, settings["min"], settings["max"])
+            if "governor" in settings:
+                ok &= pylikwid.setgovernor(c, settings["governor"]) == 0
+        return ok
+
+    def __enter__(self):
+        if not self.applied:
+            self.apply()
+        return self
+
+    def __exit__(self, *exc):
+        self.rollback()
+        return False
+
+
+def _checkrange(settings, what):
+    fmin, fmax = settings.get("min"), settings.get("max")
+    if fmin is not None and fmax is not None and fmin > fmax:
+        raise ValueError(f"{what}: min {fmin} is greater than max {fmax}")
+
+
+# Applied profiles, rolled back in reverse order at exit or on a signal
+_active = []
+_handlers_installed = False
+_previous_handlers = {}
+ROLLBACK_SIGNALS = (signal.SIGTERM, signal.SIGHUP)
+
+
+def rollback_frequency_profiles():
+    """Roll back all applied profiles, the last applied first"""
+    ok = True
+    while _active:
+        ok &= _active[-1].rollback()
+    return ok
+
+
+def _signal_handler(signum, frame):
+    rollback_frequency_profiles()
+    previous = _previous_handlers.get(signum, signal.SIG_DFL)
+    if callable(previous):
+        previous(signum, frame)
+        return
+    if previous == signal.SIG_IGN:
+        return
+    # Default action: terminate with the signal
+    signal.signal(signum, signal.SIG_DFL)
+    os.kill(os.getpid(), signum)
+
+
+def _install_handlers():
+    global _handlers_installed
+    if _handlers_installed:
+        return
+    atexit.register(rollback_frequency_profiles)
+    if threading.current_thread() is threading.main_thread():
+        for signum in ROLLBACK_SIGNALS:
+            _previous_handlers[signum] = signal.getsignal(signum)
+            signal.signal(signum, _signal_handler)
+    _handlers_installed = True
+
+
+def apply_frequency_profile(profile):
+    """Apply a frequency profile (see ``FrequencyProfile``) and return it.
+    The returned profile can be used as context manager to roll it back:
+
+    .. code-block:: python
+
+        with apply_frequency_profile({"S0:0-7": {"min": 2e9, "max": 2e9}}):
+            benchmark()
+    """
+    return FrequencyProfile(profile).apply()
+
+
+def _availfreqs(cpu):
+    """Available frequencies of ``cpu`` in Hz (getavailfreqs returns GHz)"""
+    avail = pylikwid.getavailfreqs(cpu)
+    if not avail:
+        raise RuntimeError(f"No available frequencies for CPU {cpu}")
+    return sorted({int(round(float(f) * 1e6)) * 1000 for f in avail.split()})
+
+
+class _Counters:
+    """Measure ``group`` on ``cpus`` around each run"""
+
+    def __init__(self, cpus, group):
+        pylikwid.init(cpus)
+        self.gid = pylikwid.addeventset(group)
+        if self.gid < 0:
+            pylikwid.finalize()
+            raise ValueError(f"Cannot add event set {group!r}")
+        pylikwid.setup(self.gid)
+        self.nthreads = len(cpus)
+        self.events = [pylikwid.getnameofevent(self.gid, e)
+                       for e in range(pylikwid.getnumberofevents(self.gid))]
+        self.metrics = [pylikwid.getnameofmetric(self.gid, m)
+                        for m in range(pylikwid.getnumberofmetrics(self.gid))]
+
+    def start(self):
+        pylikwid.start()
+
+    def stop(self):
+        pylikwid.stop()
+        events = {name: sum(pylikwid.getresult(self.gid, e, t) for t in range(self.nthreads))
+                  for e, name in enumerate(self.events)}
+        metrics = {name: statistics.fmean(pylikwid.getmetric(self.gid, m, t)
+                                          for t in range(self.nthreads))
+                   for m, name in enumerate(self.metrics)}
+        return events, metrics
+
+    def close(self):
+        pylikwid.finalize()
+
+
+def _energy_start(sockets, domain):
+    return {s: pylikwid.startpower(cpu, domain) for s, cpu in sockets.items()}
+
+
+def _energy_stop(sockets, domain, before):
+    return sum(pylikwid.getpower(before[s], pylikwid.stoppower(cpu, domain), domain)
+               for s, cpu in sockets.items())
+
+
+def _mean_counters(runs):
+    return {name: statistics.fmean(run[name] for run in runs) for name in runs[0]} if runs else {}
+
+
+def sweep_frequencies(func, cpus, freqs=None, repeats=3, uncore=None, group=None,
+                      domain="PKG", args=(), kwargs=None):
+    """Run ``func(*args, **kwargs)`` at each CPU frequency in ``freqs`` (Hz,
+    default: all frequencies of ``getavailfreqs``) on ``cpus`` (CPU string
+    or list) and measure the runtime, the RAPL energy of the sockets of
+    ``cpus`` and the counters of ``group``. With a list of Uncore
+    frequencies ``uncore`` (Hz), all combinations are measured. Each point
+    runs ``repeats`` times, the calling thread is pinned to ``cpus``
+    meanwhile. The original frequencies are restored afterwards.
+
+    Returns a dict with the ``points`` (one dict per setting with ``freq``,
+    ``uncore``, median ``runtime`` in s, ``energy`` in J, ``power`` in W,
+    ``edp`` (energy-delay product), the mean ``events`` and ``metrics`` of
+    ``group`` and all ``runtimes``) and the ``energy_optimal`` and
+    ``edp_optimal`` points. Without RAPL, energy values are ``None`` and
+    the optimal points are the fastest.
+    """
+    if repeats <= 0:
+        raise ValueError("repeats must be greater than 0")
+    kwargs = kwargs or {}
+    cpus = _cpulist(cpus)
+    sockets = _sockets(cpus)
+    freqs = sorted(freqs) if freqs is not None else _availfreqs(cpus[0])
+    uncores = sorted(uncore) if uncore else [None]
+    info = pylikwid.getpowerinfo()
+    domainid = None
+    if info is not None and info["domains"][domain]["supportStatus"]:
+        domainid = info["domains"][domain]["ID"]
+
+    affinity = os.sched_getaffinity(0)
+    counters = _Counters(cpus, group) if group is not None else None
+    points = []
+    try:
+        os.sched_setaffinity(0, cpus)
+        for ufreq in uncores:
+            for freq in freqs:
+                profile = {tuple(cpus): {"min": freq, "max": freq}}
+                if ufreq is not None:
+                    profile["uncore"] = {s: {"min": ufreq, "max": ufreq} for s in sockets}
+                runtimes, energies, events, metrics = [], [], [], []
+                with apply_frequency_profile(profile):
+                    for _ in range(repeats):
+                        if counters:
+                            counters.start()
+                        before = _energy_start(sockets, domainid) if domainid is not None else None
+                        start = time.perf_counter()
+                        func(*args, **kwargs)
+                        runtimes.append(time.perf_counter() - start)
+                        if before is not None:
+                            energies.append(_energy_stop(sockets, domainid, before))
+                        if counters:
+                            e, m = counters.stop()
+                            events.append(e)
+                            metrics.append(m)
+                runtime = statistics.median(runtimes)
+                energy = statistics.median(energies) if energies else None
+                points.append({
+                    "freq": freq,
+                    "uncore": ufreq,
+                    "runtime": runtime,
+                    "energy": energy,
+                    "power": energy / runtime if energy is not None and runtime > 0 else None,
+                    "edp": energy * runtime if energy is not None else None,
+                    "events": _mean_counters(events),
+                    "metrics": _mean_counters(metrics),
+                    "runtimes": runtimes,
+                })
+    finally:
+        os.sched_setaffinity(0, affinity)
+        if counters:
+            counters.close()
+
+    if domainid is not None:
+        energy_optimal = min(points, key=lambda p: p["energy"])
+        edp_optimal = min(points, key=lambda p: p["edp"])
+    else:
+        energy_optimal = edp_optimal = min(points, key=lambda p: p["runtime"])
+    return {"points": points, "energy_optimal": energy_optimal, "edp_optimal": edp_optimal}
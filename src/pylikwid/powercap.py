@@ -0,0 +1,202 @@
+import threading
+import time
+
+from . import pylikwid
+
+
+class LikwidPowerBackend:
+    """Power limits and feedback of the sockets through LIKWID.
+
+    The work done per socket is the sum of event ``event`` of group ``gid``
+    over the CPUs of the socket in ``cpus`` (the CPUs passed to
+    ``pylikwid.init``), read with ``pylikwid.read``. The counters must be
+    set up and started. The energy is read from the RAPL counter of
+    ``domain`` on the first CPU of each socket.
+    """
+
+    def __init__(self, cpus, event=0, gid=-1, domain="PKG"):
+        info = pylikwid.getpowerinfo()
+        if info is None:
+            raise RuntimeError("No RAPL support")
+        if not info["domains"][domain]["supportLimit"]:
+            raise ValueError(f"Power domain {domain} does not support limits")
+        self.gid = gid if gid >= 0 else pylikwid.getidofactivegroup()
+        if isinstance(event, str):
+            names = [pylikwid.getnameofevent(self.gid, e)
+                     for e in range(pylikwid.getnumberofevents(self.gid))]
+            if event not in names:
+                raise ValueError(f"Event {event} not in group {self.gid}")
+            event = names.index(event)
+        self.event = event
+        self.domain = domain
+        self._domainid = info["domains"][domain]["ID"]
+        self._dominfo = info["domains"][domain]
+        topo = pylikwid.getcputopology()
+        socket_of = {t["apicId"]: t["packageId"] for t in topo["threadPool"].values()}
+        self._threads = {}
+        for idx, cpu in enumerate(cpus):
+            self._threads.setdefault(socket_of[cpu], []).append(idx)
+        self._first = {}
+        for t in topo["threadPool"].values():
+            s = t["packageId"]
+            self._first[s] = min(self._first.get(s, t["apicId"]), t["apicId"])
+        self._last = {}
+
+    def sockets(self):
+        return sorted(self._threads)
+
+    def limits(self, socket):
+        """Range of the power limit in watts"""
+        d = self._dominfo
+        if d.get("supportInfo"):
+            return d["minPower"], d["maxPower"]
+        return 1.0, pylikwid.getpowerlimit(socket, self.domain)["watts"]
+
+    def getlimit(self, socket):
+        return pylikwid.getpowerlimit(socket, self.domain)["watts"]
+
+    def setlimit(self, socket, watts):
+        pylikwid.setpowerlimit(socket, self.domain, watts)
+
+    def sample(self):
+        """Work and joules per socket since the last call"""
+        pylikwid.read()
+        res = {}
+        for s, threads in self._threads.items():
+            work = sum(pylikwid.getlastresult(self.gid, self.event, t) for t in threads)
+            raw = pylikwid.startpower(self._first[s], self._domainid)
+            before = self._last.get(s, raw)
+            self._last[s] = raw
+            res[s] = (work, pylikwid.getpower(before, raw, self._domainid))
+        return res
+
+    def restore(self):
+        pylikwid.restorepowerlimits()
+
+
+class SimulatedPowerBackend:
+    """Sockets whose throughput grows with the square root of the power
+    limit: ``work/s = scale * sqrt(watts)``. The efficiency (work per joule)
+    falls with higher limits, like on real hardware above the sweet spot.
+    Used to test the controller without RAPL access."""
+
+    def __init__(self, sockets=2, scale=1e9, minpower=20.0, maxpower=200.0, limit=150.0):
+        self.scale = scale
+        self.minpower = minpower
+        self.maxpower = maxpower
+        self.limit = {s: limit for s in range(sockets)}
+        self.original = dict(self.limit)
+        self.history = []
+
+    def sockets(self):
+        return sorted(self.limit)
+
+    def limits(self, socket):
+        return self.minpower, self.maxpower
+
+    def getlimit(self, socket):
+        return self.limit[socket]
+
+    def setlimit(self, socket, watts):
+        self.limit[socket] = watts
+        self.history.append((socket, watts))
+
+    def sample(self, seconds=1.0):
+        return {s: (self.scale * w ** 0.5 * seconds, w * seconds)
+                for s, w in self.limit.items()}
+
+    def restore(self):
+        self.limit = dict(self.original)
+
+
+class PowerCapController:
+    """Closed-loop controller that adjusts the power limit of each socket
+    to reach ``target`` work per joule (e.g. instructions per joule).
+
+    Every ``interval`` seconds, the work and energy of the last interval
+    are read from ``backend``. If a socket is less efficient than the
+    target, its limit is lowered, if it is more efficient by more than
+    ``tolerance``, the limit is raised to gain throughput. The change is
+    proportional to the relative error (``gain``) and at most ``maxstep``
+    watts, within ``minwatts``/``maxwatts`` (default: the range of the
+    backend). The original limits are restored by ``stop()``.
+    """
+
+    def __init__(self, backend, target, interval=1.0, gain=0.5, maxstep=10.0,
+                 tolerance=0.02, minwatts=None, maxwatts=None):
+        if target <= 0 or interval <= 0 or gain <= 0 or maxstep <= 0:
+            raise ValueError("target, interval, gain and maxstep must be greater than 0")
+        self.backend = backend
+        self.target = target
+        self.interval = interval
+        self.gain = gain
+        self.maxstep = maxstep
+        self.tolerance = tolerance
+        self.minwatts = minwatts
+        self.maxwatts = maxwatts
+        self.efficiency = {}
+        self._thread = None
+        self._stop = threading.Event()
+
+    def _range(self, socket):
+        lo, hi = self.backend.limits(socket)
+        if self.minwatts is not None:
+            lo = max(lo, self.minwatts)
+        if self.maxwatts is not None:
+            hi = min(hi, self.maxwatts)
+        return lo, hi
+
+    def step(self, sample=None):
+        """One control step with the work and joules per socket of the last
+        interval (read from the backend if not given). Returns the new
+        limits per socket."""
+        if sample is None:
+            sample = self.backend.sample()
+        limits = {}
+        for socket, (work, joules) in sample.items():
+            watts = self.backend.getlimit(socket)
+            if joules <= 0:
+                limits[socket] = watts
+                continue
+            eff = work / joules
+            self.efficiency[socket] = eff
+            error = (eff - self.target) / self.target
+            if -self.tolerance <= error <= self.tolerance:
+                limits[socket] = watts
+                continue
+            delta = max(-self.maxstep, min(self.maxstep, self.gain * error * watts))
+            lo, hi = self._range(socket)
+            new = max(lo, min(hi, watts + delta))
+            if new != watts:
+                self.backend.setlimit(socket, new)
+            limits[socket] = new
+        return limits
+
+    def _run(self):
+        self.backend.sample()
+        while not self._stop.wait(self.interval):
+            self.step()
+
+    def start(self):
+        """Run the controller in a background thread"""
+        if self._thread is not None:
+            raise RuntimeError("Controller already running")
+        self._stop.clear()
+        self._thread = threading.Thread(target=self._run, name="powercap", daemon=True)
+        self._thread.start()
+
+    def stop(self):
+        """Stop the controller and restore the original limits"""
+        if self._thread is not None:
+            self._stop.set()
+            self._thread.join()
+            self._thread = None
+        self.backend.restore()
+
+    def __enter__(self):
+        self.start()
+        return self
+
+    def __exit__(self, *exc):
+        self.stop()
+        return False
@@ -1,15 +1,47 @@
 
 #include <Python.h>
+#include <structmember.h>
+
+#include <marshal.h>
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
 
 #include <likwid.h>
 
+#include "pylikwid_api.h"
+
 #if !(LIKWID_MAJOR == 5 && LIKWID_RELEASE >= 4)
 #include <bstrlib.h>
 #endif
 
+#if (LIKWID_MAJOR == 5 && LIKWID_RELEASE >= 4)
+#define AFFINITY_TAG(dom) ((dom)->tag)
+#else
+#define AFFINITY_TAG(dom) (bdata((dom)->tag))
+#endif
+
 #define PYSTR(str) (Py_BuildValue("s", str))
 #define PYINT(val) (Py_BuildValue("i", val))
 #define PYUINT(val) (Py_BuildValue("I", val))
+#define PYULONG(val) (Py_BuildValue("K", (unsigned long long)(val)))
 
 #ifndef NAN
 #define NAN (0.0/0.0)
@@ -26,9 +58,647 @@ NumaTopology_t numainfo = NULL;
 static int affinity_initialized = 0;
 AffinityDomains_t affinity = NULL;
 static int power_initialized = 0;
-PowerInfo_t power;
+PowerInfo_t power = NULL;
 static int timer_initialized = 0;
 static int perfmon_initialized = 0;
+static int* perfmon_cpus = NULL;
+static int perfmon_ncpus = 0;
+static PyObject* aggregate_maps = NULL;
+
+/*
+################################################################################
+# Dict and list builders
+################################################################################
+*/
+
+/* All builders steal the reference to the value (pydict_setobj also to the
+ * key), so PYSTR(), PYINT(), Py_BuildValue() etc. can be passed directly
+ * without leaking. A NULL value or container is tolerated, the error stays
+ * set and -1 is returned.
+ * Keys passed as C strings must have static storage (literals or static
+ * name tables). They are interned once and cached by their address for the
+ * lifetime of the module, so building a dict does not allocate key
+ * objects. */
+
+#define PYKEY_CACHE_SIZE 512
+
+static struct {
+    const char* str;
+    PyObject* key;
+} pykey_cache[PYKEY_CACHE_SIZE];
+
+static PyObject* pykey(const char* str)
+{
+    size_t h = (size_t)(((uintptr_t)str >> 2) * 2654435761u);
+    int i;
+    for (i = 0; i < PYKEY_CACHE_SIZE; i++)
+    {
+        size_t slot = (h + i) & (PYKEY_CACHE_SIZE - 1);
+        if (pykey_cache[slot].str == str)
+        {
+            Py_INCREF(pykey_cache[slot].key);
+            return pykey_cache[slot].key;
+        }
+        if (pykey_cache[slot].str == NULL)
+        {
+            PyObject* key = PyUnicode_InternFromString(str);
+            if (key == NULL)
+                return NULL;
+            pykey_cache[slot].str = str;
+            pykey_cache[slot].key = key;
+            Py_INCREF(key);
+            return key;
+        }
+    }
+    /* Cache full, use an uncached key */
+    return PyUnicode_InternFromString(str);
+}
+
+static int pydict_setobj(PyObject* d, PyObject* key, PyObject* value)
+{
+    int ret = -1;
+    if (d != NULL && key != NULL && value != NULL)
+        ret = PyDict_SetItem(d, key, value);
+    Py_XDECREF(key);
+    Py_XDECREF(value);
+    return ret;
+}
+
+static int pydict_set(PyObject* d, const char* key, PyObject* value)
+{
+    if (value == NULL)
+        return -1;
+    return pydict_setobj(d, pykey(key), value);
+}
+
+static int pylist_append(PyObject* l, PyObject* value)
+{
+    int ret = -1;
+    if (l != NULL && value != NULL)
+        ret = PyList_Append(l, value);
+    Py_XDECREF(value);
+    return ret;
+}
+
+static PyObject* pynone(void)
+{
+    Py_RETURN_NONE;
+}
+
+/*
+################################################################################
+# Topology snapshot
+################################################################################
+*/
+
+/* A snapshot is a single file holding copies of the CpuInfo, CpuTopology,
+ * NumaTopology and AffinityDomains structs. All pointers inside the file are
+ * stored as offsets from the file start (0 is NULL). Loading maps the file
+ * privately and relocates the offsets in place, the structs are used
+ * directly from the mapping. */
+
+#define TOPOSNAP_MAGIC "PYLWTOPO"
+#define TOPOSNAP_VERSION 1
+#define TOPOSNAP_ENV "PYLIKWID_TOPOLOGY_SNAPSHOT"
+#ifdef LIKWID_MAJOR
+#define TOPOSNAP_LIKWID (LIKWID_MAJOR * 10000 + LIKWID_RELEASE * 100 + LIKWID_MINOR)
+#else
+#define TOPOSNAP_LIKWID 0
+#endif
+#define TOPOSNAP_OFF(type, off) ((type)(uintptr_t)(off))
+
+enum {
+    TOPOSNAP_OK = 0,
+    TOPOSNAP_STALE = 1,
+    TOPOSNAP_EIO = -1,
+    TOPOSNAP_EINVAL = -2,
+};
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t likwid;
+    /* sizes of the snapshotted structs, they differ between LIKWID versions */
+    uint32_t layout[8];
+    uint64_t size;
+    /* fingerprint of the system */
+    char model[64];
+    uint64_t online;
+    /* offsets of the top-level structs */
+    uint64_t cpuinfo;
+    uint64_t cputopo;
+    uint64_t numainfo;
+    uint64_t affinity;
+} TopoSnapHeader;
+
+static char* toposnap_base = NULL;
+static size_t toposnap_size = 0;
+
+static void
+toposnap_layout(uint32_t* layout)
+{
+    layout[0] = sizeof(CpuInfo);
+    layout[1] = sizeof(CpuTopology);
+    layout[2] = sizeof(HWThread);
+    layout[3] = sizeof(CacheLevel);
+    layout[4] = sizeof(NumaTopology);
+    layout[5] = sizeof(NumaNode);
+    layout[6] = sizeof(AffinityDomains);
+    layout[7] = sizeof(AffinityDomain);
+}
+
+/* Cheap system fingerprint: CPU vendor and signature plus a hash of the
+ * online CPU mask. It does not touch the topology modules. */
+static void
+toposnap_fingerprint(char* model, size_t len, uint64_t* online)
+{
+    char buf[4096];
+    ssize_t n = -1;
+    uint64_t hash = 14695981039346656037ULL;
+    int fd, i;
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    char vendor[13];
+    __get_cpuid(0, &eax, &ebx, &ecx, &edx);
+    memcpy(vendor, &ebx, 4);
+    memcpy(vendor + 4, &edx, 4);
+    memcpy(vendor + 8, &ecx, 4);
+    vendor[12] = '\0';
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+    snprintf(model, len, "%s 0x%x", vendor, eax);
+#else
+    struct utsname uts;
+    model[0] = '\0';
+    fd = open("/sys/devices/system/cpu/cpu0/regs/identification/midr_el1", O_RDONLY);
+    if (fd >= 0)
+    {
+        n = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+    }
+    if (n > 0)
+    {
+        buf[n] = '\0';
+        buf[strcspn(buf, "\n")] = '\0';
+        snprintf(model, len, "midr %s", buf);
+    }
+    else if (uname(&uts) == 0)
+    {
+        snprintf(model, len, "%s", uts.machine);
+    }
+    n = -1;
+#endif
+    fd = open("/sys/devices/system/cpu/online", O_RDONLY);
+    if (fd >= 0)
+    {
+        n = read(fd, buf, sizeof(buf));
+        close(fd);
+    }
+    if (n <= 0)
+        n = snprintf(buf, sizeof(buf), "%ld", sysconf(_SC_NPROCESSORS_ONLN));
+    for (i = 0; i < (int)n; i++)
+    {
+        hash ^= (unsigned char)buf[i];
+        hash *= 1099511628211ULL;
+    }
+    *online = hash;
+}
+
+static int
+toposnap_owns(const void* p)
+{
+    return (toposnap_base != NULL && (const char*)p >= toposnap_base &&
+            (const char*)p < toposnap_base + toposnap_size);
+}
+
+static void
+toposnap_release(void)
+{
+    if (toposnap_base == NULL)
+        return;
+    if (toposnap_owns(cpuinfo))
+        cpuinfo = NULL;
+    if (toposnap_owns(cputopo))
+        cputopo = NULL;
+    if (toposnap_owns(numainfo))
+        numainfo = NULL;
+    if (toposnap_owns(affinity))
+        affinity = NULL;
+    munmap(toposnap_base, toposnap_size);
+    toposnap_base = NULL;
+    toposnap_size = 0;
+}
+
+/* Replace the offset in *field by a pointer into the mapping after checking
+ * that len bytes are inside the file */
+static int
+toposnap_reloc(char* base, size_t size, void* field, size_t len)
+{
+    uint64_t off = (uint64_t)(uintptr_t)(*(void**)field);
+    if (off == 0)
+        return 0;
+    if (off < sizeof(TopoSnapHeader) || off > size || len > size - off)
+        return -1;
+    *(void**)field = base + off;
+    return 0;
+}
+
+static int
+toposnap_relocstr(char* base, size_t size, void* field)
+{
+    if (toposnap_reloc(base, size, field, 1) < 0)
+        return -1;
+    char* s = *(char**)field;
+    if (s != NULL && memchr(s, '\0', base + size - s) == NULL)
+        return -1;
+    return 0;
+}
+
+static int
+toposnap_relocate(char* base, size_t size)
+{
+    TopoSnapHeader* hdr = (TopoSnapHeader*)base;
+    CpuInfo* info = TOPOSNAP_OFF(CpuInfo*, hdr->cpuinfo);
+    CpuTopology* topo = TOPOSNAP_OFF(CpuTopology*, hdr->cputopo);
+    NumaTopology* numa = TOPOSNAP_OFF(NumaTopology*, hdr->numainfo);
+    AffinityDomains* aff = TOPOSNAP_OFF(AffinityDomains*, hdr->affinity);
+    uint32_t i;
+
+    if (info == NULL || topo == NULL || numa == NULL || aff == NULL)
+        return -1;
+    if (toposnap_reloc(base, size, &info, sizeof(CpuInfo)) < 0 ||
+        toposnap_relocstr(base, size, &info->osname) < 0 ||
+        toposnap_relocstr(base, size, &info->name) < 0 ||
+        toposnap_relocstr(base, size, &info->short_name) < 0 ||
+        toposnap_relocstr(base, size, &info->features) < 0)
+        return -1;
+    if (toposnap_reloc(base, size, &topo, sizeof(CpuTopology)) < 0 ||
+        toposnap_reloc(base, size, &topo->threadPool, (size_t)topo->numHWThreads * sizeof(HWThread)) < 0 ||
+        toposnap_reloc(base, size, &topo->cacheLevels, (size_t)topo->numCacheLevels * sizeof(CacheLevel)) < 0)
+        return -1;
+    topo->topologyTree = NULL;
+    if (toposnap_reloc(base, size, &numa, sizeof(NumaTopology)) < 0 ||
+        toposnap_reloc(base, size, &numa->nodes, (size_t)numa->numberOfNodes * sizeof(NumaNode)) < 0)
+        return -1;
+    for (i = 0; numa->nodes != NULL && i < numa->numberOfNodes; i++)
+    {
+        NumaNode* node = &numa->nodes[i];
+        if (toposnap_reloc(base, size, &node->processors, (size_t)node->numberOfProcessors * sizeof(uint32_t)) < 0 ||
+            toposnap_reloc(base, size, &node->distances, (size_t)node->numberOfDistances * sizeof(uint32_t)) < 0)
+            return -1;
+    }
+    if (toposnap_reloc(base, size, &aff, sizeof(AffinityDomains)) < 0 ||
+        toposnap_reloc(base, size, &aff->domains, (size_t)aff->numberOfAffinityDomains * sizeof(AffinityDomain)) < 0)
+        return -1;
+    for (i = 0; aff->domains != NULL && i < aff->numberOfAffinityDomains; i++)
+    {
+        AffinityDomain* dom = &aff->domains[i];
+#if (LIKWID_MAJOR == 5 && LIKWID_RELEASE >= 4)
+        if (toposnap_relocstr(base, size, &dom->tag) < 0)
+            return -1;
+#else
+        if (toposnap_reloc(base, size, &dom->tag, sizeof(struct tagbstring)) < 0 ||
+            dom->tag == NULL || toposnap_relocstr(base, size, &dom->tag->data) < 0)
+            return -1;
+#endif
+        if (toposnap_reloc(base, size, &dom->processorList, (size_t)dom->numberOfProcessors * sizeof(int)) < 0)
+            return -1;
+    }
+    hdr->cpuinfo = (uint64_t)(uintptr_t)info;
+    hdr->cputopo = (uint64_t)(uintptr_t)topo;
+    hdr->numainfo = (uint64_t)(uintptr_t)numa;
+    hdr->affinity = (uint64_t)(uintptr_t)aff;
+    return 0;
+}
+
+/* Map a snapshot and make it the source of the topology, NUMA and affinity
+ * information. Returns TOPOSNAP_STALE if the snapshot was written on a
+ * different system or by a different build. */
+static int
+toposnap_load(const char* path)
+{
+    TopoSnapHeader* hdr;
+    struct stat st;
+    char model[64];
+    uint32_t layout[8];
+    uint64_t online;
+    char* base;
+    int fd, err;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return TOPOSNAP_EIO;
+    if (fstat(fd, &st) < 0)
+    {
+        err = errno;
+        close(fd);
+        errno = err;
+        return TOPOSNAP_EIO;
+    }
+    if ((size_t)st.st_size < sizeof(TopoSnapHeader))
+    {
+        close(fd);
+        return TOPOSNAP_EINVAL;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    err = errno;
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        errno = err;
+        return TOPOSNAP_EIO;
+    }
+    hdr = (TopoSnapHeader*)base;
+    if (memcmp(hdr->magic, TOPOSNAP_MAGIC, sizeof(hdr->magic)) != 0 || hdr->size != (uint64_t)st.st_size)
+    {
+        munmap(base, st.st_size);
+        return TOPOSNAP_EINVAL;
+    }
+    toposnap_layout(layout);
+    toposnap_fingerprint(model, sizeof(model), &online);
+    if (hdr->version != TOPOSNAP_VERSION || hdr->likwid != TOPOSNAP_LIKWID ||
+        memcmp(hdr->layout, layout, sizeof(layout)) != 0 ||
+        strncmp(hdr->model, model, sizeof(model)) != 0 || hdr->online != online)
+    {
+        munmap(base, st.st_size);
+        return TOPOSNAP_STALE;
+    }
+    if (toposnap_relocate(base, st.st_size) < 0)
+    {
+        munmap(base, st.st_size);
+        return TOPOSNAP_EINVAL;
+    }
+    toposnap_release();
+    Py_CLEAR(aggregate_maps);
+    toposnap_base = base;
+    toposnap_size = st.st_size;
+    cpuinfo = TOPOSNAP_OFF(CpuInfo_t, hdr->cpuinfo);
+    cputopo = TOPOSNAP_OFF(CpuTopology_t, hdr->cputopo);
+    numainfo = TOPOSNAP_OFF(NumaTopology_t, hdr->numainfo);
+    affinity = TOPOSNAP_OFF(AffinityDomains_t, hdr->affinity);
+    return TOPOSNAP_OK;
+}
+
+/*
+################################################################################
+# Lazy subsystem initialization
+################################################################################
+*/
+
+/* Every accessor initializes only the subsystems it needs by calling the
+ * need_* helpers. The helpers initialize the dependencies first:
+ *   topology: -
+ *   numa: topology
+ *   affinity: topology, numa
+ *   power: topology
+ *   configuration, timer: -
+ * The time spent in the LIKWID init functions is recorded per subsystem.
+ * A topology snapshot (see load_topology) provides the topology, NUMA and
+ * affinity information without initializing the LIKWID modules. Functions
+ * that call into LIKWID modules depending on the topology use
+ * need_native_topology. */
+
+typedef enum {
+    SUBSYS_CONFIG = 0,
+    SUBSYS_TOPOLOGY,
+    SUBSYS_NUMA,
+    SUBSYS_AFFINITY,
+    SUBSYS_TIMER,
+    SUBSYS_POWER,
+    NUM_SUBSYS
+} Subsystem;
+
+static const char* subsys_names[NUM_SUBSYS] = {"configuration", "topology", "numa", "affinity", "timer", "power"};
+static double subsys_time[NUM_SUBSYS];
+static int subsys_calls[NUM_SUBSYS];
+
+static double
+subsys_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1E-9;
+}
+
+static void
+subsys_record(Subsystem s, double start)
+{
+    subsys_time[s] += subsys_now() - start;
+    subsys_calls[s]++;
+}
+
+static int
+need_config(void)
+{
+    if (!config_initialized)
+    {
+        double start = subsys_now();
+        int ret = init_configuration();
+        subsys_record(SUBSYS_CONFIG, start);
+        if (ret != 0)
+            return -1;
+        config_initialized = 1;
+    }
+    if (configfile == NULL)
+        configfile = get_configuration();
+    return (configfile != NULL ? 0 : -1);
+}
+
+static int
+need_native_topology(void)
+{
+    if (!topo_initialized)
+    {
+        double start = subsys_now();
+        int ret = topology_init();
+        subsys_record(SUBSYS_TOPOLOGY, start);
+        if (ret != 0)
+            return -1;
+        topo_initialized = 1;
+    }
+    if (cpuinfo == NULL)
+        cpuinfo = get_cpuInfo();
+    if (cputopo == NULL)
+        cputopo = get_cpuTopology();
+    return 0;
+}
+
+static int
+need_topology(void)
+{
+    if (toposnap_base == NULL && !topo_initialized)
+    {
+        const char* path = getenv(TOPOSNAP_ENV);
+        if (path != NULL && path[0] != '\0')
+        {
+            double start = subsys_now();
+            if (toposnap_load(path) == TOPOSNAP_OK)
+                subsys_record(SUBSYS_TOPOLOGY, start);
+        }
+    }
+    if (toposnap_base != NULL)
+        return 0;
+    return need_native_topology();
+}
+
+static int
+need_numa(void)
+{
+    if (need_topology() < 0)
+        return -1;
+    if (toposnap_base != NULL)
+        return 0;
+    if (!numa_initialized)
+    {
+        double start = subsys_now();
+        int ret = numa_init();
+        subsys_record(SUBSYS_NUMA, start);
+        if (ret != 0)
+            return -1;
+        numa_initialized = 1;
+    }
+    if (numainfo == NULL)
+        numainfo = get_numaTopology();
+    return 0;
+}
+
+static int
+need_affinity(void)
+{
+    if (need_numa() < 0)
+        return -1;
+    if (toposnap_base != NULL)
+        return 0;
+    if (!affinity_initialized)
+    {
+        double start = subsys_now();
+        affinity_init();
+        subsys_record(SUBSYS_AFFINITY, start);
+        affinity_initialized = 1;
+    }
+    if (affinity == NULL)
+        affinity = get_affinityDomains();
+    return (affinity != NULL ? 0 : -1);
+}
+
+static int
+need_timer(void)
+{
+    if (!timer_initialized)
+    {
+        double start = subsys_now();
+        timer_init();
+        subsys_record(SUBSYS_TIMER, start);
+        timer_initialized = 1;
+    }
+    return 0;
+}
+
+/* Fails if the system has no RAPL support */
+static int
+need_power(void)
+{
+    if (need_native_topology() < 0)
+        return -1;
+    if (!power_initialized)
+    {
+        double start = subsys_now();
+        int ret = power_init(0);
+        subsys_record(SUBSYS_POWER, start);
+        if (!ret)
+            return -1;
+        power_initialized = 1;
+    }
+    if (power == NULL)
+        power = get_powerInfo();
+    return (power != NULL ? 0 : -1);
+}
+
+static int power_nsockets = 0;
+static int* power_sockcpu = NULL;
+static int* power_cpusock = NULL;
+static int power_ncpus = 0;
+
+/* First CPU of each socket and socket of each CPU, the power domains of a
+ * socket are accessed through its first CPU */
+static int
+power_sockets(void)
+{
+    uint32_t i;
+    int maxcpu = 0;
+    if (power_sockcpu != NULL)
+        return 0;
+    for (i = 0; i < cputopo->numHWThreads; i++)
+        if ((int)cputopo->threadPool[i].apicId > maxcpu)
+            maxcpu = cputopo->threadPool[i].apicId;
+    power_nsockets = (cputopo->numSockets > 0 ? cputopo->numSockets : 1);
+    power_ncpus = maxcpu + 1;
+    power_sockcpu = malloc(power_nsockets * sizeof(int));
+    power_cpusock = malloc(power_ncpus * sizeof(int));
+    if (power_sockcpu == NULL || power_cpusock == NULL)
+    {
+        free(power_sockcpu);
+        free(power_cpusock);
+        power_sockcpu = NULL;
+        power_cpusock = NULL;
+        return -1;
+    }
+    for (i = 0; i < (uint32_t)power_nsockets; i++)
+        power_sockcpu[i] = -1;
+    for (i = 0; i < (uint32_t)power_ncpus; i++)
+        power_cpusock[i] = 0;
+    for (i = 0; i < cputopo->numHWThreads; i++)
+    {
+        HWThread* t = &cputopo->threadPool[i];
+        int s = ((int)t->packageId < power_nsockets ? (int)t->packageId : 0);
+        power_cpusock[t->apicId] = s;
+        if (power_sockcpu[s] < 0 || (int)t->apicId < power_sockcpu[s])
+            power_sockcpu[s] = t->apicId;
+    }
+    for (i = 0; i < (uint32_t)power_nsockets; i++)
+        if (power_sockcpu[i] < 0)
+            power_sockcpu[i] = power_sockcpu[0];
+    return 0;
+}
+
+/* power_init() registers only one CPU with the HPM layer, the RAPL registers
+ * of the other sockets are read through their first CPU */
+static int
+power_addsockets(void)
+{
+    int s;
+    for (s = 0; s < power_nsockets; s++)
+        if (HPMaddThread(power_sockcpu[s]) < 0)
+            return -1;
+    return 0;
+}
+
+static PyObject *
+likwid_getinittimes(PyObject *self, PyObject *args)
+{
+    int i;
+    int states[NUM_SUBSYS] = {config_initialized, topo_initialized, numa_initialized,
+                              affinity_initialized, timer_initialized, power_initialized};
+    int snapshot[NUM_SUBSYS] = {0, toposnap_owns(cputopo), toposnap_owns(numainfo),
+                                toposnap_owns(affinity), 0, 0};
+    PyObject *d = PyDict_New();
+    if (d == NULL)
+        return NULL;
+    for (i = 0; i < NUM_SUBSYS; i++)
+    {
+        PyObject *s = Py_BuildValue("{s:O,s:O,s:d,s:i}",
+                                    "initialized", (states[i] || snapshot[i] ? Py_True : Py_False),
+                                    "snapshot", (snapshot[i] ? Py_True : Py_False),
+                                    "time", subsys_time[i], "calls", subsys_calls[i]);
+        if (s == NULL || PyDict_SetItemString(d, subsys_names[i], s) < 0)
+        {
+            Py_XDECREF(s);
+            Py_DECREF(d);
+            return NULL;
+        }
+        Py_DECREF(s);
+    }
+    return d;
+}
 
 static PyObject *
 likwid_lversion(PyObject *self, PyObject *args)
@@ -72,12 +742,146 @@ Compatibility definitions for nvmon naming scheme changes introduced in 5.3.
 #define GpuTopology_t CudaTopology_t
 #endif
 
+/*
+################################################################################
+# Hybrid core types
+################################################################################
+*/
+
+/* Core type of the hardware threads on hybrid CPUs. The kernel registers a
+ * PMU per core type and lists its CPUs in <sysfs>/devices/cpu_core/cpus
+ * (performance cores) and <sysfs>/devices/cpu_atom/cpus (efficiency cores).
+ * The sysfs root can be changed with PYLIKWID_SYSFS_ROOT, the map is
+ * re-read when it changes. */
+
+enum {
+    CORETYPE_NONE = 0,
+    CORETYPE_PERFORMANCE,
+    CORETYPE_EFFICIENCY,
+    NUM_CORETYPES
+};
+
+static const char* coretype_names[NUM_CORETYPES] = {NULL, "performance", "efficiency"};
+static const char* coretype_pmus[NUM_CORETYPES] = {NULL, "cpu_core", "cpu_atom"};
+static char* coretype_root = NULL;
+static unsigned char* coretype_map = NULL;
+static int coretype_len = 0;
+
+/* Add the CPUs of the cpulist file of a PMU to the map */
+static int
+coretype_read(const char* root, int type, unsigned char** map, int* len)
+{
+    char path[PATH_MAX], buf[8192];
+    char *p, *end;
+    ssize_t n;
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/devices/%s/cpus", root, coretype_pmus[type]);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+        return 0;
+    buf[n] = '\0';
+    for (p = buf; *p != '\0' && *p != '\n';)
+    {
+        long first = strtol(p, &end, 10), last, c;
+        if (end == p || first < 0)
+            break;
+        last = first;
+        if (*end == '-')
+        {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first)
+                break;
+        }
+        if (last >= *len)
+        {
+            unsigned char* tmp = realloc(*map, last + 1);
+            if (tmp == NULL)
+                return -1;
+            memset(tmp + *len, CORETYPE_NONE, last + 1 - *len);
+            *map = tmp;
+            *len = (int)last + 1;
+        }
+        for (c = first; c <= last; c++)
+            (*map)[c] = (unsigned char)type;
+        p = (*end == ',' ? end + 1 : end);
+    }
+    return 0;
+}
+
+static void
+coretype_load(void)
+{
+    const char* root = getenv("PYLIKWID_SYSFS_ROOT");
+    unsigned char* map = NULL;
+    int len = 0, t;
+
+    if (root == NULL || root[0] == '\0')
+        root = "/sys";
+    if (coretype_root != NULL && strcmp(coretype_root, root) == 0)
+        return;
+    for (t = CORETYPE_PERFORMANCE; t < NUM_CORETYPES; t++)
+    {
+        if (coretype_read(root, t, &map, &len) < 0)
+        {
+            free(map);
+            return;
+        }
+    }
+    free(coretype_root);
+    free(coretype_map);
+    /* The cached aggregation maps may group by core type */
+    Py_CLEAR(aggregate_maps);
+    coretype_root = strdup(root);
+    coretype_map = map;
+    coretype_len = len;
+}
+
+static int
+coretype_of(int cpu)
+{
+    coretype_load();
+    if (cpu < 0 || cpu >= coretype_len)
+        return CORETYPE_NONE;
+    return coretype_map[cpu];
+}
+
+static int
+coretype_parse(const char* name)
+{
+    int t;
+    for (t = CORETYPE_PERFORMANCE; t < NUM_CORETYPES; t++)
+        if (strcmp(coretype_names[t], name) == 0)
+            return t;
+    return -1;
+}
+
 /*
 ################################################################################
 # Marker API related functions
 ################################################################################
 */
 
+static void markershm_publish(const char* regiontag);
+#define MARKERTRACE_BEGIN 0
+#define MARKERTRACE_END 1
+static void markertrace_record(const char* regiontag, int phase);
+static void markerenergy_start(const char* regiontag);
+static void markerenergy_stop(const char* regiontag);
+static void markerenergy_reset(const char* regiontag);
+static void markerenergy_close(void);
+static void throttle_regionstart(const char* regiontag);
+static void throttle_regionstop(const char* regiontag);
+static void throttle_halt(void);
+#if (LIKWID_MAJOR == 5)
+static void freqtimeline_halt(void);
+#endif
+
 static PyObject *
 likwid_markerinit(PyObject *self, PyObject *args)
 {
@@ -113,6 +917,12 @@ likwid_markerstartregion(PyObject *self, PyObject *args)
         return NULL;
 
     ret = likwid_markerStartRegion(regiontag);
+    if (ret == 0)
+    {
+        markertrace_record(regiontag, MARKERTRACE_BEGIN);
+        markerenergy_start(regiontag);
+        throttle_regionstart(regiontag);
+    }
     return Py_BuildValue("i", ret);
 }
 
@@ -125,6 +935,13 @@ likwid_markerstopregion(PyObject *self, PyObject *args)
         return NULL;
 
     ret = likwid_markerStopRegion(regiontag);
+    if (ret == 0)
+    {
+        throttle_regionstop(regiontag);
+        markerenergy_stop(regiontag);
+        markertrace_record(regiontag, MARKERTRACE_END);
+        markershm_publish(regiontag);
+    }
     return Py_BuildValue("i", ret);
 }
 
@@ -161,7 +978,7 @@ likwid_markergetregion(PyObject *self, PyObject *args)
         PyList_SET_ITEM(pyList, (Py_ssize_t)i, Py_BuildValue("d", events[i]));
     }
     free(events);
-    return Py_BuildValue("iOdi", nr_events, pyList, time, count);
+    return Py_BuildValue("iNdi", nr_events, pyList, time, count);
 }
 
 static PyObject *
@@ -180,6 +997,8 @@ likwid_markerresetregion(PyObject *self, PyObject *args)
         return NULL;
 
     ret = likwid_markerResetRegion(regiontag);
+    if (ret == 0)
+        markerenergy_reset(regiontag);
     return Py_BuildValue("i", ret);
 }
 
@@ -187,2393 +1006,9423 @@ likwid_markerresetregion(PyObject *self, PyObject *args)
 static PyObject *
 likwid_markerclose(PyObject *self, PyObject *args)
 {
+    markerenergy_close();
     likwid_markerClose();
     Py_RETURN_NONE;
 }
 
+/*
+################################################################################
+# Marker API shared-memory aggregation
+################################################################################
+*/
 
-static PyObject *
-likwid_getprocessorid(PyObject *self, PyObject *args)
+/* Layout of the shared-memory segment: a header followed by nslots process
+ * slots. Each slot is written by a single process only and protected by a
+ * sequence lock, so readers never block the writers. A slot contains up to
+ * maxentries region entries, one per region tag and thread. */
+
+#define MARKERSHM_MAGIC 0x4d53574cU
+#define MARKERSHM_VERSION 1
+#define MARKERSHM_TAGLEN 64
+#define MARKERSHM_RETRIES 1000
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nslots;
+    uint32_t maxentries;
+    uint32_t maxevents;
+    uint32_t entrysize;
+    uint64_t slotsize;
+} MarkerShmHeader;
+
+typedef struct {
+    int32_t pid;
+    uint32_t seq;
+    uint32_t nentries;
+    uint32_t dropped;
+} MarkerShmSlot;
+
+typedef struct {
+    char tag[MARKERSHM_TAGLEN];
+    int32_t tid;
+    int32_t cpu;
+    int32_t group;
+    int32_t nevents;
+    int64_t count;
+    double time;
+    double events[];
+} MarkerShmEntry;
+
+static MarkerShmHeader* markershm = NULL;
+static size_t markershm_size = 0;
+static MarkerShmSlot* markershm_slot = NULL;
+static pid_t markershm_pid = 0;
+static pthread_mutex_t markershm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t
+markershm_entrysize(uint32_t maxevents)
 {
-    return Py_BuildValue("i", likwid_getProcessorId());
+    return (sizeof(MarkerShmEntry) + maxevents * sizeof(double) + 7) & ~((size_t)7);
 }
 
-static PyObject *
-likwid_pinprocess(PyObject *self, PyObject *args)
+static size_t
+markershm_slotsize(uint32_t maxentries, uint32_t maxevents)
 {
-    int cpuid, ret;
-    if (!PyArg_ParseTuple(args, "i", &cpuid))
-        return NULL;
-    ret = likwid_pinProcess(cpuid);
-    return Py_BuildValue("i", ret);
+    return sizeof(MarkerShmSlot) + maxentries * markershm_entrysize(maxevents);
 }
 
-static PyObject *
-likwid_pinthread(PyObject *self, PyObject *args)
+static MarkerShmSlot*
+markershm_getslot(MarkerShmHeader* hdr, uint32_t idx)
 {
-    int cpuid, ret;
-    if (!PyArg_ParseTuple(args, "i", &cpuid))
-        return NULL;
-    ret = likwid_pinThread(cpuid);
-    return Py_BuildValue("i", ret);
+    return (MarkerShmSlot*)((char*)hdr + sizeof(MarkerShmHeader) + idx * hdr->slotsize);
 }
 
-/*
-################################################################################
-# Misc functions
-################################################################################
-*/
+static MarkerShmEntry*
+markershm_getentry(MarkerShmHeader* hdr, MarkerShmSlot* slot, uint32_t idx)
+{
+    return (MarkerShmEntry*)((char*)slot + sizeof(MarkerShmSlot) + idx * hdr->entrysize);
+}
 
-static PyObject *
-likwid_setverbosity(PyObject *self, PyObject *args)
+/* POSIX shm names must start with a slash */
+static int
+markershm_name(const char* name, char* buf, size_t len)
 {
-    int verbosity;
-    if (!PyArg_ParseTuple(args, "i", &verbosity))
+    int ret = snprintf(buf, len, "%s%s", (name[0] == '/' ? "" : "/"), name);
+    if (ret < 0 || (size_t)ret >= len || strchr(buf + 1, '/') != NULL)
+    {
+        PyErr_Format(PyExc_ValueError, "Invalid shared-memory name '%s'", name);
+        return -1;
+    }
+    return 0;
+}
+
+/* Map an existing segment and check its header. Returns NULL with exception
+ * set on failure. */
+static MarkerShmHeader*
+markershm_map(const char* name, size_t *size)
+{
+    char shmname[256];
+    struct stat st;
+    MarkerShmHeader* hdr;
+    int fd;
+    if (markershm_name(name, shmname, sizeof(shmname)) < 0)
         return NULL;
-    if (verbosity >= DEBUGLEV_ONLY_ERROR && verbosity <= DEBUGLEV_DEVELOP)
+    fd = shm_open(shmname, O_RDWR, 0);
+    if (fd < 0)
     {
-        perfmon_setVerbosity(verbosity);
-        return Py_BuildValue("i", verbosity);
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, shmname);
+        return NULL;
     }
-    return Py_BuildValue("i", -1);
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+    if ((size_t)st.st_size < sizeof(MarkerShmHeader))
+    {
+        close(fd);
+        PyErr_Format(PyExc_ValueError, "Shared-memory segment %s is not a marker segment", shmname);
+        return NULL;
+    }
+    hdr = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (hdr == MAP_FAILED)
+    {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return NULL;
+    }
+    if (hdr->magic != MARKERSHM_MAGIC || hdr->version != MARKERSHM_VERSION ||
+        sizeof(MarkerShmHeader) + hdr->nslots * hdr->slotsize > (size_t)st.st_size)
+    {
+        munmap(hdr, st.st_size);
+        PyErr_Format(PyExc_ValueError, "Shared-memory segment %s is not a marker segment", shmname);
+        return NULL;
+    }
+    *size = st.st_size;
+    return hdr;
 }
 
-/*
-################################################################################
-# Access client related functions
-################################################################################
-*/
+static int
+markershm_alive(int32_t pid)
+{
+    return pid > 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
 
-static PyObject *
-likwid_hpmmode(PyObject *self, PyObject *args)
+/* Publish the current results of a region of the calling thread to the
+ * slot of this process */
+static void
+markershm_publish(const char* regiontag)
 {
-    int mode;
-    if (!PyArg_ParseTuple(args, "i", &mode))
-        Py_RETURN_FALSE;
-    if ((mode == ACCESSMODE_DIRECT) || (mode == ACCESSMODE_DAEMON))
+    MarkerShmHeader* hdr = markershm;
+    MarkerShmSlot* slot = markershm_slot;
+    MarkerShmEntry* entry = NULL;
+    int32_t tid = (int32_t)syscall(SYS_gettid);
+    int nevents, group;
+    double time = 0;
+    int count = 0;
+    uint32_t i, seq;
+    double* events;
+
+    /* A forked child must attach to its own slot */
+    if (hdr == NULL || slot == NULL || markershm_pid != getpid())
+        return;
+    nevents = (int)hdr->maxevents;
+    events = calloc(nevents > 0 ? nevents : 1, sizeof(double));
+    if (events == NULL)
+        return;
+    likwid_markerGetRegion(regiontag, &nevents, events, &time, &count);
+    group = perfmon_getIdOfActiveGroup();
+
+    pthread_mutex_lock(&markershm_lock);
+    for (i = 0; i < slot->nentries; i++)
     {
-        HPMmode(mode);
-        Py_RETURN_TRUE;
+        MarkerShmEntry* e = markershm_getentry(hdr, slot, i);
+        if (e->tid == tid && e->group == group && strncmp(e->tag, regiontag, MARKERSHM_TAGLEN) == 0)
+        {
+            entry = e;
+            break;
+        }
     }
-    Py_RETURN_FALSE;
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    if (entry == NULL && slot->nentries < hdr->maxentries)
+    {
+        entry = markershm_getentry(hdr, slot, slot->nentries);
+        memset(entry, 0, hdr->entrysize);
+        snprintf(entry->tag, MARKERSHM_TAGLEN, "%s", regiontag);
+        entry->tid = tid;
+        entry->group = group;
+        slot->nentries++;
+    }
+    if (entry != NULL)
+    {
+        entry->cpu = likwid_getProcessorId();
+        entry->nevents = (nevents > (int)hdr->maxevents ? (int)hdr->maxevents : nevents);
+        entry->count = count;
+        entry->time = time;
+        if (entry->nevents > 0)
+            memcpy(entry->events, events, entry->nevents * sizeof(double));
+    }
+    else
+    {
+        slot->dropped++;
+    }
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&markershm_lock);
+    free(events);
 }
 
-static PyObject *
-likwid_hpminit(PyObject *self, PyObject *args)
+/* Copy a consistent snapshot of a slot. Returns -1 if the writer was busy
+ * during all retries. */
+static int
+markershm_readslot(MarkerShmHeader* hdr, MarkerShmSlot* slot, char* buf)
 {
-    int err = HPMinit();
-    if (err == 0)
+    int r;
+    for (r = 0; r < MARKERSHM_RETRIES; r++)
     {
-        access_initialized = 1;
-        Py_RETURN_TRUE;
+        uint32_t s1 = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        uint32_t s2;
+        if (s1 & 1)
+        {
+            sched_yield();
+            continue;
+        }
+        memcpy(buf, slot, hdr->slotsize);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        s2 = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+        if (s1 == s2)
+            return 0;
     }
-    Py_RETURN_FALSE;
+    return -1;
 }
 
 static PyObject *
-likwid_hpmaddthread(PyObject *self, PyObject *args)
+likwid_markershmcreate(PyObject *self, PyObject *args, PyObject *kwargs)
 {
-    int cpuid, ret;
-    if (!PyArg_ParseTuple(args, "i", &cpuid))
-        return Py_BuildValue("i", -1);
-    if (access_initialized == 0)
+    static char *kwlist[] = {"name", "slots", "regions", "events", NULL};
+    const char* name;
+    char shmname[256];
+    unsigned int nslots = 64, maxentries = 64, maxevents = 32;
+    size_t slotsize, size;
+    MarkerShmHeader* hdr;
+    int fd;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|III", kwlist, &name, &nslots, &maxentries, &maxevents))
+        return NULL;
+    if (nslots == 0 || maxentries == 0 || nslots > 65536 || maxentries > 65536 || maxevents > 1024)
     {
-        return Py_BuildValue("i", -1);
+        PyErr_SetString(PyExc_ValueError, "Invalid number of slots, regions or events");
+        return NULL;
     }
-    ret = HPMaddThread(cpuid);
-    return Py_BuildValue("i", ret);
+    if (markershm_name(name, shmname, sizeof(shmname)) < 0)
+        return NULL;
+    slotsize = markershm_slotsize(maxentries, maxevents);
+    size = sizeof(MarkerShmHeader) + nslots * slotsize;
+    fd = shm_open(shmname, O_RDWR|O_CREAT|O_EXCL, 0600);
+    if (fd < 0)
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, shmname);
+    if (ftruncate(fd, size) < 0)
+    {
+        PyErr_SetFromErrno(PyExc_OSError);
+        close(fd);
+        shm_unlink(shmname);
+        return NULL;
+    }
+    hdr = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (hdr == MAP_FAILED)
+    {
+        PyErr_SetFromErrno(PyExc_OSError);
+        shm_unlink(shmname);
+        return NULL;
+    }
+    /* ftruncate zero-fills, so all slots are free */
+    hdr->version = MARKERSHM_VERSION;
+    hdr->nslots = nslots;
+    hdr->maxentries = maxentries;
+    hdr->maxevents = maxevents;
+    hdr->entrysize = (uint32_t)markershm_entrysize(maxevents);
+    hdr->slotsize = slotsize;
+    __atomic_store_n(&hdr->magic, MARKERSHM_MAGIC, __ATOMIC_RELEASE);
+    munmap(hdr, size);
+    Py_RETURN_NONE;
 }
 
 static PyObject *
-likwid_hpmfinalize(PyObject *self, PyObject *args)
+likwid_markershmunlink(PyObject *self, PyObject *args)
 {
-    HPMfinalize();
-    access_initialized = 0;
+    const char* name;
+    char shmname[256];
+    if (!PyArg_ParseTuple(args, "s", &name))
+        return NULL;
+    if (markershm_name(name, shmname, sizeof(shmname)) < 0)
+        return NULL;
+    if (shm_unlink(shmname) < 0)
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, shmname);
     Py_RETURN_NONE;
 }
 
-/*
-################################################################################
-# Config file related functions
-################################################################################
-*/
-
 static PyObject *
-likwid_initconfiguration(PyObject *self, PyObject *args)
+likwid_markershmattach(PyObject *self, PyObject *args)
 {
-    if (config_initialized)
-        Py_RETURN_TRUE;
-    int ret = init_configuration();
-    if (ret == 0)
+    const char* name;
+    MarkerShmHeader* hdr;
+    size_t size = 0;
+    int32_t pid = (int32_t)getpid();
+    uint32_t i;
+    if (!PyArg_ParseTuple(args, "s", &name))
+        return NULL;
+    if (markershm != NULL && markershm_pid != getpid())
     {
-        config_initialized = 1;
-        Py_RETURN_TRUE;
+        /* Mapping inherited from the parent process */
+        munmap(markershm, markershm_size);
+        markershm = NULL;
+        markershm_slot = NULL;
     }
-    Py_RETURN_FALSE;
+    if (markershm != NULL)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Already attached to a marker shared-memory segment");
+        return NULL;
+    }
+    hdr = markershm_map(name, &size);
+    if (hdr == NULL)
+        return NULL;
+    /* Take a free slot or the slot of a terminated process */
+    for (i = 0; i < hdr->nslots; i++)
+    {
+        MarkerShmSlot* slot = markershm_getslot(hdr, i);
+        int32_t old = __atomic_load_n(&slot->pid, __ATOMIC_ACQUIRE);
+        if (old != 0 && markershm_alive(old))
+            continue;
+        if (__atomic_compare_exchange_n(&slot->pid, &old, pid, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        {
+            uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+            __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            slot->nentries = 0;
+            slot->dropped = 0;
+            __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+            markershm = hdr;
+            markershm_size = size;
+            markershm_slot = slot;
+            markershm_pid = getpid();
+            return Py_BuildValue("i", (int)i);
+        }
+    }
+    munmap(hdr, size);
+    PyErr_Format(PyExc_RuntimeError, "No free slot in marker shared-memory segment %s", name);
+    return NULL;
 }
 
 static PyObject *
-likwid_destroyconfiguration(PyObject *self, PyObject *args)
+likwid_markershmdetach(PyObject *self, PyObject *args)
 {
-    if (!config_initialized)
-        Py_RETURN_FALSE;
-    int ret = destroy_configuration();
-    if (ret == 0)
-    {
-        config_initialized = 0;
-        Py_RETURN_TRUE;
-    }
-    Py_RETURN_FALSE;
+    int release = 0;
+    if (!PyArg_ParseTuple(args, "|p", &release))
+        return NULL;
+    if (markershm == NULL)
+        Py_RETURN_NONE;
+    pthread_mutex_lock(&markershm_lock);
+    if (release && markershm_pid == getpid())
+        __atomic_store_n(&markershm_slot->pid, 0, __ATOMIC_RELEASE);
+    munmap(markershm, markershm_size);
+    markershm = NULL;
+    markershm_slot = NULL;
+    markershm_size = 0;
+    pthread_mutex_unlock(&markershm_lock);
+    Py_RETURN_NONE;
 }
 
 static PyObject *
-likwid_getconfiguration(PyObject *self, PyObject *args)
+likwid_markershmpublish(PyObject *self, PyObject *args)
 {
-    PyObject *d = PyDict_New();
-    if (!config_initialized)
+    const char* regiontag;
+    if (!PyArg_ParseTuple(args, "s", &regiontag))
+        return NULL;
+    if (markershm == NULL)
     {
-        int ret = init_configuration();
-        if (ret == 0)
+        PyErr_SetString(PyExc_RuntimeError, "Not attached to a marker shared-memory segment");
+        return NULL;
+    }
+    markershm_publish(regiontag);
+    Py_RETURN_NONE;
+}
+
+/* Sum an entry into the region results of its tag and group. The events
+ * of different groups are different, so each group is merged separately. */
+static int
+markershm_merge(PyObject *regions, MarkerShmEntry* e, uint32_t slotidx)
+{
+    PyObject *key = Py_BuildValue("(si)", e->tag, e->group);
+    PyObject *r = (key != NULL ? PyDict_GetItem(regions, key) : NULL);
+    PyObject *events, *o;
+    int i;
+    if (key == NULL)
+        return -1;
+    if (r == NULL)
+    {
+        r = Py_BuildValue("{s:i,s:L,s:d,s:d,s:i,s:N,s:N}",
+                          "group", e->group, "count", (long long)0, "time", 0.0,
+                          "maxtime", 0.0, "threads", 0, "events", PyList_New(0),
+                          "processes", PySet_New(NULL));
+        if (r == NULL || PyDict_SetItem(regions, key, r) < 0)
         {
-            config_initialized = 1;
-            configfile = get_configuration();
+            Py_XDECREF(r);
+            Py_DECREF(key);
+            return -1;
+        }
+        Py_DECREF(r);
+    }
+    Py_DECREF(key);
+    o = PyLong_FromLongLong(PyLong_AsLongLong(PyDict_GetItemString(r, "count")) + e->count);
+    if (o == NULL || PyDict_SetItemString(r, "count", o) < 0)
+        goto error;
+    Py_DECREF(o);
+    o = PyFloat_FromDouble(PyFloat_AsDouble(PyDict_GetItemString(r, "time")) + e->time);
+    if (o == NULL || PyDict_SetItemString(r, "time", o) < 0)
+        goto error;
+    Py_DECREF(o);
+    if (e->time > PyFloat_AsDouble(PyDict_GetItemString(r, "maxtime")))
+    {
+        o = PyFloat_FromDouble(e->time);
+        if (o == NULL || PyDict_SetItemString(r, "maxtime", o) < 0)
+            goto error;
+        Py_DECREF(o);
+    }
+    o = PyLong_FromLong(PyLong_AsLong(PyDict_GetItemString(r, "threads")) + 1);
+    if (o == NULL || PyDict_SetItemString(r, "threads", o) < 0)
+        goto error;
+    Py_DECREF(o);
+    o = PyLong_FromUnsignedLong(slotidx);
+    if (o == NULL || PySet_Add(PyDict_GetItemString(r, "processes"), o) < 0)
+        goto error;
+    Py_DECREF(o);
+    events = PyDict_GetItemString(r, "events");
+    for (i = 0; i < e->nevents; i++)
+    {
+        if (i < PyList_GET_SIZE(events))
+        {
+            o = PyFloat_FromDouble(PyFloat_AsDouble(PyList_GET_ITEM(events, i)) + e->events[i]);
+            if (o == NULL)
+                return -1;
+            PyList_SetItem(events, i, o);
+        }
+        else
+        {
+            o = PyFloat_FromDouble(e->events[i]);
+            if (o == NULL || PyList_Append(events, o) < 0)
+                goto error;
+            Py_DECREF(o);
         }
     }
-    if ((config_initialized) && (configfile == NULL))
-    {
-        configfile = get_configuration();
-    }
-    PyDict_SetItem(d, PYSTR("configFileName"), PYSTR(configfile->configFileName));
-    PyDict_SetItem(d, PYSTR("topologyCfgFileName"), PYSTR(configfile->topologyCfgFileName));
-    PyDict_SetItem(d, PYSTR("daemonPath"), PYSTR(configfile->daemonPath));
-    PyDict_SetItem(d, PYSTR("groupPath"), PYSTR(configfile->groupPath));
-    PyDict_SetItem(d, PYSTR("daemonMode"), PYINT(configfile->daemonMode));
-    PyDict_SetItem(d, PYSTR("maxNumThreads"), PYINT(configfile->maxNumThreads));
-    PyDict_SetItem(d, PYSTR("maxNumNodes"), PYINT(configfile->maxNumNodes));
-    return d;
+    return 0;
+error:
+    Py_XDECREF(o);
+    return -1;
 }
 
 static PyObject *
-likwid_setgrouppath(PyObject *self, PyObject *args)
+likwid_markershmread(PyObject *self, PyObject *args)
 {
-    int ret = 0;
-    char* grouppath;
-    if (!PyArg_ParseTuple(args, "s", &grouppath))
-        Py_RETURN_FALSE;
-    ret = config_setGroupPath(grouppath);
-    if (ret == 0)
-    {
-        Py_RETURN_TRUE;
+    const char* name;
+    MarkerShmHeader* hdr;
+    size_t size = 0;
+    uint32_t i, j;
+    char* buf;
+    PyObject *procs, *regions, *ret = NULL;
+    if (!PyArg_ParseTuple(args, "s", &name))
+        return NULL;
+    hdr = markershm_map(name, &size);
+    if (hdr == NULL)
+        return NULL;
+    buf = malloc(hdr->slotsize);
+    procs = PyList_New(0);
+    regions = PyDict_New();
+    if (buf == NULL || procs == NULL || regions == NULL)
+    {
+        PyErr_NoMemory();
+        goto out;
+    }
+    for (i = 0; i < hdr->nslots; i++)
+    {
+        MarkerShmSlot* slot = (MarkerShmSlot*)buf;
+        PyObject *entries, *proc;
+        int ok;
+        if (__atomic_load_n(&markershm_getslot(hdr, i)->pid, __ATOMIC_ACQUIRE) == 0)
+            continue;
+        Py_BEGIN_ALLOW_THREADS
+        ok = markershm_readslot(hdr, markershm_getslot(hdr, i), buf);
+        Py_END_ALLOW_THREADS
+        if (ok < 0 || slot->pid == 0)
+            continue;
+        entries = PyList_New(0);
+        if (entries == NULL)
+            goto out;
+        for (j = 0; j < slot->nentries && j < hdr->maxentries; j++)
+        {
+            MarkerShmEntry* e = markershm_getentry(hdr, slot, j);
+            PyObject *events, *entry;
+            int k;
+            e->tag[MARKERSHM_TAGLEN-1] = '\0';
+            if (e->nevents < 0 || (uint32_t)e->nevents > hdr->maxevents)
+                e->nevents = 0;
+            events = PyList_New(e->nevents);
+            for (k = 0; events && k < e->nevents; k++)
+                PyList_SET_ITEM(events, k, PyFloat_FromDouble(e->events[k]));
+            entry = Py_BuildValue("{s:s,s:i,s:i,s:i,s:L,s:d,s:N}",
+                                  "tag", e->tag, "tid", e->tid, "cpu", e->cpu,
+                                  "group", e->group, "count", (long long)e->count,
+                                  "time", e->time, "events", events);
+            if (entry == NULL || PyList_Append(entries, entry) < 0 ||
+                markershm_merge(regions, e, i) < 0)
+            {
+                Py_XDECREF(entry);
+                Py_DECREF(entries);
+                goto out;
+            }
+            Py_DECREF(entry);
+        }
+        proc = Py_BuildValue("{s:I,s:i,s:O,s:I,s:N}", "slot", i, "pid", slot->pid,
+                             "alive", (markershm_alive(slot->pid) ? Py_True : Py_False),
+                             "dropped", slot->dropped, "regions", entries);
+        if (proc == NULL || PyList_Append(procs, proc) < 0)
+        {
+            Py_XDECREF(proc);
+            goto out;
+        }
+        Py_DECREF(proc);
     }
-    Py_RETURN_FALSE;
+    ret = Py_BuildValue("{s:O,s:O}", "processes", procs, "regions", regions);
+out:
+    Py_XDECREF(procs);
+    Py_XDECREF(regions);
+    free(buf);
+    munmap(hdr, size);
+    return ret;
+}
+
+static PyObject *
+likwid_getprocessorid(PyObject *self, PyObject *args)
+{
+    return Py_BuildValue("i", likwid_getProcessorId());
+}
+
+static PyObject *
+likwid_pinprocess(PyObject *self, PyObject *args)
+{
+    int cpuid, ret;
+    if (!PyArg_ParseTuple(args, "i", &cpuid))
+        return NULL;
+    ret = likwid_pinProcess(cpuid);
+    return Py_BuildValue("i", ret);
+}
+
+static PyObject *
+likwid_pinthread(PyObject *self, PyObject *args)
+{
+    int cpuid, ret;
+    if (!PyArg_ParseTuple(args, "i", &cpuid))
+        return NULL;
+    ret = likwid_pinThread(cpuid);
+    return Py_BuildValue("i", ret);
 }
 
 /*
 ################################################################################
-# CPU topology related functions
+# Marker API timeline trace
 ################################################################################
 */
 
-static PyObject *
-likwid_inittopology(PyObject *self, PyObject *args)
+/* Every thread records its region starts and stops into its own native
+ * buffer, allocated at its first record. With counters, each record carries
+ * the accumulated event values of the region from likwid_markerGetRegion,
+ * the values of a single call are the differences between its stop and
+ * start record, computed when the trace is written. Region tags are stored
+ * once in a fixed table that is read without locking, only new tags take
+ * the lock. */
+
+#define MARKERTRACE_MAXTAGS 1024
+
+typedef struct {
+    uint64_t ts;
+    int32_t tag;
+    int32_t cpu;
+    int32_t phase;
+    int32_t group;
+    int32_t nevents;
+    int32_t count;
+} MarkerTraceRecord;
+
+typedef struct MarkerTraceBuffer {
+    struct MarkerTraceBuffer* next;
+    int32_t tid;
+    uint32_t nrecords;
+    uint32_t dropped;
+    MarkerTraceRecord* records;
+    double* values;
+} MarkerTraceBuffer;
+
+static int markertrace_active = 0;
+static unsigned markertrace_gen = 0;
+static uint32_t markertrace_capacity = 0;
+static int markertrace_maxevents = 0;
+static uint64_t markertrace_t0 = 0;
+static MarkerTraceBuffer* markertrace_buffers = NULL;
+static char* markertrace_tags[MARKERTRACE_MAXTAGS];
+static int markertrace_numtags = 0;
+static pthread_mutex_t markertrace_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread MarkerTraceBuffer* markertrace_tls = NULL;
+static __thread unsigned markertrace_tlsgen = 0;
+
+static uint64_t
+markertrace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void
+markertrace_free(void)
 {
-    int ret = topology_init();
-    if (ret == 0)
+    int i;
+    while (markertrace_buffers != NULL)
     {
-        topo_initialized = 1;
-        Py_RETURN_TRUE;
+        MarkerTraceBuffer* buf = markertrace_buffers;
+        markertrace_buffers = buf->next;
+        free(buf->records);
+        free(buf->values);
+        free(buf);
     }
-    Py_RETURN_FALSE;
+    for (i = 0; i < markertrace_numtags; i++)
+        free(markertrace_tags[i]);
+    markertrace_numtags = 0;
+    /* Buffers cached by the threads are stale now */
+    markertrace_gen++;
 }
 
-static PyObject *
-likwid_finalizetopology(PyObject *self, PyObject *args)
+static int
+markertrace_tagid(const char* tag)
 {
-    topology_finalize();
-    topo_initialized = 0;
-    cputopo = NULL;
-    cpuinfo = NULL;
-    Py_RETURN_NONE;
+    int i, n = __atomic_load_n(&markertrace_numtags, __ATOMIC_ACQUIRE);
+    for (i = 0; i < n; i++)
+    {
+        if (strcmp(markertrace_tags[i], tag) == 0)
+            return i;
+    }
+    pthread_mutex_lock(&markertrace_lock);
+    for (i = n; i < markertrace_numtags; i++)
+    {
+        if (strcmp(markertrace_tags[i], tag) == 0)
+            break;
+    }
+    if (i == markertrace_numtags)
+    {
+        if (i < MARKERTRACE_MAXTAGS && (markertrace_tags[i] = strdup(tag)) != NULL)
+            __atomic_store_n(&markertrace_numtags, i + 1, __ATOMIC_RELEASE);
+        else
+            i = -1;
+    }
+    pthread_mutex_unlock(&markertrace_lock);
+    return i;
 }
 
-static PyObject *
-likwid_getcputopology(PyObject *self, PyObject *args)
+static MarkerTraceBuffer*
+markertrace_buffer(void)
 {
-    int i, ret;
-    PyObject *d = PyDict_New();
-    if (!topo_initialized)
+    MarkerTraceBuffer* buf;
+    if (markertrace_tlsgen == markertrace_gen)
+        return markertrace_tls;
+    markertrace_tlsgen = markertrace_gen;
+    markertrace_tls = NULL;
+    buf = calloc(1, sizeof(MarkerTraceBuffer));
+    if (buf == NULL)
+        return NULL;
+    buf->tid = (int32_t)syscall(SYS_gettid);
+    buf->records = malloc(markertrace_capacity * sizeof(MarkerTraceRecord));
+    if (markertrace_maxevents > 0)
+        buf->values = malloc((size_t)markertrace_capacity * markertrace_maxevents * sizeof(double));
+    if (buf->records == NULL || (markertrace_maxevents > 0 && buf->values == NULL))
+    {
+        free(buf->records);
+        free(buf->values);
+        free(buf);
+        return NULL;
+    }
+    pthread_mutex_lock(&markertrace_lock);
+    buf->next = markertrace_buffers;
+    markertrace_buffers = buf;
+    pthread_mutex_unlock(&markertrace_lock);
+    markertrace_tls = buf;
+    return buf;
+}
+
+static void
+markertrace_record(const char* regiontag, int phase)
+{
+    MarkerTraceBuffer* buf;
+    MarkerTraceRecord* rec;
+    uint64_t ts;
+    if (!markertrace_active)
+        return;
+    ts = markertrace_now();
+    buf = markertrace_buffer();
+    if (buf == NULL)
+        return;
+    if (buf->nrecords >= markertrace_capacity)
+    {
+        buf->dropped++;
+        return;
+    }
+    rec = &buf->records[buf->nrecords];
+    rec->tag = markertrace_tagid(regiontag);
+    if (rec->tag < 0)
+    {
+        buf->dropped++;
+        return;
+    }
+    rec->ts = ts - markertrace_t0;
+    rec->cpu = likwid_getProcessorId();
+    rec->phase = phase;
+    rec->group = perfmon_getIdOfActiveGroup();
+    rec->nevents = 0;
+    rec->count = 0;
+    if (markertrace_maxevents > 0)
+    {
+        int nevents = markertrace_maxevents;
+        int count = 0;
+        double time = 0;
+        likwid_markerGetRegion(regiontag, &nevents,
+                               &buf->values[(size_t)buf->nrecords * markertrace_maxevents],
+                               &time, &count);
+        rec->nevents = (nevents > markertrace_maxevents ? markertrace_maxevents : nevents);
+        rec->count = count;
+    }
+    buf->nrecords++;
+}
+
+static void
+markertrace_jsonstr(FILE* fp, const char* s)
+{
+    fputc('"', fp);
+    for (; *s != '\0'; s++)
+    {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+            fprintf(fp, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(fp, "\\u%04x", c);
+        else
+            fputc(c, fp);
+    }
+    fputc('"', fp);
+}
+
+static void
+markertrace_writecounters(FILE* fp, const char* tag, uint64_t ts, int pid, int tid,
+                          int group, int nevents, const double* values)
+{
+    int e;
+    fprintf(fp, ",\n{\"name\":");
+    markertrace_jsonstr(fp, tag);
+    fprintf(fp, ",\"cat\":\"counters\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%d,\"id\":%d,\"args\":{",
+            ts / 1000.0, pid, tid);
+    for (e = 0; e < nevents; e++)
     {
-        ret = topology_init();
-        if (ret == 0)
+        const char* name = perfmon_getEventName(group, e);
+        char ename[32];
+        if (name == NULL)
         {
-            topo_initialized = 1;
+            snprintf(ename, sizeof(ename), "EVENT%d", e);
+            name = ename;
         }
-        else
+        if (e > 0)
+            fputc(',', fp);
+        markertrace_jsonstr(fp, name);
+        fprintf(fp, ":%.17g", (values != NULL ? values[e] : 0.0));
+    }
+    fprintf(fp, "}}");
+}
+
+/* Write the records of one thread. Each region call becomes a B/E pair on
+ * the thread's track. With counters, the event values of each call are
+ * written as counter samples on a track per region and thread: the values
+ * at the region start, zero at its end. */
+static long
+markertrace_writebuffer(FILE* fp, MarkerTraceBuffer* buf, int pid)
+{
+    uint32_t i;
+    int e;
+    long nevents = 0;
+    /* Index + 1 of the last start record per tag */
+    uint32_t* begin = calloc(markertrace_numtags > 0 ? markertrace_numtags : 1, sizeof(uint32_t));
+    double* delta = calloc(markertrace_maxevents > 0 ? markertrace_maxevents : 1, sizeof(double));
+    if (begin == NULL || delta == NULL)
+    {
+        free(begin);
+        free(delta);
+        return -1;
+    }
+    for (i = 0; i < buf->nrecords; i++)
+    {
+        MarkerTraceRecord* rec = &buf->records[i];
+        MarkerTraceRecord* start;
+        const char* tag = markertrace_tags[rec->tag];
+        double *first, *last;
+        fprintf(fp, ",\n{\"name\":");
+        markertrace_jsonstr(fp, tag);
+        fprintf(fp, ",\"cat\":\"region\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,"
+                    "\"args\":{\"cpu\":%d,\"group\":%d}}",
+                (rec->phase == MARKERTRACE_BEGIN ? 'B' : 'E'), rec->ts / 1000.0,
+                pid, buf->tid, rec->cpu, rec->group);
+        nevents++;
+        if (rec->phase == MARKERTRACE_BEGIN)
         {
-            return d;
+            begin[rec->tag] = i + 1;
+            continue;
         }
-    }
-    PyObject *threads = PyDict_New();
-    PyObject *caches = PyDict_New();
-    PyObject *tmp;
-    if ((topo_initialized) && (cputopo == NULL))
+        if (begin[rec->tag] == 0)
+            continue;
+        start = &buf->records[begin[rec->tag] - 1];
+        begin[rec->tag] = 0;
+        /* No samples if the group was switched inside the region */
+        if (rec->nevents <= 0 || start->group != rec->group || start->nevents != rec->nevents)
+            continue;
+        first = &buf->values[(size_t)(start - buf->records) * markertrace_maxevents];
+        last = &buf->values[(size_t)i * markertrace_maxevents];
+        for (e = 0; e < rec->nevents; e++)
+            delta[e] = last[e] - first[e];
+        markertrace_writecounters(fp, tag, start->ts, pid, buf->tid,
+                                  rec->group, rec->nevents, delta);
+        markertrace_writecounters(fp, tag, rec->ts, pid, buf->tid,
+                                  rec->group, rec->nevents, NULL);
+        nevents += 2;
+    }
+    free(begin);
+    free(delta);
+    return nevents;
+}
+
+static PyObject *
+likwid_markertracestart(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"records", "counters", NULL};
+    int records = 65536;
+    int counters = 1;
+    int g, maxevents = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|ip", kwlist, &records, &counters))
+        return NULL;
+    if (records <= 0)
     {
-        cputopo = get_cpuTopology();
+        PyErr_SetString(PyExc_ValueError, "records must be greater than 0");
+        return NULL;
     }
-    if (!numa_initialized)
+    if (counters)
     {
-        if (numa_init() == 0)
+        for (g = 0; g < perfmon_getNumberOfGroups(); g++)
         {
-            numa_initialized = 1;
-            numainfo = get_numaTopology();
+            int n = perfmon_getNumberOfEvents(g);
+            if (n > maxevents)
+                maxevents = n;
         }
     }
-    if ((numa_initialized) && (numainfo == NULL))
+    pthread_mutex_lock(&markertrace_lock);
+    markertrace_free();
+    markertrace_capacity = (uint32_t)records;
+    markertrace_maxevents = maxevents;
+    markertrace_t0 = markertrace_now();
+    markertrace_active = 1;
+    pthread_mutex_unlock(&markertrace_lock);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+likwid_markertracestop(PyObject *self, PyObject *args)
+{
+    MarkerTraceBuffer* buf;
+    long threads = 0, records = 0, dropped = 0;
+    pthread_mutex_lock(&markertrace_lock);
+    markertrace_active = 0;
+    for (buf = markertrace_buffers; buf != NULL; buf = buf->next)
     {
-        numainfo = get_numaTopology();
+        threads++;
+        records += buf->nrecords;
+        dropped += buf->dropped;
     }
-    PyDict_SetItem(d, PYSTR("numHWThreads"), PYINT(cputopo->numHWThreads));
-    PyDict_SetItem(d, PYSTR("activeHWThreads"), PYINT(cputopo->activeHWThreads));
-    PyDict_SetItem(d, PYSTR("numSockets"), PYINT(cputopo->numSockets));
-    PyDict_SetItem(d, PYSTR("numCoresPerSocket"), PYINT(cputopo->numCoresPerSocket));
-    PyDict_SetItem(d, PYSTR("numThreadsPerCore"), PYINT(cputopo->numThreadsPerCore));
-    PyDict_SetItem(d, PYSTR("numCacheLevels"), PYINT(cputopo->numCacheLevels));
-    for (i = 0; i < (int)cputopo->numHWThreads; i++)
+    pthread_mutex_unlock(&markertrace_lock);
+    return Py_BuildValue("{s:l,s:l,s:l}", "threads", threads, "records", records,
+                         "dropped", dropped);
+}
+
+static PyObject *
+likwid_markertracewrite(PyObject *self, PyObject *args)
+{
+    const char* filename;
+    MarkerTraceBuffer* buf;
+    FILE* fp;
+    int pid = (int)getpid();
+    int err;
+    long nevents = 0, dropped = 0;
+    if (!PyArg_ParseTuple(args, "s", &filename))
+        return NULL;
+    fp = fopen(filename, "w");
+    if (fp == NULL)
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+    pthread_mutex_lock(&markertrace_lock);
+    for (buf = markertrace_buffers; buf != NULL; buf = buf->next)
+        dropped += buf->dropped;
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped\":%ld},\"traceEvents\":[\n"
+                "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                "\"args\":{\"name\":\"pylikwid\"}}", dropped, pid, pid);
+    for (buf = markertrace_buffers; buf != NULL && nevents >= 0; buf = buf->next)
     {
-        tmp = PyDict_New();
-        PyDict_SetItem(tmp, PYSTR("threadId"), PYUINT(cputopo->threadPool[i].threadId));
-        PyDict_SetItem(tmp, PYSTR("coreId"), PYUINT(cputopo->threadPool[i].coreId));
-        PyDict_SetItem(tmp, PYSTR("packageId"), PYUINT(cputopo->threadPool[i].packageId));
-        PyDict_SetItem(tmp, PYSTR("apicId"), PYUINT(cputopo->threadPool[i].apicId));
-        PyDict_SetItem(threads, PYINT(i), tmp);
+        long n = markertrace_writebuffer(fp, buf, pid);
+        nevents = (n < 0 ? -1 : nevents + n);
     }
-    PyDict_SetItem(d, PYSTR("threadPool"), threads);
-    for (i = 0; i < (int)cputopo->numCacheLevels; i++)
+    fprintf(fp, "\n]}\n");
+    pthread_mutex_unlock(&markertrace_lock);
+    if (nevents < 0)
     {
-        tmp = PyDict_New();
-        PyDict_SetItem(tmp, PYSTR("level"), PYUINT(cputopo->cacheLevels[i].level));
-        PyDict_SetItem(tmp, PYSTR("associativity"), PYUINT(cputopo->cacheLevels[i].associativity));
-        PyDict_SetItem(tmp, PYSTR("sets"), PYUINT(cputopo->cacheLevels[i].sets));
-        PyDict_SetItem(tmp, PYSTR("lineSize"), PYUINT(cputopo->cacheLevels[i].lineSize));
-        PyDict_SetItem(tmp, PYSTR("size"), PYUINT(cputopo->cacheLevels[i].size));
-        PyDict_SetItem(tmp, PYSTR("threads"), PYUINT(cputopo->cacheLevels[i].threads));
-        PyDict_SetItem(tmp, PYSTR("inclusive"), PYUINT(cputopo->cacheLevels[i].inclusive));
-        switch(cputopo->cacheLevels[i].type)
-        {
-            case DATACACHE:
-                PyDict_SetItem(tmp, PYSTR("type"), PYSTR("data"));
-                break;
-            case INSTRUCTIONCACHE:
-                PyDict_SetItem(tmp, PYSTR("type"), PYSTR("instruction"));
-                break;
-            case UNIFIEDCACHE:
-                PyDict_SetItem(tmp, PYSTR("type"), PYSTR("unified"));
-                break;
-            case ITLB:
-                PyDict_SetItem(tmp, PYSTR("type"), PYSTR("itlb"));
-                break;
-            case DTLB:
-                PyDict_SetItem(tmp, PYSTR("type"), PYSTR("dtlb"));
-                break;
-            case NOCACHE:
-                break;
-        }
-        PyDict_SetItem(caches, PYUINT(cputopo->cacheLevels[i].level), tmp);
+        fclose(fp);
+        return PyErr_NoMemory();
     }
-    PyDict_SetItem(d, PYSTR("cacheLevels"), caches);
-    return d;
+    err = ferror(fp);
+    if (fclose(fp) != 0 || err)
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+    return PyLong_FromLong(nevents);
 }
 
-static PyObject *
-likwid_getcpuinfo(PyObject *self, PyObject *args)
+/*
+################################################################################
+# Marker API region energy
+################################################################################
+*/
+
+/* Energy of marker regions from the RAPL counters. The first thread that
+ * enters a region on a socket starts the enabled power domains on the first
+ * CPU of that socket (power_start), the last thread leaving the region on the
+ * socket stops them (power_stop) and adds the energy to the region. Calls
+ * with a failed start or stop add nothing. The wall time with at least one
+ * thread inside the region gives the average power.
+ * The RAPL counters are 32 bit wide and wrap, the difference is taken modulo
+ * 2^32, so one wrap per region call is handled. Region calls longer than a
+ * full wrap (minutes at full load) report too little energy. All state is
+ * protected by the GIL like the marker calls themselves. At markerclose() the
+ * results are written next to the Marker API result file as
+ * <LIKWID_FILEPATH>.energy, the readers pick it up from there. */
+
+#define MARKERENERGY_SUFFIX ".energy"
+#define MARKERENERGY_HEADER "# pylikwid marker energy 1: group domain joules seconds tag"
+
+typedef struct {
+    int32_t tid;
+    int socket;
+} MarkerEnergyThread;
+
+typedef struct {
+    char* tag;
+    int group;
+    int active;                 /* threads inside the region */
+    int* sockactive;            /* threads inside the region per socket */
+    PowerData* data;            /* running measurement per socket and domain */
+    char* started;              /* power_start of data succeeded */
+    double joules[NUM_POWER_DOMAINS];
+    double seconds;
+    double start;
+    MarkerEnergyThread* threads;/* socket of each thread inside the region */
+    int nthreads;
+    int maxthreads;
+} MarkerEnergyRegion;
+
+static PowerType markerenergy_domains[NUM_POWER_DOMAINS];
+static int markerenergy_ndomains = 0;
+static MarkerEnergyRegion* markerenergy_regions = NULL;
+static int markerenergy_nregions = 0;
+
+static double
+markerenergy_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+static void
+markerenergy_free(void)
 {
-    int ret;
-    PyObject *d = PyDict_New();
-    if (!topo_initialized)
+    int i;
+    for (i = 0; i < markerenergy_nregions; i++)
     {
-        ret = topology_init();
-        if (ret == 0)
-        {
-            topo_initialized = 1;
-        }
-        else
-        {
-            return d;
-        }
+        MarkerEnergyRegion* r = &markerenergy_regions[i];
+        free(r->tag);
+        free(r->sockactive);
+        free(r->data);
+        free(r->started);
+        free(r->threads);
     }
-    if ((topo_initialized) && (cputopo == NULL))
+    free(markerenergy_regions);
+    markerenergy_regions = NULL;
+    markerenergy_nregions = 0;
+}
+
+static MarkerEnergyRegion*
+markerenergy_region(const char* regiontag, int group, int create)
+{
+    int i;
+    MarkerEnergyRegion* r;
+    for (i = 0; i < markerenergy_nregions; i++)
     {
-        cputopo = get_cpuTopology();
+        r = &markerenergy_regions[i];
+        if (r->group == group && strcmp(r->tag, regiontag) == 0)
+            return r;
     }
-    if (!numa_initialized)
-    {
-        if (numa_init() == 0)
+    if (!create)
+        return NULL;
+    r = realloc(markerenergy_regions, (markerenergy_nregions + 1) * sizeof(MarkerEnergyRegion));
+    if (r == NULL)
+        return NULL;
+    markerenergy_regions = r;
+    r = &markerenergy_regions[markerenergy_nregions];
+    memset(r, 0, sizeof(MarkerEnergyRegion));
+    r->group = group;
+    r->tag = strdup(regiontag);
+    r->sockactive = calloc(power_nsockets, sizeof(int));
+    r->data = calloc((size_t)power_nsockets * NUM_POWER_DOMAINS, sizeof(PowerData));
+    r->started = calloc((size_t)power_nsockets * NUM_POWER_DOMAINS, sizeof(char));
+    if (r->tag == NULL || r->sockactive == NULL || r->data == NULL || r->started == NULL)
+    {
+        free(r->tag);
+        free(r->sockactive);
+        free(r->data);
+        free(r->started);
+        return NULL;
+    }
+    markerenergy_nregions++;
+    return r;
+}
+
+static void
+markerenergy_start(const char* regiontag)
+{
+    MarkerEnergyRegion* r;
+    int32_t tid;
+    int cpu, s, d;
+    if (markerenergy_ndomains == 0)
+        return;
+    r = markerenergy_region(regiontag, perfmon_getIdOfActiveGroup(), 1);
+    if (r == NULL)
+        return;
+    if (r->nthreads == r->maxthreads)
+    {
+        int max = (r->maxthreads > 0 ? 2 * r->maxthreads : 8);
+        MarkerEnergyThread* tmp = realloc(r->threads, max * sizeof(MarkerEnergyThread));
+        if (tmp == NULL)
+            return;
+        r->threads = tmp;
+        r->maxthreads = max;
+    }
+    tid = (int32_t)syscall(SYS_gettid);
+    cpu = likwid_getProcessorId();
+    s = (cpu >= 0 && cpu < power_ncpus ? power_cpusock[cpu] : 0);
+    r->threads[r->nthreads].tid = tid;
+    r->threads[r->nthreads].socket = s;
+    r->nthreads++;
+    if (r->active++ == 0)
+        r->start = markerenergy_now();
+    if (r->sockactive[s]++ == 0)
+    {
+        for (d = 0; d < markerenergy_ndomains; d++)
         {
-            numa_initialized = 1;
-            numainfo = get_numaTopology();
+            int k = s * NUM_POWER_DOMAINS + d;
+            r->started[k] = (power_start(&r->data[k], power_sockcpu[s], markerenergy_domains[d]) == 0);
         }
     }
-    if ((numa_initialized) && (numainfo == NULL))
-    {
-        numainfo = get_numaTopology();
-    }
-    CpuInfo_t info = get_cpuInfo();
-    PyDict_SetItem(d, PYSTR("family"), PYUINT(info->family));
-    PyDict_SetItem(d, PYSTR("model"), PYUINT(info->model));
-    PyDict_SetItem(d, PYSTR("stepping"), PYUINT(info->stepping));
-    PyDict_SetItem(d, PYSTR("clock"), Py_BuildValue("k", info->clock));
-    if (info->turbo)
-    {
-        PyDict_SetItem(d, PYSTR("turbo"), Py_True);
-    }
-    else
-    {
-        PyDict_SetItem(d, PYSTR("turbo"), Py_False);
-    }
-    if (info->isIntel)
-    {
-        PyDict_SetItem(d, PYSTR("isIntel"), Py_True);
-    }
-    else
-    {
-        PyDict_SetItem(d, PYSTR("isIntel"), Py_False);
-    }
-    if (info->supportUncore)
+}
+
+static void
+markerenergy_stop(const char* regiontag)
+{
+    MarkerEnergyRegion* r;
+    int32_t tid;
+    int i, s, d;
+    if (markerenergy_ndomains == 0)
+        return;
+    r = markerenergy_region(regiontag, perfmon_getIdOfActiveGroup(), 0);
+    if (r == NULL)
+        return;
+    tid = (int32_t)syscall(SYS_gettid);
+    for (i = r->nthreads - 1; i >= 0 && r->threads[i].tid != tid; i--);
+    if (i < 0)
+        return;
+    s = r->threads[i].socket;
+    r->threads[i] = r->threads[--r->nthreads];
+    if (--r->sockactive[s] == 0)
     {
-        PyDict_SetItem(d, PYSTR("supportUncore"), Py_True);
+        for (d = 0; d < markerenergy_ndomains; d++)
+        {
+            int k = s * NUM_POWER_DOMAINS + d;
+            PowerData* data = &r->data[k];
+            /* Failed reads are left out of the region energy */
+            if (!r->started[k] || power_stop(data, power_sockcpu[s], markerenergy_domains[d]) != 0)
+                continue;
+            /* Modulo 2^32 for a wrapped counter */
+            r->joules[d] += (double)(uint32_t)(data->after - data->before) *
+                            power->domains[markerenergy_domains[d]].energyUnit;
+        }
     }
-    else
-    {
-        PyDict_SetItem(d, PYSTR("supportUncore"), Py_False);
-    }
-    PyDict_SetItem(d, PYSTR("osname"), PYSTR(info->osname));
-    PyDict_SetItem(d, PYSTR("name"), PYSTR(info->name));
-    PyDict_SetItem(d, PYSTR("short_name"), PYSTR(info->short_name));
-    PyDict_SetItem(d, PYSTR("features"), PYSTR(info->features));
-    PyDict_SetItem(d, PYSTR("featureFlags"), PYUINT(info->featureFlags));
-    PyDict_SetItem(d, PYSTR("perf_version"), PYUINT(info->perf_version));
-    PyDict_SetItem(d, PYSTR("perf_num_ctr"), PYUINT(info->perf_num_ctr));
-    PyDict_SetItem(d, PYSTR("perf_width_ctr"), PYUINT(info->perf_width_ctr));
-    PyDict_SetItem(d, PYSTR("perf_num_fixed_ctr"), PYUINT(info->perf_num_fixed_ctr));
-#if (LIKWID_MAJOR == 5)
-    PyDict_SetItem(d, PYSTR("architecture"), PYSTR(info->architecture));
-#endif
-    return d;
+    if (--r->active == 0)
+        r->seconds += markerenergy_now() - r->start;
 }
 
-
-static PyObject *
-likwid_printsupportedcpus(PyObject *self, PyObject *args)
+static void
+markerenergy_reset(const char* regiontag)
 {
-    print_supportedCPUs();
-    Py_RETURN_NONE;
+    MarkerEnergyRegion* r = markerenergy_region(regiontag, perfmon_getIdOfActiveGroup(), 0);
+    if (r == NULL)
+        return;
+    memset(r->joules, 0, sizeof(r->joules));
+    r->seconds = 0;
+    if (r->active > 0)
+        r->start = markerenergy_now();
 }
 
-/*
-################################################################################
-# NUMA related functions
-################################################################################
-*/
-
+/* Dict {"seconds": s, "joules": {domain: J}, "watts": {domain: W}} */
 static PyObject *
-likwid_initnuma(PyObject *self, PyObject *args)
+markerenergy_dict(double seconds, const int* domains, const double* joules, int n)
 {
-    int i,j;
-    if (!topo_initialized)
+    int d;
+    PyObject* res = PyDict_New();
+    PyObject* pj = PyDict_New();
+    PyObject* pw = PyDict_New();
+    for (d = 0; d < n; d++)
     {
-        topology_init();
-        topo_initialized = 1;
-        cpuinfo = get_cpuInfo();
-        cputopo = get_cpuTopology();
+        pydict_set(pj, power_names[domains[d]], PyFloat_FromDouble(joules[d]));
+        pydict_set(pw, power_names[domains[d]],
+                   PyFloat_FromDouble(seconds > 0 ? joules[d] / seconds : 0.0));
     }
-    if ((topo_initialized) && (cpuinfo == NULL))
+    pydict_set(res, "seconds", PyFloat_FromDouble(seconds));
+    pydict_set(res, "joules", pj);
+    pydict_set(res, "watts", pw);
+    return res;
+}
+
+static int
+markerenergy_write(const char* filename)
+{
+    int i, d, err;
+    FILE* fp = fopen(filename, "w");
+    if (fp == NULL)
+        return -1;
+    fprintf(fp, "%s\n", MARKERENERGY_HEADER);
+    for (i = 0; i < markerenergy_nregions; i++)
     {
-        cpuinfo = get_cpuInfo();
+        MarkerEnergyRegion* r = &markerenergy_regions[i];
+        for (d = 0; d < markerenergy_ndomains; d++)
+            fprintf(fp, "%d\t%s\t%.17g\t%.17g\t%s\n", r->group,
+                    power_names[markerenergy_domains[d]], r->joules[d], r->seconds, r->tag);
     }
-    if ((topo_initialized) && (cputopo == NULL))
+    err = ferror(fp);
+    if (fclose(fp) != 0 || err)
+        return -1;
+    return 0;
+}
+
+/* Called by markerclose(), the results of the session are written to the
+ * energy file if LIKWID_FILEPATH is set */
+static void
+markerenergy_close(void)
+{
+    const char* path = getenv("LIKWID_FILEPATH");
+    if (markerenergy_ndomains > 0 && markerenergy_nregions > 0 && path != NULL)
     {
-        cputopo = get_cpuTopology();
+        char filename[PATH_MAX];
+        snprintf(filename, sizeof(filename), "%s%s", path, MARKERENERGY_SUFFIX);
+        if (markerenergy_write(filename) < 0)
+            fprintf(stderr, "pylikwid: Cannot write region energy to %s: %s\n",
+                    filename, strerror(errno));
     }
-    if (numa_initialized == 0)
-    {
-        if (numa_init() == 0)
+    markerenergy_free();
+}
+
+/* Energy file of a Marker API result file as dict {(tag, group): energy},
+ * empty if there is none */
+static PyObject *
+markerenergy_load(const char* markerfile)
+{
+    char filename[PATH_MAX];
+    char line[4096];
+    long lineno = 0;
+    FILE* fp;
+    PyObject* res = PyDict_New();
+    if (res == NULL)
+        return NULL;
+    snprintf(filename, sizeof(filename), "%s%s", markerfile, MARKERENERGY_SUFFIX);
+    fp = fopen(filename, "r");
+    if (fp == NULL)
+        return res;
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        char domain[32];
+        int group, n = 0;
+        double joules, seconds;
+        char* tag;
+        size_t len = strcspn(line, "\r\n");
+        PyObject *key, *entry;
+        lineno++;
+        line[len] = '\0';
+        if (line[0] == '#' || line[0] == '\0')
+            continue;
+        if (sscanf(line, "%d\t%31[^\t]\t%lf\t%lf\t%n", &group, domain, &joules, &seconds, &n) != 4 ||
+            n == 0)
         {
-            numa_initialized = 1;
-            numainfo = get_numaTopology();
+            fclose(fp);
+            Py_DECREF(res);
+            PyErr_Format(PyExc_ValueError, "Invalid region energy file %s (line %ld)", filename, lineno);
+            return NULL;
         }
-        else
+        tag = line + n;
+        key = Py_BuildValue("(si)", tag, group);
+        entry = (key != NULL ? PyDict_GetItemWithError(res, key) : NULL);
+        if (entry == NULL && key != NULL && !PyErr_Occurred())
         {
-            PyObject *d = PyDict_New();
-            PyDict_SetItem(d, PYSTR("numberOfNodes"), PYINT(0));
-            PyDict_SetItem(d, PYSTR("nodes"), PyDict_New());
-            return d;
+            entry = markerenergy_dict(seconds, NULL, NULL, 0);
+            if (PyDict_SetItem(res, key, entry) < 0)
+                Py_CLEAR(key);
+            Py_DECREF(entry);
+        }
+        if (key == NULL || entry == NULL)
+        {
+            Py_XDECREF(key);
+            fclose(fp);
+            Py_DECREF(res);
+            return NULL;
         }
+        Py_DECREF(key);
+        /* domain is not a static string, no interned key */
+        pydict_setobj(PyDict_GetItemString(entry, "joules"), PYSTR(domain), PyFloat_FromDouble(joules));
+        pydict_setobj(PyDict_GetItemString(entry, "watts"), PYSTR(domain),
+                      PyFloat_FromDouble(seconds > 0 ? joules / seconds : 0.0));
     }
-    if ((numa_initialized) && (numainfo == NULL))
+    fclose(fp);
+    return res;
+}
+
+static PyObject *
+likwid_markerenergy(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"domains", NULL};
+    PyObject* pydomains = NULL;
+    PyObject *seq, *res;
+    PowerType domains[NUM_POWER_DOMAINS];
+    int n = 0;
+    Py_ssize_t i;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", kwlist, &pydomains))
+        return NULL;
+    if (pydomains == Py_None || (pydomains != NULL && PyObject_Not(pydomains) == 1))
     {
-        numainfo = get_numaTopology();
+        markerenergy_ndomains = 0;
+        markerenergy_free();
+        return PyList_New(0);
     }
-    if (affinity_initialized == 0)
+    if (need_power() < 0)
     {
-        affinity_init();
-        affinity_initialized = 1;
-        affinity = get_affinityDomains();
+        PyErr_SetString(PyExc_RuntimeError, "Cannot initialize the power module, no RAPL support");
+        return NULL;
     }
-    if ((affinity_initialized) && (affinity == NULL))
+    if (power_sockets() < 0)
+        return PyErr_NoMemory();
+    if (power_addsockets() < 0)
     {
-        affinity = get_affinityDomains();
+        PyErr_SetString(PyExc_RuntimeError, "Cannot access the RAPL registers of all sockets");
+        return NULL;
     }
-    PyObject *d = PyDict_New();
-    PyObject *nodes = PyDict_New();
-    PyDict_SetItem(d, PYSTR("numberOfNodes"), PYINT(numainfo->numberOfNodes));
-    for(i = 0;i < (int)numainfo->numberOfNodes; i++)
+    if (pydomains == NULL)
     {
-        PyObject *n = PyDict_New();
-        PyDict_SetItem(n, PYSTR("id"), PYINT(numainfo->nodes[i].id));
-        PyDict_SetItem(n, PYSTR("totalMemory"), PYINT(numainfo->nodes[i].totalMemory));
-        PyDict_SetItem(n, PYSTR("freeMemory"), PYINT(numainfo->nodes[i].freeMemory));
-        PyDict_SetItem(n, PYSTR("numberOfProcessors"), PYINT(numainfo->nodes[i].numberOfProcessors));
-        PyDict_SetItem(n, PYSTR("numberOfDistances"), PYINT(numainfo->nodes[i].numberOfDistances));
-        PyObject *l = PyList_New(numainfo->nodes[i].numberOfProcessors);
-        for(j = 0; j < (int)numainfo->nodes[i].numberOfProcessors; j++)
-        {
-            PyList_SET_ITEM(l, (Py_ssize_t)j, PYINT(numainfo->nodes[i].processors[j]));
-        }
-        PyDict_SetItem(n, PYSTR("processors"), l);
-        PyObject *dist = PyList_New(numainfo->nodes[i].numberOfDistances);
-        for(j = 0; j < (int)numainfo->nodes[i].numberOfDistances; j++)
+        int defaults[] = {PKG, DRAM};
+        for (i = 0; i < 2; i++)
+            if (power->domains[defaults[i]].supportFlags & POWER_DOMAIN_SUPPORT_STATUS)
+                domains[n++] = defaults[i];
+    }
+    else
+    {
+        if (PyUnicode_Check(pydomains))
+            seq = PyTuple_Pack(1, pydomains);
+        else
+            seq = PySequence_Fast(pydomains, "domains must be a sequence of power domain names");
+        if (seq == NULL)
+            return NULL;
+        for (i = 0; i < PySequence_Fast_GET_SIZE(seq); i++)
         {
-            PyList_SET_ITEM(dist, (Py_ssize_t)j, PYINT(numainfo->nodes[i].distances[j]));
+            const char* name = PyUnicode_AsUTF8(PySequence_Fast_GET_ITEM(seq, i));
+            int d, k;
+            if (name == NULL)
+            {
+                Py_DECREF(seq);
+                return NULL;
+            }
+            for (d = 0; d < NUM_POWER_DOMAINS && strcmp(power_names[d], name) != 0; d++);
+            if (d == NUM_POWER_DOMAINS || !(power->domains[d].supportFlags & POWER_DOMAIN_SUPPORT_STATUS))
+            {
+                PyErr_Format(PyExc_ValueError, "Power domain %s not supported", name);
+                Py_DECREF(seq);
+                return NULL;
+            }
+            for (k = 0; k < n && domains[k] != (PowerType)d; k++);
+            if (k == n)
+                domains[n++] = d;
         }
-        PyDict_SetItem(n, PYSTR("distances"), dist);
-        PyDict_SetItem(nodes, PYINT(i), n);
+        Py_DECREF(seq);
     }
-    PyDict_SetItem(d, PYSTR("nodes"), nodes);
-    return d;
+    markerenergy_free();
+    memcpy(markerenergy_domains, domains, n * sizeof(PowerType));
+    markerenergy_ndomains = n;
+    res = PyList_New(0);
+    for (i = 0; i < n; i++)
+        pylist_append(res, PYSTR(power_names[domains[i]]));
+    return res;
 }
 
 static PyObject *
-likwid_finalizenuma(PyObject *self, PyObject *args)
+likwid_markergetregionenergy(PyObject *self, PyObject *args)
 {
-    if (numa_initialized)
+    const char* regiontag;
+    MarkerEnergyRegion* r;
+    int domains[NUM_POWER_DOMAINS];
+    double seconds;
+    int d;
+    if (!PyArg_ParseTuple(args, "s", &regiontag))
+        return NULL;
+    r = markerenergy_region(regiontag, perfmon_getIdOfActiveGroup(), 0);
+    if (markerenergy_ndomains == 0 || r == NULL)
     {
-        numa_finalize();
-        numainfo = NULL;
-        numa_initialized = 0;
+        Py_RETURN_NONE;
     }
-    Py_RETURN_NONE;
+    for (d = 0; d < markerenergy_ndomains; d++)
+        domains[d] = markerenergy_domains[d];
+    seconds = r->seconds + (r->active > 0 ? markerenergy_now() - r->start : 0.0);
+    return markerenergy_dict(seconds, domains, r->joules, markerenergy_ndomains);
 }
 
-
 /*
 ################################################################################
-# Affinity related functions
+# Misc functions
 ################################################################################
 */
 
 static PyObject *
-likwid_initaffinity(PyObject *self, PyObject *args)
+likwid_setverbosity(PyObject *self, PyObject *args)
 {
-    int i,j;
-
-    if (topo_initialized == 0)
-    {
-        topology_init();
-        topo_initialized = 1;
-        cpuinfo = get_cpuInfo();
-        cputopo = get_cpuTopology();
-    }
-    if ((topo_initialized) && (cpuinfo == NULL))
-    {
-        cpuinfo = get_cpuInfo();
-    }
-    if ((topo_initialized) && (cputopo == NULL))
-    {
-        cputopo = get_cpuTopology();
-    }
-    if (numa_initialized == 0)
-    {
-        if (numa_init() == 0)
-        {
-            numa_initialized = 1;
-            numainfo = get_numaTopology();
-        }
-    }
-    if ((numa_initialized) && (numainfo == NULL))
-    {
-        numainfo = get_numaTopology();
-    }
-    if (affinity_initialized == 0)
-    {
-        affinity_init();
-        affinity_initialized = 1;
-        affinity = get_affinityDomains();
-    }
-    if ((affinity_initialized) && (affinity == NULL))
-    {
-        affinity = get_affinityDomains();
-    }
-    PyObject *n = PyDict_New();
-    if (affinity == NULL)
-    {
-        return n;
-    }
-    PyDict_SetItem(n, PYSTR("numberOfAffinityDomains"), PYINT(affinity->numberOfAffinityDomains));
-    PyDict_SetItem(n, PYSTR("numberOfSocketDomains"), PYINT(affinity->numberOfSocketDomains));
-    PyDict_SetItem(n, PYSTR("numberOfNumaDomains"), PYINT(affinity->numberOfNumaDomains));
-    PyDict_SetItem(n, PYSTR("numberOfProcessorsPerSocket"), PYINT(affinity->numberOfProcessorsPerSocket));
-    PyDict_SetItem(n, PYSTR("numberOfCacheDomains"), PYINT(affinity->numberOfCacheDomains));
-    PyDict_SetItem(n, PYSTR("numberOfCoresPerCache"), PYINT(affinity->numberOfCoresPerCache));
-    PyDict_SetItem(n, PYSTR("numberOfProcessorsPerCache"), PYINT(affinity->numberOfProcessorsPerCache));
-    PyObject *doms = PyDict_New();
-    for(i = 0; i < (int)affinity->numberOfAffinityDomains; i++)
+    int verbosity;
+    if (!PyArg_ParseTuple(args, "i", &verbosity))
+        return NULL;
+    if (verbosity >= DEBUGLEV_ONLY_ERROR && verbosity <= DEBUGLEV_DEVELOP)
     {
-        PyObject *a = PyDict_New();
-#if (LIKWID_MAJOR == 5 && LIKWID_RELEASE >= 4)
-        PyDict_SetItem(a, PYSTR("tag"), PYSTR(affinity->domains[i].tag));
-#else
-        PyDict_SetItem(a, PYSTR("tag"), PYSTR(bdata(affinity->domains[i].tag)));
-#endif
-        PyDict_SetItem(a, PYSTR("numberOfProcessors"), PYINT(affinity->domains[i].numberOfProcessors));
-        PyDict_SetItem(a, PYSTR("numberOfCores"), PYINT(affinity->domains[i].numberOfCores));
-        PyObject *l = PyList_New(affinity->domains[i].numberOfProcessors);
-        for(j = 0;j < (int)affinity->domains[i].numberOfProcessors; j++)
-        {
-            PyList_SET_ITEM(l, (Py_ssize_t)j, PYINT(affinity->domains[i].processorList[j]));
-        }
-        PyDict_SetItem(a, PYSTR("processorList"), l);
-        PyDict_SetItem(doms, PYINT(i), a);
+        perfmon_setVerbosity(verbosity);
+        return Py_BuildValue("i", verbosity);
     }
-    PyDict_SetItem(n, PYSTR("domains"), doms);
-    return n;
+    return Py_BuildValue("i", -1);
 }
 
+/*
+################################################################################
+# Access client related functions
+################################################################################
+*/
+
 static PyObject *
-likwid_finalizeaffinity(PyObject *self, PyObject *args)
+likwid_hpmmode(PyObject *self, PyObject *args)
 {
-    if (affinity_initialized)
+    int mode;
+    if (!PyArg_ParseTuple(args, "i", &mode))
+        Py_RETURN_FALSE;
+    if ((mode == ACCESSMODE_DIRECT) || (mode == ACCESSMODE_DAEMON))
     {
-        affinity_finalize();
-        affinity_initialized = 0;
-        affinity = NULL;
+        HPMmode(mode);
+        Py_RETURN_TRUE;
     }
-    Py_RETURN_NONE;
+    Py_RETURN_FALSE;
 }
 
 static PyObject *
-likwid_cpustr_to_cpulist(PyObject *self, PyObject *args)
+likwid_hpminit(PyObject *self, PyObject *args)
 {
-    int ret = 0, j = 0;
-    const char *cpustr;
-    if (!PyArg_ParseTuple(args, "s", &cpustr))
-    {
-        Py_RETURN_NONE;
-    }
-    if (configfile == NULL)
-    {
-        init_configuration();
-        configfile = get_configuration();
-    }
-    int* cpulist = (int*) malloc(configfile->maxNumThreads * sizeof(int));
-    if (!cpulist)
-    {
-        Py_RETURN_NONE;
-    }
-    ret = cpustr_to_cpulist((char *)cpustr, cpulist, configfile->maxNumThreads);
-    if (ret < 0)
-    {
-        free(cpulist);
-        Py_RETURN_NONE;
-    }
-    PyObject *l = PyList_New(ret);
-    for(j=0;j<ret;j++)
+    int err = HPMinit();
+    if (err == 0)
     {
-        PyList_SET_ITEM(l, (Py_ssize_t)j, PYINT(cpulist[j]));
+        access_initialized = 1;
+        Py_RETURN_TRUE;
     }
-    free(cpulist);
-    return l;
+    Py_RETURN_FALSE;
 }
 
-
-
-#if LIKWID_MAJOR == 5 && defined LIKWID_NVMON
 static PyObject *
-likwid_gpustr_to_gpulist(PyObject *self, PyObject *args)
+likwid_hpmaddthread(PyObject *self, PyObject *args)
 {
-    int ret = 0, j = 0;
-    const char *gpustr;
-    if (!PyArg_ParseTuple(args, "s", &gpustr))
-    {
-        Py_RETURN_NONE;
-    }
-    if (configfile == NULL)
-    {
-        init_configuration();
-        configfile = get_configuration();
-    }
-    int* gpulist = (int*) malloc(configfile->maxNumThreads * sizeof(int));
-    if (!gpulist)
-    {
-        Py_RETURN_NONE;
-    }
-    ret = gpustr_to_gpulist((char *)gpustr, gpulist, configfile->maxNumThreads);
-    if (ret < 0)
-    {
-        free(gpulist);
-        Py_RETURN_NONE;
-    }
-    PyObject *l = PyList_New(ret);
-    for(j=0;j<ret;j++)
+    int cpuid, ret;
+    if (!PyArg_ParseTuple(args, "i", &cpuid))
+        return Py_BuildValue("i", -1);
+    if (access_initialized == 0)
     {
-        PyList_SET_ITEM(l, (Py_ssize_t)j, PYINT(gpulist[j]));
+        return Py_BuildValue("i", -1);
     }
-    free(gpulist);
-    return l;
+    ret = HPMaddThread(cpuid);
+    return Py_BuildValue("i", ret);
 }
+
+static PyObject *
+likwid_hpmfinalize(PyObject *self, PyObject *args)
+{
+    /* The throttle monitor and the frequency timeline read MSRs */
+    throttle_halt();
+#if (LIKWID_MAJOR == 5)
+    freqtimeline_halt();
 #endif
+    HPMfinalize();
+    access_initialized = 0;
+    Py_RETURN_NONE;
+}
 
 /*
 ################################################################################
-# Timer related functions
+# Config file related functions
 ################################################################################
 */
 
 static PyObject *
-likwid_getCpuClock(PyObject *self, PyObject *args)
+likwid_initconfiguration(PyObject *self, PyObject *args)
 {
-    if (timer_initialized == 0)
-    {
-        timer_init();
-        timer_initialized = 1;
-    }
-    return PYINT(timer_getCpuClock());
+    if (need_config() == 0)
+        Py_RETURN_TRUE;
+    Py_RETURN_FALSE;
 }
 
 static PyObject *
-likwid_startClock(PyObject *self, PyObject *args)
+likwid_destroyconfiguration(PyObject *self, PyObject *args)
 {
-    TimerData timer;
-    if (timer_initialized == 0)
+    if (!config_initialized)
+        Py_RETURN_FALSE;
+    int ret = destroy_configuration();
+    if (ret == 0)
     {
-        timer_init();
-        timer_initialized = 1;
+        config_initialized = 0;
+        configfile = NULL;
+        Py_RETURN_TRUE;
     }
-    timer_start(&timer);
-    return Py_BuildValue("K", timer.start.int64);
+    Py_RETURN_FALSE;
 }
 
 static PyObject *
-likwid_stopClock(PyObject *self, PyObject *args)
+likwid_getconfiguration(PyObject *self, PyObject *args)
 {
-    TimerData timer;
-    if (timer_initialized == 0)
-    {
-        timer_init();
-        timer_initialized = 1;
-    }
-    timer_stop(&timer);
-    return Py_BuildValue("K", timer.stop.int64);
+    PyObject *d = PyDict_New();
+    if (need_config() < 0)
+        return d;
+    pydict_set(d, "configFileName", PYSTR(configfile->configFileName));
+    pydict_set(d, "topologyCfgFileName", PYSTR(configfile->topologyCfgFileName));
+    pydict_set(d, "daemonPath", PYSTR(configfile->daemonPath));
+    pydict_set(d, "groupPath", PYSTR(configfile->groupPath));
+    pydict_set(d, "daemonMode", PYINT(configfile->daemonMode));
+    pydict_set(d, "maxNumThreads", PYINT(configfile->maxNumThreads));
+    pydict_set(d, "maxNumNodes", PYINT(configfile->maxNumNodes));
+    return d;
 }
 
-static PyObject *
-likwid_getClockCycles(PyObject *self, PyObject *args)
-{
-    TimerData timer;
-    uint64_t start,stop;
-    if (!PyArg_ParseTuple(args, "KK", &start, &stop))
-    {
-        Py_RETURN_NONE;
-    }
-    if (timer_initialized == 0)
-    {
-        timer_init();
-        timer_initialized = 1;
-    }
-    timer.start.int64 = start;
-    timer.stop.int64 = stop;
-    return Py_BuildValue("K", timer_printCycles(&timer));
-}
+static void groupcatalog_clear(void);
 
 static PyObject *
-likwid_getClock(PyObject *self, PyObject *args)
+likwid_setgrouppath(PyObject *self, PyObject *args)
 {
-    TimerData timer;
-    uint64_t start,stop;
-    if (!PyArg_ParseTuple(args, "KK", &start, &stop))
-    {
-        Py_RETURN_NONE;
-    }
-    if (timer_initialized == 0)
+    int ret = 0;
+    char* grouppath;
+    if (!PyArg_ParseTuple(args, "s", &grouppath))
+        Py_RETURN_FALSE;
+    ret = config_setGroupPath(grouppath);
+    if (ret == 0)
     {
-        timer_init();
-        timer_initialized = 1;
+        groupcatalog_clear();
+        Py_RETURN_TRUE;
     }
-    timer.start.int64 = start;
-    timer.stop.int64 = stop;
-    return Py_BuildValue("d", timer_print(&timer));
+    Py_RETURN_FALSE;
 }
 
 /*
 ################################################################################
-# Temperature related functions
+# CPU topology related functions
 ################################################################################
 */
 
 static PyObject *
-likwid_initTemp(PyObject *self, PyObject *args)
+likwid_inittopology(PyObject *self, PyObject *args)
 {
-    int cpuid;
-    if (PyArg_ParseTuple(args, "i", &cpuid))
-    {
-        thermal_init(cpuid);
-    }
-    Py_RETURN_NONE;
+    if (need_topology() == 0)
+        Py_RETURN_TRUE;
+    Py_RETURN_FALSE;
 }
 
 static PyObject *
-likwid_readTemp(PyObject *self, PyObject *args)
+likwid_finalizetopology(PyObject *self, PyObject *args)
 {
-    int cpuid;
-    unsigned int data = 0;
-    if (PyArg_ParseTuple(args, "i", &cpuid))
-    {
-        thermal_read(cpuid, &data);
-    }
-    return PYUINT(data);
+    throttle_halt();
+#if (LIKWID_MAJOR == 5)
+    freqtimeline_halt();
+#endif
+    Py_CLEAR(aggregate_maps);
+    toposnap_release();
+    topology_finalize();
+    topo_initialized = 0;
+    cputopo = NULL;
+    cpuinfo = NULL;
+    Py_RETURN_NONE;
 }
 
-/*
-################################################################################
-# Power/Energy related functions
-################################################################################
-*/
-
 static PyObject *
-likwid_getPowerInfo(PyObject *self, PyObject *args)
+likwid_getcputopology(PyObject *self, PyObject *args)
 {
     int i;
-    int power_hasRAPL = 0;
-    if (topo_initialized == 0)
-    {
-        topology_init();
-        topo_initialized = 1;
-        cpuinfo = get_cpuInfo();
-        cputopo = get_cpuTopology();
-    }
-    if ((topo_initialized) && (cpuinfo == NULL))
+    PyObject *d = PyDict_New();
+    if (need_topology() < 0)
     {
-        cpuinfo = get_cpuInfo();
+        return d;
     }
-    if ((topo_initialized) && (cputopo == NULL))
+    PyObject *threads = PyDict_New();
+    PyObject *caches = PyDict_New();
+    PyObject *tmp;
+    pydict_set(d, "numHWThreads", PYINT(cputopo->numHWThreads));
+    pydict_set(d, "activeHWThreads", PYINT(cputopo->activeHWThreads));
+    pydict_set(d, "numSockets", PYINT(cputopo->numSockets));
+    pydict_set(d, "numCoresPerSocket", PYINT(cputopo->numCoresPerSocket));
+    pydict_set(d, "numThreadsPerCore", PYINT(cputopo->numThreadsPerCore));
+    pydict_set(d, "numCacheLevels", PYINT(cputopo->numCacheLevels));
+    for (i = 0; i < (int)cputopo->numHWThreads; i++)
     {
-        cputopo = get_cpuTopology();
-    }
-    if (power_initialized == 0)
+        tmp = PyDict_New();
+        pydict_set(tmp, "threadId", PYUINT(cputopo->threadPool[i].threadId));
+        pydict_set(tmp, "coreId", PYUINT(cputopo->threadPool[i].coreId));
+        pydict_set(tmp, "packageId", PYUINT(cputopo->threadPool[i].packageId));
+        pydict_set(tmp, "apicId", PYUINT(cputopo->threadPool[i].apicId));
+        int type = coretype_of((int)cputopo->threadPool[i].apicId);
+        pydict_set(tmp, "coreType", (type != CORETYPE_NONE ? PYSTR(coretype_names[type]) : pynone()));
+        pydict_setobj(threads, PYINT(i), tmp);
+    }
+    pydict_set(d, "threadPool", threads);
+    for (i = 0; i < (int)cputopo->numCacheLevels; i++)
     {
-        power_hasRAPL = power_init(0);
-        if (power_hasRAPL)
-        {
-            power_initialized = 1;
-            power = get_powerInfo();
-        }
-        else
+        tmp = PyDict_New();
+        pydict_set(tmp, "level", PYUINT(cputopo->cacheLevels[i].level));
+        pydict_set(tmp, "associativity", PYUINT(cputopo->cacheLevels[i].associativity));
+        pydict_set(tmp, "sets", PYUINT(cputopo->cacheLevels[i].sets));
+        pydict_set(tmp, "lineSize", PYUINT(cputopo->cacheLevels[i].lineSize));
+        pydict_set(tmp, "size", PYUINT(cputopo->cacheLevels[i].size));
+        pydict_set(tmp, "threads", PYUINT(cputopo->cacheLevels[i].threads));
+        pydict_set(tmp, "inclusive", PYUINT(cputopo->cacheLevels[i].inclusive));
+        switch(cputopo->cacheLevels[i].type)
         {
-            Py_RETURN_NONE;
+            case DATACACHE:
+                pydict_set(tmp, "type", PYSTR("data"));
+                break;
+            case INSTRUCTIONCACHE:
+                pydict_set(tmp, "type", PYSTR("instruction"));
+                break;
+            case UNIFIEDCACHE:
+                pydict_set(tmp, "type", PYSTR("unified"));
+                break;
+            case ITLB:
+                pydict_set(tmp, "type", PYSTR("itlb"));
+                break;
+            case DTLB:
+                pydict_set(tmp, "type", PYSTR("dtlb"));
+                break;
+            case NOCACHE:
+                break;
         }
+        pydict_setobj(caches, PYUINT(cputopo->cacheLevels[i].level), tmp);
     }
-    PyObject *n = PyDict_New();
-    PyDict_SetItem(n, PYSTR("hasRAPL"), PYINT(power_hasRAPL));
-    PyDict_SetItem(n, PYSTR("baseFrequency"), Py_BuildValue("d", power->baseFrequency));
-    PyDict_SetItem(n, PYSTR("minFrequency"), Py_BuildValue("d", power->minFrequency));
-    PyDict_SetItem(n, PYSTR("powerUnit"), Py_BuildValue("d", power->powerUnit));
-    PyDict_SetItem(n, PYSTR("timeUnit"), Py_BuildValue("d", power->timeUnit));
+    pydict_set(d, "cacheLevels", caches);
+    return d;
+}
 
-    PyObject *l = PyList_New(power->turbo.numSteps);
-    for (i=0; i<power->turbo.numSteps; i++)
-    {
-        PyList_SET_ITEM(l, (Py_ssize_t)i, Py_BuildValue("d", power->turbo.steps[i]));
-    }
-    PyDict_SetItem(n, PYSTR("turbo"), l);
+static PyObject *
+likwid_getcpuinfo(PyObject *self, PyObject *args)
+{
     PyObject *d = PyDict_New();
-    for(i=0;i<NUM_POWER_DOMAINS;i++)
+    if (need_topology() < 0)
+    {
+        return d;
+    }
+    CpuInfo_t info = cpuinfo;
+    pydict_set(d, "family", PYUINT(info->family));
+    pydict_set(d, "model", PYUINT(info->model));
+    pydict_set(d, "stepping", PYUINT(info->stepping));
+    pydict_set(d, "clock", Py_BuildValue("k", info->clock));
+    pydict_set(d, "turbo", PyBool_FromLong(info->turbo));
+    pydict_set(d, "isIntel", PyBool_FromLong(info->isIntel));
+    pydict_set(d, "supportUncore", PyBool_FromLong(info->supportUncore));
+    pydict_set(d, "osname", PYSTR(info->osname));
+    pydict_set(d, "name", PYSTR(info->name));
+    pydict_set(d, "short_name", PYSTR(info->short_name));
+    pydict_set(d, "features", PYSTR(info->features));
+    pydict_set(d, "featureFlags", PYUINT(info->featureFlags));
+    pydict_set(d, "perf_version", PYUINT(info->perf_version));
+    pydict_set(d, "perf_num_ctr", PYUINT(info->perf_num_ctr));
+    pydict_set(d, "perf_width_ctr", PYUINT(info->perf_width_ctr));
+    pydict_set(d, "perf_num_fixed_ctr", PYUINT(info->perf_num_fixed_ctr));
+#if (LIKWID_MAJOR == 5)
+    pydict_set(d, "architecture", PYSTR(info->architecture));
+#endif
+    return d;
+}
+
+
+static PyObject *
+likwid_printsupportedcpus(PyObject *self, PyObject *args)
+{
+    print_supportedCPUs();
+    Py_RETURN_NONE;
+}
+
+/* Append len bytes (zeroed if data is NULL) 8-byte aligned and return the
+ * offset, 0 on allocation failure */
+typedef struct {
+    char* buf;
+    size_t len;
+    size_t cap;
+    int failed;
+} TopoSnapBuf;
+
+static uint64_t
+toposnap_put(TopoSnapBuf* b, const void* data, size_t len)
+{
+    size_t off = (b->len + 7) & ~(size_t)7;
+    if (b->failed)
+        return 0;
+    if (off + len > b->cap)
     {
-        PyObject *pd = PyDict_New();
-        PyDict_SetItem(pd, PYSTR("ID"), Py_BuildValue("I", power->domains[i].type));
-        PyDict_SetItem(pd, PYSTR("energyUnit"), Py_BuildValue("d", power->domains[i].energyUnit));
-        if (power->domains[i].supportFlags & POWER_DOMAIN_SUPPORT_STATUS)
-        {
-            PyDict_SetItem(pd, PYSTR("supportStatus"), Py_True);
-        }
-        else
-        {
-            PyDict_SetItem(pd, PYSTR("supportStatus"), Py_False);
-        }
-        if (power->domains[i].supportFlags & POWER_DOMAIN_SUPPORT_PERF)
-        {
-            PyDict_SetItem(pd, PYSTR("supportPerf"), Py_True);
-        }
-        else
-        {
-            PyDict_SetItem(pd, PYSTR("supportPerf"), Py_False);
-        }
-        if (power->domains[i].supportFlags & POWER_DOMAIN_SUPPORT_POLICY)
-        {
-            PyDict_SetItem(pd, PYSTR("supportPolicy"), Py_True);
-        }
-        else
-        {
-            PyDict_SetItem(pd, PYSTR("supportPolicy"), Py_False);
-        }
-        if (power->domains[i].supportFlags & POWER_DOMAIN_SUPPORT_LIMIT)
-        {
-            PyDict_SetItem(pd, PYSTR("supportLimit"), Py_True);
-        }
-        else
+        size_t cap = (b->cap > 0 ? b->cap : 4096);
+        while (cap < off + len)
+            cap *= 2;
+        char* tmp = realloc(b->buf, cap);
+        if (tmp == NULL)
         {
-            PyDict_SetItem(pd, PYSTR("supportLimit"), Py_False);
+            b->failed = 1;
+            return 0;
         }
-        if (power->domains[i].supportFlags & POWER_DOMAIN_SUPPORT_INFO)
+        memset(tmp + b->cap, 0, cap - b->cap);
+        b->buf = tmp;
+        b->cap = cap;
+    }
+    if (data != NULL)
+        memcpy(b->buf + off, data, len);
+    b->len = off + len;
+    return off;
+}
+
+static uint64_t
+toposnap_putstr(TopoSnapBuf* b, const char* s)
+{
+    return (s != NULL ? toposnap_put(b, s, strlen(s) + 1) : 0);
+}
+
+static int
+toposnap_build(TopoSnapBuf* b)
+{
+    TopoSnapHeader hdr;
+    CpuInfo info = *cpuinfo;
+    CpuTopology topo = *cputopo;
+    NumaTopology numa = *numainfo;
+    AffinityDomains aff = *affinity;
+    NumaNode* nodes = NULL;
+    AffinityDomain* doms = NULL;
+    uint32_t i;
+
+    memset(&hdr, 0, sizeof(hdr));
+    toposnap_put(b, NULL, sizeof(hdr));
+    info.osname = TOPOSNAP_OFF(char*, toposnap_putstr(b, cpuinfo->osname));
+    info.name = TOPOSNAP_OFF(char*, toposnap_putstr(b, cpuinfo->name));
+    info.short_name = TOPOSNAP_OFF(char*, toposnap_putstr(b, cpuinfo->short_name));
+    info.features = TOPOSNAP_OFF(char*, toposnap_putstr(b, cpuinfo->features));
+    hdr.cpuinfo = toposnap_put(b, &info, sizeof(info));
+
+    topo.threadPool = TOPOSNAP_OFF(HWThread*, toposnap_put(b, cputopo->threadPool,
+                                   (size_t)cputopo->numHWThreads * sizeof(HWThread)));
+    topo.cacheLevels = TOPOSNAP_OFF(CacheLevel*, toposnap_put(b, cputopo->cacheLevels,
+                                    (size_t)cputopo->numCacheLevels * sizeof(CacheLevel)));
+    topo.topologyTree = NULL;
+    hdr.cputopo = toposnap_put(b, &topo, sizeof(topo));
+
+    if (numa.numberOfNodes > 0)
+    {
+        nodes = malloc(numa.numberOfNodes * sizeof(NumaNode));
+        if (nodes == NULL)
+            return -1;
+        memcpy(nodes, numainfo->nodes, numa.numberOfNodes * sizeof(NumaNode));
+        for (i = 0; i < numa.numberOfNodes; i++)
         {
-            PyDict_SetItem(pd, PYSTR("supportInfo"), Py_True);
-            PyDict_SetItem(pd, PYSTR("tdp"), Py_BuildValue("d", power->domains[i].tdp));
-            PyDict_SetItem(pd, PYSTR("minPower"), Py_BuildValue("d", power->domains[i].minPower));
-            PyDict_SetItem(pd, PYSTR("maxPower"), Py_BuildValue("d", power->domains[i].maxPower));
-            PyDict_SetItem(pd, PYSTR("maxTimeWindow"), Py_BuildValue("d", power->domains[i].maxTimeWindow));
+            NumaNode* node = &numainfo->nodes[i];
+            nodes[i].processors = TOPOSNAP_OFF(uint32_t*, toposnap_put(b, node->processors,
+                                               (size_t)node->numberOfProcessors * sizeof(uint32_t)));
+            nodes[i].distances = TOPOSNAP_OFF(uint32_t*, toposnap_put(b, node->distances,
+                                              (size_t)node->numberOfDistances * sizeof(uint32_t)));
         }
-        else
+        numa.nodes = TOPOSNAP_OFF(NumaNode*, toposnap_put(b, nodes, numa.numberOfNodes * sizeof(NumaNode)));
+        free(nodes);
+    }
+    else
+    {
+        numa.nodes = NULL;
+    }
+    hdr.numainfo = toposnap_put(b, &numa, sizeof(numa));
+
+    if (aff.numberOfAffinityDomains > 0)
+    {
+        doms = malloc(aff.numberOfAffinityDomains * sizeof(AffinityDomain));
+        if (doms == NULL)
+            return -1;
+        memcpy(doms, affinity->domains, aff.numberOfAffinityDomains * sizeof(AffinityDomain));
+        for (i = 0; i < aff.numberOfAffinityDomains; i++)
         {
-            PyDict_SetItem(pd, PYSTR("supportInfo"), Py_False);
+            AffinityDomain* dom = &affinity->domains[i];
+#if (LIKWID_MAJOR == 5 && LIKWID_RELEASE >= 4)
+            doms[i].tag = TOPOSNAP_OFF(char*, toposnap_putstr(b, dom->tag));
+#else
+            struct tagbstring tag;
+            tag.slen = strlen(AFFINITY_TAG(dom));
+            tag.mlen = tag.slen + 1;
+            tag.data = TOPOSNAP_OFF(unsigned char*, toposnap_putstr(b, AFFINITY_TAG(dom)));
+            doms[i].tag = TOPOSNAP_OFF(bstring, toposnap_put(b, &tag, sizeof(tag)));
+#endif
+            doms[i].processorList = TOPOSNAP_OFF(int*, toposnap_put(b, dom->processorList,
+                                                  (size_t)dom->numberOfProcessors * sizeof(int)));
         }
-        PyDict_SetItem(d, PYSTR(power_names[i]), pd);
+        aff.domains = TOPOSNAP_OFF(AffinityDomain*, toposnap_put(b, doms,
+                                   aff.numberOfAffinityDomains * sizeof(AffinityDomain)));
+        free(doms);
     }
-    PyDict_SetItem(n, PYSTR("domains"), d);
-    return n;
-}
-
-
-static PyObject *
-likwid_putPowerInfo(PyObject *self, PyObject *args)
-{
-    if (power_initialized)
+    else
     {
-        power_finalize();
-        power_initialized = 0;
-        power = NULL;
+        aff.domains = NULL;
     }
-    Py_RETURN_NONE;
+    hdr.affinity = toposnap_put(b, &aff, sizeof(aff));
+    if (b->failed)
+        return -1;
+
+    memcpy(hdr.magic, TOPOSNAP_MAGIC, sizeof(hdr.magic));
+    hdr.version = TOPOSNAP_VERSION;
+    hdr.likwid = TOPOSNAP_LIKWID;
+    toposnap_layout(hdr.layout);
+    toposnap_fingerprint(hdr.model, sizeof(hdr.model), &hdr.online);
+    hdr.size = b->len;
+    memcpy(b->buf, &hdr, sizeof(hdr));
+    return 0;
 }
 
 static PyObject *
-likwid_startPower(PyObject *self, PyObject *args)
+likwid_savetopology(PyObject *self, PyObject *args)
 {
-    PowerData pwrdata;
-    pwrdata.before = 0;
-    int cpuId;
-    PowerType type;
-    if (PyArg_ParseTuple(args, "iI", &cpuId, &type))
+    const char* path;
+    char tmppath[PATH_MAX];
+    TopoSnapBuf b = {NULL, 0, 0, 0};
+    size_t done = 0;
+    int fd;
+
+    if (!PyArg_ParseTuple(args, "s", &path))
+        return NULL;
+    if (need_affinity() < 0 || cpuinfo == NULL || cputopo == NULL || numainfo == NULL)
     {
-        pwrdata.domain = type;
-        power_start(&pwrdata, cpuId, type);
+        PyErr_SetString(PyExc_RuntimeError, "Cannot initialize the topology, NUMA and affinity modules");
+        return NULL;
     }
-    return Py_BuildValue("I", pwrdata.before);
-}
-
-static PyObject *
-likwid_stopPower(PyObject *self, PyObject *args)
-{
-    PowerData pwrdata;
-    pwrdata.after = 0;
-    int cpuId;
-    PowerType type;
-    if (PyArg_ParseTuple(args, "iI", &cpuId, &type))
+    if (toposnap_build(&b) < 0)
     {
-        pwrdata.domain = type;
-        power_stop(&pwrdata, cpuId, type);
+        free(b.buf);
+        return PyErr_NoMemory();
     }
-    return Py_BuildValue("I", pwrdata.after);
+    /* Write to a temporary file and rename it, concurrent readers see either
+     * the old or the new snapshot */
+    snprintf(tmppath, sizeof(tmppath), "%s.%d.tmp", path, (int)getpid());
+    fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        free(b.buf);
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, tmppath);
+    }
+    while (done < b.len)
+    {
+        ssize_t n = write(fd, b.buf + done, b.len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            break;
+        done += n;
+    }
+    free(b.buf);
+    if (done < b.len || close(fd) < 0 || rename(tmppath, path) < 0)
+    {
+        int err = errno;
+        if (done < b.len)
+            close(fd);
+        unlink(tmppath);
+        errno = err;
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+    }
+    Py_RETURN_NONE;
 }
 
 static PyObject *
-likwid_getPower(PyObject *self, PyObject *args)
+likwid_loadtopology(PyObject *self, PyObject *args)
 {
-    PowerData pwrdata;
-    double energy = 0.0;
-    pwrdata.before = 0;
-    pwrdata.after = 0;
-    if (PyArg_ParseTuple(args, "III", &pwrdata.before, &pwrdata.after, &pwrdata.domain))
+    const char* path;
+    double start;
+    int ret;
+
+    if (!PyArg_ParseTuple(args, "s", &path))
+        return NULL;
+    if (topo_initialized || numa_initialized || affinity_initialized)
     {
-        energy = power_printEnergy(&pwrdata);
+        PyErr_SetString(PyExc_RuntimeError, "The topology module is already initialized, finalize it first");
+        return NULL;
+    }
+    start = subsys_now();
+    ret = toposnap_load(path);
+    switch (ret)
+    {
+        case TOPOSNAP_OK:
+            subsys_record(SUBSYS_TOPOLOGY, start);
+            Py_RETURN_TRUE;
+        case TOPOSNAP_STALE:
+            Py_RETURN_FALSE;
+        case TOPOSNAP_EINVAL:
+            PyErr_Format(PyExc_ValueError, "%s is not a valid topology snapshot", path);
+            return NULL;
+        default:
+            if (errno == ENOENT)
+                Py_RETURN_FALSE;
+            return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
     }
-    return Py_BuildValue("d", energy);
 }
 
 /*
 ################################################################################
-# Perfmon related functions
+# NUMA related functions
 ################################################################################
 */
 
 static PyObject *
-likwid_init(PyObject *self, PyObject *args)
+likwid_initnuma(PyObject *self, PyObject *args)
 {
-    int ret, i;
-    int nrThreads = 0;
-    PyObject * pyList;
-
-    if (topo_initialized == 0)
-    {
-        topology_init();
-        topo_initialized = 1;
-        cpuinfo = get_cpuInfo();
-        cputopo = get_cpuTopology();
-    }
-    if ((topo_initialized) && (cpuinfo == NULL))
-    {
-        cpuinfo = get_cpuInfo();
-    }
-    if ((topo_initialized) && (cputopo == NULL))
-    {
-        cputopo = get_cpuTopology();
-    }
-    if (numa_initialized == 0)
-    {
-        numa_init();
-        numa_initialized = 1;
-        numainfo = get_numaTopology();
-    }
-    if ((numa_initialized) && (numainfo == NULL))
-    {
-        numainfo = get_numaTopology();
-    }
-    ret = PyArg_ParseTuple(args, "O!", &PyList_Type, &pyList);
-    if (pyList == NULL || ret == 0)
-    {
-        printf("No or wrong function argument: List required\n");
-        return PYINT(1);
-    }
-    if (!PyList_Check(pyList))
-    {
-        printf("Function argument is no list\n");
-        return PYINT(1);
-    }
-    nrThreads = PyList_Size(pyList);
-    int * cpulist = malloc(nrThreads * sizeof(int));
-    if (!cpulist)
-    {
-        printf("Cannot allocate space for cpu list\n");
-        return PYINT(1);
-    }
-    for (i=0; i<nrThreads; i++)
+    int i,j;
+    if (need_numa() < 0)
     {
-        int size = 0;
-#if (PY_MAJOR_VERSION == 2)
-        size = (int)PyInt_AsSsize_t(PyList_GetItem(pyList, i));
-#endif
-#if (PY_MAJOR_VERSION == 3)
-        size = (int)PyLong_AsSsize_t(PyList_GetItem(pyList, i));
-#endif
-        cpulist[i] = size;
+        PyObject *d = PyDict_New();
+        pydict_set(d, "numberOfNodes", PYINT(0));
+        pydict_set(d, "nodes", PyDict_New());
+        return d;
     }
-    if (perfmon_initialized == 0)
+    PyObject *d = PyDict_New();
+    PyObject *nodes = PyDict_New();
+    pydict_set(d, "numberOfNodes", PYINT(numainfo->numberOfNodes));
+    for(i = 0;i < (int)numainfo->numberOfNodes; i++)
     {
-        ret = perfmon_init(nrThreads, &(cpulist[0]));
-        if (ret != 0)
+        PyObject *n = PyDict_New();
+        pydict_set(n, "id", PYINT(numainfo->nodes[i].id));
+        pydict_set(n, "totalMemory", PYINT(numainfo->nodes[i].totalMemory));
+        pydict_set(n, "freeMemory", PYINT(numainfo->nodes[i].freeMemory));
+        pydict_set(n, "numberOfProcessors", PYINT(numainfo->nodes[i].numberOfProcessors));
+        pydict_set(n, "numberOfDistances", PYINT(numainfo->nodes[i].numberOfDistances));
+        PyObject *l = PyList_New(numainfo->nodes[i].numberOfProcessors);
+        for(j = 0; j < (int)numainfo->nodes[i].numberOfProcessors; j++)
         {
-            free(cpulist);
-            printf("Initialization of PerfMon module failed.\n");
-            return PYINT(1);
+            PyList_SET_ITEM(l, (Py_ssize_t)j, PYINT(numainfo->nodes[i].processors[j]));
         }
-        perfmon_initialized = 1;
-        timer_initialized = 1;
+        pydict_set(n, "processors", l);
+        PyObject *dist = PyList_New(numainfo->nodes[i].numberOfDistances);
+        for(j = 0; j < (int)numainfo->nodes[i].numberOfDistances; j++)
+        {
+            PyList_SET_ITEM(dist, (Py_ssize_t)j, PYINT(numainfo->nodes[i].distances[j]));
+        }
+        pydict_set(n, "distances", dist);
+        pydict_setobj(nodes, PYINT(i), n);
     }
-    free(cpulist);
-    return PYINT(0);
+    pydict_set(d, "nodes", nodes);
+    return d;
 }
 
 static PyObject *
-likwid_addEventSet(PyObject *self, PyObject *args)
+likwid_finalizenuma(PyObject *self, PyObject *args)
 {
-    if (perfmon_initialized == 0)
-    {
-        PYINT(-1);
-    }
-    const char* tmpString;
-    int groupId = -1;
-    if (PyArg_ParseTuple(args, "s", &tmpString))
+    if (numa_initialized)
     {
-        groupId = perfmon_addEventSet((char*)tmpString);
+        numa_finalize();
+        numainfo = NULL;
+        numa_initialized = 0;
     }
-    return PYINT(groupId);
+    Py_RETURN_NONE;
 }
 
-static PyObject *
-likwid_setupCounters(PyObject *self, PyObject *args)
+/*
+################################################################################
+# NUMA-local buffer allocation
+################################################################################
+*/
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE 14
+#endif
+#define NUMABUF_HUGEPAGE_SIZE (2UL*1024*1024)
+
+typedef struct {
+    PyObject_HEAD
+    char* ptr;
+    Py_ssize_t size;
+    size_t mapsize;
+    int node;
+    int hugepages;
+    Py_ssize_t exports;
+} NumaBufferObject;
+
+static int
+numabuffer_unmap(NumaBufferObject *self)
 {
-    if (perfmon_initialized == 0)
+    if (self->exports > 0)
     {
-        PYINT(-1);
+        PyErr_SetString(PyExc_BufferError, "NUMA buffer has exported views");
+        return -1;
     }
-    int groupId, ret = -1;
-    if (PyArg_ParseTuple(args, "i", &groupId))
+    if (self->ptr != NULL)
     {
-        ret = perfmon_setupCounters(groupId);
+        munmap(self->ptr, self->mapsize);
+        self->ptr = NULL;
     }
-    return PYINT(ret);
+    return 0;
 }
 
-static PyObject *
-likwid_startCounters(PyObject *self, PyObject *args)
+static void
+numabuffer_dealloc(NumaBufferObject *self)
 {
-    int ret;
-    if (perfmon_initialized == 0)
+    if (self->ptr != NULL)
     {
-        PYINT(-1);
+        munmap(self->ptr, self->mapsize);
+        self->ptr = NULL;
     }
-    ret = perfmon_startCounters();
-    return PYINT(ret);
+    Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
-static PyObject *
-likwid_stopCounters(PyObject *self, PyObject *args)
+static int
+numabuffer_getbuffer(NumaBufferObject *self, Py_buffer *view, int flags)
 {
-    int ret;
-    if (perfmon_initialized == 0)
+    if (self->ptr == NULL)
     {
-        PYINT(-1);
+        PyErr_SetString(PyExc_ValueError, "NUMA buffer is closed");
+        view->obj = NULL;
+        return -1;
     }
-    ret = perfmon_stopCounters();
-    return PYINT(ret);
+    if (PyBuffer_FillInfo(view, (PyObject*)self, self->ptr, self->size, 0, flags) < 0)
+    {
+        return -1;
+    }
+    self->exports++;
+    return 0;
 }
 
-static PyObject *
-likwid_readCounters(PyObject *self, PyObject *args)
+static void
+numabuffer_releasebuffer(NumaBufferObject *self, Py_buffer *view)
 {
-    int ret;
-    if (perfmon_initialized == 0)
-    {
-        PYINT(-1);
-    }
-    ret = perfmon_readCounters();
-    return PYINT(ret);
+    self->exports--;
 }
 
 static PyObject *
-likwid_readCountersCpu(PyObject *self, PyObject *args)
+numabuffer_close(NumaBufferObject *self, PyObject *args)
 {
-    int ret = -1;
-    if (perfmon_initialized > 0 && PyArg_ParseTuple(args, "i", &ret))
-    {
-        ret = perfmon_readCountersCpu(ret);
-    }
-    return PYINT(ret);
+    if (numabuffer_unmap(self) < 0)
+        return NULL;
+    Py_RETURN_NONE;
 }
 
-static PyObject *
-likwid_readGroupCounters(PyObject *self, PyObject *args)
+static Py_ssize_t
+numabuffer_length(NumaBufferObject *self)
 {
-    int ret = -1;
-    if (perfmon_initialized > 0 && PyArg_ParseTuple(args, "i", &ret))
-    {
-        ret = perfmon_readGroupCounters(ret);
-    }
-    return PYINT(ret);
+    return (self->ptr != NULL ? self->size : 0);
 }
 
 static PyObject *
-likwid_readGroupThreadCounters(PyObject *self, PyObject *args)
+numabuffer_repr(NumaBufferObject *self)
 {
-    int ret = -1;
-    int thread = 0;
-    if (perfmon_initialized > 0 && PyArg_ParseTuple(args, "ii", &ret, &thread))
-    {
-        ret = perfmon_readGroupThreadCounters(ret, thread);
-    }
-    return PYINT(ret);
+    return PyUnicode_FromFormat("<pylikwid.NumaBuffer size=%zd node=%d hugepages=%d%s>",
+                                self->size, self->node, self->hugepages,
+                                (self->ptr == NULL ? " closed" : ""));
 }
 
+static PyBufferProcs numabuffer_as_buffer = {
+    .bf_getbuffer = (getbufferproc)numabuffer_getbuffer,
+    .bf_releasebuffer = (releasebufferproc)numabuffer_releasebuffer,
+};
+
+static PySequenceMethods numabuffer_as_sequence = {
+    .sq_length = (lenfunc)numabuffer_length,
+};
+
+static PyMethodDef numabuffer_methods[] = {
+    {"close", (PyCFunction)numabuffer_close, METH_NOARGS, "Unmap the buffer. Fails if views are still exported."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyMemberDef numabuffer_members[] = {
+    {"node", T_INT, offsetof(NumaBufferObject, node), READONLY, "NUMA node the memory is bound to."},
+    {"hugepages", T_INT, offsetof(NumaBufferObject, hugepages), READONLY, "0 = none, 1 = transparent, 2 = explicit huge pages."},
+    {"nbytes", T_PYSSIZET, offsetof(NumaBufferObject, size), READONLY, "Size of the buffer in bytes."},
+    {NULL, 0, 0, 0, NULL}
+};
+
+static PyTypeObject NumaBufferType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "pylikwid.NumaBuffer",
+    .tp_basicsize = sizeof(NumaBufferObject),
+    .tp_dealloc = (destructor)numabuffer_dealloc,
+    .tp_repr = (reprfunc)numabuffer_repr,
+    .tp_as_sequence = &numabuffer_as_sequence,
+    .tp_as_buffer = &numabuffer_as_buffer,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Memory buffer bound to a NUMA node, created by pylikwid.numa_alloc().",
+    .tp_methods = numabuffer_methods,
+    .tp_members = numabuffer_members,
+};
+
 static PyObject *
-likwid_switchGroup(PyObject *self, PyObject *args)
+likwid_numaalloc(PyObject *self, PyObject *args, PyObject *kwargs)
 {
-    int ret = -1;
-    int newgroup = 0;
-    if (perfmon_initialized > 0 && PyArg_ParseTuple(args, "i", &newgroup))
+    static char *kwlist[] = {"nbytes", "node", "hugepages", NULL};
+    Py_ssize_t nbytes = 0;
+    int node = -1;
+    PyObject *pyHuge = Py_False;
+    int huge = 0;
+    int mflags = MAP_PRIVATE | MAP_ANONYMOUS;
+    size_t pagesize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t mapsize, off;
+    unsigned long nodemask[16];
+    char *ptr;
+    NumaBufferObject *buf;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "n|iO", kwlist, &nbytes, &node, &pyHuge))
+        return NULL;
+    if (nbytes <= 0)
     {
-        if (newgroup >= perfmon_getNumberOfGroups())
-        {
-            newgroup = 0;
-        }
-        if (newgroup != perfmon_getIdOfActiveGroup())
+        PyErr_SetString(PyExc_ValueError, "nbytes must be greater than 0");
+        return NULL;
+    }
+    if (PyUnicode_Check(pyHuge))
+    {
+        if (PyUnicode_CompareWithASCIIString(pyHuge, "explicit") == 0)
+            huge = 2;
+        else if (PyUnicode_CompareWithASCIIString(pyHuge, "transparent") == 0)
+            huge = 1;
+        else
         {
-            ret = perfmon_switchActiveGroup(newgroup);
+            PyErr_SetString(PyExc_ValueError, "hugepages must be a bool, 'transparent' or 'explicit'");
+            return NULL;
         }
     }
-    return PYINT(ret);
-}
+    else
+    {
+        huge = PyObject_IsTrue(pyHuge);
+        if (huge < 0)
+            return NULL;
+    }
 
-static PyObject *
-likwid_finalize(PyObject *self, PyObject *args)
-{
-    if (perfmon_initialized == 1)
+    if (need_topology() < 0)
     {
-        perfmon_finalize();
-        perfmon_initialized = 0;
+        PyErr_SetString(PyExc_RuntimeError, "Cannot initialize topology module");
+        return NULL;
     }
-    if (affinity_initialized == 1)
+    if (need_numa() < 0)
     {
-        affinity_finalize();
-        affinity_initialized = 0;
-        affinity = NULL;
+        PyErr_SetString(PyExc_RuntimeError, "Cannot initialize NUMA module");
+        return NULL;
     }
-    if (numa_initialized == 1)
+    if (node < 0)
     {
-        numa_finalize();
-        numa_initialized = 0;
-        numainfo = NULL;
+        int i, j;
+        int cpu = likwid_getProcessorId();
+        node = (numainfo->numberOfNodes > 0 ? (int)numainfo->nodes[0].id : 0);
+        for (i = 0; i < (int)numainfo->numberOfNodes; i++)
+        {
+            for (j = 0; j < (int)numainfo->nodes[i].numberOfProcessors; j++)
+            {
+                if ((int)numainfo->nodes[i].processors[j] == cpu)
+                {
+                    node = numainfo->nodes[i].id;
+                }
+            }
+        }
     }
-    if (topo_initialized == 1)
+    else
     {
-        topology_finalize();
-        topo_initialized = 0;
-        cputopo = NULL;
-        cpuinfo = NULL;
+        /* Node IDs may be sparse, look the node up by ID */
+        int i;
+        for (i = 0; i < (int)numainfo->numberOfNodes && (int)numainfo->nodes[i].id != node; i++);
+        if (i == (int)numainfo->numberOfNodes)
+        {
+            PyErr_Format(PyExc_ValueError, "Invalid NUMA node %d", node);
+            return NULL;
+        }
     }
-    if (config_initialized == 1)
+    if (node >= (int)(sizeof(nodemask) * 8))
     {
-        destroy_configuration();
-        config_initialized = 0;
-        configfile = NULL;
+        PyErr_Format(PyExc_ValueError, "Invalid NUMA node %d", node);
+        return NULL;
     }
-    return PYINT(0);
-}
 
-static PyObject *
-likwid_getResult(PyObject *self, PyObject *args)
-{
-    int g, e, t;
-    double result = NAN;
-    if (PyArg_ParseTuple(args, "iii", &g, &e, &t))
+    if (huge)
     {
-        result = perfmon_getResult(g, e, t);
+        pagesize = NUMABUF_HUGEPAGE_SIZE;
     }
-    return Py_BuildValue("d", result);
-}
-
-static PyObject *
-likwid_getLastResult(PyObject *self, PyObject *args)
-{
-    int g, e, t;
-    double result = NAN;
-    if (PyArg_ParseTuple(args, "iii", &g, &e, &t))
+    if (huge == 2)
     {
-        result = perfmon_getLastResult(g, e, t);
+        mflags |= MAP_HUGETLB;
     }
-    return Py_BuildValue("d", result);
-}
-
-static PyObject *
-likwid_getMetric(PyObject *self, PyObject *args)
-{
-    int g, m, t;
-    double result = NAN;
-    if (PyArg_ParseTuple(args, "iii", &g, &m, &t))
+    mapsize = (((size_t)nbytes + pagesize - 1) / pagesize) * pagesize;
+    ptr = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, mflags, -1, 0);
+    if (ptr == MAP_FAILED)
     {
-        result = perfmon_getMetric(g, m, t);
+        return PyErr_SetFromErrno(PyExc_MemoryError);
     }
-    return Py_BuildValue("d", result);
-}
-
-static PyObject *
-likwid_getLastMetric(PyObject *self, PyObject *args)
-{
-    int g, m, t;
-    double result = NAN;
-    if (PyArg_ParseTuple(args, "iii", &g, &m, &t))
+    if (huge == 1)
     {
-        result = perfmon_getLastMetric(g, m, t);
+        madvise(ptr, mapsize, MADV_HUGEPAGE);
     }
-    return Py_BuildValue("d", result);
-}
-
-static PyObject *
-likwid_getNumberOfGroups(PyObject *self, PyObject *args)
-{
-    if (perfmon_initialized == 0)
+    memset(nodemask, 0, sizeof(nodemask));
+    nodemask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+    if (syscall(SYS_mbind, ptr, mapsize, MPOL_BIND, nodemask, sizeof(nodemask) * 8, 0) != 0)
     {
-        return 0;
+        /* Kernels without NUMA support reject mbind, but then there is only
+         * one node anyway */
+        if (!(errno == ENOSYS && numainfo->numberOfNodes <= 1))
+        {
+            PyErr_SetFromErrno(PyExc_OSError);
+            munmap(ptr, mapsize);
+            return NULL;
+        }
     }
-    return PYINT(perfmon_getNumberOfGroups());
-}
-
-static PyObject *
-likwid_getIdOfActiveGroup(PyObject *self, PyObject *args)
-{
-    if (perfmon_initialized == 0)
+    /* First touch so that the pages are allocated now on the bound node */
+    Py_BEGIN_ALLOW_THREADS
+    for (off = 0; off < mapsize; off += pagesize)
     {
-        return 0;
+        ptr[off] = 0;
     }
-    return PYINT(perfmon_getIdOfActiveGroup());
-}
+    Py_END_ALLOW_THREADS
 
-static PyObject *
-likwid_getNumberOfThreads(PyObject *self, PyObject *args)
-{
-    if (perfmon_initialized == 0)
+    buf = PyObject_New(NumaBufferObject, &NumaBufferType);
+    if (buf == NULL)
     {
-        return 0;
+        munmap(ptr, mapsize);
+        return NULL;
     }
-    return PYINT(perfmon_getNumberOfThreads());
+    buf->ptr = ptr;
+    buf->size = nbytes;
+    buf->mapsize = mapsize;
+    buf->node = node;
+    buf->hugepages = huge;
+    buf->exports = 0;
+    return (PyObject*)buf;
 }
 
+
+/*
+################################################################################
+# Affinity related functions
+################################################################################
+*/
+
 static PyObject *
-likwid_getTimeOfGroup(PyObject *self, PyObject *args)
+likwid_initaffinity(PyObject *self, PyObject *args)
 {
-    if (perfmon_initialized == 0)
+    int i,j;
+
+    need_affinity();
+    PyObject *n = PyDict_New();
+    if (affinity == NULL)
     {
-        return 0;
+        return n;
     }
-    int groupId;
-    double time = 0.0;
-    if (PyArg_ParseTuple(args, "i", &groupId))
+    pydict_set(n, "numberOfAffinityDomains", PYINT(affinity->numberOfAffinityDomains));
+    pydict_set(n, "numberOfSocketDomains", PYINT(affinity->numberOfSocketDomains));
+    pydict_set(n, "numberOfNumaDomains", PYINT(affinity->numberOfNumaDomains));
+    pydict_set(n, "numberOfProcessorsPerSocket", PYINT(affinity->numberOfProcessorsPerSocket));
+    pydict_set(n, "numberOfCacheDomains", PYINT(affinity->numberOfCacheDomains));
+    pydict_set(n, "numberOfCoresPerCache", PYINT(affinity->numberOfCoresPerCache));
+    pydict_set(n, "numberOfProcessorsPerCache", PYINT(affinity->numberOfProcessorsPerCache));
+    PyObject *doms = PyDict_New();
+    for(i = 0; i < (int)affinity->numberOfAffinityDomains; i++)
     {
-        time = perfmon_getTimeOfGroup(groupId);
+        PyObject *a = PyDict_New();
+#if (LIKWID_MAJOR == 5 && LIKWID_RELEASE >= 4)
+        pydict_set(a, "tag", PYSTR(affinity->domains[i].tag));
+#else
+        pydict_set(a, "tag", PYSTR(bdata(affinity->domains[i].tag)));
+#endif
+        pydict_set(a, "numberOfProcessors", PYINT(affinity->domains[i].numberOfProcessors));
+        pydict_set(a, "numberOfCores", PYINT(affinity->domains[i].numberOfCores));
+        PyObject *l = PyList_New(affinity->domains[i].numberOfProcessors);
+        for(j = 0;j < (int)affinity->domains[i].numberOfProcessors; j++)
+        {
+            PyList_SET_ITEM(l, (Py_ssize_t)j, PYINT(affinity->domains[i].processorList[j]));
+        }
+        pydict_set(a, "processorList", l);
+        pydict_setobj(doms, PYINT(i), a);
     }
-    return Py_BuildValue("d", time);
+    pydict_set(n, "domains", doms);
+    return n;
 }
 
 static PyObject *
-likwid_getNumberOfEvents(PyObject *self, PyObject *args)
+likwid_finalizeaffinity(PyObject *self, PyObject *args)
 {
-    if (perfmon_initialized == 0)
-    {
-        return 0;
-    }
-    int groupId;
-    int num_events = 0;
-    if (PyArg_ParseTuple(args, "i", &groupId))
+    if (affinity_initialized)
     {
-        num_events = perfmon_getNumberOfEvents(groupId);
+        affinity_finalize();
+        affinity_initialized = 0;
+        affinity = NULL;
     }
-    return PYINT(num_events);
+    Py_RETURN_NONE;
 }
 
 static PyObject *
-likwid_getNumberOfMetrics(PyObject *self, PyObject *args)
+likwid_cpustr_to_cpulist(PyObject *self, PyObject *args)
 {
-    if (perfmon_initialized == 0)
-    {
-        return 0;
-    }
-    int groupId;
-    int num_metrics = 0;
-    if (PyArg_ParseTuple(args, "i", &groupId))
+    int ret = 0, j = 0;
+    const char *cpustr;
+    if (!PyArg_ParseTuple(args, "s", &cpustr))
     {
-        num_metrics = perfmon_getNumberOfMetrics(groupId);
+        Py_RETURN_NONE;
     }
-    return PYINT(num_metrics);
-}
-
-static PyObject *
-likwid_getNameOfEvent(PyObject *self, PyObject *args)
-{
-    if (perfmon_initialized == 0)
+    if (need_config() < 0)
     {
-        return 0;
+        Py_RETURN_NONE;
     }
-    int g, e;
-    char* name = NULL;
-    if (PyArg_ParseTuple(args, "ii", &g, &e))
+    int* cpulist = (int*) malloc(configfile->maxNumThreads * sizeof(int));
+    if (!cpulist)
     {
-        name = perfmon_getEventName(g,e);
+        Py_RETURN_NONE;
     }
-    return PYSTR(name);
-}
-
-static PyObject *
-likwid_getNameOfCounter(PyObject *self, PyObject *args)
-{
-    if (perfmon_initialized == 0)
+    ret = cpustr_to_cpulist((char *)cpustr, cpulist, configfile->maxNumThreads);
+    if (ret < 0)
     {
-        return 0;
+        free(cpulist);
+        Py_RETURN_NONE;
     }
-    int g, c;
-    char* name = NULL;
-    if (PyArg_ParseTuple(args, "ii", &g, &c))
+    PyObject *l = PyList_New(ret);
+    for(j=0;j<ret;j++)
     {
-        name = perfmon_getCounterName(g,c);
+        PyList_SET_ITEM(l, (Py_ssize_t)j, PYINT(cpulist[j]));
     }
-    return PYSTR(name);
+    free(cpulist);
+    return l;
 }
 
-static PyObject *
-likwid_getNameOfMetric(PyObject *self, PyObject *args)
+/*
+################################################################################
+# Cache blocking advisor
+################################################################################
+*/
+
+/* Maximal padding of the row stride in cache lines */
+#define CACHEBLOCKING_MAXPAD 256
+
+/* Number of active hardware threads sharing one instance of a cache level.
+ * threads is the number of active threads per last level cache domain or
+ * <= 0 if all hardware threads of the domain are used. */
+static int
+cacheblocking_sharers(CacheLevel* level, int threads)
 {
-    if (perfmon_initialized == 0)
-    {
-        return 0;
-    }
-    int g, m;
-    char* name = NULL;
-    if (PyArg_ParseTuple(args, "ii", &g, &m))
+    int d, domprocs = 0;
+    int smt = (cputopo->numThreadsPerCore > 0 ? (int)cputopo->numThreadsPerCore : 1);
+    if (affinity != NULL)
     {
-        name = perfmon_getMetricName(g, m);
+        for (d = 0; d < (int)affinity->numberOfAffinityDomains; d++)
+        {
+            AffinityDomain* dom = &affinity->domains[d];
+            if (AFFINITY_TAG(dom)[0] == 'C' && (int)dom->numberOfProcessors > domprocs)
+                domprocs = (int)dom->numberOfProcessors;
+        }
     }
-    return PYSTR(name);
-}
-
-static PyObject *
-likwid_getNameOfGroup(PyObject *self, PyObject *args)
-{
-    if (perfmon_initialized == 0)
+    if (domprocs <= 0)
+        domprocs = (int)level->threads;
+    if (threads <= 0)
     {
-        return 0;
+        /* Offline hardware threads do not count */
+        return ((int)level->threads < domprocs ? (int)level->threads : domprocs);
     }
-    int groupId;
-    char* name = NULL;
-    if (PyArg_ParseTuple(args, "i", &groupId))
+    if ((int)level->threads <= smt)
     {
-        name = perfmon_getGroupName(groupId);
+        /* Per-core cache: threads are spread over the cores of the domain */
+        int cores = domprocs / smt;
+        int sharers = (cores > 0 ? (threads + cores - 1) / cores : threads);
+        return (sharers < (int)level->threads ? sharers : (int)level->threads);
     }
-    return PYSTR(name);
+    return (threads < (int)level->threads ? threads : (int)level->threads);
 }
 
-static PyObject *
-likwid_getShortInfoOfGroup(PyObject *self, PyObject *args)
+/* Maximal number of lines of a rows x rowbytes tile with a row stride of
+ * ldbytes that map to the same cache set */
+static int
+cacheblocking_maxlines(CacheLevel* level, long rows, long rowbytes, long ldbytes)
 {
-    if (perfmon_initialized == 0)
-    {
-        return 0;
-    }
-    int groupId;
-    char* info = NULL;
-    if (PyArg_ParseTuple(args, "i", &groupId))
+    long r, l, nlines = (rowbytes + level->lineSize - 1) / level->lineSize;
+    int max = 0;
+    int* sets = calloc(level->sets, sizeof(int));
+    if (sets == NULL)
+        return -1;
+    for (r = 0; r < rows; r++)
     {
-        info = perfmon_getGroupInfoShort(groupId);
+        long first = (r * ldbytes) / level->lineSize;
+        for (l = 0; l < nlines; l++)
+        {
+            long s = (first + l) % level->sets;
+            if (++sets[s] > max)
+                max = sets[s];
+        }
     }
-    return PYSTR(info);
+    free(sets);
+    return max;
 }
 
-static PyObject *
-likwid_getLongInfoOfGroup(PyObject *self, PyObject *args)
+static long
+cacheblocking_gcd(long a, long b)
 {
-    if (perfmon_initialized == 0)
-    {
-        return 0;
-    }
-    int groupId;
-    char* info = NULL;
-    if (PyArg_ParseTuple(args, "i", &groupId))
+    while (b != 0)
     {
-        info = perfmon_getGroupInfoLong(groupId);
+        long t = a % b;
+        a = b;
+        b = t;
     }
-    return PYSTR(info);
+    return a;
 }
 
 static PyObject *
-likwid_getGroups(PyObject *self, PyObject *args)
+likwid_cacheblocking(PyObject *self, PyObject *args, PyObject *kwargs)
 {
-    int i, ret;
-    char** tmp, **infos, **longs;
+    static char *kwlist[] = {"elemsize", "streams", "threads", "ld", NULL};
+    int elemsize = 8, streams = 2, threads = 0, i;
+    long ld = 0;
     PyObject *l;
-    if (topo_initialized == 0)
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|iiil", kwlist, &elemsize, &streams, &threads, &ld))
+        return NULL;
+    if (elemsize <= 0 || streams <= 0 || threads < 0 || ld < 0)
     {
-        topology_init();
-        topo_initialized = 1;
+        PyErr_SetString(PyExc_ValueError, "elemsize and streams must be greater than 0, threads and ld must not be negative");
+        return NULL;
     }
-    ret = perfmon_getGroups(&tmp, &infos, &longs);
-    if (ret > 0)
+    if (need_topology() < 0)
     {
-        l = PyList_New(ret);
-        for(i=0;i<ret;i++)
-        {
-            PyObject *d = PyDict_New();
-            PyDict_SetItem(d, PYSTR("Name"), PYSTR(tmp[i]));
-            PyDict_SetItem(d, PYSTR("Info"), PYSTR(infos[i]));
-            PyDict_SetItem(d, PYSTR("Long"), PYSTR(longs[i]));
-            PyList_SET_ITEM(l, (Py_ssize_t)i, d);
-        }
-        perfmon_returnGroups(ret, tmp, infos, longs);
+        PyErr_SetString(PyExc_RuntimeError, "Cannot initialize topology module");
+        return NULL;
     }
-    else
+    need_affinity();
+
+    l = PyList_New(0);
+    if (l == NULL)
+        return NULL;
+    for (i = 0; i < (int)cputopo->numCacheLevels; i++)
     {
-        l = PyList_New(0);
+        CacheLevel* level = &cputopo->cacheLevels[i];
+        int sharers, assoc, maxlines, conflicts = 0;
+        long line, lineelems, capacity, tile, critical, paddedld = 0;
+        PyObject *d;
+        if (level->type != DATACACHE && level->type != UNIFIEDCACHE)
+            continue;
+        if (level->size == 0 || level->lineSize == 0 || level->sets == 0)
+            continue;
+        line = level->lineSize;
+        assoc = (level->associativity > 0 ? (int)level->associativity : 1);
+        sharers = cacheblocking_sharers(level, threads);
+        if (sharers < 1)
+            sharers = 1;
+        /* Keep one way free for other data (stack, indices, prefetches) */
+        capacity = (long)level->size / sharers;
+        if (assoc > 1)
+            capacity = capacity / assoc * (assoc - 1);
+        /* Bytes at which addresses map to the same set again */
+        critical = (long)level->sets * line;
+        lineelems = line / elemsize;
+        if (lineelems < 1)
+            lineelems = 1;
+        tile = (long)sqrt((double)(capacity / streams) / elemsize);
+        tile = tile / lineelems * lineelems;
+        if (tile < lineelems)
+            tile = lineelems;
+        /* A tile of one stream may use at most its share of the ways. If the
+         * row stride ld maps too many tile rows to the same sets, the tile is
+         * shrunk and conflicts is set. */
+        maxlines = assoc / streams;
+        if (maxlines < 1)
+            maxlines = 1;
+        if (ld > 0)
+        {
+            long captile = tile, stride, pad;
+            conflicts = (cacheblocking_maxlines(level, tile, tile * elemsize, ld * elemsize) > maxlines);
+            while (tile > lineelems &&
+                   cacheblocking_maxlines(level, tile, tile * elemsize, ld * elemsize) > maxlines)
+            {
+                tile -= lineelems;
+            }
+            /* Smallest padding (in cache lines) of the row stride that fits the
+             * unshrunk tile. Fall back to a row stride coprime to the number of
+             * sets, which at least spreads the rows over all sets. */
+            paddedld = ld;
+            if (conflicts)
+            {
+                stride = (ld * elemsize + line - 1) / line;
+                for (pad = 0; pad < (long)level->sets && pad < CACHEBLOCKING_MAXPAD; pad++)
+                {
+                    if (cacheblocking_maxlines(level, captile, captile * elemsize, (stride + pad) * line) <= maxlines)
+                        break;
+                }
+                if (pad == (long)level->sets || pad == CACHEBLOCKING_MAXPAD)
+                {
+                    pad = 0;
+                    while (cacheblocking_gcd(stride + pad, level->sets) != 1)
+                        pad++;
+                }
+                paddedld = ((stride + pad) * line + elemsize - 1) / elemsize;
+            }
+        }
+        d = Py_BuildValue("{s:I,s:I,s:I,s:I,s:I,s:i,s:l,s:l,s:l,s:l}",
+                          "level", level->level, "size", level->size,
+                          "lineSize", level->lineSize, "associativity", level->associativity,
+                          "sets", level->sets, "sharers", sharers, "capacity", capacity,
+                          "criticalStride", critical, "tile", tile,
+                          "tileBytes", tile * tile * elemsize);
+        if (d == NULL)
+        {
+            Py_DECREF(l);
+            return NULL;
+        }
+        if (ld > 0)
+        {
+            PyObject *o = Py_BuildValue("{s:l,s:O,s:l}", "ld", ld,
+                                        "conflicts", (conflicts ? Py_True : Py_False),
+                                        "paddedLd", paddedld);
+            if (o == NULL || PyDict_Update(d, o) < 0)
+            {
+                Py_XDECREF(o);
+                Py_DECREF(d);
+                Py_DECREF(l);
+                return NULL;
+            }
+            Py_DECREF(o);
+        }
+        if (PyList_Append(l, d) < 0)
+        {
+            Py_DECREF(d);
+            Py_DECREF(l);
+            return NULL;
+        }
+        Py_DECREF(d);
     }
     return l;
 }
 
+
 /*
 ################################################################################
-# Perfmon MarkerAPI related functions
+# Placement planner
 ################################################################################
 */
 
-static PyObject *
-likwid_readMarkerFile(PyObject *self, PyObject *args)
-{
-    const char* filename;
-    if (PyArg_ParseTuple(args, "s", &filename))
-    {
-        perfmon_readMarkerFile(filename);
-    }
-    Py_RETURN_NONE;
+#define PLACEMENT_COMPACT 0
+#define PLACEMENT_SCATTER 1
+#define PLACEMENT_PERNUMA 2
+
+typedef struct {
+    int cpu;
+    int package;
+    int core;
+    int thread;
+    int node;
+    int type;
+    int domain;
+} PlacementCpu;
+
+/* Fill order inside a domain: physical cores first (performance cores
+ * before efficiency cores on hybrid CPUs), then the SMT siblings.
+ * Domains are sockets (compact, scatter) or NUMA nodes (per-numa). */
+static int
+placement_cmp(const void* a, const void* b)
+{
+    const PlacementCpu* x = (const PlacementCpu*)a;
+    const PlacementCpu* y = (const PlacementCpu*)b;
+    if (x->domain != y->domain)
+        return x->domain - y->domain;
+    if (x->thread != y->thread)
+        return x->thread - y->thread;
+    if (x->type != y->type)
+        return x->type - y->type;
+    if (x->package != y->package)
+        return x->package - y->package;
+    if (x->core != y->core)
+        return x->core - y->core;
+    return x->cpu - y->cpu;
+}
+
+static int
+placement_intcmp(const void* a, const void* b)
+{
+    return *(const int*)a - *(const int*)b;
+}
+
+static int
+placement_corecmp(const void* a, const void* b)
+{
+    const PlacementCpu* x = (const PlacementCpu*)a;
+    const PlacementCpu* y = (const PlacementCpu*)b;
+    if (x->package != y->package)
+        return x->package - y->package;
+    if (x->core != y->core)
+        return x->core - y->core;
+    if (x->thread != y->thread)
+        return x->thread - y->thread;
+    return x->cpu - y->cpu;
+}
+
+static int
+placement_getint(PyObject *d, const char* key, int *value)
+{
+    PyObject *o = PyDict_GetItemString(d, key);
+    long v;
+    if (o == NULL)
+    {
+        PyErr_Format(PyExc_ValueError, "Topology entry without '%s'", key);
+        return -1;
+    }
+    v = PyLong_AsLong(o);
+    if (v == -1 && PyErr_Occurred())
+        return -1;
+    *value = (int)v;
+    return 0;
+}
+
+/* Read the hardware threads either from the dicts of getcputopology() and
+ * initnuma() (synthetic topologies) or from the topology module. Returns the
+ * number of hardware threads or -1 with exception set. */
+static int
+placement_read_topology(PyObject *pytopo, PyObject *pynuma, PlacementCpu** cpus)
+{
+    int i, j, n = 0;
+    PlacementCpu* l = NULL;
+    if (pytopo != Py_None)
+    {
+        PyObject *pool = (PyDict_Check(pytopo) ? PyDict_GetItemString(pytopo, "threadPool") : NULL);
+        PyObject *key, *value, *type;
+        Py_ssize_t pos = 0;
+        if (pool == NULL || !PyDict_Check(pool))
+        {
+            PyErr_SetString(PyExc_ValueError, "topology must be a dict with a 'threadPool' dict");
+            return -1;
+        }
+        l = malloc((PyDict_Size(pool) > 0 ? PyDict_Size(pool) : 1) * sizeof(PlacementCpu));
+        if (l == NULL)
+        {
+            PyErr_NoMemory();
+            return -1;
+        }
+        while (PyDict_Next(pool, &pos, &key, &value))
+        {
+            if (!PyDict_Check(value) ||
+                placement_getint(value, "apicId", &l[n].cpu) < 0 ||
+                placement_getint(value, "packageId", &l[n].package) < 0 ||
+                placement_getint(value, "coreId", &l[n].core) < 0 ||
+                placement_getint(value, "threadId", &l[n].thread) < 0)
+            {
+                if (!PyErr_Occurred())
+                    PyErr_SetString(PyExc_ValueError, "threadPool entries must be dicts");
+                free(l);
+                return -1;
+            }
+            l[n].node = l[n].package;
+            l[n].type = CORETYPE_NONE;
+            type = PyDict_GetItemString(value, "coreType");
+            if (type != NULL && type != Py_None)
+            {
+                const char* name = (PyUnicode_Check(type) ? PyUnicode_AsUTF8(type) : NULL);
+                l[n].type = (name != NULL ? coretype_parse(name) : -1);
+                if (l[n].type < 0)
+                {
+                    PyErr_Clear();
+                    PyErr_SetString(PyExc_ValueError, "coreType must be None, 'performance' or 'efficiency'");
+                    free(l);
+                    return -1;
+                }
+            }
+            n++;
+        }
+    }
+    else
+    {
+        if (need_topology() < 0)
+        {
+            PyErr_SetString(PyExc_RuntimeError, "Cannot initialize topology module");
+            return -1;
+        }
+        need_numa();
+        l = malloc((cputopo->numHWThreads > 0 ? cputopo->numHWThreads : 1) * sizeof(PlacementCpu));
+        if (l == NULL)
+        {
+            PyErr_NoMemory();
+            return -1;
+        }
+        for (i = 0; i < (int)cputopo->numHWThreads; i++)
+        {
+            HWThread* t = &cputopo->threadPool[i];
+#if (LIKWID_MAJOR == 5 && LIKWID_RELEASE >= 2)
+            if (!t->inCpuSet)
+                continue;
+#endif
+            l[n].cpu = (int)t->apicId;
+            l[n].package = (int)t->packageId;
+            l[n].core = (int)t->coreId;
+            l[n].thread = (int)t->threadId;
+            l[n].node = (int)t->packageId;
+            l[n].type = coretype_of(l[n].cpu);
+            n++;
+        }
+        if (pynuma == Py_None && numainfo != NULL)
+        {
+            for (i = 0; i < (int)numainfo->numberOfNodes; i++)
+                for (j = 0; j < (int)numainfo->nodes[i].numberOfProcessors; j++)
+                {
+                    int k;
+                    for (k = 0; k < n; k++)
+                        if (l[k].cpu == (int)numainfo->nodes[i].processors[j])
+                            l[k].node = (int)numainfo->nodes[i].id;
+                }
+        }
+    }
+    if (pynuma != Py_None)
+    {
+        PyObject *nodes = (PyDict_Check(pynuma) ? PyDict_GetItemString(pynuma, "nodes") : NULL);
+        PyObject *key, *value;
+        Py_ssize_t pos = 0;
+        if (nodes == NULL || !PyDict_Check(nodes))
+        {
+            PyErr_SetString(PyExc_ValueError, "numa must be a dict with a 'nodes' dict");
+            free(l);
+            return -1;
+        }
+        while (PyDict_Next(nodes, &pos, &key, &value))
+        {
+            PyObject *procs = (PyDict_Check(value) ? PyDict_GetItemString(value, "processors") : NULL);
+            int id;
+            Py_ssize_t p;
+            if (procs == NULL || !PyList_Check(procs) || placement_getint(value, "id", &id) < 0)
+            {
+                if (!PyErr_Occurred())
+                    PyErr_SetString(PyExc_ValueError, "NUMA nodes must contain 'id' and a 'processors' list");
+                free(l);
+                return -1;
+            }
+            for (p = 0; p < PyList_GET_SIZE(procs); p++)
+            {
+                long cpu = PyLong_AsLong(PyList_GET_ITEM(procs, p));
+                if (cpu == -1 && PyErr_Occurred())
+                {
+                    free(l);
+                    return -1;
+                }
+                for (i = 0; i < n; i++)
+                    if (l[i].cpu == cpu)
+                        l[i].node = id;
+            }
+        }
+    }
+    *cpus = l;
+    return n;
 }
 
 static PyObject *
-likwid_markerNumRegions(PyObject *self, PyObject *args)
+likwid_planplacement(PyObject *self, PyObject *args, PyObject *kwargs)
 {
-    return PYINT(perfmon_getNumberOfRegions());
-}
+    static char *kwlist[] = {"nworkers", "policy", "avoid_smt", "reserve", "cpus_per_worker", "topology", "numa",
+                             "core_type", NULL};
+    int nworkers, avoid_smt = 1, perworker = 1, mode, coretype = CORETYPE_NONE;
+    const char* policy = "compact";
+    const char* coretypename = NULL;
+    PyObject *pyreserve = NULL, *pytopo = Py_None, *pynuma = Py_None;
+    PlacementCpu* cpus = NULL;
+    int ncpus, i, j, w, ndomains = 0;
+    int *ids = NULL, *domstart = NULL, *domfill = NULL, *domsize = NULL;
+    PyObject *ret = NULL;
 
-static PyObject *
-likwid_markerRegionGroup(PyObject *self, PyObject *args)
-{
-    int r = -1;
-    if (PyArg_ParseTuple(args, "i", &r))
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i|spOiOOz", kwlist, &nworkers, &policy, &avoid_smt,
+                                     &pyreserve, &perworker, &pytopo, &pynuma, &coretypename))
+        return NULL;
+    if (coretypename != NULL)
     {
-        r = perfmon_getGroupOfRegion(r);
+        coretype = coretype_parse(coretypename);
+        if (coretype < 0)
+        {
+            PyErr_Format(PyExc_ValueError, "Unknown core type '%s', valid are performance and efficiency", coretypename);
+            return NULL;
+        }
     }
-    return PYINT(r);
-}
-
-static PyObject *
-likwid_markerRegionTag(PyObject *self, PyObject *args)
-{
-    int r = -1;
-    char* tag = NULL;
-    if (PyArg_ParseTuple(args, "i", &r))
+    if (strcmp(policy, "compact") == 0)
+        mode = PLACEMENT_COMPACT;
+    else if (strcmp(policy, "scatter") == 0)
+        mode = PLACEMENT_SCATTER;
+    else if (strcmp(policy, "per-numa") == 0)
+        mode = PLACEMENT_PERNUMA;
+    else
     {
-        tag = perfmon_getTagOfRegion(r);
+        PyErr_Format(PyExc_ValueError, "Unknown placement policy '%s', valid are compact, scatter and per-numa", policy);
+        return NULL;
     }
-    return PYSTR(tag);
-}
-
-static PyObject *
-likwid_markerRegionEvents(PyObject *self, PyObject *args)
-{
-    int r = -1;
-    if (PyArg_ParseTuple(args, "i", &r))
+    if (nworkers <= 0 || perworker <= 0)
     {
-        r = perfmon_getEventsOfRegion(r);
+        PyErr_SetString(PyExc_ValueError, "nworkers and cpus_per_worker must be greater than 0");
+        return NULL;
+    }
+    ncpus = placement_read_topology(pytopo, pynuma, &cpus);
+    if (ncpus < 0)
+        return NULL;
+    if (coretype != CORETYPE_NONE)
+    {
+        for (i = 0, j = 0; i < ncpus; i++)
+            if (cpus[i].type == coretype)
+                cpus[j++] = cpus[i];
+        ncpus = j;
     }
-    return PYINT(r);
-}
 
-static PyObject *
-likwid_markerRegionThreads(PyObject *self, PyObject *args)
-{
-    int r = -1;
-    if (PyArg_ParseTuple(args, "i", &r))
+    /* Reserved CPUs: an integer reserves the first physical cores with all
+     * their hardware threads, a sequence the listed CPUs */
+    qsort(cpus, ncpus, sizeof(PlacementCpu), placement_corecmp);
+    if (pyreserve != NULL && pyreserve != Py_None)
     {
-        r = perfmon_getThreadsOfRegion(r);
+        if (PyLong_Check(pyreserve))
+        {
+            long nres = PyLong_AsLong(pyreserve);
+            int cores = 0;
+            if (nres < 0)
+            {
+                PyErr_SetString(PyExc_ValueError, "reserve must not be negative");
+                goto out;
+            }
+            for (i = 0, j = 0; i < ncpus; i++)
+            {
+                if (i == 0 || cpus[i].package != cpus[i-1].package || cpus[i].core != cpus[i-1].core)
+                    cores++;
+                if (cores > nres)
+                    cpus[j++] = cpus[i];
+            }
+            ncpus = j;
+        }
+        else
+        {
+            PyObject *seq = PySequence_Fast(pyreserve, "reserve must be an integer or a sequence of CPUs");
+            if (seq == NULL)
+                goto out;
+            for (i = 0, j = 0; i < ncpus; i++)
+            {
+                int found = 0;
+                Py_ssize_t k;
+                for (k = 0; k < PySequence_Fast_GET_SIZE(seq); k++)
+                {
+                    long c = PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, k));
+                    if (c == -1 && PyErr_Occurred())
+                    {
+                        Py_DECREF(seq);
+                        goto out;
+                    }
+                    if (c == cpus[i].cpu)
+                        found = 1;
+                }
+                if (!found)
+                    cpus[j++] = cpus[i];
+            }
+            Py_DECREF(seq);
+            ncpus = j;
+        }
+    }
+    /* Only the first usable hardware thread of each core */
+    if (avoid_smt)
+    {
+        for (i = 0, j = 0; i < ncpus; i++)
+        {
+            if (j == 0 || cpus[i].package != cpus[j-1].package || cpus[i].core != cpus[j-1].core)
+                cpus[j++] = cpus[i];
+        }
+        ncpus = j;
+    }
+    if (ncpus < nworkers * perworker)
+    {
+        PyErr_Format(PyExc_ValueError, "%d workers with %d CPUs each requested but only %d CPUs available",
+                     nworkers, perworker, ncpus);
+        goto out;
     }
-    return PYINT(r);
-}
 
-static PyObject *
-likwid_markerRegionCpulist(PyObject *self, PyObject *args)
-{
-    int r, ret = 0;
-    int* cpulist;
-    if (!PyArg_ParseTuple(args, "i", &r))
+    /* Group the CPUs into domains (sockets or NUMA nodes) with dense indices
+     * in ascending order of the domain IDs */
+    ids = malloc(ncpus * sizeof(int));
+    if (ids == NULL)
     {
-        return PyList_New(0);
+        PyErr_NoMemory();
+        goto out;
     }
-    if (!topo_initialized)
+    for (i = 0; i < ncpus; i++)
+        ids[i] = (mode == PLACEMENT_PERNUMA ? cpus[i].node : cpus[i].package);
+    qsort(ids, ncpus, sizeof(int), placement_intcmp);
+    for (i = 0; i < ncpus; i++)
+        if (i == 0 || ids[i] != ids[ndomains-1])
+            ids[ndomains++] = ids[i];
+    for (i = 0; i < ncpus; i++)
+    {
+        int id = (mode == PLACEMENT_PERNUMA ? cpus[i].node : cpus[i].package);
+        int *pos = bsearch(&id, ids, ndomains, sizeof(int), placement_intcmp);
+        cpus[i].domain = (int)(pos - ids);
+    }
+    qsort(cpus, ncpus, sizeof(PlacementCpu), placement_cmp);
+    domstart = calloc(ndomains, sizeof(int));
+    domfill = calloc(ndomains, sizeof(int));
+    domsize = calloc(ndomains, sizeof(int));
+    if (!domstart || !domfill || !domsize)
+    {
+        PyErr_NoMemory();
+        goto out;
+    }
+    for (i = ncpus - 1; i >= 0; i--)
+    {
+        domstart[cpus[i].domain] = i;
+        domsize[cpus[i].domain]++;
+    }
+
+    /* compact fills one domain after the other, the other policies go
+     * round-robin over the domains. All CPUs of a worker come from the same
+     * domain as long as one has enough free CPUs. */
+    ret = PyList_New(nworkers);
+    if (ret == NULL)
+        goto out;
+    for (w = 0, j = 0; w < nworkers; w++)
     {
-        ret = topology_init();
-        if (ret == 0)
+        PyObject *l = PyList_New(perworker);
+        int d, k;
+        if (l == NULL)
         {
-            topo_initialized = 1;
+            Py_CLEAR(ret);
+            goto out;
         }
-        else
+        for (k = 0; k < ndomains; k++)
+        {
+            d = (j + k) % ndomains;
+            if (domsize[d] - domfill[d] >= perworker)
+                break;
+        }
+        for (i = 0; i < perworker; i++)
         {
-            return PyList_New(0);
+            if (k == ndomains)
+            {
+                /* Spill over: take the next free CPU of any domain */
+                for (d = 0; d < ndomains && domfill[d] == domsize[d]; d++);
+            }
+            else
+            {
+                d = (j + k) % ndomains;
+            }
+            PyList_SET_ITEM(l, i, PYINT(cpus[domstart[d] + domfill[d]].cpu));
+            domfill[d]++;
         }
+        PyList_SET_ITEM(ret, w, l);
+        if (k < ndomains)
+            j = (j + k) % ndomains;
+        if (mode != PLACEMENT_COMPACT)
+            j++;
     }
-    if ((topo_initialized) && (cpuinfo == NULL))
+out:
+    free(cpus);
+    free(ids);
+    free(domstart);
+    free(domfill);
+    free(domsize);
+    return ret;
+}
+
+#if LIKWID_MAJOR == 5 && defined LIKWID_NVMON
+static PyObject *
+likwid_gpustr_to_gpulist(PyObject *self, PyObject *args)
+{
+    int ret = 0, j = 0;
+    const char *gpustr;
+    if (!PyArg_ParseTuple(args, "s", &gpustr))
     {
-        cpuinfo = get_cpuInfo();
+        Py_RETURN_NONE;
     }
-    if ((topo_initialized) && (cputopo == NULL))
+    if (need_config() < 0)
     {
-        cputopo = get_cpuTopology();
+        Py_RETURN_NONE;
     }
-    cpulist = (int*)malloc(cputopo->numHWThreads * sizeof(int));
-    if (cpulist == NULL)
+    int* gpulist = (int*) malloc(configfile->maxNumThreads * sizeof(int));
+    if (!gpulist)
     {
-        return PyList_New(0);
+        Py_RETURN_NONE;
+    }
+    ret = gpustr_to_gpulist((char *)gpustr, gpulist, configfile->maxNumThreads);
+    if (ret < 0)
+    {
+        free(gpulist);
+        Py_RETURN_NONE;
     }
-    ret = perfmon_getCpulistOfRegion(r, cputopo->numHWThreads, cpulist);
     PyObject *l = PyList_New(ret);
-    for(r=0; r<ret;r++)
+    for(j=0;j<ret;j++)
     {
-        PyList_SET_ITEM(l, (Py_ssize_t)r, PYINT(cpulist[r]));
+        PyList_SET_ITEM(l, (Py_ssize_t)j, PYINT(gpulist[j]));
     }
-    free(cpulist);
+    free(gpulist);
     return l;
 }
+#endif
+
+/*
+################################################################################
+# Timer related functions
+################################################################################
+*/
 
 static PyObject *
-likwid_markerRegionTime(PyObject *self, PyObject *args)
+likwid_getCpuClock(PyObject *self, PyObject *args)
 {
-    int r, t;
-    PyArg_ParseTuple(args, "ii", &r, &t);
-    return Py_BuildValue("d", perfmon_getTimeOfRegion(r, t));
+    need_timer();
+    return PYINT(timer_getCpuClock());
 }
 
 static PyObject *
-likwid_markerRegionCount(PyObject *self, PyObject *args)
+likwid_startClock(PyObject *self, PyObject *args)
 {
-    int r, t;
-    PyArg_ParseTuple(args, "ii", &r, &t);
-    return PYINT(perfmon_getCountOfRegion(r, t));
+    TimerData timer;
+    need_timer();
+    timer_start(&timer);
+    return Py_BuildValue("K", timer.start.int64);
 }
 
 static PyObject *
-likwid_markerRegionResult(PyObject *self, PyObject *args)
+likwid_stopClock(PyObject *self, PyObject *args)
 {
-    int r, t, e;
-    PyArg_ParseTuple(args, "iii", &r, &e, &t);
-    return Py_BuildValue("d", perfmon_getResultOfRegionThread(r, e, t));
+    TimerData timer;
+    need_timer();
+    timer_stop(&timer);
+    return Py_BuildValue("K", timer.stop.int64);
 }
 
 static PyObject *
-likwid_markerRegionMetric(PyObject *self, PyObject *args)
+likwid_getClockCycles(PyObject *self, PyObject *args)
 {
-    int r, t, m;
-    PyArg_ParseTuple(args, "iii", &r, &m, &t);
-    return Py_BuildValue("d", perfmon_getMetricOfRegionThread(r, m, t));
+    TimerData timer;
+    uint64_t start,stop;
+    if (!PyArg_ParseTuple(args, "KK", &start, &stop))
+    {
+        Py_RETURN_NONE;
+    }
+    need_timer();
+    timer.start.int64 = start;
+    timer.stop.int64 = stop;
+    return Py_BuildValue("K", timer_printCycles(&timer));
+}
+
+static PyObject *
+likwid_getClock(PyObject *self, PyObject *args)
+{
+    TimerData timer;
+    uint64_t start,stop;
+    if (!PyArg_ParseTuple(args, "KK", &start, &stop))
+    {
+        Py_RETURN_NONE;
+    }
+    need_timer();
+    timer.start.int64 = start;
+    timer.stop.int64 = stop;
+    return Py_BuildValue("d", timer_print(&timer));
 }
 
 /*
 ################################################################################
-# CPU frequency related functions
+# Temperature related functions
 ################################################################################
 */
-#if (LIKWID_MAJOR == 5)
+
 static PyObject *
-likwid_freqInit(PyObject *self, PyObject *args)
+likwid_initTemp(PyObject *self, PyObject *args)
 {
-    return PYUINT(freq_init());
+    int cpuid;
+    if (PyArg_ParseTuple(args, "i", &cpuid))
+    {
+        thermal_init(cpuid);
+    }
+    Py_RETURN_NONE;
 }
-#endif
 
 static PyObject *
-likwid_freqGetCpuClockCurrent(PyObject *self, PyObject *args)
+likwid_readTemp(PyObject *self, PyObject *args)
 {
-    int c = 0;
-    PyArg_ParseTuple(args, "i", &c);
-    return PYUINT(freq_getCpuClockCurrent(c));
+    int cpuid;
+    unsigned int data = 0;
+    if (PyArg_ParseTuple(args, "i", &cpuid))
+    {
+        thermal_read(cpuid, &data);
+    }
+    return PYUINT(data);
 }
 
-static PyObject *
-likwid_freqGetCpuClockMax(PyObject *self, PyObject *args)
+/*
+################################################################################
+# Power/Energy related functions
+################################################################################
+*/
+
+/* Power limits set by setpowerlimit() are saved on the first change of a
+ * socket and domain and restored by restorepowerlimits(), putpowerinfo()
+ * and at interpreter exit */
+typedef struct {
+    int socket;
+    PowerType domain;
+    double watts;
+    double window;
+    int active;
+} PowerLimitSave;
+
+static PowerLimitSave* powerlimit_saved = NULL;
+static int powerlimit_nsaved = 0;
+static int register_atexit(PyMethodDef* def, int* registered);
+
+/* Power domain from a name or ID that supports flag */
+static int
+power_domainarg(PyObject* arg, uint32_t flag)
+{
+    int d = -1;
+    if (PyUnicode_Check(arg))
+    {
+        const char* name = PyUnicode_AsUTF8(arg);
+        if (name == NULL)
+            return -1;
+        for (d = 0; d < NUM_POWER_DOMAINS && strcmp(power_names[d], name) != 0; d++);
+    }
+    else
+    {
+        d = (int)PyLong_AsLong(arg);
+        if (d == -1 && PyErr_Occurred())
+            return -1;
+    }
+    if (d < 0 || d >= NUM_POWER_DOMAINS || !(power->domains[d].supportFlags & flag))
+    {
+        PyObject* repr = PyObject_Repr(arg);
+        PyErr_Format(PyExc_ValueError, "Power domain %s not supported",
+                     (repr != NULL ? PyUnicode_AsUTF8(repr) : "?"));
+        Py_XDECREF(repr);
+        return -1;
+    }
+    return d;
+}
+
+static int
+power_socketarg(int socket)
 {
-    int c = 0;
-    PyArg_ParseTuple(args, "i", &c);
-    return PYUINT(freq_getCpuClockMax(c));
+    if (need_power() < 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Cannot initialize the power module, no RAPL support");
+        return -1;
+    }
+    if (power_sockets() < 0)
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+    if (socket < 0 || socket >= power_nsockets)
+    {
+        PyErr_Format(PyExc_ValueError, "Invalid socket %d, the system has %d sockets",
+                     socket, power_nsockets);
+        return -1;
+    }
+    if (HPMaddThread(power_sockcpu[socket]) < 0)
+    {
+        PyErr_Format(PyExc_RuntimeError, "Cannot access the RAPL registers of socket %d", socket);
+        return -1;
+    }
+    return 0;
 }
 
-#if (LIKWID_MAJOR == 5)
-static PyObject *
-likwid_freqGetConfCpuClockMax(PyObject *self, PyObject *args)
+/* Restore the saved limits, the entries that fail are kept for a retry.
+ * Returns the number of failed entries. */
+static int
+powerlimit_restore(void)
 {
-    int c = 0;
-    PyArg_ParseTuple(args, "i", &c);
-    return PYUINT(freq_getConfCpuClockMax(c));
+    int i, failed = 0;
+    for (i = 0; i < powerlimit_nsaved; i++)
+    {
+        PowerLimitSave* s = &powerlimit_saved[i];
+        int cpu = power_sockcpu[s->socket];
+        /* The power module may have been reinitialized since the change */
+        int err = HPMaddThread(cpu);
+        if (err >= 0)
+            err = power_limitSet(cpu, s->domain, s->watts, s->window, 0);
+        if (err >= 0)
+            err = (s->active ? power_limitActivate(cpu, s->domain) : power_limitDectivate(cpu, s->domain));
+        if (err < 0)
+            powerlimit_saved[failed++] = *s;
+    }
+    powerlimit_nsaved = failed;
+    if (failed == 0)
+    {
+        free(powerlimit_saved);
+        powerlimit_saved = NULL;
+    }
+    return failed;
 }
-#endif
 
 static PyObject *
-likwid_freqGetCpuClockMin(PyObject *self, PyObject *args)
+likwid_restorepowerlimits(PyObject *self, PyObject *args)
+{
+    int n = powerlimit_nsaved;
+    int failed;
+    /* Limits left after putpowerinfo() need the power module again */
+    if (n > 0 && need_power() < 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Cannot initialize the power module, no RAPL support");
+        return NULL;
+    }
+    failed = powerlimit_restore();
+    if (failed > 0)
+    {
+        PyErr_Format(PyExc_RuntimeError, "Cannot restore %d of %d power limits", failed, n);
+        return NULL;
+    }
+    return PYINT(n);
+}
+
+static PyMethodDef powerlimit_atexit_def = {"restorepowerlimits", likwid_restorepowerlimits, METH_NOARGS, NULL};
+
+static PyObject *
+likwid_getpowerlimit(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"socket", "domain", NULL};
+    int socket, d, cpu;
+    PyObject* pydomain = NULL;
+    double watts = 0, window = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i|O", kwlist, &socket, &pydomain))
+        return NULL;
+    if (power_socketarg(socket) < 0)
+        return NULL;
+    d = (pydomain != NULL ? power_domainarg(pydomain, POWER_DOMAIN_SUPPORT_LIMIT) : PKG);
+    if (d < 0)
+        return NULL;
+    cpu = power_sockcpu[socket];
+    if (power_limitGet(cpu, d, &watts, &window) < 0)
+    {
+        PyErr_Format(PyExc_RuntimeError, "Cannot read the %s power limit of socket %d",
+                     power_names[d], socket);
+        return NULL;
+    }
+    return Py_BuildValue("{s:d,s:d,s:N}", "watts", watts, "window", window,
+                         "active", PyBool_FromLong(power_limitState(cpu, d) > 0));
+}
+
+static PyObject *
+likwid_setpowerlimit(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"socket", "domain", "watts", "window", "clamp", NULL};
+    static int atexit_registered = 0;
+    int socket, d, cpu, i, clamp = 0;
+    PyObject *pydomain, *pywindow = Py_None;
+    double watts, window = 0, oldwatts = 0, oldwindow = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "iOd|Op", kwlist, &socket, &pydomain,
+                                     &watts, &pywindow, &clamp))
+        return NULL;
+    if (power_socketarg(socket) < 0)
+        return NULL;
+    d = power_domainarg(pydomain, POWER_DOMAIN_SUPPORT_LIMIT);
+    if (d < 0)
+        return NULL;
+    if (pywindow != Py_None)
+    {
+        window = PyFloat_AsDouble(pywindow);
+        if (window == -1.0 && PyErr_Occurred())
+            return NULL;
+    }
+    if (watts <= 0 || (pywindow != Py_None && window <= 0))
+    {
+        PyErr_SetString(PyExc_ValueError, "watts and window must be greater than 0");
+        return NULL;
+    }
+    cpu = power_sockcpu[socket];
+    if (power_limitGet(cpu, d, &oldwatts, &oldwindow) < 0)
+    {
+        PyErr_Format(PyExc_RuntimeError, "Cannot read the %s power limit of socket %d",
+                     power_names[d], socket);
+        return NULL;
+    }
+    /* Keep the current time window */
+    if (pywindow == Py_None)
+        window = oldwindow;
+    for (i = 0; i < powerlimit_nsaved; i++)
+        if (powerlimit_saved[i].socket == socket && powerlimit_saved[i].domain == (PowerType)d)
+            break;
+    if (i == powerlimit_nsaved)
+    {
+        PowerLimitSave* tmp;
+        if (register_atexit(&powerlimit_atexit_def, &atexit_registered) < 0)
+            return NULL;
+        tmp = realloc(powerlimit_saved, (powerlimit_nsaved + 1) * sizeof(PowerLimitSave));
+        if (tmp == NULL)
+            return PyErr_NoMemory();
+        powerlimit_saved = tmp;
+        powerlimit_saved[i].socket = socket;
+        powerlimit_saved[i].domain = d;
+        powerlimit_saved[i].watts = oldwatts;
+        powerlimit_saved[i].window = oldwindow;
+        powerlimit_saved[i].active = (power_limitState(cpu, d) > 0);
+        powerlimit_nsaved++;
+    }
+    if (power_limitSet(cpu, d, watts, window, clamp) < 0 || power_limitActivate(cpu, d) < 0)
+    {
+        PyErr_Format(PyExc_RuntimeError, "Cannot set the %s power limit of socket %d to %g W",
+                     power_names[d], socket, watts);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+likwid_getPowerInfo(PyObject *self, PyObject *args)
+{
+    int i;
+    if (need_power() < 0)
+    {
+        Py_RETURN_NONE;
+    }
+    PyObject *n = PyDict_New();
+    pydict_set(n, "hasRAPL", PYINT(1));
+    pydict_set(n, "baseFrequency", Py_BuildValue("d", power->baseFrequency));
+    pydict_set(n, "minFrequency", Py_BuildValue("d", power->minFrequency));
+    pydict_set(n, "powerUnit", Py_BuildValue("d", power->powerUnit));
+    pydict_set(n, "timeUnit", Py_BuildValue("d", power->timeUnit));
+
+    PyObject *l = PyList_New(power->turbo.numSteps);
+    for (i=0; i<power->turbo.numSteps; i++)
+    {
+        PyList_SET_ITEM(l, (Py_ssize_t)i, Py_BuildValue("d", power->turbo.steps[i]));
+    }
+    pydict_set(n, "turbo", l);
+    PyObject *d = PyDict_New();
+    for(i=0;i<NUM_POWER_DOMAINS;i++)
+    {
+        PyObject *pd = PyDict_New();
+        pydict_set(pd, "ID", Py_BuildValue("I", power->domains[i].type));
+        pydict_set(pd, "energyUnit", Py_BuildValue("d", power->domains[i].energyUnit));
+        pydict_set(pd, "supportStatus", PyBool_FromLong((power->domains[i].supportFlags & POWER_DOMAIN_SUPPORT_STATUS) != 0));
+        pydict_set(pd, "supportPerf", PyBool_FromLong((power->domains[i].supportFlags & POWER_DOMAIN_SUPPORT_PERF) != 0));
+        pydict_set(pd, "supportPolicy", PyBool_FromLong((power->domains[i].supportFlags & POWER_DOMAIN_SUPPORT_POLICY) != 0));
+        pydict_set(pd, "supportLimit", PyBool_FromLong((power->domains[i].supportFlags & POWER_DOMAIN_SUPPORT_LIMIT) != 0));
+        if (power->domains[i].supportFlags & POWER_DOMAIN_SUPPORT_INFO)
+        {
+            pydict_set(pd, "supportInfo", PyBool_FromLong(1));
+            pydict_set(pd, "tdp", Py_BuildValue("d", power->domains[i].tdp));
+            pydict_set(pd, "minPower", Py_BuildValue("d", power->domains[i].minPower));
+            pydict_set(pd, "maxPower", Py_BuildValue("d", power->domains[i].maxPower));
+            pydict_set(pd, "maxTimeWindow", Py_BuildValue("d", power->domains[i].maxTimeWindow));
+        }
+        else
+        {
+            pydict_set(pd, "supportInfo", PyBool_FromLong(0));
+        }
+        pydict_set(d, power_names[i], pd);
+    }
+    pydict_set(n, "domains", d);
+    return n;
+}
+
+
+static PyObject *
+likwid_putPowerInfo(PyObject *self, PyObject *args)
+{
+    if (power_initialized)
+    {
+        powerlimit_restore();
+        markerenergy_ndomains = 0;
+        markerenergy_free();
+        power_finalize();
+        power_initialized = 0;
+        power = NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+likwid_startPower(PyObject *self, PyObject *args)
+{
+    PowerData pwrdata;
+    pwrdata.before = 0;
+    int cpuId;
+    PowerType type;
+    if (PyArg_ParseTuple(args, "iI", &cpuId, &type))
+    {
+        pwrdata.domain = type;
+        power_start(&pwrdata, cpuId, type);
+    }
+    return Py_BuildValue("I", pwrdata.before);
+}
+
+static PyObject *
+likwid_stopPower(PyObject *self, PyObject *args)
+{
+    PowerData pwrdata;
+    pwrdata.after = 0;
+    int cpuId;
+    PowerType type;
+    if (PyArg_ParseTuple(args, "iI", &cpuId, &type))
+    {
+        pwrdata.domain = type;
+        power_stop(&pwrdata, cpuId, type);
+    }
+    return Py_BuildValue("I", pwrdata.after);
+}
+
+static PyObject *
+likwid_getPower(PyObject *self, PyObject *args)
+{
+    PowerData pwrdata;
+    double energy = 0.0;
+    pwrdata.before = 0;
+    pwrdata.after = 0;
+    if (PyArg_ParseTuple(args, "III", &pwrdata.before, &pwrdata.after, &pwrdata.domain))
+    {
+        energy = power_printEnergy(&pwrdata);
+    }
+    return Py_BuildValue("d", energy);
+}
+
+/*
+################################################################################
+# Perfmon related functions
+################################################################################
+*/
+
+/* Convert a CPU specification into a list of CPU IDs. Accepted are a cpu
+ * string in LIKWID syntax, a buffer of int32 or int64 (e.g. array.array or
+ * numpy arrays) and any iterable of integers. For C-contiguous int32
+ * buffers, *cpulist points directly into the buffer view, which stays
+ * acquired until cpulist_release(). Returns the number of CPUs or -1 with
+ * exception set. */
+typedef struct {
+    int* cpus;
+    int owned;
+    Py_buffer view;
+} PyCpuList;
+
+static void
+cpulist_release(PyCpuList* l)
+{
+    if (l->owned)
+        free(l->cpus);
+    else if (l->view.obj != NULL)
+        PyBuffer_Release(&l->view);
+    l->cpus = NULL;
+    l->owned = 0;
+}
+
+/* CPU IDs must be hardware threads of the system */
+static int
+cpulist_check(PyCpuList* l, int n)
+{
+    int i, max = (need_topology() == 0 ? (int)cputopo->numHWThreads : INT_MAX);
+    for (i = 0; i < n; i++)
+    {
+        if (l->cpus[i] < 0 || l->cpus[i] >= max)
+        {
+            PyErr_Format(PyExc_ValueError, "Invalid CPU ID %d", l->cpus[i]);
+            cpulist_release(l);
+            return -1;
+        }
+    }
+    return n;
+}
+
+static int
+cpulist_from_object(PyObject *obj, PyCpuList* l)
+{
+    Py_ssize_t i, n;
+    l->cpus = NULL;
+    l->owned = 0;
+    l->view.obj = NULL;
+    if (PyUnicode_Check(obj))
+    {
+        const char* cpustr = PyUnicode_AsUTF8(obj);
+        int ret;
+        if (cpustr == NULL)
+            return -1;
+        if (need_config() < 0)
+        {
+            PyErr_SetString(PyExc_RuntimeError, "Cannot initialize configuration module");
+            return -1;
+        }
+        l->cpus = malloc(configfile->maxNumThreads * sizeof(int));
+        if (l->cpus == NULL)
+        {
+            PyErr_NoMemory();
+            return -1;
+        }
+        l->owned = 1;
+        ret = cpustr_to_cpulist((char *)cpustr, l->cpus, configfile->maxNumThreads);
+        if (ret <= 0)
+        {
+            cpulist_release(l);
+            PyErr_Format(PyExc_ValueError, "Invalid CPU string '%s'", cpustr);
+            return -1;
+        }
+        return ret;
+    }
+    if (PyObject_CheckBuffer(obj))
+    {
+        Py_buffer* v = &l->view;
+        const char* fmt;
+        if (PyObject_GetBuffer(obj, v, PyBUF_FORMAT|PyBUF_STRIDES) < 0)
+            return -1;
+        fmt = (v->format ? v->format : "B");
+        if (fmt[0] == '@' || fmt[0] == '=')
+            fmt++;
+        if (v->ndim != 1 || fmt[0] == '\0' || fmt[1] != '\0' || strchr("ilqn", fmt[0]) == NULL ||
+            (v->itemsize != 4 && v->itemsize != 8))
+        {
+            PyErr_Format(PyExc_TypeError, "CPU buffer must be a one-dimensional buffer of int32 or int64, not '%s'",
+                         (v->format ? v->format : "B"));
+            PyBuffer_Release(v);
+            v->obj = NULL;
+            return -1;
+        }
+        n = v->shape[0];
+        if (v->itemsize == sizeof(int) && PyBuffer_IsContiguous(v, 'C'))
+        {
+            /* Zero-copy */
+            l->cpus = (int*)v->buf;
+            return cpulist_check(l, (int)n);
+        }
+        l->cpus = malloc((n > 0 ? n : 1) * sizeof(int));
+        if (l->cpus == NULL)
+        {
+            PyBuffer_Release(v);
+            v->obj = NULL;
+            PyErr_NoMemory();
+            return -1;
+        }
+        /* Copy strided buffers (e.g. slices with a step) and int64 */
+        for (i = 0; i < n; i++)
+        {
+            const char* item = (const char*)v->buf + i * v->strides[0];
+            int64_t c = (v->itemsize == 8 ? *(const int64_t*)item : *(const int32_t*)item);
+            if (c < 0 || c > INT_MAX)
+            {
+                free(l->cpus);
+                l->cpus = NULL;
+                PyBuffer_Release(v);
+                v->obj = NULL;
+                PyErr_Format(PyExc_ValueError, "Invalid CPU ID %lld", (long long)c);
+                return -1;
+            }
+            l->cpus[i] = (int)c;
+        }
+        PyBuffer_Release(v);
+        v->obj = NULL;
+        l->owned = 1;
+        return cpulist_check(l, (int)n);
+    }
+    else
+    {
+        PyObject *seq = PySequence_Fast(obj, "CPUs must be given as cpu string, buffer or iterable of integers");
+        if (seq == NULL)
+            return -1;
+        n = PySequence_Fast_GET_SIZE(seq);
+        l->cpus = malloc((n > 0 ? n : 1) * sizeof(int));
+        if (l->cpus == NULL)
+        {
+            Py_DECREF(seq);
+            PyErr_NoMemory();
+            return -1;
+        }
+        l->owned = 1;
+        for (i = 0; i < n; i++)
+        {
+            long c = PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+            if (c == -1 && PyErr_Occurred())
+            {
+                Py_DECREF(seq);
+                cpulist_release(l);
+                return -1;
+            }
+            if (c < 0 || c > INT_MAX)
+            {
+                Py_DECREF(seq);
+                cpulist_release(l);
+                PyErr_Format(PyExc_ValueError, "Invalid CPU ID %ld", c);
+                return -1;
+            }
+            l->cpus[i] = (int)c;
+        }
+        Py_DECREF(seq);
+        return cpulist_check(l, (int)n);
+    }
+}
+
+static PyObject *
+likwid_init(PyObject *self, PyObject *args)
+{
+    int ret;
+    int nrThreads = 0;
+    PyObject *pycpus;
+    PyCpuList cpulist;
+
+    if (!PyArg_ParseTuple(args, "O", &pycpus))
+        return NULL;
+    if (need_native_topology() < 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Cannot initialize topology module");
+        return NULL;
+    }
+    nrThreads = cpulist_from_object(pycpus, &cpulist);
+    if (nrThreads < 0)
+        return NULL;
+    if (nrThreads == 0)
+    {
+        cpulist_release(&cpulist);
+        PyErr_SetString(PyExc_ValueError, "CPU list is empty");
+        return NULL;
+    }
+    if (perfmon_initialized == 0)
+    {
+        ret = perfmon_init(nrThreads, cpulist.cpus);
+        if (ret != 0)
+        {
+            cpulist_release(&cpulist);
+            PyErr_Format(PyExc_RuntimeError, "Initialization of PerfMon module failed (error %d)", ret);
+            return NULL;
+        }
+        perfmon_initialized = 1;
+        timer_initialized = 1;
+        perfmon_cpus = malloc(nrThreads * sizeof(int));
+        if (perfmon_cpus != NULL)
+        {
+            memcpy(perfmon_cpus, cpulist.cpus, nrThreads * sizeof(int));
+            perfmon_ncpus = nrThreads;
+        }
+    }
+    cpulist_release(&cpulist);
+    return PYINT(0);
+}
+
+/* Registry of the added event sets: normalized event set string -> group ID.
+ * Adding an event set twice would use up another perfmon group. */
+static PyObject *eventset_registry = NULL;
+
+/* Event set strings without whitespace */
+static PyObject *
+eventset_normalize(const char* eventset)
+{
+    size_t i, n = 0, len = strlen(eventset);
+    PyObject *key;
+    char* buf = malloc(len + 1);
+    if (buf == NULL)
+        return PyErr_NoMemory();
+    for (i = 0; i < len; i++)
+    {
+        if (!isspace((unsigned char)eventset[i]))
+            buf[n++] = eventset[i];
+    }
+    key = PyUnicode_FromStringAndSize(buf, n);
+    free(buf);
+    return key;
+}
+
+static PyObject *
+likwid_addEventSet(PyObject *self, PyObject *args)
+{
+    const char* tmpString;
+    int groupId = -1;
+    PyObject *key, *gid;
+    if (!PyArg_ParseTuple(args, "s", &tmpString))
+        return NULL;
+    if (perfmon_initialized == 0)
+    {
+        return PYINT(-1);
+    }
+    if (eventset_registry == NULL)
+    {
+        eventset_registry = PyDict_New();
+        if (eventset_registry == NULL)
+            return NULL;
+    }
+    key = eventset_normalize(tmpString);
+    if (key == NULL)
+        return NULL;
+    gid = PyDict_GetItem(eventset_registry, key);
+    if (gid != NULL)
+    {
+        Py_DECREF(key);
+        Py_INCREF(gid);
+        return gid;
+    }
+    groupId = perfmon_addEventSet((char*)PyUnicode_AsUTF8(key));
+    gid = PYINT(groupId);
+    if (groupId >= 0 && gid != NULL && PyDict_SetItem(eventset_registry, key, gid) < 0)
+        Py_CLEAR(gid);
+    Py_DECREF(key);
+    return gid;
+}
+
+static PyObject *
+likwid_getgid(PyObject *self, PyObject *args)
+{
+    const char* eventset;
+    PyObject *key, *gid = NULL;
+    if (!PyArg_ParseTuple(args, "s", &eventset))
+        return NULL;
+    key = eventset_normalize(eventset);
+    if (key == NULL)
+        return NULL;
+    if (eventset_registry != NULL)
+        gid = PyDict_GetItem(eventset_registry, key);
+    Py_DECREF(key);
+    if (gid == NULL)
+        return PYINT(-1);
+    Py_INCREF(gid);
+    return gid;
+}
+
+static PyObject *
+likwid_setupCounters(PyObject *self, PyObject *args)
+{
+    if (perfmon_initialized == 0)
+    {
+        return PYINT(-1);
+    }
+    int groupId, ret = -1;
+    if (PyArg_ParseTuple(args, "i", &groupId))
+    {
+        ret = perfmon_setupCounters(groupId);
+    }
+    return PYINT(ret);
+}
+
+static PyObject *
+likwid_startCounters(PyObject *self, PyObject *args)
+{
+    int ret;
+    if (perfmon_initialized == 0)
+    {
+        return PYINT(-1);
+    }
+    ret = perfmon_startCounters();
+    return PYINT(ret);
+}
+
+static PyObject *
+likwid_stopCounters(PyObject *self, PyObject *args)
+{
+    int ret;
+    if (perfmon_initialized == 0)
+    {
+        return PYINT(-1);
+    }
+    ret = perfmon_stopCounters();
+    return PYINT(ret);
+}
+
+static PyObject *
+likwid_readCounters(PyObject *self, PyObject *args)
+{
+    int ret;
+    if (perfmon_initialized == 0)
+    {
+        return PYINT(-1);
+    }
+    ret = perfmon_readCounters();
+    return PYINT(ret);
+}
+
+static PyObject *
+likwid_readCountersCpu(PyObject *self, PyObject *args)
+{
+    int ret = -1;
+    if (perfmon_initialized > 0 && PyArg_ParseTuple(args, "i", &ret))
+    {
+        ret = perfmon_readCountersCpu(ret);
+    }
+    return PYINT(ret);
+}
+
+static PyObject *
+likwid_readGroupCounters(PyObject *self, PyObject *args)
+{
+    int ret = -1;
+    if (perfmon_initialized > 0 && PyArg_ParseTuple(args, "i", &ret))
+    {
+        ret = perfmon_readGroupCounters(ret);
+    }
+    return PYINT(ret);
+}
+
+static PyObject *
+likwid_readGroupThreadCounters(PyObject *self, PyObject *args)
+{
+    int ret = -1;
+    int thread = 0;
+    if (perfmon_initialized > 0 && PyArg_ParseTuple(args, "ii", &ret, &thread))
+    {
+        ret = perfmon_readGroupThreadCounters(ret, thread);
+    }
+    return PYINT(ret);
+}
+
+static PyObject *
+likwid_switchGroup(PyObject *self, PyObject *args)
+{
+    int ret = -1;
+    int newgroup = 0;
+    if (perfmon_initialized > 0 && PyArg_ParseTuple(args, "i", &newgroup))
+    {
+        if (newgroup >= perfmon_getNumberOfGroups())
+        {
+            newgroup = 0;
+        }
+        if (newgroup != perfmon_getIdOfActiveGroup())
+        {
+            ret = perfmon_switchActiveGroup(newgroup);
+        }
+    }
+    return PYINT(ret);
+}
+
+static int sampler_event;
+static void sampler_halt(void);
+static void trigger_halt(void);
+
+static PyObject *
+likwid_finalize(PyObject *self, PyObject *args)
+{
+    /* A counter-weighted sampler, the trigger and a frequency timeline with
+     * metrics read the perfmon CPUs, the throttle monitor and the timeline
+     * also the access layer and the topology */
+    if (sampler_event >= 0)
+        sampler_halt();
+    trigger_halt();
+    throttle_halt();
+#if (LIKWID_MAJOR == 5)
+    freqtimeline_halt();
+#endif
+    if (perfmon_initialized == 1)
+    {
+        perfmon_finalize();
+        perfmon_initialized = 0;
+    }
+    free(perfmon_cpus);
+    perfmon_cpus = NULL;
+    perfmon_ncpus = 0;
+    Py_CLEAR(eventset_registry);
+    Py_CLEAR(aggregate_maps);
+    toposnap_release();
+    if (affinity_initialized == 1)
+    {
+        affinity_finalize();
+        affinity_initialized = 0;
+        affinity = NULL;
+    }
+    if (numa_initialized == 1)
+    {
+        numa_finalize();
+        numa_initialized = 0;
+        numainfo = NULL;
+    }
+    if (topo_initialized == 1)
+    {
+        topology_finalize();
+        topo_initialized = 0;
+        cputopo = NULL;
+        cpuinfo = NULL;
+    }
+    if (config_initialized == 1)
+    {
+        destroy_configuration();
+        config_initialized = 0;
+        configfile = NULL;
+    }
+    return PYINT(0);
+}
+
+static PyObject *
+likwid_getResult(PyObject *self, PyObject *args)
+{
+    int g, e, t;
+    double result = NAN;
+    if (PyArg_ParseTuple(args, "iii", &g, &e, &t))
+    {
+        result = perfmon_getResult(g, e, t);
+    }
+    return Py_BuildValue("d", result);
+}
+
+static PyObject *
+likwid_getLastResult(PyObject *self, PyObject *args)
+{
+    int g, e, t;
+    double result = NAN;
+    if (PyArg_ParseTuple(args, "iii", &g, &e, &t))
+    {
+        result = perfmon_getLastResult(g, e, t);
+    }
+    return Py_BuildValue("d", result);
+}
+
+static PyObject *
+likwid_getMetric(PyObject *self, PyObject *args)
+{
+    int g, m, t;
+    double result = NAN;
+    if (PyArg_ParseTuple(args, "iii", &g, &m, &t))
+    {
+        result = perfmon_getMetric(g, m, t);
+    }
+    return Py_BuildValue("d", result);
+}
+
+static PyObject *
+likwid_getLastMetric(PyObject *self, PyObject *args)
+{
+    int g, m, t;
+    double result = NAN;
+    if (PyArg_ParseTuple(args, "iii", &g, &m, &t))
+    {
+        result = perfmon_getLastMetric(g, m, t);
+    }
+    return Py_BuildValue("d", result);
+}
+
+static PyObject *
+likwid_getNumberOfGroups(PyObject *self, PyObject *args)
+{
+    if (perfmon_initialized == 0)
+    {
+        return 0;
+    }
+    return PYINT(perfmon_getNumberOfGroups());
+}
+
+static PyObject *
+likwid_getIdOfActiveGroup(PyObject *self, PyObject *args)
+{
+    if (perfmon_initialized == 0)
+    {
+        return 0;
+    }
+    return PYINT(perfmon_getIdOfActiveGroup());
+}
+
+static PyObject *
+likwid_getNumberOfThreads(PyObject *self, PyObject *args)
+{
+    if (perfmon_initialized == 0)
+    {
+        return 0;
+    }
+    return PYINT(perfmon_getNumberOfThreads());
+}
+
+static PyObject *
+likwid_getTimeOfGroup(PyObject *self, PyObject *args)
+{
+    if (perfmon_initialized == 0)
+    {
+        return 0;
+    }
+    int groupId;
+    double time = 0.0;
+    if (PyArg_ParseTuple(args, "i", &groupId))
+    {
+        time = perfmon_getTimeOfGroup(groupId);
+    }
+    return Py_BuildValue("d", time);
+}
+
+static PyObject *
+likwid_getNumberOfEvents(PyObject *self, PyObject *args)
+{
+    if (perfmon_initialized == 0)
+    {
+        return 0;
+    }
+    int groupId;
+    int num_events = 0;
+    if (PyArg_ParseTuple(args, "i", &groupId))
+    {
+        num_events = perfmon_getNumberOfEvents(groupId);
+    }
+    return PYINT(num_events);
+}
+
+static PyObject *
+likwid_getNumberOfMetrics(PyObject *self, PyObject *args)
+{
+    if (perfmon_initialized == 0)
+    {
+        return 0;
+    }
+    int groupId;
+    int num_metrics = 0;
+    if (PyArg_ParseTuple(args, "i", &groupId))
+    {
+        num_metrics = perfmon_getNumberOfMetrics(groupId);
+    }
+    return PYINT(num_metrics);
+}
+
+static PyObject *
+likwid_getNameOfEvent(PyObject *self, PyObject *args)
+{
+    if (perfmon_initialized == 0)
+    {
+        return 0;
+    }
+    int g, e;
+    char* name = NULL;
+    if (PyArg_ParseTuple(args, "ii", &g, &e))
+    {
+        name = perfmon_getEventName(g,e);
+    }
+    return PYSTR(name);
+}
+
+static PyObject *
+likwid_getNameOfCounter(PyObject *self, PyObject *args)
+{
+    if (perfmon_initialized == 0)
+    {
+        return 0;
+    }
+    int g, c;
+    char* name = NULL;
+    if (PyArg_ParseTuple(args, "ii", &g, &c))
+    {
+        name = perfmon_getCounterName(g,c);
+    }
+    return PYSTR(name);
+}
+
+static PyObject *
+likwid_getNameOfMetric(PyObject *self, PyObject *args)
+{
+    if (perfmon_initialized == 0)
+    {
+        return 0;
+    }
+    int g, m;
+    char* name = NULL;
+    if (PyArg_ParseTuple(args, "ii", &g, &m))
+    {
+        name = perfmon_getMetricName(g, m);
+    }
+    return PYSTR(name);
+}
+
+static PyObject *
+likwid_getNameOfGroup(PyObject *self, PyObject *args)
+{
+    if (perfmon_initialized == 0)
+    {
+        return 0;
+    }
+    int groupId;
+    char* name = NULL;
+    if (PyArg_ParseTuple(args, "i", &groupId))
+    {
+        name = perfmon_getGroupName(groupId);
+    }
+    return PYSTR(name);
+}
+
+static PyObject *
+likwid_getShortInfoOfGroup(PyObject *self, PyObject *args)
+{
+    if (perfmon_initialized == 0)
+    {
+        return 0;
+    }
+    int groupId;
+    char* info = NULL;
+    if (PyArg_ParseTuple(args, "i", &groupId))
+    {
+        info = perfmon_getGroupInfoShort(groupId);
+    }
+    return PYSTR(info);
+}
+
+static PyObject *
+likwid_getLongInfoOfGroup(PyObject *self, PyObject *args)
+{
+    if (perfmon_initialized == 0)
+    {
+        return 0;
+    }
+    int groupId;
+    char* info = NULL;
+    if (PyArg_ParseTuple(args, "i", &groupId))
+    {
+        info = perfmon_getGroupInfoLong(groupId);
+    }
+    return PYSTR(info);
+}
+
+/* Cached catalog of the performance groups. The group files of the current
+ * architecture are parsed once per (architecture, group path) and parsed
+ * again only if a group directory or file changed (mtime and size). */
+
+typedef struct {
+    char* shortname;
+    char* grouppath;
+    char* userpath;
+    PyObject *stamp;
+    PyObject *catalog;
+} GroupCatalog;
+
+static GroupCatalog groupcatalog = {NULL, NULL, NULL, NULL, NULL};
+
+static void
+groupcatalog_clear(void)
+{
+    free(groupcatalog.shortname);
+    free(groupcatalog.grouppath);
+    free(groupcatalog.userpath);
+    groupcatalog.shortname = NULL;
+    groupcatalog.grouppath = NULL;
+    groupcatalog.userpath = NULL;
+    Py_CLEAR(groupcatalog.stamp);
+    Py_CLEAR(groupcatalog.catalog);
+}
+
+static int
+groupcatalog_same(const char* a, const char* b)
+{
+    if (a == NULL || b == NULL)
+        return a == b;
+    return strcmp(a, b) == 0;
+}
+
+/* Append the modification stamps of a directory and all group files in it to
+ * the list. Missing directories are recorded as well, so creating them
+ * invalidates the catalog. */
+static int
+groupcatalog_stamp_dir(PyObject *stamp, const char* dir)
+{
+    struct stat st;
+    DIR* dp;
+    struct dirent* ent;
+    PyObject *o;
+    if (stat(dir, &st) != 0)
+    {
+        o = Py_BuildValue("(sO)", dir, Py_None);
+        if (o == NULL || PyList_Append(stamp, o) < 0)
+        {
+            Py_XDECREF(o);
+            return -1;
+        }
+        Py_DECREF(o);
+        return 0;
+    }
+    o = Py_BuildValue("(sLL)", dir, (long long)st.st_mtim.tv_sec, (long long)st.st_mtim.tv_nsec);
+    if (o == NULL || PyList_Append(stamp, o) < 0)
+    {
+        Py_XDECREF(o);
+        return -1;
+    }
+    Py_DECREF(o);
+    dp = opendir(dir);
+    if (dp == NULL)
+        return 0;
+    while ((ent = readdir(dp)) != NULL)
+    {
+        char path[PATH_MAX];
+        size_t len = strlen(ent->d_name);
+        if (len < 5 || strcmp(ent->d_name + len - 4, ".txt") != 0)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+        if (stat(path, &st) != 0)
+            continue;
+        o = Py_BuildValue("(sLLL)", path, (long long)st.st_mtim.tv_sec,
+                          (long long)st.st_mtim.tv_nsec, (long long)st.st_size);
+        if (o == NULL || PyList_Append(stamp, o) < 0)
+        {
+            Py_XDECREF(o);
+            closedir(dp);
+            return -1;
+        }
+        Py_DECREF(o);
+    }
+    closedir(dp);
+    /* readdir order is arbitrary */
+    return PyList_Sort(stamp);
+}
+
+static char*
+groupcatalog_strip(char* s)
+{
+    char* e;
+    while (isspace((unsigned char)*s))
+        s++;
+    e = s + strlen(s);
+    while (e > s && isspace((unsigned char)e[-1]))
+        *(--e) = '\0';
+    return s;
+}
+
+/* Parse a group file in the LIKWID format:
+ *   SHORT <short description>
+ *   EVENTSET
+ *   <counter> <event>
+ *   METRICS
+ *   <metric name> <formula>
+ *   LONG
+ *   <long description>
+ * Returns a read-only mapping or NULL with exception set. */
+static PyObject *
+groupcatalog_parse(const char* path, const char* name, int user)
+{
+    FILE* fp = fopen(path, "r");
+    char* line = NULL;
+    size_t cap = 0;
+    int section = 0, err = 0;
+    PyObject *events, *metrics, *longinfo, *d = NULL, *proxy = NULL;
+    char shortinfo[1024] = "";
+    if (fp == NULL)
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+    events = PyList_New(0);
+    metrics = PyList_New(0);
+    longinfo = PyList_New(0);
+    if (events == NULL || metrics == NULL || longinfo == NULL)
+    {
+        fclose(fp);
+        goto error;
+    }
+    while (err == 0 && getline(&line, &cap, fp) >= 0)
+    {
+        char* s = groupcatalog_strip(line);
+        PyObject *o = NULL;
+        if (section != 4 && (s[0] == '\0' || s[0] == '#'))
+            continue;
+        if (strncmp(s, "SHORT", 5) == 0 && (s[5] == '\0' || isspace((unsigned char)s[5])))
+        {
+            snprintf(shortinfo, sizeof(shortinfo), "%s", groupcatalog_strip(s + 5));
+            section = 0;
+            continue;
+        }
+        if (strcmp(s, "EVENTSET") == 0)
+            section = 1;
+        else if (strcmp(s, "METRICS") == 0)
+            section = 2;
+        else if (strcmp(s, "LONG") == 0)
+            section = 4;
+        else if (section == 1)
+        {
+            char* sep = s + strcspn(s, " \t");
+            if (*sep == '\0')
+                continue;
+            *sep = '\0';
+            o = Py_BuildValue("(ss)", s, groupcatalog_strip(sep + 1));
+            err = (o == NULL || PyList_Append(events, o) < 0);
+        }
+        else if (section == 2)
+        {
+            /* The formula is the last word, the name everything before */
+            char* sep = s + strlen(s);
+            while (sep > s && !isspace((unsigned char)sep[-1]))
+                sep--;
+            if (sep == s)
+                continue;
+            sep[-1] = '\0';
+            o = Py_BuildValue("(ss)", groupcatalog_strip(s), sep);
+            err = (o == NULL || PyList_Append(metrics, o) < 0);
+        }
+        else if (section == 4)
+        {
+            o = PyUnicode_FromString(s);
+            err = (o == NULL || PyList_Append(longinfo, o) < 0);
+        }
+        Py_XDECREF(o);
+    }
+    free(line);
+    fclose(fp);
+    if (err)
+        goto error;
+    /* Trailing empty lines of the long description */
+    while (PyList_GET_SIZE(longinfo) > 0 &&
+           PyUnicode_GetLength(PyList_GET_ITEM(longinfo, PyList_GET_SIZE(longinfo) - 1)) == 0)
+    {
+        if (PyList_SetSlice(longinfo, PyList_GET_SIZE(longinfo) - 1, PyList_GET_SIZE(longinfo), NULL) < 0)
+            goto error;
+    }
+    {
+        PyObject *sep = PyUnicode_FromString("\n");
+        PyObject *joined = (sep ? PyUnicode_Join(sep, longinfo) : NULL);
+        Py_XDECREF(sep);
+        if (joined == NULL)
+            goto error;
+        d = Py_BuildValue("{s:s,s:s,s:N,s:N,s:N,s:s,s:O}",
+                          "Name", name, "Info", shortinfo, "Long", joined,
+                          "Events", PyList_AsTuple(events), "Metrics", PyList_AsTuple(metrics),
+                          "Path", path, "User", (user ? Py_True : Py_False));
+    }
+    if (d != NULL)
+        proxy = PyDictProxy_New(d);
+error:
+    Py_XDECREF(d);
+    Py_XDECREF(events);
+    Py_XDECREF(metrics);
+    Py_XDECREF(longinfo);
+    return proxy;
+}
+
+static int
+groupcatalog_parse_dir(PyObject *groups, const char* dir, int user)
+{
+    DIR* dp = opendir(dir);
+    struct dirent* ent;
+    if (dp == NULL)
+        return 0;
+    while ((ent = readdir(dp)) != NULL)
+    {
+        char path[PATH_MAX];
+        char name[256];
+        size_t len = strlen(ent->d_name);
+        PyObject *g;
+        if (len < 5 || strcmp(ent->d_name + len - 4, ".txt") != 0)
+            continue;
+        snprintf(name, sizeof(name), "%.*s", (int)(len - 4), ent->d_name);
+        snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+        g = groupcatalog_parse(path, name, user);
+        if (g == NULL)
+        {
+            /* Unreadable files are skipped like in LIKWID */
+            PyErr_Clear();
+            continue;
+        }
+        /* User groups override the system groups */
+        if (PyDict_SetItemString(groups, name, g) < 0)
+        {
+            Py_DECREF(g);
+            closedir(dp);
+            return -1;
+        }
+        Py_DECREF(g);
+    }
+    closedir(dp);
+    return 0;
+}
+
+/* Return the cached catalog (borrowed reference) or NULL with exception set */
+static PyObject *
+groupcatalog_get(void)
+{
+    char sysdir[PATH_MAX], userdir[PATH_MAX];
+    const char* home = getenv("HOME");
+    const char* shortname;
+    PyObject *stamp, *groups, *sorted, *keys;
+    Py_ssize_t i;
+
+    need_topology();
+    need_config();
+    if (cpuinfo == NULL || configfile == NULL || configfile->groupPath == NULL)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Cannot determine the architecture or the group path");
+        return NULL;
+    }
+    shortname = cpuinfo->short_name;
+    snprintf(sysdir, sizeof(sysdir), "%s/%s", configfile->groupPath, shortname);
+    userdir[0] = '\0';
+    if (home != NULL)
+        snprintf(userdir, sizeof(userdir), "%s/.likwid/groups/%s", home, shortname);
+
+    stamp = PyList_New(0);
+    if (stamp == NULL || groupcatalog_stamp_dir(stamp, sysdir) < 0 ||
+        (userdir[0] && groupcatalog_stamp_dir(stamp, userdir) < 0))
+    {
+        Py_XDECREF(stamp);
+        return NULL;
+    }
+    if (groupcatalog.catalog != NULL &&
+        groupcatalog_same(groupcatalog.shortname, shortname) &&
+        groupcatalog_same(groupcatalog.grouppath, configfile->groupPath) &&
+        groupcatalog_same(groupcatalog.userpath, userdir) &&
+        PyObject_RichCompareBool(groupcatalog.stamp, stamp, Py_EQ) == 1)
+    {
+        Py_DECREF(stamp);
+        return groupcatalog.catalog;
+    }
+
+    groups = PyDict_New();
+    if (groups == NULL || groupcatalog_parse_dir(groups, sysdir, 0) < 0 ||
+        (userdir[0] && groupcatalog_parse_dir(groups, userdir, 1) < 0))
+    {
+        Py_XDECREF(groups);
+        Py_DECREF(stamp);
+        return NULL;
+    }
+    /* Sorted by group name */
+    keys = PyDict_Keys(groups);
+    sorted = PyDict_New();
+    if (keys == NULL || sorted == NULL || PyList_Sort(keys) < 0)
+        goto error;
+    for (i = 0; i < PyList_GET_SIZE(keys); i++)
+    {
+        PyObject *k = PyList_GET_ITEM(keys, i);
+        if (PyDict_SetItem(sorted, k, PyDict_GetItem(groups, k)) < 0)
+            goto error;
+    }
+    groupcatalog_clear();
+    groupcatalog.catalog = PyDictProxy_New(sorted);
+    if (groupcatalog.catalog == NULL)
+        goto error;
+    groupcatalog.shortname = strdup(shortname);
+    groupcatalog.grouppath = strdup(configfile->groupPath);
+    groupcatalog.userpath = strdup(userdir);
+    groupcatalog.stamp = stamp;
+    Py_DECREF(keys);
+    Py_DECREF(sorted);
+    Py_DECREF(groups);
+    return groupcatalog.catalog;
+error:
+    Py_XDECREF(keys);
+    Py_XDECREF(sorted);
+    Py_DECREF(groups);
+    Py_DECREF(stamp);
+    return NULL;
+}
+
+static PyObject *
+likwid_getgroupcatalog(PyObject *self, PyObject *args)
+{
+    PyObject *catalog = groupcatalog_get();
+    Py_XINCREF(catalog);
+    return catalog;
+}
+
+static PyObject *
+likwid_getGroups(PyObject *self, PyObject *args)
+{
+    int i, ret;
+    char** tmp, **infos, **longs;
+    PyObject *l, *catalog;
+    catalog = groupcatalog_get();
+    if (catalog == NULL)
+        return NULL;
+    if (PyObject_Length(catalog) > 0)
+    {
+        PyObject *values = PyMapping_Values(catalog);
+        if (values == NULL)
+            return NULL;
+        l = PyList_New(PyList_GET_SIZE(values));
+        for (i = 0; l != NULL && i < PyList_GET_SIZE(values); i++)
+        {
+            PyObject *g = PyList_GET_ITEM(values, i);
+            PyObject *d = Py_BuildValue("{s:N,s:N,s:N}",
+                                        "Name", PyMapping_GetItemString(g, "Name"),
+                                        "Info", PyMapping_GetItemString(g, "Info"),
+                                        "Long", PyMapping_GetItemString(g, "Long"));
+            if (d == NULL)
+            {
+                Py_CLEAR(l);
+                break;
+            }
+            PyList_SET_ITEM(l, (Py_ssize_t)i, d);
+        }
+        Py_DECREF(values);
+        return l;
+    }
+    /* No group files found (e.g. groups compiled into the library) */
+    ret = perfmon_getGroups(&tmp, &infos, &longs);
+    if (ret > 0)
+    {
+        l = PyList_New(ret);
+        for(i=0;i<ret;i++)
+        {
+            PyObject *d = PyDict_New();
+            pydict_set(d, "Name", PYSTR(tmp[i]));
+            pydict_set(d, "Info", PYSTR(infos[i]));
+            pydict_set(d, "Long", PYSTR(longs[i]));
+            PyList_SET_ITEM(l, (Py_ssize_t)i, d);
+        }
+        perfmon_returnGroups(ret, tmp, infos, longs);
+    }
+    else
+    {
+        l = PyList_New(0);
+    }
+    return l;
+}
+
+/*
+################################################################################
+# Result aggregation
+################################################################################
+*/
+
+/* Index map from result columns (hardware threads) to topological domains.
+ * Maps are cached per level and CPU list until the topology is finalized. */
+/* Scope of a counter: read per hardware thread or once per socket, NUMA
+ * node or last level cache segment */
+enum {
+    AGGREGATE_THREAD = 0,
+    AGGREGATE_SOCKET,
+    AGGREGATE_NUMA,
+    AGGREGATE_CACHE,
+    AGGREGATE_NSCOPES
+};
+
+static const char* aggregate_scopelevels[] = {NULL, "socket", "numa", "cache"};
+
+/* Columns grouped by the unit that reads a shared counter */
+typedef struct {
+    int* unit;       /* unit index of each column */
+    int* rep;        /* 1 if the column is the first column of its unit */
+    int nunits;      /* 0 if not built yet, -1 if not available */
+} AggregateUnits;
+
+typedef struct {
+    int ncols;
+    int ndomains;
+    int* domain;     /* domain index of each column */
+    HWThread** hw;   /* hardware thread of each column */
+    AggregateUnits units[AGGREGATE_NSCOPES];
+    PyObject* keys;  /* sorted list of domain keys */
+} AggregateMap;
+
+static const char* aggregate_levels[] = {"core", "socket", "numa", "cache", "coretype", NULL};
+
+static void
+aggregate_map_release(AggregateMap* map)
+{
+    int i;
+    free(map->domain);
+    free(map->hw);
+    for (i = 0; i < AGGREGATE_NSCOPES; i++)
+    {
+        free(map->units[i].unit);
+        free(map->units[i].rep);
+    }
+    Py_XDECREF(map->keys);
+    free(map);
+}
+
+static void
+aggregate_map_free(PyObject* capsule)
+{
+    AggregateMap* map = PyCapsule_GetPointer(capsule, "pylikwid.aggregatemap");
+    if (map != NULL)
+        aggregate_map_release(map);
+}
+
+/* Scope of the register types in the counter maps of LIKWID, by the
+ * counter name prefix. LIKWID reads the core counters (PMC, FIXC, TMP) on
+ * each hardware thread and the others only on the thread that holds the
+ * lock of their unit: the L3 counters of AMD (CPMC) per last level cache
+ * segment, the data fabric counters of AMD (DFC) per NUMA node and all
+ * other Uncore boxes and RAPL once per socket. The public API has no query
+ * for the register type of a counter. */
+static const struct {
+    const char* prefix;
+    int scope;
+} aggregate_counterscopes[] = {
+    {"PMC", AGGREGATE_THREAD},
+    {"FIXC", AGGREGATE_THREAD},
+    {"TMP", AGGREGATE_THREAD},
+    {"CPMC", AGGREGATE_CACHE},
+    {"DFC", AGGREGATE_NUMA},
+};
+
+static int
+aggregate_counterscope(const char* counter)
+{
+    size_t i;
+    if (counter == NULL)
+        return AGGREGATE_THREAD;
+    for (i = 0; i < sizeof(aggregate_counterscopes) / sizeof(aggregate_counterscopes[0]); i++)
+    {
+        const char* prefix = aggregate_counterscopes[i].prefix;
+        if (strncmp(counter, prefix, strlen(prefix)) == 0)
+            return aggregate_counterscopes[i].scope;
+    }
+    return AGGREGATE_SOCKET;
+}
+
+/* Domain key of a CPU for the level or NULL with exception set */
+static PyObject *
+aggregate_key(const char* level, HWThread* hw)
+{
+    int i, j;
+    if (strcmp(level, "core") == 0)
+        return Py_BuildValue("(II)", hw->packageId, hw->coreId);
+    if (strcmp(level, "socket") == 0)
+        return PyLong_FromUnsignedLong(hw->packageId);
+    if (strcmp(level, "coretype") == 0)
+    {
+        int type = coretype_of((int)hw->apicId);
+        if (type != CORETYPE_NONE)
+            return PyUnicode_FromString(coretype_names[type]);
+        PyErr_Format(PyExc_ValueError, "CPU %u has no core type, the CPU is not hybrid", hw->apicId);
+        return NULL;
+    }
+    if (strcmp(level, "numa") == 0)
+    {
+        for (i = 0; numainfo != NULL && i < (int)numainfo->numberOfNodes; i++)
+            for (j = 0; j < (int)numainfo->nodes[i].numberOfProcessors; j++)
+                if (numainfo->nodes[i].processors[j] == hw->apicId)
+                    return PyLong_FromUnsignedLong(numainfo->nodes[i].id);
+    }
+    else
+    {
+        for (i = 0; affinity != NULL && i < (int)affinity->numberOfAffinityDomains; i++)
+        {
+            AffinityDomain* dom = &affinity->domains[i];
+            if (AFFINITY_TAG(dom)[0] != 'C')
+                continue;
+            for (j = 0; j < (int)dom->numberOfProcessors; j++)
+                if (dom->processorList[j] == (int)hw->apicId)
+                    return PyLong_FromLong(strtol(AFFINITY_TAG(dom) + 1, NULL, 10));
+        }
+    }
+    PyErr_Format(PyExc_ValueError, "CPU %u is not part of a %s domain", hw->apicId, level);
+    return NULL;
+}
+
+static AggregateMap *
+aggregate_build_map(const char* level, const int* cpus, int ncols)
+{
+    AggregateMap* map = calloc(1, sizeof(AggregateMap));
+    PyObject *index = NULL, *colkeys = NULL;
+    int c, i;
+
+    if (map == NULL)
+    {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    map->ncols = ncols;
+    map->domain = malloc(ncols * sizeof(int));
+    map->hw = malloc(ncols * sizeof(HWThread*));
+    index = PyDict_New();
+    colkeys = PyList_New(ncols);
+    if (map->domain == NULL || map->hw == NULL)
+        PyErr_NoMemory();
+    if (PyErr_Occurred() || index == NULL || colkeys == NULL)
+        goto error;
+    for (c = 0; c < ncols; c++)
+    {
+        HWThread* hw = NULL;
+        PyObject *key;
+        for (i = 0; i < (int)cputopo->numHWThreads; i++)
+        {
+            if ((int)cputopo->threadPool[i].apicId == cpus[c])
+            {
+                hw = &cputopo->threadPool[i];
+                break;
+            }
+        }
+        if (hw == NULL)
+        {
+            PyErr_Format(PyExc_ValueError, "CPU %d is not part of the system topology", cpus[c]);
+            goto error;
+        }
+        map->hw[c] = hw;
+        key = aggregate_key(level, hw);
+        if (key == NULL)
+            goto error;
+        PyList_SET_ITEM(colkeys, c, key);
+        if (PyDict_SetItem(index, key, Py_None) < 0)
+            goto error;
+    }
+    map->keys = PyDict_Keys(index);
+    if (map->keys == NULL || PyList_Sort(map->keys) < 0)
+        goto error;
+    map->ndomains = (int)PyList_GET_SIZE(map->keys);
+    PyDict_Clear(index);
+    for (i = 0; i < map->ndomains; i++)
+    {
+        PyObject* idx = PyLong_FromLong(i);
+        if (idx == NULL || PyDict_SetItem(index, PyList_GET_ITEM(map->keys, i), idx) < 0)
+        {
+            Py_XDECREF(idx);
+            goto error;
+        }
+        Py_DECREF(idx);
+    }
+    for (c = 0; c < ncols; c++)
+        map->domain[c] = (int)PyLong_AsLong(PyDict_GetItem(index, PyList_GET_ITEM(colkeys, c)));
+    Py_DECREF(index);
+    Py_DECREF(colkeys);
+    return map;
+error:
+    Py_XDECREF(index);
+    Py_XDECREF(colkeys);
+    aggregate_map_release(map);
+    return NULL;
+}
+
+/* Scope given for a row: True for socket counters or the name of the unit */
+static int
+aggregate_scopearg(PyObject* obj)
+{
+    int i;
+    if (PyUnicode_Check(obj))
+    {
+        const char* name = PyUnicode_AsUTF8(obj);
+        if (name == NULL)
+            return -1;
+        for (i = AGGREGATE_SOCKET; i < AGGREGATE_NSCOPES; i++)
+            if (strcmp(name, aggregate_scopelevels[i]) == 0)
+                return i;
+        PyErr_Format(PyExc_ValueError, "Invalid uncore scope '%s', use socket, numa or cache", name);
+        return -1;
+    }
+    i = PyObject_IsTrue(obj);
+    if (i < 0)
+        return -1;
+    return (i ? AGGREGATE_SOCKET : AGGREGATE_THREAD);
+}
+
+/* Units of a shared counter scope, built on first use. Falls back to the
+ * sockets if the NUMA or cache domains are not available. */
+static AggregateUnits *
+aggregate_units(AggregateMap* map, int scope)
+{
+    AggregateUnits* u = &map->units[scope];
+    PyObject* index;
+    int c;
+    if (u->nunits > 0)
+        return u;
+    if (u->nunits < 0)
+        return aggregate_units(map, AGGREGATE_SOCKET);
+    if ((scope == AGGREGATE_NUMA && need_numa() < 0) ||
+        (scope == AGGREGATE_CACHE && need_affinity() < 0))
+    {
+        u->nunits = -1;
+        return aggregate_units(map, AGGREGATE_SOCKET);
+    }
+    u->unit = malloc(map->ncols * sizeof(int));
+    u->rep = calloc(map->ncols, sizeof(int));
+    index = PyDict_New();
+    if (u->unit == NULL || u->rep == NULL || index == NULL)
+    {
+        free(u->unit);
+        free(u->rep);
+        u->unit = u->rep = NULL;
+        Py_XDECREF(index);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    for (c = 0; c < map->ncols; c++)
+    {
+        PyObject *key = aggregate_key(aggregate_scopelevels[scope], map->hw[c]);
+        PyObject *idx = (key != NULL ? PyDict_GetItemWithError(index, key) : NULL);
+        if (idx != NULL)
+        {
+            u->unit[c] = (int)PyLong_AsLong(idx);
+        }
+        else if (key != NULL && !PyErr_Occurred())
+        {
+            idx = PyLong_FromLong(u->nunits);
+            if (idx == NULL || PyDict_SetItem(index, key, idx) < 0)
+            {
+                Py_XDECREF(idx);
+                Py_DECREF(key);
+                break;
+            }
+            Py_DECREF(idx);
+            u->rep[c] = 1;
+            u->unit[c] = u->nunits++;
+        }
+        Py_XDECREF(key);
+        if (PyErr_Occurred())
+            break;
+    }
+    Py_DECREF(index);
+    if (c < map->ncols)
+    {
+        free(u->unit);
+        free(u->rep);
+        u->unit = u->rep = NULL;
+        u->nunits = 0;
+        if (scope == AGGREGATE_SOCKET)
+            return NULL;
+        /* A CPU outside of the NUMA or cache domains */
+        PyErr_Clear();
+        u->nunits = -1;
+        return aggregate_units(map, AGGREGATE_SOCKET);
+    }
+    return u;
+}
+
+/* Cached map for level and CPU list (borrowed) or NULL with exception set */
+static AggregateMap *
+aggregate_get_map(const char* level, const int* cpus, int ncols)
+{
+    PyObject *key, *capsule, *cpukey;
+    AggregateMap* map;
+    int c;
+
+    if (need_topology() < 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Cannot initialize topology module");
+        return NULL;
+    }
+    if ((strcmp(level, "numa") == 0 && need_numa() < 0) ||
+        (strcmp(level, "cache") == 0 && need_affinity() < 0))
+    {
+        PyErr_Format(PyExc_RuntimeError, "Cannot initialize the modules for level %s", level);
+        return NULL;
+    }
+    /* Drops the cached maps if the core types changed */
+    coretype_load();
+    if (aggregate_maps == NULL)
+    {
+        aggregate_maps = PyDict_New();
+        if (aggregate_maps == NULL)
+            return NULL;
+    }
+    cpukey = PyTuple_New(ncols);
+    if (cpukey == NULL)
+        return NULL;
+    for (c = 0; c < ncols; c++)
+    {
+        PyObject* v = PyLong_FromLong(cpus[c]);
+        if (v == NULL)
+        {
+            Py_DECREF(cpukey);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(cpukey, c, v);
+    }
+    key = Py_BuildValue("(sN)", level, cpukey);
+    if (key == NULL)
+        return NULL;
+    capsule = PyDict_GetItem(aggregate_maps, key);
+    if (capsule != NULL)
+    {
+        Py_DECREF(key);
+        return PyCapsule_GetPointer(capsule, "pylikwid.aggregatemap");
+    }
+    map = aggregate_build_map(level, cpus, ncols);
+    if (map == NULL)
+    {
+        Py_DECREF(key);
+        return NULL;
+    }
+    capsule = PyCapsule_New(map, "pylikwid.aggregatemap", aggregate_map_free);
+    if (capsule == NULL || PyDict_SetItem(aggregate_maps, key, capsule) < 0)
+    {
+        if (capsule == NULL)
+            aggregate_map_release(map);
+        Py_XDECREF(capsule);
+        Py_DECREF(key);
+        return NULL;
+    }
+    Py_DECREF(capsule);
+    Py_DECREF(key);
+    return map;
+}
+
+/* Aggregate one row of per-thread values into out[ndomains] */
+static void
+aggregate_row(AggregateMap* map, const double* row, AggregateUnits* units, int op, double* out, double* work)
+{
+    int c, d;
+    int* count = (int*)work;
+    double* smax = work + map->ndomains;
+    for (d = 0; d < map->ndomains; d++)
+    {
+        out[d] = (op == 2 ? -INFINITY : 0.0);
+        count[d] = 0;
+    }
+    if (units != NULL)
+    {
+        /* One value per unit: the reading of the thread that owned the
+         * unit counters, the other threads report 0 or a copy of it */
+        for (d = 0; d < units->nunits; d++)
+            smax[d] = -INFINITY;
+        for (c = 0; c < map->ncols; c++)
+            if (row[c] > smax[units->unit[c]])
+                smax[units->unit[c]] = row[c];
+        for (c = 0; c < map->ncols; c++)
+        {
+            double v;
+            if (!units->rep[c])
+                continue;
+            v = smax[units->unit[c]];
+            d = map->domain[c];
+            if (op == 2)
+                out[d] = (v > out[d] ? v : out[d]);
+            else
+                out[d] += v;
+            count[d]++;
+        }
+    }
+    else
+    {
+        for (c = 0; c < map->ncols; c++)
+        {
+            d = map->domain[c];
+            if (op == 2)
+                out[d] = (row[c] > out[d] ? row[c] : out[d]);
+            else
+                out[d] += row[c];
+            count[d]++;
+        }
+    }
+    for (d = 0; d < map->ndomains; d++)
+    {
+        if (op == 1)
+            out[d] = (count[d] > 0 ? out[d] / count[d] : NAN);
+        else if (op == 2 && count[d] == 0)
+            out[d] = NAN;
+    }
+}
+
+static PyObject *
+likwid_aggregate(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"matrix", "level", "op", "cpus", "gid", "uncore", NULL};
+    static const char* ops[] = {"sum", "mean", "max", NULL};
+    PyObject *matrix = Py_None, *pycpus = Py_None, *pyuncore = Py_None;
+    PyObject *rows = NULL, *result = NULL;
+    const char *level = "socket", *opname = "sum";
+    int gid = -1, op, nrows, ncols = 0, r, c, d, twod = 1;
+    int *cpus = NULL, *uncore = NULL;
+    double *values = NULL, *out = NULL, *work = NULL;
+    AggregateMap* map;
+    PyCpuList cpulist;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|OssOiO", kwlist, &matrix, &level, &opname,
+                                     &pycpus, &gid, &pyuncore))
+        return NULL;
+    for (r = 0; aggregate_levels[r] != NULL && strcmp(aggregate_levels[r], level) != 0; r++);
+    if (aggregate_levels[r] == NULL)
+    {
+        PyErr_Format(PyExc_ValueError, "Unknown level '%s', valid are core, socket, numa, cache and coretype", level);
+        return NULL;
+    }
+    for (op = 0; ops[op] != NULL && strcmp(ops[op], opname) != 0; op++);
+    if (ops[op] == NULL)
+    {
+        PyErr_Format(PyExc_ValueError, "Unknown operation '%s', valid are sum, mean and max", opname);
+        return NULL;
+    }
+
+    /* Columns */
+    cpulist.cpus = NULL;
+    cpulist.owned = 0;
+    cpulist.view.obj = NULL;
+    if (pycpus != Py_None)
+    {
+        ncols = cpulist_from_object(pycpus, &cpulist);
+        if (ncols < 0)
+            return NULL;
+        cpus = cpulist.cpus;
+    }
+    else if (perfmon_initialized && perfmon_cpus != NULL)
+    {
+        ncols = perfmon_ncpus;
+        cpus = perfmon_cpus;
+    }
+    else
+    {
+        PyErr_SetString(PyExc_ValueError, "cpus is required if the perfmon module is not initialized");
+        return NULL;
+    }
+    if (ncols == 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "CPU list is empty");
+        goto done;
+    }
+
+    /* Rows, either the given matrix or the current results of group gid */
+    if (matrix == Py_None)
+    {
+        if (gid < 0 || !perfmon_initialized)
+        {
+            PyErr_SetString(PyExc_ValueError, "matrix or the gid of an initialized group is required");
+            goto done;
+        }
+        nrows = perfmon_getNumberOfEvents(gid);
+        if (nrows < 0 || perfmon_getNumberOfThreads() != ncols)
+        {
+            PyErr_Format(PyExc_ValueError, "No results for group %d and %d threads", gid, ncols);
+            goto done;
+        }
+        values = malloc(((size_t)nrows * ncols + 1) * sizeof(double));
+        if (values == NULL)
+        {
+            PyErr_NoMemory();
+            goto done;
+        }
+        for (r = 0; r < nrows; r++)
+            for (c = 0; c < ncols; c++)
+                values[(size_t)r * ncols + c] = perfmon_getResult(gid, r, c);
+    }
+    else
+    {
+        rows = PySequence_Fast(matrix, "matrix must be a sequence");
+        if (rows == NULL)
+            goto done;
+        nrows = (int)PySequence_Fast_GET_SIZE(rows);
+        if (nrows > 0 && !PySequence_Check(PySequence_Fast_GET_ITEM(rows, 0)))
+        {
+            /* One row of per-thread values */
+            PyObject* tmp = Py_BuildValue("(O)", rows);
+            Py_DECREF(rows);
+            rows = tmp;
+            nrows = 1;
+            twod = 0;
+            if (rows == NULL)
+                goto done;
+        }
+        values = malloc(((size_t)nrows * ncols + 1) * sizeof(double));
+        if (values == NULL)
+        {
+            PyErr_NoMemory();
+            goto done;
+        }
+        for (r = 0; r < nrows; r++)
+        {
+            PyObject* row = PySequence_Fast(PySequence_Fast_GET_ITEM(rows, r), "matrix rows must be sequences");
+            if (row == NULL)
+                goto done;
+            if (PySequence_Fast_GET_SIZE(row) != ncols)
+            {
+                PyErr_Format(PyExc_ValueError, "Row %d has %zd values for %d CPUs", r,
+                             PySequence_Fast_GET_SIZE(row), ncols);
+                Py_DECREF(row);
+                goto done;
+            }
+            for (c = 0; c < ncols; c++)
+                values[(size_t)r * ncols + c] = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(row, c));
+            Py_DECREF(row);
+            if (PyErr_Occurred())
+                goto done;
+        }
+    }
+
+    /* Scope of the rows, from the counter names of group gid or given */
+    uncore = calloc(nrows + 1, sizeof(int));
+    if (uncore == NULL)
+    {
+        PyErr_NoMemory();
+        goto done;
+    }
+    if (pyuncore == Py_None)
+    {
+        if (gid >= 0 && perfmon_initialized)
+            for (r = 0; r < nrows; r++)
+                uncore[r] = aggregate_counterscope(perfmon_getCounterName(gid, r));
+    }
+    else if (PyUnicode_Check(pyuncore) || !PySequence_Check(pyuncore))
+    {
+        int u = aggregate_scopearg(pyuncore);
+        if (u < 0)
+            goto done;
+        for (r = 0; r < nrows; r++)
+            uncore[r] = u;
+    }
+    else
+    {
+        if (PySequence_Size(pyuncore) != nrows)
+        {
+            PyErr_Format(PyExc_ValueError, "uncore must have %d entries", nrows);
+            goto done;
+        }
+        for (r = 0; r < nrows; r++)
+        {
+            PyObject* u = PySequence_GetItem(pyuncore, r);
+            uncore[r] = (u != NULL ? aggregate_scopearg(u) : -1);
+            Py_XDECREF(u);
+            if (uncore[r] < 0)
+                goto done;
+        }
+    }
+
+    map = aggregate_get_map(level, cpus, ncols);
+    if (map == NULL)
+        goto done;
+    out = malloc(((size_t)nrows * map->ndomains + 1) * sizeof(double));
+    /* At most one unit per column */
+    work = malloc((size_t)(map->ndomains + ncols + 1) * sizeof(double));
+    if (out == NULL || work == NULL)
+    {
+        PyErr_NoMemory();
+        goto done;
+    }
+    for (r = 0; r < nrows; r++)
+    {
+        AggregateUnits* units = NULL;
+        if (uncore[r] != AGGREGATE_THREAD)
+        {
+            units = aggregate_units(map, uncore[r]);
+            if (units == NULL)
+                goto done;
+        }
+        aggregate_row(map, &values[(size_t)r * ncols], units, op, &out[(size_t)r * map->ndomains], work);
+    }
+
+    result = PyDict_New();
+    for (d = 0; result != NULL && d < map->ndomains; d++)
+    {
+        PyObject* v;
+        if (twod)
+        {
+            v = PyList_New(nrows);
+            for (r = 0; v != NULL && r < nrows; r++)
+                PyList_SET_ITEM(v, r, PyFloat_FromDouble(out[(size_t)r * map->ndomains + d]));
+        }
+        else
+        {
+            v = PyFloat_FromDouble(out[d]);
+        }
+        if (v == NULL || PyDict_SetItem(result, PyList_GET_ITEM(map->keys, d), v) < 0)
+            Py_CLEAR(result);
+        Py_XDECREF(v);
+    }
+done:
+    Py_XDECREF(rows);
+    free(values);
+    free(uncore);
+    free(out);
+    free(work);
+    cpulist_release(&cpulist);
+    return result;
+}
+
+/*
+################################################################################
+# Perfmon MarkerAPI related functions
+################################################################################
+*/
+
+/* Region energy of the file read by markerreadfile() */
+static PyObject* markerfile_energy = NULL;
+
+static PyObject *
+likwid_readMarkerFile(PyObject *self, PyObject *args)
+{
+    const char* filename;
+    if (PyArg_ParseTuple(args, "s", &filename))
+    {
+        perfmon_readMarkerFile(filename);
+        Py_XSETREF(markerfile_energy, markerenergy_load(filename));
+        if (markerfile_energy == NULL)
+            return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+/* Energy of region r of the file read by markerreadfile() or None */
+static PyObject *
+markerfile_regionenergy(int r)
+{
+    PyObject *key, *energy = NULL;
+    char* tag = perfmon_getTagOfRegion(r);
+    if (markerfile_energy == NULL || tag == NULL)
+        return pynone();
+    key = Py_BuildValue("(si)", tag, perfmon_getGroupOfRegion(r));
+    if (key == NULL)
+        return NULL;
+    energy = PyDict_GetItemWithError(markerfile_energy, key);
+    Py_DECREF(key);
+    if (energy == NULL)
+        return (PyErr_Occurred() ? NULL : pynone());
+    Py_INCREF(energy);
+    return energy;
+}
+
+static PyObject *
+likwid_markerRegionEnergy(PyObject *self, PyObject *args)
+{
+    int r;
+    if (!PyArg_ParseTuple(args, "i", &r))
+        return NULL;
+    return markerfile_regionenergy(r);
+}
+
+static PyObject *
+likwid_markerNumRegions(PyObject *self, PyObject *args)
+{
+    return PYINT(perfmon_getNumberOfRegions());
+}
+
+static PyObject *
+likwid_markerRegionGroup(PyObject *self, PyObject *args)
+{
+    int r = -1;
+    if (PyArg_ParseTuple(args, "i", &r))
+    {
+        r = perfmon_getGroupOfRegion(r);
+    }
+    return PYINT(r);
+}
+
+static PyObject *
+likwid_markerRegionTag(PyObject *self, PyObject *args)
+{
+    int r = -1;
+    char* tag = NULL;
+    if (PyArg_ParseTuple(args, "i", &r))
+    {
+        tag = perfmon_getTagOfRegion(r);
+    }
+    return PYSTR(tag);
+}
+
+static PyObject *
+likwid_markerRegionEvents(PyObject *self, PyObject *args)
+{
+    int r = -1;
+    if (PyArg_ParseTuple(args, "i", &r))
+    {
+        r = perfmon_getEventsOfRegion(r);
+    }
+    return PYINT(r);
+}
+
+static PyObject *
+likwid_markerRegionThreads(PyObject *self, PyObject *args)
+{
+    int r = -1;
+    if (PyArg_ParseTuple(args, "i", &r))
+    {
+        r = perfmon_getThreadsOfRegion(r);
+    }
+    return PYINT(r);
+}
+
+static PyObject *
+likwid_markerRegionCpulist(PyObject *self, PyObject *args)
+{
+    int r, ret = 0;
+    int* cpulist;
+    if (!PyArg_ParseTuple(args, "i", &r))
+    {
+        return PyList_New(0);
+    }
+    if (need_topology() < 0)
+    {
+        return PyList_New(0);
+    }
+    cpulist = (int*)malloc(cputopo->numHWThreads * sizeof(int));
+    if (cpulist == NULL)
+    {
+        return PyList_New(0);
+    }
+    ret = perfmon_getCpulistOfRegion(r, cputopo->numHWThreads, cpulist);
+    PyObject *l = PyList_New(ret);
+    for(r=0; r<ret;r++)
+    {
+        PyList_SET_ITEM(l, (Py_ssize_t)r, PYINT(cpulist[r]));
+    }
+    free(cpulist);
+    return l;
+}
+
+static PyObject *
+likwid_markerRegionTime(PyObject *self, PyObject *args)
+{
+    int r, t;
+    PyArg_ParseTuple(args, "ii", &r, &t);
+    return Py_BuildValue("d", perfmon_getTimeOfRegion(r, t));
+}
+
+static PyObject *
+likwid_markerRegionCount(PyObject *self, PyObject *args)
+{
+    int r, t;
+    PyArg_ParseTuple(args, "ii", &r, &t);
+    return PYINT(perfmon_getCountOfRegion(r, t));
+}
+
+static PyObject *
+likwid_markerRegionResult(PyObject *self, PyObject *args)
+{
+    int r, t, e;
+    PyArg_ParseTuple(args, "iii", &r, &e, &t);
+    return Py_BuildValue("d", perfmon_getResultOfRegionThread(r, e, t));
+}
+
+static PyObject *
+likwid_markerRegionMetric(PyObject *self, PyObject *args)
+{
+    int r, t, m;
+    PyArg_ParseTuple(args, "iii", &r, &m, &t);
+    return Py_BuildValue("d", perfmon_getMetricOfRegionThread(r, m, t));
+}
+
+/*
+################################################################################
+# Streaming Marker API result file reader
+################################################################################
+*/
+
+/* Iterates over the regions of a Marker API result file without reading it
+ * into the perfmon module. The file is mapped read-only, the pages already
+ * parsed are dropped from the mapping every MARKERFILE_DROP bytes, so the
+ * memory use does not grow with the file size. File format:
+ *   <threads> <regions> <groups>
+ *   <regionId>:<tag>-<groupId>            (one line per region)
+ *   <regionId> <groupId> <cpu> <count> <time> <nevents> <event>...
+ *                                         (one line per region and thread) */
+
+#define MARKERFILE_DROP (32UL << 20)
+#define MARKERFILE_TOKEN 64
+
+typedef struct {
+    PyObject_HEAD
+    char* base;
+    size_t size;
+    size_t pos;
+    size_t dropped;
+    long lineno;
+    int threads;
+    int regions;
+    int groups;
+    PyObject* tags;       /* tag of each region ID without the group suffix */
+    PyObject* tagfilter;  /* set of tags or NULL */
+    PyObject* groupfilter;/* set of group IDs or NULL */
+    PyObject* energy;     /* region energy by (tag, group) */
+} MarkerFileObject;
+
+static PyStructSequence_Field markerregion_fields[] = {
+    {"id", "Region ID in the file"},
+    {"tag", "Region tag"},
+    {"group", "Group ID"},
+    {"cpus", "List of CPUs that executed the region"},
+    {"counts", "Call count per thread"},
+    {"times", "Accumulated time per thread"},
+    {"events", "Event results per thread (list of lists)"},
+    {"energy", "Region energy (dict with seconds, joules and watts per domain) or None"},
+    {NULL, NULL}
+};
+
+static PyStructSequence_Desc markerregion_desc = {
+    "pylikwid.MarkerRegion",
+    "Results of one region from a Marker API result file.",
+    markerregion_fields,
+    7
+};
+
+static PyTypeObject MarkerRegionType;
+
+/* Next whitespace separated token of [*p, end) copied to buf */
+static int
+markerfile_token(const char** p, const char* end, char* buf)
+{
+    const char* s = *p;
+    size_t n;
+    while (s < end && (*s == ' ' || *s == '\t' || *s == '\r'))
+        s++;
+    for (n = 0; s + n < end && s[n] != ' ' && s[n] != '\t' && s[n] != '\r'; n++);
+    if (n == 0 || n >= MARKERFILE_TOKEN)
+        return -1;
+    memcpy(buf, s, n);
+    buf[n] = '\0';
+    *p = s + n;
+    return 0;
+}
+
+static int
+markerfile_long(const char** p, const char* end, long* value)
+{
+    char buf[MARKERFILE_TOKEN], *e;
+    if (markerfile_token(p, end, buf) < 0)
+        return -1;
+    *value = strtol(buf, &e, 10);
+    return (*e == '\0' ? 0 : -1);
+}
+
+static int
+markerfile_double(const char** p, const char* end, double* value)
+{
+    char buf[MARKERFILE_TOKEN], *e;
+    if (markerfile_token(p, end, buf) < 0)
+        return -1;
+    *value = strtod(buf, &e);
+    return (*e == '\0' ? 0 : -1);
+}
+
+/* Current line as [*line, *lineend), advances the position */
+static int
+markerfile_nextline(MarkerFileObject* self, const char** line, const char** lineend)
+{
+    const char* s = self->base + self->pos;
+    const char* e;
+    while (self->pos < self->size && (*s == '\n'))
+    {
+        s++;
+        self->pos++;
+        self->lineno++;
+    }
+    if (self->pos >= self->size)
+        return -1;
+    e = memchr(s, '\n', self->size - self->pos);
+    if (e == NULL)
+        e = self->base + self->size;
+    *line = s;
+    *lineend = e;
+    self->pos = (e - self->base) + (e < self->base + self->size ? 1 : 0);
+    self->lineno++;
+    return 0;
+}
+
+/* Region ID of the next data line without consuming it, -1 at the end */
+static long
+markerfile_peek(MarkerFileObject* self)
+{
+    size_t pos = self->pos;
+    long lineno = self->lineno, id = -1;
+    const char *line, *end;
+    if (markerfile_nextline(self, &line, &end) == 0 && markerfile_long(&line, end, &id) < 0)
+        id = -2;
+    self->pos = pos;
+    self->lineno = lineno;
+    return id;
+}
+
+static PyObject *
+markerfile_error(MarkerFileObject* self)
+{
+    PyErr_Format(PyExc_ValueError, "Invalid Marker API result file (line %ld)", self->lineno);
+    return NULL;
+}
+
+static void
+markerfile_unmap(MarkerFileObject* self)
+{
+    if (self->base != NULL)
+    {
+        munmap(self->base, self->size);
+        self->base = NULL;
+    }
+}
+
+static void
+markerfile_dealloc(MarkerFileObject* self)
+{
+    markerfile_unmap(self);
+    Py_XDECREF(self->tags);
+    Py_XDECREF(self->tagfilter);
+    Py_XDECREF(self->groupfilter);
+    Py_XDECREF(self->energy);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject *
+markerfile_iter(PyObject* self)
+{
+    Py_INCREF(self);
+    return self;
+}
+
+static PyObject *
+markerfile_next(MarkerFileObject* self)
+{
+    const char *line, *end;
+    long id, group, cpu, count, nevents, e, nid, ngroup;
+    double time, value;
+    PyObject *region, *tag, *key, *energy;
+    PyObject *cpus = NULL, *counts = NULL, *times = NULL, *events = NULL;
+
+    if (self->base == NULL)
+        return NULL;
+    for (;;)
+    {
+        int match = 1;
+        /* Drop the pages of the parsed part of the file */
+        if (self->pos - self->dropped >= MARKERFILE_DROP)
+        {
+            size_t page = sysconf(_SC_PAGESIZE);
+            size_t upto = self->pos & ~(page - 1);
+            madvise(self->base + self->dropped, upto - self->dropped, MADV_DONTNEED);
+            self->dropped = upto;
+        }
+        if (markerfile_nextline(self, &line, &end) < 0)
+            return NULL;
+        if (markerfile_long(&line, end, &id) < 0 || markerfile_long(&line, end, &group) < 0 ||
+            id < 0 || id >= self->regions)
+            return markerfile_error(self);
+        tag = PyList_GET_ITEM(self->tags, id);
+        if (self->tagfilter != NULL)
+        {
+            match = PySet_Contains(self->tagfilter, tag);
+            if (match < 0)
+                return NULL;
+        }
+        if (match && self->groupfilter != NULL)
+        {
+            PyObject* g = PyLong_FromLong(group);
+            match = (g != NULL ? PySet_Contains(self->groupfilter, g) : -1);
+            Py_XDECREF(g);
+            if (match < 0)
+                return NULL;
+        }
+        if (match)
+            break;
+        /* Skip the other threads of the region */
+        while (markerfile_peek(self) == id)
+            markerfile_nextline(self, &line, &end);
+    }
+
+    cpus = PyList_New(0);
+    counts = PyList_New(0);
+    times = PyList_New(0);
+    events = PyList_New(0);
+    if (cpus == NULL || counts == NULL || times == NULL || events == NULL)
+        goto error;
+    for (;;)
+    {
+        PyObject *row, *v;
+        /* nevents comes from the file, each value needs at least a digit
+         * and a separator, so the line length bounds it */
+        if (markerfile_long(&line, end, &cpu) < 0 || markerfile_long(&line, end, &count) < 0 ||
+            markerfile_double(&line, end, &time) < 0 || markerfile_long(&line, end, &nevents) < 0 ||
+            nevents < 0 || nevents > (end - line + 1) / 2)
+        {
+            markerfile_error(self);
+            goto error;
+        }
+        row = PyList_New(0);
+        if (row == NULL)
+            goto error;
+        for (e = 0; e < nevents; e++)
+        {
+            if (markerfile_double(&line, end, &value) < 0)
+            {
+                Py_DECREF(row);
+                markerfile_error(self);
+                goto error;
+            }
+            v = PyFloat_FromDouble(value);
+            if (v == NULL || PyList_Append(row, v) < 0)
+            {
+                Py_XDECREF(v);
+                Py_DECREF(row);
+                goto error;
+            }
+            Py_DECREF(v);
+        }
+        if (PyList_Append(events, row) < 0)
+        {
+            Py_DECREF(row);
+            goto error;
+        }
+        Py_DECREF(row);
+        v = PyLong_FromLong(cpu);
+        if (v == NULL || PyList_Append(cpus, v) < 0)
+        {
+            Py_XDECREF(v);
+            goto error;
+        }
+        Py_DECREF(v);
+        v = PyLong_FromLong(count);
+        if (v == NULL || PyList_Append(counts, v) < 0)
+        {
+            Py_XDECREF(v);
+            goto error;
+        }
+        Py_DECREF(v);
+        v = PyFloat_FromDouble(time);
+        if (v == NULL || PyList_Append(times, v) < 0)
+        {
+            Py_XDECREF(v);
+            goto error;
+        }
+        Py_DECREF(v);
+        if (markerfile_peek(self) != id)
+            break;
+        markerfile_nextline(self, &line, &end);
+        /* region and group ID of the next thread */
+        if (markerfile_long(&line, end, &nid) < 0 || markerfile_long(&line, end, &ngroup) < 0)
+        {
+            markerfile_error(self);
+            goto error;
+        }
+    }
+    key = Py_BuildValue("(Ol)", tag, group);
+    energy = (key != NULL ? PyDict_GetItemWithError(self->energy, key) : NULL);
+    Py_XDECREF(key);
+    if (energy == NULL && PyErr_Occurred())
+        goto error;
+    energy = (energy != NULL ? energy : Py_None);
+    region = PyStructSequence_New(&MarkerRegionType);
+    if (region == NULL)
+        goto error;
+    Py_INCREF(tag);
+    Py_INCREF(energy);
+    PyStructSequence_SET_ITEM(region, 0, PyLong_FromLong(id));
+    PyStructSequence_SET_ITEM(region, 1, tag);
+    PyStructSequence_SET_ITEM(region, 2, PyLong_FromLong(group));
+    PyStructSequence_SET_ITEM(region, 3, cpus);
+    PyStructSequence_SET_ITEM(region, 4, counts);
+    PyStructSequence_SET_ITEM(region, 5, times);
+    PyStructSequence_SET_ITEM(region, 6, events);
+    PyStructSequence_SET_ITEM(region, 7, energy);
+    if (PyErr_Occurred())
+    {
+        Py_DECREF(region);
+        return NULL;
+    }
+    return region;
+error:
+    Py_XDECREF(cpus);
+    Py_XDECREF(counts);
+    Py_XDECREF(times);
+    Py_XDECREF(events);
+    return NULL;
+}
+
+static PyObject *
+markerfile_close(MarkerFileObject* self, PyObject* args)
+{
+    markerfile_unmap(self);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+markerfile_enter(MarkerFileObject* self, PyObject* args)
+{
+    Py_INCREF(self);
+    return (PyObject*)self;
+}
+
+static PyObject *
+markerfile_exit(MarkerFileObject* self, PyObject* args)
+{
+    markerfile_unmap(self);
+    Py_RETURN_FALSE;
+}
+
+static PyMethodDef markerfile_methods[] = {
+    {"close", (PyCFunction)markerfile_close, METH_NOARGS, "Unmap the file."},
+    {"__enter__", (PyCFunction)markerfile_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)markerfile_exit, METH_VARARGS, NULL},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyMemberDef markerfile_members[] = {
+    {"threads", T_INT, offsetof(MarkerFileObject, threads), READONLY, "Number of threads in the file."},
+    {"regions", T_INT, offsetof(MarkerFileObject, regions), READONLY, "Number of regions in the file."},
+    {"groups", T_INT, offsetof(MarkerFileObject, groups), READONLY, "Number of groups in the file."},
+    {"tags", T_OBJECT, offsetof(MarkerFileObject, tags), READONLY, "Tag of each region ID."},
+    {NULL, 0, 0, 0, NULL}
+};
+
+static PyTypeObject MarkerFileType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "pylikwid.MarkerFile",
+    .tp_basicsize = sizeof(MarkerFileObject),
+    .tp_dealloc = (destructor)markerfile_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Iterator over the regions of a Marker API result file, created by pylikwid.markerfileiter().",
+    .tp_iter = markerfile_iter,
+    .tp_iternext = (iternextfunc)markerfile_next,
+    .tp_methods = markerfile_methods,
+    .tp_members = markerfile_members,
+};
+
+/* Set of the filter values or NULL for None */
+static int
+markerfile_filter(PyObject* arg, int isstr, PyObject** filter)
+{
+    *filter = NULL;
+    if (arg == Py_None)
+        return 0;
+    if ((isstr && PyUnicode_Check(arg)) || (!isstr && PyLong_Check(arg)))
+    {
+        *filter = PySet_New(NULL);
+        if (*filter == NULL || PySet_Add(*filter, arg) < 0)
+            return -1;
+        return 0;
+    }
+    *filter = PySet_New(arg);
+    return (*filter != NULL ? 0 : -1);
+}
+
+static PyObject *
+likwid_markerfileiter(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"filename", "tags", "groups", NULL};
+    const char *filename, *line, *end;
+    PyObject *pytags = Py_None, *pygroups = Py_None;
+    MarkerFileObject* reader;
+    struct stat st;
+    long threads, regions, groups, id;
+    int fd, i;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|OO", kwlist, &filename, &pytags, &pygroups))
+        return NULL;
+    reader = PyObject_New(MarkerFileObject, &MarkerFileType);
+    if (reader == NULL)
+        return NULL;
+    reader->base = NULL;
+    reader->size = 0;
+    reader->pos = 0;
+    reader->dropped = 0;
+    reader->lineno = 0;
+    reader->tags = NULL;
+    reader->tagfilter = NULL;
+    reader->groupfilter = NULL;
+    reader->energy = NULL;
+    if (markerfile_filter(pytags, 1, &reader->tagfilter) < 0 ||
+        markerfile_filter(pygroups, 0, &reader->groupfilter) < 0)
+        goto error;
+
+    fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+        if (fd >= 0)
+            close(fd);
+        goto error;
+    }
+    if (st.st_size > 0)
+    {
+        reader->base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (reader->base == MAP_FAILED)
+        {
+            reader->base = NULL;
+            PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+            close(fd);
+            goto error;
+        }
+        reader->size = st.st_size;
+        madvise(reader->base, reader->size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    reader->energy = markerenergy_load(filename);
+    if (reader->energy == NULL)
+        goto error;
+
+    /* Header and region tags */
+    if (markerfile_nextline(reader, &line, &end) < 0 ||
+        markerfile_long(&line, end, &threads) < 0 || markerfile_long(&line, end, &regions) < 0 ||
+        markerfile_long(&line, end, &groups) < 0 || threads < 0 || regions < 0 || groups < 0 ||
+        regions > INT_MAX)
+    {
+        markerfile_error(reader);
+        goto error;
+    }
+    reader->threads = (int)threads;
+    reader->regions = (int)regions;
+    reader->groups = (int)groups;
+    reader->tags = PyList_New(regions);
+    if (reader->tags == NULL)
+        goto error;
+    for (i = 0; i < regions; i++)
+    {
+        const char *colon, *dash, *s;
+        char* e;
+        PyObject* tag;
+        if (markerfile_nextline(reader, &line, &end) < 0)
+        {
+            markerfile_error(reader);
+            goto error;
+        }
+        colon = memchr(line, ':', end - line);
+        id = (colon != NULL ? strtol(line, &e, 10) : -1);
+        if (colon == NULL || e != colon || id < 0 || id >= regions || PyList_GET_ITEM(reader->tags, id) != NULL)
+        {
+            markerfile_error(reader);
+            goto error;
+        }
+        /* Strip the -<groupId> suffix */
+        while (end > colon + 1 && end[-1] == '\r')
+            end--;
+        for (dash = end - 1; dash > colon && *dash != '-'; dash--);
+        for (s = dash + 1; dash > colon && s < end && isdigit((unsigned char)*s); s++);
+        if (dash <= colon || s != end || dash + 1 == end)
+            dash = end;
+        tag = PyUnicode_DecodeUTF8(colon + 1, dash - colon - 1, "replace");
+        if (tag == NULL)
+            goto error;
+        PyList_SET_ITEM(reader->tags, id, tag);
+    }
+    return (PyObject*)reader;
+error:
+    Py_DECREF(reader);
+    return NULL;
+}
+
+/*
+################################################################################
+# Counter-weighted stack sampler
+################################################################################
+*/
+
+/* A native thread wakes up every interval, takes the GIL and reads the
+ * counters of all perfmon CPUs with perfmon_readCountersCpu. The Python
+ * threads that ran since the last sample are located by the CPU and runtime
+ * in /proc/self/task/<tid>/{stat,schedstat}. The counter delta of a CPU
+ * (perfmon_getLastResult) is split between the threads that ran on it by
+ * their runtime and added to the folded stack of each thread. Without an
+ * event, the runtime itself is the weight. Holding the GIL while sampling
+ * keeps LIKWID calls serialized with the rest of the module. */
+
+typedef struct {
+    PyObject* stack;
+    int cpu;
+    double runtime;
+} SamplerThread;
+
+static pthread_t sampler_thread;
+static int sampler_running = 0;
+static int sampler_stopping = 0;
+static double sampler_interval = 0.01;
+static int sampler_gid = -1;
+static int sampler_event = -1;
+static int sampler_lines = 0;
+static int32_t sampler_tid = 0;
+static long sampler_samples = 0;
+static double sampler_unattributed = 0;
+static PyObject* sampler_stacks = NULL;
+static PyObject* sampler_runtimes = NULL;
+
+/* Register a module function with atexit once */
+static int
+register_atexit(PyMethodDef* def, int* registered)
+{
+    PyObject *atexit, *func, *ret;
+    if (*registered)
+        return 0;
+    atexit = PyImport_ImportModule("atexit");
+    func = PyCFunction_New(def, NULL);
+    ret = (atexit && func ? PyObject_CallMethod(atexit, "register", "O", func) : NULL);
+    Py_XDECREF(atexit);
+    Py_XDECREF(func);
+    if (ret == NULL)
+        return -1;
+    Py_DECREF(ret);
+    *registered = 1;
+    return 0;
+}
+
+/* CPU of the last run and total runtime in ns of a thread of this process */
+static int
+sampler_threadstat(long tid, int* cpu, double* runtime)
+{
+    char path[64], buf[1024];
+    char *p, *tok, *save = NULL;
+    unsigned long long utime = 0, stime = 0, ns = 0;
+    int i, fd;
+    ssize_t len;
+    snprintf(path, sizeof(path), "/proc/self/task/%ld/stat", tid);
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0)
+        return -1;
+    buf[len] = '\0';
+    /* The command name may contain spaces, fields are counted after it */
+    p = strrchr(buf, ')');
+    if (p == NULL)
+        return -1;
+    *cpu = -1;
+    for (i = 3, tok = strtok_r(p + 1, " ", &save); tok != NULL; i++, tok = strtok_r(NULL, " ", &save))
+    {
+        if (i == 14)
+            utime = strtoull(tok, NULL, 10);
+        else if (i == 15)
+            stime = strtoull(tok, NULL, 10);
+        else if (i == 39)
+        {
+            *cpu = atoi(tok);
+            break;
+        }
+    }
+    if (*cpu < 0)
+        return -1;
+    snprintf(path, sizeof(path), "/proc/self/task/%ld/schedstat", tid);
+    fd = open(path, O_RDONLY);
+    if (fd >= 0)
+    {
+        len = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        if (len > 0)
+        {
+            buf[len] = '\0';
+            ns = strtoull(buf, NULL, 10);
+        }
+    }
+    /* Kernels without schedstats: clock ticks */
+    if (ns == 0)
+        ns = (utime + stime) * (1000000000ULL / sysconf(_SC_CLK_TCK));
+    *runtime = (double)ns;
+    return 0;
+}
+
+/* Folded stack of a frame object, outermost frame first. NULL on error.
+ * The frames and code objects are read through their Python attributes,
+ * the frame and thread state structs differ between Python versions. */
+static PyObject*
+sampler_foldstack(PyObject* frame)
+{
+    PyObject *frames, *sep, *stack = NULL;
+    frames = PyList_New(0);
+    Py_INCREF(frame);
+    while (frame != NULL && frame != Py_None && frames != NULL)
+    {
+        PyObject* code = PyObject_GetAttrString(frame, "f_code");
+        PyObject* co_name = (code ? PyObject_GetAttrString(code, "co_name") : NULL);
+        PyObject* co_filename = (code ? PyObject_GetAttrString(code, "co_filename") : NULL);
+        PyObject* lineno = (sampler_lines ? PyObject_GetAttrString(frame, "f_lineno") : NULL);
+        PyObject* back = PyObject_GetAttrString(frame, "f_back");
+        PyObject* name = NULL;
+        if (co_name != NULL && co_filename != NULL)
+        {
+            if (sampler_lines)
+                name = PyUnicode_FromFormat("%U (%U:%ld)", co_name, co_filename,
+                                            (lineno && lineno != Py_None ? PyLong_AsLong(lineno) : -1L));
+            else
+                name = PyUnicode_FromFormat("%U (%U)", co_name, co_filename);
+        }
+        Py_XDECREF(code);
+        Py_XDECREF(co_name);
+        Py_XDECREF(co_filename);
+        Py_XDECREF(lineno);
+        Py_DECREF(frame);
+        frame = back;
+        if (pylist_append(frames, name) < 0)
+            Py_CLEAR(frames);
+    }
+    Py_XDECREF(frame);
+    if (frames == NULL || PyErr_Occurred() || PyList_Reverse(frames) < 0)
+    {
+        Py_XDECREF(frames);
+        return NULL;
+    }
+    sep = PyUnicode_FromString(";");
+    if (sep != NULL)
+        stack = PyUnicode_Join(sep, frames);
+    Py_XDECREF(sep);
+    Py_DECREF(frames);
+    return stack;
+}
+
+/* Native thread IDs of the Python threads from the threading module: dict
+ * of ident to native_id */
+static PyObject*
+sampler_nativeids(void)
+{
+    PyObject *threading, *threads, *ids = PyDict_New();
+    Py_ssize_t i;
+    threading = PyImport_ImportModule("threading");
+    threads = (threading ? PyObject_CallMethod(threading, "enumerate", NULL) : NULL);
+    Py_XDECREF(threading);
+    for (i = 0; ids != NULL && threads != NULL && i < PyList_Size(threads); i++)
+    {
+        PyObject* t = PyList_GET_ITEM(threads, i);
+        pydict_setobj(ids, PyObject_GetAttrString(t, "ident"),
+                      PyObject_GetAttrString(t, "native_id"));
+    }
+    Py_XDECREF(threads);
+    PyErr_Clear();
+    return ids;
+}
+
+/* Current frame of each Python thread: dict of ident to frame */
+static PyObject*
+sampler_frames(void)
+{
+    PyObject* sys = PyImport_ImportModule("sys");
+    PyObject* frames = (sys ? PyObject_CallMethod(sys, "_current_frames", NULL) : NULL);
+    Py_XDECREF(sys);
+    return frames;
+}
+
+static void
+sampler_add(PyObject* stack, double weight)
+{
+    PyObject* old = PyDict_GetItem(sampler_stacks, stack);
+    double value = (old != NULL ? PyFloat_AsDouble(old) : 0.0) + weight;
+    Py_INCREF(stack);
+    pydict_setobj(sampler_stacks, stack, PyFloat_FromDouble(value));
+}
+
+/* Take one sample, called with the GIL held */
+static void
+sampler_tick(void)
+{
+    PyObject *ids = NULL, *frames = NULL, *ident, *frame;
+    Py_ssize_t pos = 0;
+    SamplerThread* threads = NULL;
+    double* cpuweight = NULL;
+    double* cpuruntime = NULL;
+    int nthreads = 0, maxthreads = 0;
+    int i, j;
+
+    if (sampler_event >= 0)
+    {
+        cpuweight = calloc(perfmon_ncpus, sizeof(double));
+        cpuruntime = calloc(perfmon_ncpus, sizeof(double));
+        if (cpuweight == NULL || cpuruntime == NULL)
+            goto out;
+        for (i = 0; i < perfmon_ncpus; i++)
+        {
+            if (perfmon_readCountersCpu(perfmon_cpus[i]) == 0)
+                cpuweight[i] = perfmon_getLastResult(sampler_gid, sampler_event, i);
+        }
+    }
+    ids = sampler_nativeids();
+    frames = sampler_frames();
+    if (ids == NULL || frames == NULL || !PyDict_Check(frames))
+        goto out;
+    maxthreads = (int)PyDict_Size(frames);
+    threads = calloc(maxthreads > 0 ? maxthreads : 1, sizeof(SamplerThread));
+    if (threads == NULL)
+        goto out;
+    while (PyDict_Next(frames, &pos, &ident, &frame) && nthreads < maxthreads)
+    {
+        PyObject* id = PyDict_GetItem(ids, ident);
+        long tid = (id != NULL && PyLong_Check(id) ? PyLong_AsLong(id) : -1);
+        PyObject *key, *last;
+        double runtime, prev;
+        int cpu;
+        if (tid <= 0 || tid == sampler_tid || sampler_threadstat(tid, &cpu, &runtime) < 0)
+            continue;
+        key = PyLong_FromLong(tid);
+        if (key == NULL)
+            break;
+        /* A new thread only establishes its runtime baseline */
+        last = PyDict_GetItem(sampler_runtimes, key);
+        prev = (last != NULL ? PyFloat_AsDouble(last) : runtime);
+        pydict_setobj(sampler_runtimes, key, PyFloat_FromDouble(runtime));
+        if (runtime <= prev)
+            continue;
+        threads[nthreads].stack = sampler_foldstack(frame);
+        if (threads[nthreads].stack == NULL)
+        {
+            PyErr_Clear();
+            continue;
+        }
+        threads[nthreads].cpu = cpu;
+        threads[nthreads].runtime = runtime - prev;
+        nthreads++;
+    }
+    if (sampler_event < 0)
+    {
+        for (j = 0; j < nthreads; j++)
+            sampler_add(threads[j].stack, threads[j].runtime);
+    }
+    else
+    {
+        /* Split the counts of each CPU by runtime of the threads on it */
+        for (j = 0; j < nthreads; j++)
+        {
+            for (i = 0; i < perfmon_ncpus && perfmon_cpus[i] != threads[j].cpu; i++);
+            threads[j].cpu = (i < perfmon_ncpus ? i : -1);
+            if (threads[j].cpu >= 0)
+                cpuruntime[i] += threads[j].runtime;
+        }
+        for (j = 0; j < nthreads; j++)
+        {
+            i = threads[j].cpu;
+            if (i >= 0)
+                sampler_add(threads[j].stack, cpuweight[i] * threads[j].runtime / cpuruntime[i]);
+        }
+        for (i = 0; i < perfmon_ncpus; i++)
+        {
+            if (cpuruntime[i] == 0)
+                sampler_unattributed += cpuweight[i];
+        }
+    }
+    sampler_samples++;
+out:
+    for (j = 0; j < nthreads; j++)
+        Py_DECREF(threads[j].stack);
+    free(threads);
+    free(cpuweight);
+    free(cpuruntime);
+    Py_XDECREF(ids);
+    Py_XDECREF(frames);
+    PyErr_Clear();
+}
+
+static void*
+sampler_main(void* arg)
+{
+    struct timespec next;
+    long interval = (long)(sampler_interval * 1e9);
+    (void)arg;
+    sampler_tid = (int32_t)syscall(SYS_gettid);
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (!__atomic_load_n(&sampler_stopping, __ATOMIC_ACQUIRE))
+    {
+        PyGILState_STATE gstate;
+        next.tv_sec += (next.tv_nsec + interval) / 1000000000L;
+        next.tv_nsec = (next.tv_nsec + interval) % 1000000000L;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR);
+        if (__atomic_load_n(&sampler_stopping, __ATOMIC_ACQUIRE))
+            break;
+        gstate = PyGILState_Ensure();
+        if (!__atomic_load_n(&sampler_stopping, __ATOMIC_ACQUIRE))
+            sampler_tick();
+        PyGILState_Release(gstate);
+    }
+    return NULL;
+}
+
+/* Stop the sampler thread, called with the GIL held */
+static void
+sampler_halt(void)
+{
+    if (!sampler_running)
+        return;
+    __atomic_store_n(&sampler_stopping, 1, __ATOMIC_RELEASE);
+    Py_BEGIN_ALLOW_THREADS
+    pthread_join(sampler_thread, NULL);
+    Py_END_ALLOW_THREADS
+    sampler_running = 0;
+}
+
+static PyObject *
+likwid_samplerstop(PyObject *self, PyObject *args)
+{
+    sampler_halt();
+    return Py_BuildValue("{s:l,s:n,s:d}", "samples", sampler_samples,
+                         "stacks", (sampler_stacks ? PyDict_Size(sampler_stacks) : 0),
+                         "unattributed", sampler_unattributed);
+}
+
+static PyMethodDef sampler_atexit_def = {"samplerstop", likwid_samplerstop, METH_NOARGS, NULL};
+
+static PyObject *
+likwid_samplerstart(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"interval", "event", "gid", "lines", NULL};
+    static int atexit_registered = 0;
+    double interval = 0.01;
+    PyObject* event = Py_None;
+    int gid = -1, lines = 0, eventid = -1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|dOip", kwlist, &interval, &event, &gid, &lines))
+        return NULL;
+    if (interval < 0.0001 || interval > 3600)
+    {
+        PyErr_SetString(PyExc_ValueError, "interval must be between 0.0001 and 3600 seconds");
+        return NULL;
+    }
+    if (sampler_running)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Sampler already running");
+        return NULL;
+    }
+    if (event != Py_None)
+    {
+        int n;
+        if (!perfmon_initialized || perfmon_cpus == NULL)
+        {
+            PyErr_SetString(PyExc_RuntimeError, "Counter-weighted sampling requires init()");
+            return NULL;
+        }
+        if (gid < 0)
+            gid = perfmon_getIdOfActiveGroup();
+        n = perfmon_getNumberOfEvents(gid);
+        if (PyLong_Check(event))
+        {
+            eventid = (int)PyLong_AsLong(event);
+        }
+        else if (PyUnicode_Check(event))
+        {
+            const char* name = PyUnicode_AsUTF8(event);
+            for (eventid = 0; name != NULL && eventid < n; eventid++)
+            {
+                const char* e = perfmon_getEventName(gid, eventid);
+                if (e != NULL && strcmp(e, name) == 0)
+                    break;
+            }
+        }
+        else
+        {
+            PyErr_SetString(PyExc_TypeError, "event must be an event index or name");
+            return NULL;
+        }
+        if (PyErr_Occurred())
+            return NULL;
+        if (eventid < 0 || eventid >= n)
+        {
+            PyObject* r = PyObject_Repr(event);
+            PyErr_Format(PyExc_ValueError, "Event %s not in group %d", (r ? PyUnicode_AsUTF8(r) : "?"), gid);
+            Py_XDECREF(r);
+            return NULL;
+        }
+    }
+    /* The thread must not take the GIL during interpreter shutdown */
+    if (register_atexit(&sampler_atexit_def, &atexit_registered) < 0)
+        return NULL;
+    Py_XDECREF(sampler_stacks);
+    Py_XDECREF(sampler_runtimes);
+    sampler_stacks = PyDict_New();
+    sampler_runtimes = PyDict_New();
+    if (sampler_stacks == NULL || sampler_runtimes == NULL)
+        return NULL;
+    sampler_interval = interval;
+    sampler_gid = gid;
+    sampler_event = eventid;
+    sampler_lines = lines;
+    sampler_samples = 0;
+    sampler_unattributed = 0;
+    sampler_stopping = 0;
+    if (pthread_create(&sampler_thread, NULL, sampler_main, NULL) != 0)
+        return PyErr_SetFromErrno(PyExc_OSError);
+    sampler_running = 1;
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+likwid_samplerstacks(PyObject *self, PyObject *args)
+{
+    if (sampler_stacks == NULL)
+        return PyDict_New();
+    return PyDict_Copy(sampler_stacks);
+}
+
+static int
+sampler_cmpstack(const void* a, const void* b)
+{
+    PyObject* x = *(PyObject* const*)a;
+    PyObject* y = *(PyObject* const*)b;
+    return PyUnicode_Compare(PyTuple_GET_ITEM(x, 0), PyTuple_GET_ITEM(y, 0));
+}
+
+static PyObject *
+likwid_samplerwrite(PyObject *self, PyObject *args)
+{
+    const char* filename;
+    PyObject* items;
+    Py_ssize_t i, n;
+    long written = 0;
+    FILE* fp;
+    int err;
+    if (!PyArg_ParseTuple(args, "s", &filename))
+        return NULL;
+    items = (sampler_stacks ? PyDict_Items(sampler_stacks) : PyList_New(0));
+    if (items == NULL)
+        return NULL;
+    n = PyList_GET_SIZE(items);
+    qsort(PySequence_Fast_ITEMS(items), n, sizeof(PyObject*), sampler_cmpstack);
+    fp = fopen(filename, "w");
+    if (fp == NULL)
+    {
+        Py_DECREF(items);
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+    }
+    /* Folded stacks: one "frame;frame;... weight" line per stack, the flame
+     * graph tools expect integer weights */
+    for (i = 0; i < n; i++)
+    {
+        PyObject* item = PyList_GET_ITEM(items, i);
+        const char* stack = PyUnicode_AsUTF8(PyTuple_GET_ITEM(item, 0));
+        double weight = PyFloat_AsDouble(PyTuple_GET_ITEM(item, 1));
+        if (stack == NULL || llround(weight) <= 0)
+            continue;
+        fprintf(fp, "%s %lld\n", stack, llround(weight));
+        written++;
+    }
+    Py_DECREF(items);
+    err = ferror(fp);
+    if (fclose(fp) != 0 || err)
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+    if (PyErr_Occurred())
+        return NULL;
+    return PyLong_FromLong(written);
+}
+
+/*
+################################################################################
+# Threshold-triggered capture
+################################################################################
+*/
+
+/* A native thread reads the group with perfmon_readGroupCounters and
+ * evaluates the mean of a metric (reduced over the threads) every
+ * interval. When the condition holds, it keeps sampling every
+ * capture_interval for post seconds and hands out the samples from pre
+ * seconds before the trigger up to the end of the capture. The samples are
+ * kept in a ring buffer of all metrics per thread. Data before the trigger
+ * requires reading at the capture rate all the time, with pre=0 the thread
+ * reads at the low rate until the condition fires. */
+
+#define TRIGGER_SUM 0
+#define TRIGGER_MEAN 1
+#define TRIGGER_MIN 2
+#define TRIGGER_MAX 3
+
+static const char* trigger_ops[] = {"sum", "mean", "min", "max", NULL};
+
+static pthread_t trigger_thread;
+static int trigger_running = 0;
+static int trigger_stopping = 0;
+static int trigger_gid = -1;
+static int trigger_metric = 0;
+static int trigger_op = TRIGGER_SUM;
+static int trigger_above = 1;
+static double trigger_threshold = 0;
+static double trigger_interval = 1.0;
+static double trigger_capinterval = 0.01;
+static double trigger_pre = 0;
+static double trigger_post = 0;
+static PyObject* trigger_callback = NULL;
+static PyObject* trigger_queue = NULL;
+static long trigger_count = 0;
+static long trigger_samples = 0;
+static int trigger_nmetrics = 0;
+static int trigger_nthreads = 0;
+/* Ring buffer of sample times and nmetrics * nthreads values per sample */
+static long trigger_capacity = 0;
+static long trigger_head = 0;
+static long trigger_size = 0;
+static double* trigger_times = NULL;
+static double* trigger_values = NULL;
+
+static double
+trigger_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double
+trigger_reduce(const double* values)
+{
+    int t;
+    double r = values[0];
+    for (t = 1; t < trigger_nthreads; t++)
+    {
+        if (trigger_op == TRIGGER_MIN)
+            r = (values[t] < r ? values[t] : r);
+        else if (trigger_op == TRIGGER_MAX)
+            r = (values[t] > r ? values[t] : r);
+        else
+            r += values[t];
+    }
+    return (trigger_op == TRIGGER_MEAN ? r / trigger_nthreads : r);
+}
+
+/* Read the group and append a sample to the ring, returns the reduced
+ * value of the trigger metric */
+static double
+trigger_read(double now)
+{
+    long slot = (trigger_head + trigger_size) % trigger_capacity;
+    double* values = &trigger_values[(size_t)slot * trigger_nmetrics * trigger_nthreads];
+    int m, t;
+    perfmon_readGroupCounters(trigger_gid);
+    for (m = 0; m < trigger_nmetrics; m++)
+    {
+        for (t = 0; t < trigger_nthreads; t++)
+            values[m * trigger_nthreads + t] = perfmon_getLastMetric(trigger_gid, m, t);
+    }
+    trigger_times[slot] = now;
+    if (trigger_size < trigger_capacity)
+        trigger_size++;
+    else
+        trigger_head = (trigger_head + 1) % trigger_capacity;
+    trigger_samples++;
+    return trigger_reduce(&values[trigger_metric * trigger_nthreads]);
+}
+
+static PyObject*
+trigger_cpulist(void)
+{
+    PyObject* l = PyList_New(trigger_nthreads);
+    int t;
+    for (t = 0; l != NULL && t < trigger_nthreads; t++)
+        PyList_SET_ITEM(l, t, PYINT(perfmon_cpus[t]));
+    return l;
+}
+
+/* Build the capture dict from the samples after since */
+static PyObject*
+trigger_capture(double t0, double when, double value, double since)
+{
+    PyObject *d = PyDict_New(), *samples = PyList_New(0), *names = PyList_New(0);
+    long i;
+    int m, t;
+    for (m = 0; m < trigger_nmetrics; m++)
+        pylist_append(names, PYSTR(perfmon_getMetricName(trigger_gid, m)));
+    for (i = 0; i < trigger_size && samples != NULL; i++)
+    {
+        long slot = (trigger_head + i) % trigger_capacity;
+        double* values = &trigger_values[(size_t)slot * trigger_nmetrics * trigger_nthreads];
+        PyObject* metrics;
+        if (trigger_times[slot] < since)
+            continue;
+        metrics = PyList_New(trigger_nmetrics);
+        for (m = 0; m < trigger_nmetrics && metrics != NULL; m++)
+        {
+            PyObject* l = PyList_New(trigger_nthreads);
+            for (t = 0; t < trigger_nthreads && l != NULL; t++)
+                PyList_SET_ITEM(l, t, PyFloat_FromDouble(values[m * trigger_nthreads + t]));
+            PyList_SET_ITEM(metrics, m, l);
+        }
+        pylist_append(samples, Py_BuildValue("(dN)", trigger_times[slot] - t0, metrics));
+    }
+    pydict_set(d, "time", PyFloat_FromDouble(when - t0));
+    pydict_set(d, "value", PyFloat_FromDouble(value));
+    pydict_set(d, "metric", PYSTR(perfmon_getMetricName(trigger_gid, trigger_metric)));
+    pydict_set(d, "gid", PYINT(trigger_gid));
+    pydict_set(d, "metrics", names);
+    pydict_set(d, "cpus", trigger_cpulist());
+    pydict_set(d, "samples", samples);
+    if (PyErr_Occurred())
+    {
+        Py_XDECREF(d);
+        return NULL;
+    }
+    return d;
+}
+
+/* Hand a capture to the callback or queue it, called with the GIL held */
+static void
+trigger_deliver(PyObject* capture)
+{
+    if (trigger_callback != NULL)
+    {
+        PyObject* ret = PyObject_CallFunctionObjArgs(trigger_callback, capture, NULL);
+        if (ret == NULL)
+            PyErr_WriteUnraisable(trigger_callback);
+        Py_XDECREF(ret);
+    }
+    else if (trigger_queue != NULL)
+    {
+        PyList_Append(trigger_queue, capture);
+    }
+    PyErr_Clear();
+}
+
+static void*
+trigger_main(void* arg)
+{
+    double t0 = trigger_now(), next = t0, evaluate = t0 + trigger_interval;
+    double when = 0, until = 0, value = 0, wsum = 0;
+    long wcount = 0;
+    int capturing = 0;
+    (void)arg;
+    while (!__atomic_load_n(&trigger_stopping, __ATOMIC_ACQUIRE))
+    {
+        PyGILState_STATE gstate;
+        struct timespec ts;
+        double now, v;
+        /* Low rate until the trigger unless data before it is kept */
+        next += (capturing || trigger_pre > 0 ? trigger_capinterval : trigger_interval);
+        ts.tv_sec = (time_t)next;
+        ts.tv_nsec = (long)((next - ts.tv_sec) * 1e9);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+        if (__atomic_load_n(&trigger_stopping, __ATOMIC_ACQUIRE))
+            break;
+        gstate = PyGILState_Ensure();
+        if (__atomic_load_n(&trigger_stopping, __ATOMIC_ACQUIRE))
+        {
+            PyGILState_Release(gstate);
+            break;
+        }
+        now = trigger_now();
+        v = trigger_read(now);
+        if (capturing)
+        {
+            if (now >= until)
+            {
+                PyObject* capture = trigger_capture(t0, when, value, when - trigger_pre);
+                if (capture != NULL)
+                    trigger_deliver(capture);
+                Py_XDECREF(capture);
+                PyErr_Clear();
+                capturing = 0;
+                trigger_size = 0;
+                evaluate = now + trigger_interval;
+                wsum = 0;
+                wcount = 0;
+            }
+        }
+        else
+        {
+            wsum += v;
+            wcount++;
+            if (now >= evaluate)
+            {
+                double mean = wsum / wcount;
+                if (trigger_above ? mean > trigger_threshold : mean < trigger_threshold)
+                {
+                    capturing = 1;
+                    when = now;
+                    value = mean;
+                    until = now + trigger_post;
+                    trigger_count++;
+                }
+                evaluate = now + trigger_interval;
+                wsum = 0;
+                wcount = 0;
+            }
+        }
+        PyGILState_Release(gstate);
+        /* Do not catch up after a stall */
+        if (trigger_now() > next + trigger_interval)
+            next = trigger_now();
+    }
+    return NULL;
+}
+
+/* Stop the trigger thread, called with the GIL held */
+static void
+trigger_halt(void)
+{
+    if (!trigger_running)
+        return;
+    __atomic_store_n(&trigger_stopping, 1, __ATOMIC_RELEASE);
+    Py_BEGIN_ALLOW_THREADS
+    pthread_join(trigger_thread, NULL);
+    Py_END_ALLOW_THREADS
+    trigger_running = 0;
+    free(trigger_times);
+    free(trigger_values);
+    trigger_times = NULL;
+    trigger_values = NULL;
+    Py_CLEAR(trigger_callback);
+}
+
+static PyObject *
+likwid_triggerstop(PyObject *self, PyObject *args)
+{
+    trigger_halt();
+    return Py_BuildValue("{s:l,s:l}", "triggers", trigger_count, "samples", trigger_samples);
+}
+
+static PyMethodDef trigger_atexit_def = {"triggerstop", likwid_triggerstop, METH_NOARGS, NULL};
+
+static PyObject *
+likwid_triggerstart(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"metric", "threshold", "above", "interval", "capture_interval",
+                             "pre", "post", "gid", "op", "callback", NULL};
+    static int atexit_registered = 0;
+    PyObject* metric;
+    PyObject* callback = Py_None;
+    double threshold, interval = 1.0, capinterval = 0.01, pre = 0.0, post = 10.0;
+    int above = 1, gid = -1, op, metricid = -1, nmetrics;
+    const char* opname = "sum";
+    long capacity;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Od|pddddisO", kwlist, &metric, &threshold,
+                                     &above, &interval, &capinterval, &pre, &post, &gid,
+                                     &opname, &callback))
+        return NULL;
+    if (trigger_running)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Trigger already running");
+        return NULL;
+    }
+    if (!perfmon_initialized || perfmon_ncpus <= 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Triggered capture requires init()");
+        return NULL;
+    }
+    for (op = 0; trigger_ops[op] != NULL && strcmp(trigger_ops[op], opname) != 0; op++);
+    if (trigger_ops[op] == NULL)
+    {
+        PyErr_Format(PyExc_ValueError, "Unknown op '%s', valid are sum, mean, min, max", opname);
+        return NULL;
+    }
+    if (capinterval < 0.0001 || interval < capinterval || pre < 0 || post < 0 ||
+        interval > 3600 || pre + post > 3600)
+    {
+        PyErr_SetString(PyExc_ValueError, "Invalid intervals, required is "
+                        "0.0001 <= capture_interval <= interval <= 3600 and pre, post >= 0");
+        return NULL;
+    }
+    if (callback != Py_None && !PyCallable_Check(callback))
+    {
+        PyErr_SetString(PyExc_TypeError, "callback must be callable");
+        return NULL;
+    }
+    if (gid < 0)
+        gid = perfmon_getIdOfActiveGroup();
+    nmetrics = perfmon_getNumberOfMetrics(gid);
+    if (PyLong_Check(metric))
+    {
+        metricid = (int)PyLong_AsLong(metric);
+    }
+    else if (PyUnicode_Check(metric))
+    {
+        const char* name = PyUnicode_AsUTF8(metric);
+        for (metricid = 0; name != NULL && metricid < nmetrics; metricid++)
+        {
+            const char* m = perfmon_getMetricName(gid, metricid);
+            if (m != NULL && strcmp(m, name) == 0)
+                break;
+        }
+    }
+    else
+    {
+        PyErr_SetString(PyExc_TypeError, "metric must be a metric index or name");
+        return NULL;
+    }
+    if (PyErr_Occurred())
+        return NULL;
+    if (metricid < 0 || metricid >= nmetrics)
+    {
+        PyObject* r = PyObject_Repr(metric);
+        PyErr_Format(PyExc_ValueError, "Metric %s not in group %d", (r ? PyUnicode_AsUTF8(r) : "?"), gid);
+        Py_XDECREF(r);
+        return NULL;
+    }
+    if (register_atexit(&trigger_atexit_def, &atexit_registered) < 0)
+        return NULL;
+    capacity = (long)ceil((pre + post) / capinterval) + 2;
+    trigger_times = malloc(capacity * sizeof(double));
+    trigger_values = malloc((size_t)capacity * nmetrics * perfmon_ncpus * sizeof(double));
+    if (trigger_queue == NULL)
+        trigger_queue = PyList_New(0);
+    if (trigger_times == NULL || trigger_values == NULL || trigger_queue == NULL)
+    {
+        free(trigger_times);
+        free(trigger_values);
+        trigger_times = NULL;
+        trigger_values = NULL;
+        return PyErr_NoMemory();
+    }
+    if (callback != Py_None)
+    {
+        Py_INCREF(callback);
+        trigger_callback = callback;
+    }
+    trigger_gid = gid;
+    trigger_metric = metricid;
+    trigger_op = op;
+    trigger_above = above;
+    trigger_threshold = threshold;
+    trigger_interval = interval;
+    trigger_capinterval = capinterval;
+    trigger_pre = pre;
+    trigger_post = post;
+    trigger_nmetrics = nmetrics;
+    trigger_nthreads = perfmon_ncpus;
+    trigger_capacity = capacity;
+    trigger_head = 0;
+    trigger_size = 0;
+    trigger_count = 0;
+    trigger_samples = 0;
+    trigger_stopping = 0;
+    if (pthread_create(&trigger_thread, NULL, trigger_main, NULL) != 0)
+    {
+        free(trigger_times);
+        free(trigger_values);
+        trigger_times = NULL;
+        trigger_values = NULL;
+        Py_CLEAR(trigger_callback);
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    trigger_running = 1;
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+likwid_triggercaptures(PyObject *self, PyObject *args)
+{
+    PyObject* l = trigger_queue;
+    trigger_queue = PyList_New(0);
+    if (l == NULL)
+        return PyList_New(0);
+    return l;
+}
+
+/*
+################################################################################
+# CPU frequency related functions
+################################################################################
+*/
+#if (LIKWID_MAJOR == 5)
+static PyObject *
+likwid_freqInit(PyObject *self, PyObject *args)
+{
+    return PYUINT(freq_init());
+}
+#endif
+
+static PyObject *
+likwid_freqGetCpuClockCurrent(PyObject *self, PyObject *args)
+{
+    int c = 0;
+    PyArg_ParseTuple(args, "i", &c);
+    return PYULONG(freq_getCpuClockCurrent(c));
+}
+
+static PyObject *
+likwid_freqGetCpuClockMax(PyObject *self, PyObject *args)
+{
+    int c = 0;
+    PyArg_ParseTuple(args, "i", &c);
+    return PYULONG(freq_getCpuClockMax(c));
+}
+
+#if (LIKWID_MAJOR == 5)
+static PyObject *
+likwid_freqGetConfCpuClockMax(PyObject *self, PyObject *args)
+{
+    int c = 0;
+    PyArg_ParseTuple(args, "i", &c);
+    return PYULONG(freq_getConfCpuClockMax(c));
+}
+#endif
+
+static PyObject *
+likwid_freqGetCpuClockMin(PyObject *self, PyObject *args)
+{
+    int c = 0;
+    PyArg_ParseTuple(args, "i", &c);
+    return PYULONG(freq_getCpuClockMin(c));
+}
+
+#if (LIKWID_MAJOR == 5)
+static PyObject *
+likwid_freqGetConfCpuClockMin(PyObject *self, PyObject *args)
+{
+    int c = 0;
+    PyArg_ParseTuple(args, "i", &c);
+    return PYULONG(freq_getConfCpuClockMin(c));
+}
+#endif
+
+static PyObject *
+likwid_freqSetCpuClockMax(PyObject *self, PyObject *args)
+{
+    int c = 0;
+    int f = 0;
+    PyArg_ParseTuple(args, "ii", &c, &f);
+    return PYUINT(freq_setCpuClockMax(c, f));
+}
+
+static PyObject *
+likwid_freqSetCpuClockMin(PyObject *self, PyObject *args)
+{
+    int c = 0;
+    int f = 0;
+    PyArg_ParseTuple(args, "ii", &c, &f);
+    return PYUINT(freq_setCpuClockMin(c, f));
+}
+
+static PyObject *
+likwid_freqGetGovernor(PyObject *self, PyObject *args)
+{
+    int c = 0;
+    PyArg_ParseTuple(args, "i", &c);
+    return PYSTR(freq_getGovernor(c));
+}
+
+static PyObject *
+likwid_freqSetGovernor(PyObject *self, PyObject *args)
+{
+    int c = 0;
+    const char* g;
+    PyArg_ParseTuple(args, "is", &c, &g);
+    return PYINT(freq_setGovernor(c, (char*)g));
+}
+
+static PyObject *
+likwid_freqGetAvailFreq(PyObject *self, PyObject *args)
+{
+    int c = 0;
+    PyArg_ParseTuple(args, "i", &c);
+    return PYSTR(freq_getAvailFreq(c));
+}
+
+static PyObject *
+likwid_freqGetAvailGovs(PyObject *self, PyObject *args)
 {
     int c = 0;
     PyArg_ParseTuple(args, "i", &c);
-    return PYUINT(freq_getCpuClockMin(c));
+    return PYSTR(freq_getAvailGovs(c));
+}
+
+static PyObject *
+likwid_freqSetUncoreClockMin(PyObject *self, PyObject *args)
+{
+    int s = 0;
+    int f = 0;
+    PyArg_ParseTuple(args, "ii", &s, &f);
+    return Py_BuildValue("i", freq_setUncoreFreqMin(s, f));
+}
+
+static PyObject *
+likwid_freqGetUncoreClockMin(PyObject *self, PyObject *args)
+{
+    int s = 0;
+    PyArg_ParseTuple(args, "i", &s);
+    return PYULONG(freq_getUncoreFreqMin(s)*1000000);
+}
+
+static PyObject *
+likwid_freqSetUncoreClockMax(PyObject *self, PyObject *args)
+{
+    int s = 0;
+    int f = 0;
+    PyArg_ParseTuple(args, "ii", &s, &f);
+    return Py_BuildValue("i", freq_setUncoreFreqMax(s, f));
+}
+
+static PyObject *
+likwid_freqGetUncoreClockMax(PyObject *self, PyObject *args)
+{
+    int s = 0;
+    PyArg_ParseTuple(args, "i", &s);
+    return PYULONG(freq_getUncoreFreqMax(s)*1000000);
+}
+
+#if (LIKWID_MAJOR == 5)
+static PyObject *
+likwid_freqFinalize(PyObject *self, PyObject *args)
+{
+    freqtimeline_halt();
+    freq_finalize();
+    Py_RETURN_NONE;
+}
+#endif
+
+#if (LIKWID_MAJOR == 5)
+/* Current Uncore clock of a socket in Hz. freq_getUncoreFreqCur returns 0
+ * if the status register is not readable. Then the clock is derived from
+ * the UNCORE_CLOCK event if it is measured in the active group: the count
+ * of the last measurement interval divided by its length. 0 if neither is
+ * available. */
+static double
+uncore_clockcurrent(int socket)
+{
+    uint64_t f = freq_getUncoreFreqCur(socket);
+    double time, clock = 0;
+    int gid, e, t, nevents;
+    if (f > 0)
+        return (double)f * 1E6;
+    if (!perfmon_initialized || perfmon_ncpus <= 0 || need_native_topology() < 0 ||
+        power_sockets() < 0)
+        return 0;
+    gid = perfmon_getIdOfActiveGroup();
+    time = perfmon_getLastTimeOfGroup(gid);
+    nevents = perfmon_getNumberOfEvents(gid);
+    if (gid < 0 || time <= 0)
+        return 0;
+    for (e = 0; e < nevents; e++)
+    {
+        const char* name = perfmon_getEventName(gid, e);
+        if (name == NULL || strcmp(name, "UNCORE_CLOCK") != 0)
+            continue;
+        /* Socket-wide counter, read by one CPU of the socket */
+        for (t = 0; t < perfmon_ncpus; t++)
+        {
+            int cpu = perfmon_cpus[t];
+            double v;
+            if (cpu < 0 || cpu >= power_ncpus || power_cpusock[cpu] != socket)
+                continue;
+            v = perfmon_getLastResult(gid, e, t);
+            if (v > clock)
+                clock = v;
+        }
+        break;
+    }
+    return clock / time;
+}
+
+static PyObject *
+likwid_freqGetUncoreClockCurrent(PyObject *self, PyObject *args)
+{
+    int s = 0;
+    if (!PyArg_ParseTuple(args, "i", &s))
+        return NULL;
+    return PYULONG(uncore_clockcurrent(s));
+}
+
+/*
+################################################################################
+# Frequency timeline
+################################################################################
+*/
+
+/* A native thread samples the current core clock of the CPUs, the Uncore
+ * clock of each socket and optionally metrics of a performance group (e.g.
+ * the memory bandwidth, summed over the threads) every interval. The group
+ * is read with perfmon_readGroupCounters while holding the GIL, which also
+ * keeps the Uncore clock fallback on UNCORE_CLOCK up to date. These reads
+ * replace the last results of the group, so getlastresult() and
+ * getlastmetric() return the values of the latest sample while the
+ * timeline runs. */
+
+static pthread_t freqtimeline_thread;
+static int freqtimeline_running = 0;
+static int freqtimeline_stopping = 0;
+static int freqtimeline_gid = -1;
+static double freqtimeline_interval = 0.1;
+static int freqtimeline_ncpus = 0;
+static int* freqtimeline_cpus = NULL;
+static int freqtimeline_nmetrics = 0;
+static int* freqtimeline_metrics = NULL;
+/* Ring buffer of the last maxsamples samples, each with the time, ncpus
+ * core clocks, nsockets Uncore clocks and nmetrics values */
+static double* freqtimeline_data = NULL;
+static long freqtimeline_nsamples = 0;
+static long freqtimeline_capacity = 0;
+static long freqtimeline_head = 0;
+static long freqtimeline_maxsamples = 0;
+static double freqtimeline_t0 = 0;
+
+#define FREQTIMELINE_STRIDE (1 + freqtimeline_ncpus + power_nsockets + freqtimeline_nmetrics)
+
+static double
+freqtimeline_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+static void
+freqtimeline_sample(double now)
+{
+    double* s;
+    long slot;
+    int i, t;
+    /* Grow up to maxsamples, the ring only wraps at full size */
+    if (freqtimeline_nsamples == freqtimeline_capacity && freqtimeline_capacity < freqtimeline_maxsamples)
+    {
+        long cap = (freqtimeline_capacity > 0 ? 2 * freqtimeline_capacity : 1024);
+        double* tmp;
+        if (cap > freqtimeline_maxsamples)
+            cap = freqtimeline_maxsamples;
+        tmp = realloc(freqtimeline_data, (size_t)cap * FREQTIMELINE_STRIDE * sizeof(double));
+        if (tmp == NULL)
+            return;
+        freqtimeline_data = tmp;
+        freqtimeline_capacity = cap;
+    }
+    slot = (freqtimeline_head + freqtimeline_nsamples) % freqtimeline_capacity;
+    s = &freqtimeline_data[(size_t)slot * FREQTIMELINE_STRIDE];
+    if (freqtimeline_gid >= 0)
+        perfmon_readGroupCounters(freqtimeline_gid);
+    *s++ = now - freqtimeline_t0;
+    for (i = 0; i < freqtimeline_ncpus; i++)
+        *s++ = (double)freq_getCpuClockCurrent(freqtimeline_cpus[i]);
+    for (i = 0; i < power_nsockets; i++)
+        *s++ = uncore_clockcurrent(i);
+    for (i = 0; i < freqtimeline_nmetrics; i++)
+    {
+        double sum = 0;
+        for (t = 0; t < perfmon_ncpus; t++)
+            sum += perfmon_getLastMetric(freqtimeline_gid, freqtimeline_metrics[i], t);
+        *s++ = sum;
+    }
+    if (freqtimeline_nsamples < freqtimeline_capacity)
+        freqtimeline_nsamples++;
+    else
+        freqtimeline_head = (freqtimeline_head + 1) % freqtimeline_capacity;
+}
+
+static void*
+freqtimeline_main(void* arg)
+{
+    double next = freqtimeline_t0;
+    (void)arg;
+    while (!__atomic_load_n(&freqtimeline_stopping, __ATOMIC_ACQUIRE))
+    {
+        PyGILState_STATE gstate;
+        struct timespec ts;
+        next += freqtimeline_interval;
+        ts.tv_sec = (time_t)next;
+        ts.tv_nsec = (long)((next - ts.tv_sec) * 1e9);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+        if (__atomic_load_n(&freqtimeline_stopping, __ATOMIC_ACQUIRE))
+            break;
+        gstate = PyGILState_Ensure();
+        if (!__atomic_load_n(&freqtimeline_stopping, __ATOMIC_ACQUIRE))
+            freqtimeline_sample(freqtimeline_now());
+        PyGILState_Release(gstate);
+        /* Do not catch up after a stall */
+        if (freqtimeline_now() > next + freqtimeline_interval)
+            next = freqtimeline_now();
+    }
+    return NULL;
+}
+
+/* Stop the timeline thread, called with the GIL held */
+static void
+freqtimeline_halt(void)
+{
+    if (!freqtimeline_running)
+        return;
+    __atomic_store_n(&freqtimeline_stopping, 1, __ATOMIC_RELEASE);
+    Py_BEGIN_ALLOW_THREADS
+    pthread_join(freqtimeline_thread, NULL);
+    Py_END_ALLOW_THREADS
+    freqtimeline_running = 0;
+    /* The group may be gone after finalize(), keep the metric names */
+    freqtimeline_gid = -1;
+}
+
+static PyObject *
+likwid_freqtimelinestop(PyObject *self, PyObject *args)
+{
+    freqtimeline_halt();
+    return PyLong_FromLong(freqtimeline_nsamples);
+}
+
+static PyMethodDef freqtimeline_atexit_def = {"freqtimelinestop", likwid_freqtimelinestop, METH_NOARGS, NULL};
+
+static PyObject* freqtimeline_names = NULL;
+
+static PyObject *
+likwid_freqtimelinestart(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"interval", "metrics", "gid", "maxsamples", NULL};
+    static int atexit_registered = 0;
+    double interval = 0.1;
+    long maxsamples = 100000;
+    PyObject* pymetrics = Py_None;
+    PyObject *names, *seq = NULL;
+    int gid = -1, nmetrics = 0, i, m, n;
+    int* metrics = NULL;
+    int* cpus;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|dOil", kwlist, &interval, &pymetrics, &gid, &maxsamples))
+        return NULL;
+    if (freqtimeline_running)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Frequency timeline already running");
+        return NULL;
+    }
+    if (interval < 0.001 || interval > 3600)
+    {
+        PyErr_SetString(PyExc_ValueError, "interval must be between 0.001 and 3600 seconds");
+        return NULL;
+    }
+    if (maxsamples < 1)
+    {
+        PyErr_SetString(PyExc_ValueError, "maxsamples must be positive");
+        return NULL;
+    }
+    if (need_native_topology() < 0 || power_sockets() < 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Cannot initialize the topology module");
+        return NULL;
+    }
+    names = PyList_New(0);
+    if (names == NULL)
+        return NULL;
+    if (perfmon_initialized && perfmon_ncpus > 0)
+    {
+        if (gid < 0)
+            gid = perfmon_getIdOfActiveGroup();
+        n = perfmon_getNumberOfMetrics(gid);
+        if (pymetrics != Py_None)
+        {
+            seq = PySequence_Fast(pymetrics, "metrics must be a sequence of metric names");
+            if (seq == NULL)
+            {
+                Py_DECREF(names);
+                return NULL;
+            }
+        }
+        metrics = malloc((seq ? PySequence_Fast_GET_SIZE(seq) : n) * sizeof(int) + 1);
+        if (metrics == NULL)
+        {
+            PyErr_NoMemory();
+            goto error;
+        }
+        if (seq == NULL)
+        {
+            /* Default: the bandwidth metrics of the group */
+            for (m = 0; m < n; m++)
+            {
+                const char* name = perfmon_getMetricName(gid, m);
+                if (name != NULL && (strstr(name, "bandwidth") || strstr(name, "Bandwidth")))
+                {
+                    metrics[nmetrics++] = m;
+                    pylist_append(names, PYSTR(name));
+                }
+            }
+        }
+        else
+        {
+            for (i = 0; i < PySequence_Fast_GET_SIZE(seq); i++)
+            {
+                PyObject* item = PySequence_Fast_GET_ITEM(seq, i);
+                const char* s = (PyUnicode_Check(item) ? PyUnicode_AsUTF8(item) : NULL);
+                for (m = 0; s != NULL && m < n; m++)
+                {
+                    const char* name = perfmon_getMetricName(gid, m);
+                    if (name != NULL && strcmp(s, name) == 0)
+                        break;
+                }
+                if (s == NULL || m == n)
+                {
+                    PyErr_Format(PyExc_ValueError, "Metric %R not found in group %d", item, gid);
+                    goto error;
+                }
+                metrics[nmetrics++] = m;
+                pylist_append(names, PYSTR(s));
+            }
+        }
+        Py_CLEAR(seq);
+        if (nmetrics == 0)
+            gid = -1;
+    }
+    else if (pymetrics != Py_None)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Metrics require init() and a group");
+        goto error;
+    }
+    else
+    {
+        gid = -1;
+    }
+    /* The perfmon CPUs or all hardware threads */
+    n = (perfmon_initialized && perfmon_ncpus > 0 ? perfmon_ncpus : (int)cputopo->numHWThreads);
+    cpus = malloc(n * sizeof(int));
+    if (cpus == NULL)
+    {
+        PyErr_NoMemory();
+        goto error;
+    }
+    for (i = 0; i < n; i++)
+        cpus[i] = (perfmon_initialized && perfmon_ncpus > 0 ? perfmon_cpus[i] : (int)cputopo->threadPool[i].apicId);
+    if (register_atexit(&freqtimeline_atexit_def, &atexit_registered) < 0)
+    {
+        free(cpus);
+        goto error;
+    }
+    free(freqtimeline_cpus);
+    free(freqtimeline_metrics);
+    free(freqtimeline_data);
+    freqtimeline_cpus = cpus;
+    freqtimeline_ncpus = n;
+    freqtimeline_metrics = metrics;
+    freqtimeline_nmetrics = nmetrics;
+    freqtimeline_data = NULL;
+    freqtimeline_nsamples = 0;
+    freqtimeline_capacity = 0;
+    freqtimeline_head = 0;
+    freqtimeline_maxsamples = maxsamples;
+    freqtimeline_gid = gid;
+    freqtimeline_interval = interval;
+    Py_XSETREF(freqtimeline_names, names);
+    freqtimeline_stopping = 0;
+    freqtimeline_t0 = freqtimeline_now();
+    if (pthread_create(&freqtimeline_thread, NULL, freqtimeline_main, NULL) != 0)
+    {
+        freqtimeline_gid = -1;
+        PyErr_SetString(PyExc_RuntimeError, "Cannot start the frequency timeline thread");
+        return NULL;
+    }
+    freqtimeline_running = 1;
+    Py_RETURN_NONE;
+error:
+    Py_XDECREF(seq);
+    Py_DECREF(names);
+    free(metrics);
+    return NULL;
+}
+
+static PyObject *
+likwid_freqtimeline(PyObject *self, PyObject *args)
+{
+    PyObject *d, *times, *core, *uncore, *metrics, *cpus, *sockets;
+    long i;
+    int j;
+    if (freqtimeline_running)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Stop the frequency timeline first");
+        return NULL;
+    }
+    d = PyDict_New();
+    times = PyList_New(0);
+    core = PyList_New(0);
+    uncore = PyList_New(0);
+    metrics = PyDict_New();
+    cpus = PyList_New(0);
+    sockets = PyList_New(0);
+    for (j = 0; j < freqtimeline_ncpus; j++)
+        pylist_append(cpus, PYINT(freqtimeline_cpus[j]));
+    for (j = 0; j < power_nsockets; j++)
+        pylist_append(sockets, PYINT(j));
+    for (j = 0; j < freqtimeline_nmetrics; j++)
+    {
+        PyObject* name = PyList_GET_ITEM(freqtimeline_names, j);
+        Py_INCREF(name);
+        pydict_setobj(metrics, name, PyList_New(0));
+    }
+    for (i = 0; i < freqtimeline_nsamples; i++)
+    {
+        long slot = (freqtimeline_head + i) % freqtimeline_capacity;
+        double* s = &freqtimeline_data[(size_t)slot * FREQTIMELINE_STRIDE];
+        PyObject *c = PyList_New(freqtimeline_ncpus), *u = PyList_New(power_nsockets);
+        pylist_append(times, PyFloat_FromDouble(*s++));
+        for (j = 0; j < freqtimeline_ncpus && c != NULL; j++)
+            PyList_SET_ITEM(c, j, PyFloat_FromDouble(*s++));
+        for (j = 0; j < power_nsockets && u != NULL; j++)
+            PyList_SET_ITEM(u, j, PyFloat_FromDouble(*s++));
+        pylist_append(core, c);
+        pylist_append(uncore, u);
+        for (j = 0; j < freqtimeline_nmetrics; j++)
+            pylist_append(PyDict_GetItem(metrics, PyList_GET_ITEM(freqtimeline_names, j)),
+                          PyFloat_FromDouble(*s++));
+    }
+    pydict_set(d, "interval", PyFloat_FromDouble(freqtimeline_interval));
+    pydict_set(d, "time", times);
+    pydict_set(d, "cpus", cpus);
+    pydict_set(d, "core", core);
+    pydict_set(d, "sockets", sockets);
+    pydict_set(d, "uncore", uncore);
+    pydict_set(d, "metrics", metrics);
+    if (PyErr_Occurred())
+    {
+        Py_XDECREF(d);
+        return NULL;
+    }
+    return d;
+}
+
+static void
+freqtimeline_writecounter(FILE* fp, const char* name, double ts, int pid,
+                          const char* prefix, const int* ids, const double* values, int n)
+{
+    int i;
+    fprintf(fp, ",\n{\"name\":");
+    markertrace_jsonstr(fp, name);
+    fprintf(fp, ",\"cat\":\"frequency\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%d,\"args\":{", ts * 1E6, pid);
+    for (i = 0; i < n; i++)
+    {
+        if (prefix == NULL)
+            fprintf(fp, "%s\"value\":%.17g", (i > 0 ? "," : ""), values[i]);
+        else
+            fprintf(fp, "%s\"%s%d\":%.17g", (i > 0 ? "," : ""), prefix, (ids ? ids[i] : i), values[i]);
+    }
+    fprintf(fp, "}}");
+}
+
+/* Chrome trace JSON with a counter track for the core clocks, the Uncore
+ * clocks and each metric. Clocks in MHz. */
+static PyObject *
+likwid_freqtimelinewrite(PyObject *self, PyObject *args)
+{
+    const char* filename;
+    FILE* fp;
+    long i;
+    int j, err, pid = (int)getpid();
+    double* mhz;
+    if (!PyArg_ParseTuple(args, "s", &filename))
+        return NULL;
+    if (freqtimeline_running)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Stop the frequency timeline first");
+        return NULL;
+    }
+    mhz = malloc((freqtimeline_ncpus + power_nsockets + 1) * sizeof(double));
+    if (mhz == NULL)
+        return PyErr_NoMemory();
+    fp = fopen(filename, "w");
+    if (fp == NULL)
+    {
+        free(mhz);
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+    }
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+                "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                "\"args\":{\"name\":\"pylikwid\"}}", pid, pid);
+    for (i = 0; i < freqtimeline_nsamples; i++)
+    {
+        long slot = (freqtimeline_head + i) % freqtimeline_capacity;
+        double* s = &freqtimeline_data[(size_t)slot * FREQTIMELINE_STRIDE];
+        double ts = s[0];
+        for (j = 0; j < freqtimeline_ncpus + power_nsockets; j++)
+            mhz[j] = s[1 + j] / 1E6;
+        freqtimeline_writecounter(fp, "Core clock [MHz]", ts, pid, "CPU ", freqtimeline_cpus,
+                                  mhz, freqtimeline_ncpus);
+        freqtimeline_writecounter(fp, "Uncore clock [MHz]", ts, pid, "Socket ", NULL,
+                                  &mhz[freqtimeline_ncpus], power_nsockets);
+        for (j = 0; j < freqtimeline_nmetrics; j++)
+        {
+            const char* name = PyUnicode_AsUTF8(PyList_GET_ITEM(freqtimeline_names, j));
+            freqtimeline_writecounter(fp, (name ? name : "?"), ts, pid, NULL, NULL,
+                                      &s[1 + freqtimeline_ncpus + power_nsockets + j], 1);
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    free(mhz);
+    err = ferror(fp);
+    if (fclose(fp) != 0 || err)
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+    return PyLong_FromLong(freqtimeline_nsamples);
+}
+#endif
+
+/*
+################################################################################
+# Thermal throttling monitor
+################################################################################
+*/
+
+/* A native thread samples the temperature (thermal_read), the current core
+ * clock and, on Intel with initialized access layer (hpminit() or init()),
+ * the throttle indicators of IA32_THERM_STATUS and IA32_PACKAGE_THERM_STATUS
+ * of each monitored CPU. The effective clock of a CPU is
+ * nominal * CPU_CLK_UNHALTED_CORE / CPU_CLK_UNHALTED_REF of the last interval
+ * if the active group measures both events (AMD: ACTUAL_CPU_CLOCK and
+ * MAX_CPU_CLOCK). The current core clock is used instead only on request,
+ * it is also low on idle CPUs and under powersave. Consecutive samples with
+ * an effective clock below nominal * (1 - tolerance) form a drop interval.
+ * Marker regions started on a CPU while the monitor runs are attributed to
+ * the drop intervals of that CPU. Samples and marker calls hold the GIL. */
+
+#define THROTTLE_MSR_THERM_STATUS 0x19C
+#define THROTTLE_MSR_PACKAGE_THERM_STATUS 0x1B1
+
+/* Current status bits, same position in both registers */
+static const struct {
+    int bit;
+    const char* name;
+} throttle_reasons[] = {
+    {0, "thermal"},
+    {2, "prochot"},
+    {4, "critical"},
+    {10, "powerlimit"},
+};
+#define THROTTLE_NREASONS ((int)(sizeof(throttle_reasons) / sizeof(throttle_reasons[0])))
+
+typedef struct {
+    int32_t tid;
+    int cpu;
+    char* tag;
+} ThrottleRegion;
+
+typedef struct {
+    int cpu;
+    int thread;         /* perfmon thread index or -1 */
+    int open;           /* inside a drop interval */
+    double start;
+    double last;
+    double minclock;
+    double sumclock;
+    long nsamples;
+    unsigned reasons;
+    uint32_t maxtemp;   /* in the drop interval */
+    uint32_t peaktemp;  /* over the whole run */
+    PyObject* regions;  /* set of region tags of the drop interval */
+} ThrottleCpu;
+
+static pthread_t throttle_thread;
+static int throttle_running = 0;
+static int throttle_stopping = 0;
+static int throttle_gid = -1;
+static int throttle_core = -1;
+static int throttle_ref = -1;
+static int throttle_msr = 0;
+static double throttle_interval = 0.1;
+static double throttle_nominal = 0;
+static double throttle_tolerance = 0.05;
+static double throttle_t0 = 0;
+static long throttle_nsamples = 0;
+static ThrottleCpu* throttle_cpus = NULL;
+static int throttle_ncpus = 0;
+static ThrottleRegion* throttle_regions = NULL;
+static int throttle_nregions = 0;
+static int throttle_maxregions = 0;
+static PyObject* throttle_intervals = NULL;
+
+static double
+throttle_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+static void
+throttle_regionstart(const char* regiontag)
+{
+    ThrottleRegion* r;
+    if (!throttle_running)
+        return;
+    if (throttle_nregions == throttle_maxregions)
+    {
+        int max = (throttle_maxregions > 0 ? 2 * throttle_maxregions : 16);
+        r = realloc(throttle_regions, max * sizeof(ThrottleRegion));
+        if (r == NULL)
+            return;
+        throttle_regions = r;
+        throttle_maxregions = max;
+    }
+    r = &throttle_regions[throttle_nregions];
+    r->tag = strdup(regiontag);
+    if (r->tag == NULL)
+        return;
+    r->tid = (int32_t)syscall(SYS_gettid);
+    r->cpu = likwid_getProcessorId();
+    throttle_nregions++;
+}
+
+static void
+throttle_regionstop(const char* regiontag)
+{
+    int32_t tid;
+    int i;
+    if (throttle_nregions == 0)
+        return;
+    tid = (int32_t)syscall(SYS_gettid);
+    for (i = throttle_nregions - 1; i >= 0; i--)
+    {
+        if (throttle_regions[i].tid == tid && strcmp(throttle_regions[i].tag, regiontag) == 0)
+        {
+            free(throttle_regions[i].tag);
+            throttle_regions[i] = throttle_regions[--throttle_nregions];
+            return;
+        }
+    }
+}
+
+static void
+throttle_close(ThrottleCpu* c)
+{
+    PyObject *d, *reasons, *regions;
+    int i;
+    if (!c->open)
+        return;
+    c->open = 0;
+    d = PyDict_New();
+    reasons = PyList_New(0);
+    for (i = 0; i < THROTTLE_NREASONS; i++)
+    {
+        if (c->reasons & (1U << i))
+            pylist_append(reasons, PYSTR(throttle_reasons[i].name));
+    }
+    regions = PySequence_List(c->regions);
+    if (regions != NULL)
+        PyList_Sort(regions);
+    Py_CLEAR(c->regions);
+    pydict_set(d, "cpu", PYINT(c->cpu));
+    pydict_set(d, "start", PyFloat_FromDouble(c->start));
+    pydict_set(d, "end", PyFloat_FromDouble(c->last + throttle_interval));
+    pydict_set(d, "samples", PyLong_FromLong(c->nsamples));
+    pydict_set(d, "minclock", PyFloat_FromDouble(c->minclock));
+    pydict_set(d, "meanclock", PyFloat_FromDouble(c->sumclock / c->nsamples));
+    pydict_set(d, "maxtemp", PYUINT(c->maxtemp));
+    pydict_set(d, "reasons", reasons);
+    pydict_set(d, "regions", regions);
+    pylist_append(throttle_intervals, d);
+}
+
+static void
+throttle_sample(double now)
+{
+    int i, r;
+    if (throttle_gid >= 0)
+        perfmon_readGroupCounters(throttle_gid);
+    for (i = 0; i < throttle_ncpus; i++)
+    {
+        ThrottleCpu* c = &throttle_cpus[i];
+        uint32_t temp = 0;
+        unsigned reasons = 0;
+        double clock = 0;
+        if (thermal_read(c->cpu, &temp) == 0 && temp > c->peaktemp)
+            c->peaktemp = temp;
+        if (throttle_gid >= 0 && c->thread >= 0)
+        {
+            double core = perfmon_getLastResult(throttle_gid, throttle_core, c->thread);
+            double ref = perfmon_getLastResult(throttle_gid, throttle_ref, c->thread);
+            /* Idle in the whole interval, nothing to judge */
+            if (ref <= 0)
+                continue;
+            clock = throttle_nominal * core / ref;
+        }
+        else
+        {
+            clock = (double)freq_getCpuClockCurrent(c->cpu);
+            if (clock <= 0)
+                continue;
+        }
+        if (throttle_msr)
+        {
+            uint64_t core = 0, pkg = 0;
+            HPMread(c->cpu, MSR_DEV, THROTTLE_MSR_THERM_STATUS, &core);
+            HPMread(c->cpu, MSR_DEV, THROTTLE_MSR_PACKAGE_THERM_STATUS, &pkg);
+            for (r = 0; r < THROTTLE_NREASONS; r++)
+            {
+                if ((core | pkg) & (1ULL << throttle_reasons[r].bit))
+                    reasons |= (1U << r);
+            }
+        }
+        if (clock >= throttle_nominal * (1 - throttle_tolerance))
+        {
+            throttle_close(c);
+            continue;
+        }
+        if (!c->open)
+        {
+            c->regions = PySet_New(NULL);
+            if (c->regions == NULL)
+            {
+                PyErr_Clear();
+                continue;
+            }
+            c->open = 1;
+            c->start = now - throttle_t0;
+            c->minclock = clock;
+            c->sumclock = 0;
+            c->nsamples = 0;
+            c->reasons = 0;
+            c->maxtemp = 0;
+        }
+        c->last = now - throttle_t0;
+        c->nsamples++;
+        c->sumclock += clock;
+        if (clock < c->minclock)
+            c->minclock = clock;
+        if (temp > c->maxtemp)
+            c->maxtemp = temp;
+        c->reasons |= reasons;
+        for (r = 0; r < throttle_nregions; r++)
+        {
+            if (throttle_regions[r].cpu == c->cpu)
+            {
+                PyObject* tag = PYSTR(throttle_regions[r].tag);
+                if (tag == NULL || PySet_Add(c->regions, tag) < 0)
+                    PyErr_Clear();
+                Py_XDECREF(tag);
+            }
+        }
+    }
+    throttle_nsamples++;
+}
+
+static void*
+throttle_main(void* arg)
+{
+    double next = throttle_t0;
+    (void)arg;
+    while (!__atomic_load_n(&throttle_stopping, __ATOMIC_ACQUIRE))
+    {
+        PyGILState_STATE gstate;
+        struct timespec ts;
+        next += throttle_interval;
+        ts.tv_sec = (time_t)next;
+        ts.tv_nsec = (long)((next - ts.tv_sec) * 1e9);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+        if (__atomic_load_n(&throttle_stopping, __ATOMIC_ACQUIRE))
+            break;
+        gstate = PyGILState_Ensure();
+        if (!__atomic_load_n(&throttle_stopping, __ATOMIC_ACQUIRE))
+            throttle_sample(throttle_now());
+        PyGILState_Release(gstate);
+        /* Do not catch up after a stall */
+        if (throttle_now() > next + throttle_interval)
+            next = throttle_now();
+    }
+    return NULL;
+}
+
+/* Stop the monitor thread and close open drop intervals, called with the
+ * GIL held */
+static void
+throttle_halt(void)
+{
+    int i;
+    if (!throttle_running)
+        return;
+    __atomic_store_n(&throttle_stopping, 1, __ATOMIC_RELEASE);
+    Py_BEGIN_ALLOW_THREADS
+    pthread_join(throttle_thread, NULL);
+    Py_END_ALLOW_THREADS
+    throttle_running = 0;
+    throttle_gid = -1;
+    for (i = 0; i < throttle_ncpus; i++)
+        throttle_close(&throttle_cpus[i]);
+    for (i = 0; i < throttle_nregions; i++)
+        free(throttle_regions[i].tag);
+    throttle_nregions = 0;
+}
+
+static PyObject *
+likwid_throttlestop(PyObject *self, PyObject *args)
+{
+    throttle_halt();
+    return PyLong_FromSsize_t(throttle_intervals ? PyList_GET_SIZE(throttle_intervals) : 0);
+}
+
+static PyMethodDef throttle_atexit_def = {"throttlestop", likwid_throttlestop, METH_NOARGS, NULL};
+
+/* Indices of the unhalted core and reference cycle events in group gid */
+static int
+throttle_events(int gid, int* core, int* ref)
+{
+    static const char* names[][2] = {
+        {"CPU_CLK_UNHALTED_CORE", "CPU_CLK_UNHALTED_REF"},
+        {"ACTUAL_CPU_CLOCK", "MAX_CPU_CLOCK"},
+    };
+    int n = perfmon_getNumberOfEvents(gid);
+    int p, e;
+    for (p = 0; p < (int)(sizeof(names) / sizeof(names[0])); p++)
+    {
+        *core = *ref = -1;
+        for (e = 0; e < n; e++)
+        {
+            const char* name = perfmon_getEventName(gid, e);
+            if (name == NULL)
+                continue;
+            if (strcmp(name, names[p][0]) == 0)
+                *core = e;
+            else if (strcmp(name, names[p][1]) == 0)
+                *ref = e;
+        }
+        if (*core >= 0 && *ref >= 0)
+            return 0;
+    }
+    *core = *ref = -1;
+    return -1;
+}
+
+static PyObject *
+likwid_throttlestart(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"interval", "cpus", "nominal", "tolerance", "frequency", NULL};
+    static int atexit_registered = 0;
+    double interval = 0.1, nominal = 0, tolerance = 0.05;
+    PyObject* pycpus = Py_None;
+    PyObject* seq = NULL;
+    ThrottleCpu* cpus;
+    int i, t, n, core = -1, ref = -1, gid = -1, frequency = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|dOddp", kwlist, &interval, &pycpus,
+                                     &nominal, &tolerance, &frequency))
+        return NULL;
+    if (throttle_running)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Throttle monitor already running");
+        return NULL;
+    }
+    if (interval < 0.001 || interval > 3600)
+    {
+        PyErr_SetString(PyExc_ValueError, "interval must be between 0.001 and 3600 seconds");
+        return NULL;
+    }
+    if (tolerance < 0 || tolerance >= 1 || nominal < 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "tolerance must be in [0, 1) and nominal positive");
+        return NULL;
+    }
+    if (need_native_topology() < 0 || need_timer() < 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Cannot initialize the topology and timer modules");
+        return NULL;
+    }
+    if (nominal == 0)
+        nominal = (double)timer_getCpuClock();
+    if (nominal <= 0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Cannot determine the nominal clock, pass nominal");
+        return NULL;
+    }
+    /* The given CPUs, the perfmon CPUs or all hardware threads */
+    if (pycpus != Py_None)
+    {
+        seq = PySequence_Fast(pycpus, "cpus must be a sequence of CPU IDs");
+        if (seq == NULL)
+            return NULL;
+        n = (int)PySequence_Fast_GET_SIZE(seq);
+    }
+    else if (perfmon_initialized && perfmon_ncpus > 0)
+        n = perfmon_ncpus;
+    else
+        n = (int)cputopo->numHWThreads;
+    if (n == 0)
+    {
+        Py_XDECREF(seq);
+        PyErr_SetString(PyExc_ValueError, "No CPUs to monitor");
+        return NULL;
+    }
+    cpus = calloc(n, sizeof(ThrottleCpu));
+    if (cpus == NULL)
+    {
+        Py_XDECREF(seq);
+        return PyErr_NoMemory();
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (seq != NULL)
+        {
+            cpus[i].cpu = (int)PyLong_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+            if (cpus[i].cpu == -1 && PyErr_Occurred())
+                break;
+            if (cpus[i].cpu < 0 || cpus[i].cpu >= (int)cputopo->numHWThreads)
+            {
+                PyErr_Format(PyExc_ValueError, "Invalid CPU %d", cpus[i].cpu);
+                break;
+            }
+        }
+        else if (perfmon_initialized && perfmon_ncpus > 0)
+            cpus[i].cpu = perfmon_cpus[i];
+        else
+            cpus[i].cpu = (int)cputopo->threadPool[i].apicId;
+        cpus[i].thread = -1;
+    }
+    Py_XDECREF(seq);
+    if (PyErr_Occurred())
+    {
+        free(cpus);
+        return NULL;
+    }
+    /* Effective clock from the cycle counters of the active group */
+    if (perfmon_initialized && perfmon_ncpus > 0)
+    {
+        gid = perfmon_getIdOfActiveGroup();
+        if (gid < 0 || throttle_events(gid, &core, &ref) < 0)
+            gid = -1;
+        for (i = 0; i < n && gid >= 0; i++)
+        {
+            for (t = 0; t < perfmon_ncpus; t++)
+            {
+                if (perfmon_cpus[t] == cpus[i].cpu)
+                    cpus[i].thread = t;
+            }
+        }
+    }
+    /* The current core clock is also low on idle or clocked down CPUs */
+    for (i = 0; i < n && !frequency; i++)
+    {
+        if (gid < 0 || cpus[i].thread < 0)
+        {
+            PyErr_Format(PyExc_RuntimeError, "No cycle counters of CPU %d in the active group, "
+                         "pass frequency=True to use the current core clock", cpus[i].cpu);
+            free(cpus);
+            return NULL;
+        }
+    }
+    if (register_atexit(&throttle_atexit_def, &atexit_registered) < 0)
+    {
+        free(cpus);
+        return NULL;
+    }
+    Py_XSETREF(throttle_intervals, PyList_New(0));
+    if (throttle_intervals == NULL)
+    {
+        free(cpus);
+        return NULL;
+    }
+    throttle_msr = (cpuinfo != NULL && cpuinfo->isIntel && (access_initialized || perfmon_initialized));
+    for (i = 0; i < n; i++)
+    {
+        thermal_init(cpus[i].cpu);
+        if (throttle_msr)
+            HPMaddThread(cpus[i].cpu);
+    }
+    free(throttle_cpus);
+    throttle_cpus = cpus;
+    throttle_ncpus = n;
+    throttle_gid = gid;
+    throttle_core = core;
+    throttle_ref = ref;
+    throttle_interval = interval;
+    throttle_nominal = nominal;
+    throttle_tolerance = tolerance;
+    throttle_nsamples = 0;
+    throttle_stopping = 0;
+    /* Start the counter interval with the monitor */
+    if (gid >= 0)
+        perfmon_readGroupCounters(gid);
+    throttle_t0 = throttle_now();
+    if (pthread_create(&throttle_thread, NULL, throttle_main, NULL) != 0)
+    {
+        throttle_gid = -1;
+        PyErr_SetString(PyExc_RuntimeError, "Cannot start the throttle monitor thread");
+        return NULL;
+    }
+    throttle_running = 1;
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+likwid_throttlereport(PyObject *self, PyObject *args)
+{
+    PyObject *d, *temps, *regions, *intervals;
+    Py_ssize_t i, j;
+    int c;
+    if (throttle_running)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Stop the throttle monitor first");
+        return NULL;
+    }
+    if (throttle_intervals == NULL)
+        Py_RETURN_NONE;
+    intervals = PySequence_List(throttle_intervals);
+    if (intervals == NULL)
+        return NULL;
+    d = PyDict_New();
+    temps = PyDict_New();
+    regions = PyDict_New();
+    for (c = 0; c < throttle_ncpus; c++)
+        pydict_setobj(temps, PYINT(throttle_cpus[c].cpu), PYUINT(throttle_cpus[c].peaktemp));
+    /* Drop intervals and seconds per region */
+    for (i = 0; i < PyList_GET_SIZE(intervals); i++)
+    {
+        PyObject* iv = PyList_GET_ITEM(intervals, i);
+        PyObject* tags = PyDict_GetItemString(iv, "regions");
+        double seconds = PyFloat_AsDouble(PyDict_GetItemString(iv, "end")) -
+                         PyFloat_AsDouble(PyDict_GetItemString(iv, "start"));
+        for (j = 0; tags != NULL && j < PyList_GET_SIZE(tags); j++)
+        {
+            PyObject* tag = PyList_GET_ITEM(tags, j);
+            PyObject* r = PyDict_GetItem(regions, tag);
+            if (r == NULL)
+            {
+                r = PyDict_New();
+                pydict_set(r, "intervals", PyLong_FromLong(0));
+                pydict_set(r, "seconds", PyFloat_FromDouble(0));
+                Py_INCREF(tag);
+                pydict_setobj(regions, tag, r);
+            }
+            pydict_set(r, "intervals",
+                       PyLong_FromLong(PyLong_AsLong(PyDict_GetItemString(r, "intervals")) + 1));
+            pydict_set(r, "seconds",
+                       PyFloat_FromDouble(PyFloat_AsDouble(PyDict_GetItemString(r, "seconds")) + seconds));
+        }
+    }
+    pydict_set(d, "samples", PyLong_FromLong(throttle_nsamples));
+    pydict_set(d, "nominal", PyFloat_FromDouble(throttle_nominal));
+    pydict_set(d, "source", PYSTR(throttle_core >= 0 ? "counters" : "frequency"));
+    pydict_set(d, "indicators", PyBool_FromLong(throttle_msr));
+    pydict_set(d, "maxtemp", temps);
+    pydict_set(d, "intervals", intervals);
+    pydict_set(d, "regions", regions);
+    if (PyErr_Occurred())
+    {
+        Py_XDECREF(d);
+        return NULL;
+    }
+    return d;
+}
+
+
+#if LIKWID_MAJOR == 5 && defined LIKWID_NVMON
+static int gpuTopology_initialized = 0;
+static GpuTopology_t gputopo = NULL;
+static int nvmon_initialized = 0;
+
+static PyObject *
+likwid_initgputopology(PyObject *self, PyObject *args)
+{
+    int ret = 0;
+    if (!gpuTopology_initialized)
+    {
+        ret = topology_gpu_init();
+        if (ret == EXIT_SUCCESS)
+        {
+            gpuTopology_initialized = 1;
+        }
+    }
+    return Py_BuildValue("i", ret);
+}
+
+static PyObject *
+likwid_finalizegputopology(PyObject *self, PyObject *args)
+{
+    if (gpuTopology_initialized)
+    {
+        topology_gpu_finalize();
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+likwid_getgputopology(PyObject *self, PyObject *args)
+{
+    int i, ret;
+
+    if (!gpuTopology_initialized)
+    {
+        ret = topology_gpu_init();
+        if (ret == EXIT_SUCCESS)
+        {
+            gpuTopology_initialized = 1;
+        }
+        else
+        {
+            Py_RETURN_NONE;
+        }
+    }
+    gputopo = get_gpuTopology();
+    if (gputopo)
+    {
+        PyObject *l = PyList_New(gputopo->numDevices);
+        for(i = 0; i < gputopo->numDevices; i++)
+        {
+            GpuDevice* dev = &gputopo->devices[i];
+            PyObject *d = PyDict_New();
+
+            pydict_set(d, "devid", PYUINT(dev->devid));
+            pydict_set(d, "numaNode", PYUINT(dev->numaNode));
+            pydict_set(d, "name", PYSTR(dev->name));
+            pydict_set(d, "mem", PYUINT(dev->mem));
+            pydict_set(d, "ccapMajor", PYUINT(dev->ccapMajor));
+            pydict_set(d, "ccapMinor", PYUINT(dev->ccapMinor));
+            pydict_set(d, "maxThreadsPerBlock", PYUINT(dev->maxThreadsPerBlock));
+            pydict_set(d, "sharedMemPerBlock", PYUINT(dev->sharedMemPerBlock));
+            pydict_set(d, "totalConstantMemory", PYUINT(dev->totalConstantMemory));
+            pydict_set(d, "simdWidth", PYUINT(dev->simdWidth));
+            pydict_set(d, "memPitch", PYUINT(dev->memPitch));
+            pydict_set(d, "regsPerBlock", PYUINT(dev->regsPerBlock));
+            pydict_set(d, "clockRatekHz", PYUINT(dev->clockRatekHz));
+            pydict_set(d, "textureAlign", PYUINT(dev->textureAlign));
+            pydict_set(d, "l2Size", PYUINT(dev->l2Size));
+            pydict_set(d, "memClockRatekHz", PYUINT(dev->memClockRatekHz));
+            pydict_set(d, "pciBus", PYUINT(dev->pciBus));
+            pydict_set(d, "pciDev", PYUINT(dev->pciDev));
+            pydict_set(d, "pciDom", PYUINT(dev->pciDom));
+            pydict_set(d, "maxBlockRegs", PYUINT(dev->maxBlockRegs));
+            pydict_set(d, "numMultiProcs", PYUINT(dev->numMultiProcs));
+            pydict_set(d, "maxThreadPerMultiProc", PYUINT(dev->maxThreadPerMultiProc));
+            pydict_set(d, "memBusWidth", PYUINT(dev->memBusWidth));
+            pydict_set(d, "unifiedAddrSpace", PYUINT(dev->unifiedAddrSpace));
+            pydict_set(d, "ecc", PYUINT(dev->ecc));
+            pydict_set(d, "asyncEngines", PYUINT(dev->asyncEngines));
+            pydict_set(d, "mapHostMem", PYUINT(dev->mapHostMem));
+            pydict_set(d, "integrated", PYUINT(dev->integrated));
+
+            PyObject *maxThreadsDim = PyList_New(3);
+            PyList_SET_ITEM(maxThreadsDim, 0, PYUINT(dev->maxThreadsDim[0]));
+            PyList_SET_ITEM(maxThreadsDim, 1, PYUINT(dev->maxThreadsDim[1]));
+            PyList_SET_ITEM(maxThreadsDim, 2, PYUINT(dev->maxThreadsDim[2]));
+            pydict_set(d, "maxThreadsDim", maxThreadsDim);
+
+            PyObject *maxGridSize = PyList_New(3);
+            PyList_SET_ITEM(maxGridSize, 0, PYUINT(dev->maxGridSize[0]));
+            PyList_SET_ITEM(maxGridSize, 1, PYUINT(dev->maxGridSize[1]));
+            PyList_SET_ITEM(maxGridSize, 2, PYUINT(dev->maxGridSize[2]));
+            pydict_set(d, "maxGridSize", maxGridSize);
+
+            PyList_SET_ITEM(l, (Py_ssize_t)i, d);
+        }
+        return l;
+    }
+    Py_RETURN_NONE;
 }
 
-#if (LIKWID_MAJOR == 5)
+/*
+################################################################################
+# Nvmon Marker API related functions
+################################################################################
+*/
+
 static PyObject *
-likwid_freqGetConfCpuClockMin(PyObject *self, PyObject *args)
+likwid_gpumarkerinit(PyObject *self, PyObject *args)
 {
-    int c = 0;
-    PyArg_ParseTuple(args, "i", &c);
-    return PYUINT(freq_getConfCpuClockMin(c));
+    likwid_gpuMarkerInit();
+    Py_RETURN_NONE;
 }
-#endif
+
 
 static PyObject *
-likwid_freqSetCpuClockMax(PyObject *self, PyObject *args)
+likwid_gpumarkerregisterregion(PyObject *self, PyObject *args)
 {
-    int c = 0;
-    int f = 0;
-    PyArg_ParseTuple(args, "ii", &c, &f);
-    return PYUINT(freq_setCpuClockMax(c, f));
+    const char *regiontag;
+    int ret;
+    if (!PyArg_ParseTuple(args, "s", &regiontag))
+        return NULL;
+
+    ret = likwid_gpuMarkerRegisterRegion(regiontag);
+    return Py_BuildValue("i", ret);
 }
 
 static PyObject *
-likwid_freqSetCpuClockMin(PyObject *self, PyObject *args)
+likwid_gpumarkerstartregion(PyObject *self, PyObject *args)
 {
-    int c = 0;
-    int f = 0;
-    PyArg_ParseTuple(args, "ii", &c, &f);
-    return PYUINT(freq_setCpuClockMin(c, f));
+    const char *regiontag;
+    int ret;
+    if (!PyArg_ParseTuple(args, "s", &regiontag))
+        return NULL;
+
+    ret = likwid_gpuMarkerStartRegion(regiontag);
+    return Py_BuildValue("i", ret);
 }
 
 static PyObject *
-likwid_freqGetGovernor(PyObject *self, PyObject *args)
+likwid_gpumarkerstopregion(PyObject *self, PyObject *args)
 {
-    int c = 0;
-    PyArg_ParseTuple(args, "i", &c);
-    return PYSTR(freq_getGovernor(c));
+    const char *regiontag;
+    int ret;
+    if (!PyArg_ParseTuple(args, "s", &regiontag))
+        return NULL;
+
+    ret = likwid_gpuMarkerStopRegion(regiontag);
+    return Py_BuildValue("i", ret);
 }
 
 static PyObject *
-likwid_freqSetGovernor(PyObject *self, PyObject *args)
+likwid_gpumarkergetregion(PyObject *self, PyObject *args)
 {
-    int c = 0;
-    const char* g;
-    PyArg_ParseTuple(args, "is", &c, &g);
-    return PYINT(freq_setGovernor(c, (char*)g));
+    int i;
+    int currentGroup = 0;
+    const char *regiontag = NULL;
+    int nr_events = 0;
+    double* events = NULL;
+    double time = 0;
+    int count = 0;
+    int nr_gpus = 0;
+    Py_ssize_t pyLen = 0;
+    PyObject *pyList;
+    if (!PyArg_ParseTuple(args, "s", &regiontag))
+        return NULL;
+    currentGroup = nvmon_getIdOfActiveGroup();
+    nr_events = nvmon_getNumberOfEvents(currentGroup);
+    events = (double*) malloc(nr_events * sizeof(double));
+    if (events == NULL)
+    {
+        return NULL;
+    }
+    for (i = 0; i < nr_events; i++)
+    {
+        events[i] = 0.0;
+    }
+    pyLen = (Py_ssize_t)nr_events;
+    pyList = PyList_New(pyLen);
+    likwid_gpuMarkerGetRegion(regiontag, &nr_gpus, &nr_events, &events, &time, &count);
+    for (i=0; i< nr_events; i++)
+    {
+        PyList_SET_ITEM(pyList, (Py_ssize_t)i, Py_BuildValue("d", events[i]));
+    }
+    free(events);
+    return Py_BuildValue("iiNdi", nr_gpus, nr_events, pyList, time, count);
 }
 
 static PyObject *
-likwid_freqGetAvailFreq(PyObject *self, PyObject *args)
+likwid_gpumarkernextgroup(PyObject *self, PyObject *args)
 {
-    int c = 0;
-    PyArg_ParseTuple(args, "i", &c);
-    return PYSTR(freq_getAvailFreq(c));
+    likwid_gpuMarkerNextGroup();
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+likwid_gpumarkerresetregion(PyObject *self, PyObject *args)
+{
+    const char *regiontag;
+    int ret;
+    if (!PyArg_ParseTuple(args, "s", &regiontag))
+        return NULL;
+
+    ret = likwid_gpuMarkerResetRegion(regiontag);
+    return Py_BuildValue("i", ret);
+}
+
+
+static PyObject *
+likwid_gpumarkerclose(PyObject *self, PyObject *args)
+{
+    likwid_gpuMarkerClose();
+    Py_RETURN_NONE;
+}
+
+
+/*
+################################################################################
+# Nvmon related functions
+################################################################################
+*/
+
+static PyObject *
+likwid_nvmon_init(PyObject *self, PyObject *args)
+{
+    int ret, i;
+    int nrGpus = 0;
+    PyObject * pyList;
+
+    if (gpuTopology_initialized == 0)
+    {
+        topology_gpu_init();
+        gpuTopology_initialized = 1;
+        gputopo = get_gpuTopology();
+    }
+    if ((gpuTopology_initialized) && (gputopo == NULL))
+    {
+        gputopo = get_gpuTopology();
+    }
+
+    PyArg_ParseTuple(args, "O!", &PyList_Type, &pyList);
+    if (pyList == NULL)
+    {
+        printf("No function argument\n");
+        return PYINT(1);
+    }
+    if (!PyList_Check(pyList))
+    {
+        printf("Function argument is no list\n");
+        return PYINT(1);
+    }
+    nrGpus = PyList_Size(pyList);
+    int * gpulist = malloc(nrGpus * sizeof(int));
+    if (!gpulist)
+    {
+        printf("Cannot allocate space for gpu list\n");
+        return PYINT(1);
+    }
+    for (i=0; i<nrGpus; i++)
+    {
+        int size = 0;
+#if (PY_MAJOR_VERSION == 2)
+        size = (int)PyInt_AsSsize_t(PyList_GetItem(pyList, i));
+#endif
+#if (PY_MAJOR_VERSION == 3)
+        size = (int)PyLong_AsSsize_t(PyList_GetItem(pyList, i));
+#endif
+        gpulist[i] = size;
+    }
+    if (nvmon_initialized == 0)
+    {
+        ret = nvmon_init(nrGpus, &(gpulist[0]));
+        if (ret != 0)
+        {
+            free(gpulist);
+            printf("Initialization of PerfMon module failed.\n");
+            return PYINT(1);
+        }
+        nvmon_initialized = 1;
+    }
+    free(gpulist);
+    return PYINT(0);
+}
+
+static PyObject *
+likwid_nvmon_addEventSet(PyObject *self, PyObject *args)
+{
+    if (nvmon_initialized == 0)
+    {
+        return PYINT(-1);
+    }
+    const char* tmpString;
+    int groupId;
+    PyArg_ParseTuple(args, "s", &tmpString);
+    groupId = nvmon_addEventSet((char*)tmpString);
+    return PYINT(groupId);
+}
+
+static PyObject *
+likwid_nvmon_setupCounters(PyObject *self, PyObject *args)
+{
+    if (nvmon_initialized == 0)
+    {
+        return PYINT(-1);
+    }
+    int groupId, ret = 0;
+    PyArg_ParseTuple(args, "i", &groupId);
+    ret = nvmon_setupCounters(groupId);
+    return PYINT(ret);
+}
+
+static PyObject *
+likwid_nvmon_startCounters(PyObject *self, PyObject *args)
+{
+    int ret;
+    if (nvmon_initialized == 0)
+    {
+        return PYINT(-1);
+    }
+    ret = nvmon_startCounters();
+    return PYINT(ret);
+}
+
+static PyObject *
+likwid_nvmon_stopCounters(PyObject *self, PyObject *args)
+{
+    int ret;
+    if (nvmon_initialized == 0)
+    {
+        return PYINT(-1);
+    }
+    ret = nvmon_stopCounters();
+    return PYINT(ret);
 }
 
 static PyObject *
-likwid_freqGetAvailGovs(PyObject *self, PyObject *args)
+likwid_nvmon_readCounters(PyObject *self, PyObject *args)
 {
-    int c = 0;
-    PyArg_ParseTuple(args, "i", &c);
-    return PYSTR(freq_getAvailGovs(c));
+    int ret;
+    if (nvmon_initialized == 0)
+    {
+        return PYINT(-1);
+    }
+    ret = nvmon_readCounters();
+    return PYINT(ret);
 }
 
 static PyObject *
-likwid_freqSetUncoreClockMin(PyObject *self, PyObject *args)
+likwid_nvmon_switchGroup(PyObject *self, PyObject *args)
 {
-    int s = 0;
-    int f = 0;
-    PyArg_ParseTuple(args, "ii", &s, &f);
-    return Py_BuildValue("i", freq_setUncoreFreqMin(s, f));
+    int ret = 0, newgroup;
+    if (nvmon_initialized == 0)
+    {
+        return PYINT(-1);
+    }
+    PyArg_ParseTuple(args, "i", &newgroup);
+    if (newgroup >= nvmon_getNumberOfGroups())
+    {
+        newgroup = 0;
+    }
+    if (newgroup == nvmon_getIdOfActiveGroup())
+    {
+        return PYINT(-1);
+    }
+    ret = nvmon_switchActiveGroup(newgroup);
+    return PYINT(ret);
 }
 
 static PyObject *
-likwid_freqGetUncoreClockMin(PyObject *self, PyObject *args)
+likwid_nvmon_finalize(PyObject *self, PyObject *args)
 {
-    int s = 0;
-    PyArg_ParseTuple(args, "i", &s);
-    return PYUINT(freq_getUncoreFreqMin(s)*1000000);
+    if (nvmon_initialized == 1)
+    {
+        nvmon_finalize();
+        nvmon_initialized = 0;
+    }
+    if (gpuTopology_initialized == 1)
+    {
+        topology_gpu_finalize();
+        gpuTopology_initialized = 0;
+        gputopo = NULL;
+    }
+    return PYINT(0);
 }
 
 static PyObject *
-likwid_freqSetUncoreClockMax(PyObject *self, PyObject *args)
+likwid_nvmon_getResult(PyObject *self, PyObject *args)
 {
-    int s = 0;
-    int f = 0;
-    PyArg_ParseTuple(args, "ii", &s, &f);
-    return Py_BuildValue("i", freq_setUncoreFreqMax(s, f));
+    int g, e, t;
+    double result;
+    PyArg_ParseTuple(args, "iii", &g, &e, &t);
+    result = nvmon_getResult(g, e, t);
+    return Py_BuildValue("d", result);
 }
 
 static PyObject *
-likwid_freqGetUncoreClockMax(PyObject *self, PyObject *args)
+likwid_nvmon_getLastResult(PyObject *self, PyObject *args)
 {
-    int s = 0;
-    PyArg_ParseTuple(args, "i", &s);
-    return PYUINT(freq_getUncoreFreqMax(s)*1000000);
+    int g, e, t;
+    double result;
+    PyArg_ParseTuple(args, "iii", &g, &e, &t);
+    result = nvmon_getLastResult(g, e, t);
+    return Py_BuildValue("d", result);
 }
 
-#if (LIKWID_MAJOR == 5)
 static PyObject *
-likwid_freqFinalize(PyObject *self, PyObject *args)
+likwid_nvmon_getMetric(PyObject *self, PyObject *args)
 {
-    freq_finalize();
-    Py_RETURN_NONE;
+    int g, m, t;
+    double result;
+    PyArg_ParseTuple(args, "iii", &g, &m, &t);
+    result = nvmon_getMetric(g, m, t);
+    return Py_BuildValue("d", result);
 }
-#endif
 
-#if 0
 static PyObject *
-likwid_freqGetUncoreClockCurrent(PyObject *self, PyObject *args)
+likwid_nvmon_getLastMetric(PyObject *self, PyObject *args)
 {
-    int s = 0;
-    PyArg_ParseTuple(args, "i", &s);
-    return PYUINT(freq_getUncoreFreqCur(s)*1000000);
+    int g, m, t;
+    double result = 0.0;
+    PyArg_ParseTuple(args, "iii", &g, &m, &t);
+    result = nvmon_getLastMetric(g, m, t);
+    return Py_BuildValue("d", result);
 }
-#endif
-
-
-#if LIKWID_MAJOR == 5 && defined LIKWID_NVMON
-static int gpuTopology_initialized = 0;
-static GpuTopology_t gputopo = NULL;
-static int nvmon_initialized = 0;
 
 static PyObject *
-likwid_initgputopology(PyObject *self, PyObject *args)
+likwid_nvmon_getNumberOfGroups(PyObject *self, PyObject *args)
 {
-    int ret = 0;
-    if (!gpuTopology_initialized)
+    if (nvmon_initialized == 0)
     {
-        ret = topology_gpu_init();
-        if (ret == EXIT_SUCCESS)
-        {
-            gpuTopology_initialized = 1;
-        }
+        return 0;
     }
-    return Py_BuildValue("i", ret);
+    return PYINT(nvmon_getNumberOfGroups());
 }
 
 static PyObject *
-likwid_finalizegputopology(PyObject *self, PyObject *args)
+likwid_nvmon_getIdOfActiveGroup(PyObject *self, PyObject *args)
 {
-    if (gpuTopology_initialized)
+    if (nvmon_initialized == 0)
     {
-        topology_gpu_finalize();
+        return 0;
     }
-    Py_RETURN_NONE;
+    return PYINT(nvmon_getIdOfActiveGroup());
 }
 
 static PyObject *
-likwid_getgputopology(PyObject *self, PyObject *args)
+likwid_nvmon_getNumberOfGpus(PyObject *self, PyObject *args)
 {
-    int i, ret;
-
-    if (!gpuTopology_initialized)
-    {
-        ret = topology_gpu_init();
-        if (ret == EXIT_SUCCESS)
-        {
-            gpuTopology_initialized = 1;
-        }
-        else
-        {
-            Py_RETURN_NONE;
-        }
-    }
-    gputopo = get_gpuTopology();
-    if (gputopo)
+    if (nvmon_initialized == 0)
     {
-        PyObject *l = PyList_New(gputopo->numDevices);
-        for(i = 0; i < gputopo->numDevices; i++)
-        {
-            GpuDevice* dev = &gputopo->devices[i];
-            PyObject *d = PyDict_New();
-
-            PyDict_SetItem(d, PYSTR("devid"), PYUINT(dev->devid));
-            PyDict_SetItem(d, PYSTR("numaNode"), PYUINT(dev->numaNode));
-            PyDict_SetItem(d, PYSTR("name"), PYSTR(dev->name));
-            PyDict_SetItem(d, PYSTR("mem"), PYUINT(dev->mem));
-            PyDict_SetItem(d, PYSTR("ccapMajor"), PYUINT(dev->ccapMajor));
-            PyDict_SetItem(d, PYSTR("ccapMinor"), PYUINT(dev->ccapMinor));
-            PyDict_SetItem(d, PYSTR("maxThreadsPerBlock"), PYUINT(dev->maxThreadsPerBlock));
-            PyDict_SetItem(d, PYSTR("sharedMemPerBlock"), PYUINT(dev->sharedMemPerBlock));
-            PyDict_SetItem(d, PYSTR("totalConstantMemory"), PYUINT(dev->totalConstantMemory));
-            PyDict_SetItem(d, PYSTR("simdWidth"), PYUINT(dev->simdWidth));
-            PyDict_SetItem(d, PYSTR("memPitch"), PYUINT(dev->memPitch));
-            PyDict_SetItem(d, PYSTR("regsPerBlock"), PYUINT(dev->regsPerBlock));
-            PyDict_SetItem(d, PYSTR("clockRatekHz"), PYUINT(dev->clockRatekHz));
-            PyDict_SetItem(d, PYSTR("textureAlign"), PYUINT(dev->textureAlign));
-            PyDict_SetItem(d, PYSTR("l2Size"), PYUINT(dev->l2Size));
-            PyDict_SetItem(d, PYSTR("memClockRatekHz"), PYUINT(dev->memClockRatekHz));
-            PyDict_SetItem(d, PYSTR("pciBus"), PYUINT(dev->pciBus));
-            PyDict_SetItem(d, PYSTR("pciDev"), PYUINT(dev->pciDev));
-            PyDict_SetItem(d, PYSTR("pciDom"), PYUINT(dev->pciDom));
-            PyDict_SetItem(d, PYSTR("maxBlockRegs"), PYUINT(dev->maxBlockRegs));
-            PyDict_SetItem(d, PYSTR("numMultiProcs"), PYUINT(dev->numMultiProcs));
-            PyDict_SetItem(d, PYSTR("maxThreadPerMultiProc"), PYUINT(dev->maxThreadPerMultiProc));
-            PyDict_SetItem(d, PYSTR("memBusWidth"), PYUINT(dev->memBusWidth));
-            PyDict_SetItem(d, PYSTR("unifiedAddrSpace"), PYUINT(dev->unifiedAddrSpace));
-            PyDict_SetItem(d, PYSTR("ecc"), PYUINT(dev->ecc));
-            PyDict_SetItem(d, PYSTR("asyncEngines"), PYUINT(dev->asyncEngines));
-            PyDict_SetItem(d, PYSTR("mapHostMem"), PYUINT(dev->mapHostMem));
-            PyDict_SetItem(d, PYSTR("integrated"), PYUINT(dev->integrated));
-
-            PyObject *maxThreadsDim = PyList_New(3);
-            PyList_SET_ITEM(maxThreadsDim, 0, PYUINT(dev->maxThreadsDim[0]));
-            PyList_SET_ITEM(maxThreadsDim, 1, PYUINT(dev->maxThreadsDim[1]));
-            PyList_SET_ITEM(maxThreadsDim, 2, PYUINT(dev->maxThreadsDim[2]));
-            PyDict_SetItem(d, PYSTR("maxThreadsDim"), maxThreadsDim);
-
-            PyObject *maxGridSize = PyList_New(3);
-            PyList_SET_ITEM(maxGridSize, 0, PYUINT(dev->maxGridSize[0]));
-            PyList_SET_ITEM(maxGridSize, 1, PYUINT(dev->maxGridSize[1]));
-            PyList_SET_ITEM(maxGridSize, 2, PYUINT(dev->maxGridSize[2]));
-            PyDict_SetItem(d, PYSTR("maxGridSize"), maxGridSize);
-
-            PyList_SET_ITEM(l, (Py_ssize_t)i, d);
-        }
-        return l;
+        return 0;
     }
-    Py_RETURN_NONE;
+    return PYINT(nvmon_getNumberOfGPUs());
 }
 
-/*
-################################################################################
-# Nvmon Marker API related functions
-################################################################################
-*/
-
 static PyObject *
-likwid_gpumarkerinit(PyObject *self, PyObject *args)
+likwid_nvmon_getTimeOfGroup(PyObject *self, PyObject *args)
 {
-    likwid_gpuMarkerInit();
-    Py_RETURN_NONE;
+    if (nvmon_initialized == 0)
+    {
+        return 0;
+    }
+    int groupId;
+    PyArg_ParseTuple(args, "i", &groupId);
+    return Py_BuildValue("d", nvmon_getTimeOfGroup(groupId));
 }
 
-
 static PyObject *
-likwid_gpumarkerregisterregion(PyObject *self, PyObject *args)
+likwid_nvmon_getNumberOfEvents(PyObject *self, PyObject *args)
 {
-    const char *regiontag;
-    int ret;
-    if (!PyArg_ParseTuple(args, "s", &regiontag))
-        return NULL;
-
-    ret = likwid_gpuMarkerRegisterRegion(regiontag);
-    return Py_BuildValue("i", ret);
+    if (nvmon_initialized == 0)
+    {
+        return 0;
+    }
+    int groupId;
+    PyArg_ParseTuple(args, "i", &groupId);
+    return PYINT(nvmon_getNumberOfEvents(groupId));
 }
 
 static PyObject *
-likwid_gpumarkerstartregion(PyObject *self, PyObject *args)
+likwid_nvmon_getNumberOfMetrics(PyObject *self, PyObject *args)
 {
-    const char *regiontag;
-    int ret;
-    if (!PyArg_ParseTuple(args, "s", &regiontag))
-        return NULL;
-
-    ret = likwid_gpuMarkerStartRegion(regiontag);
-    return Py_BuildValue("i", ret);
+    if (nvmon_initialized == 0)
+    {
+        return 0;
+    }
+    int groupId;
+    PyArg_ParseTuple(args, "i", &groupId);
+    return PYINT(nvmon_getNumberOfMetrics(groupId));
 }
 
 static PyObject *
-likwid_gpumarkerstopregion(PyObject *self, PyObject *args)
+likwid_nvmon_getNameOfEvent(PyObject *self, PyObject *args)
 {
-    const char *regiontag;
-    int ret;
-    if (!PyArg_ParseTuple(args, "s", &regiontag))
-        return NULL;
-
-    ret = likwid_gpuMarkerStopRegion(regiontag);
-    return Py_BuildValue("i", ret);
+    if (nvmon_initialized == 0)
+    {
+        return 0;
+    }
+    int g, e;
+    PyArg_ParseTuple(args, "ii", &g, &e);
+    return PYSTR(nvmon_getEventName(g,e));
 }
 
 static PyObject *
-likwid_gpumarkergetregion(PyObject *self, PyObject *args)
+likwid_nvmon_getNameOfCounter(PyObject *self, PyObject *args)
 {
-    int i;
-    int currentGroup = 0;
-    const char *regiontag = NULL;
-    int nr_events = 0;
-    double* events = NULL;
-    double time = 0;
-    int count = 0;
-    int nr_gpus = 0;
-    Py_ssize_t pyLen = 0;
-    PyObject *pyList;
-    if (!PyArg_ParseTuple(args, "s", &regiontag))
-        return NULL;
-    currentGroup = nvmon_getIdOfActiveGroup();
-    nr_events = nvmon_getNumberOfEvents(currentGroup);
-    events = (double*) malloc(nr_events * sizeof(double));
-    if (events == NULL)
-    {
-        return NULL;
-    }
-    for (i = 0; i < nr_events; i++)
+    if (nvmon_initialized == 0)
     {
-        events[i] = 0.0;
+        return 0;
     }
-    pyLen = (Py_ssize_t)nr_events;
-    pyList = PyList_New(pyLen);
-    likwid_gpuMarkerGetRegion(regiontag, &nr_gpus, &nr_events, &events, &time, &count);
-    for (i=0; i< nr_events; i++)
+    int g, c;
+    PyArg_ParseTuple(args, "ii", &g, &c);
+    return PYSTR(nvmon_getCounterName(g,c));
+}
+
+static PyObject *
+likwid_nvmon_getNameOfMetric(PyObject *self, PyObject *args)
+{
+    if (nvmon_initialized == 0)
     {
-        PyList_SET_ITEM(pyList, (Py_ssize_t)i, Py_BuildValue("d", events[i]));
+        return 0;
     }
-    free(events);
-    return Py_BuildValue("iiOdi", nr_gpus, nr_events, pyList, time, count);
+    int g, m;
+    PyArg_ParseTuple(args, "ii", &g, &m);
+    return PYSTR(nvmon_getMetricName(g,m));
 }
 
 static PyObject *
-likwid_gpumarkernextgroup(PyObject *self, PyObject *args)
+likwid_nvmon_getNameOfGroup(PyObject *self, PyObject *args)
 {
-    likwid_gpuMarkerNextGroup();
-    Py_RETURN_NONE;
+    if (nvmon_initialized == 0)
+    {
+        return 0;
+    }
+    int groupId;
+    PyArg_ParseTuple(args, "i", &groupId);
+    return PYSTR(nvmon_getGroupName(groupId));
 }
 
 static PyObject *
-likwid_gpumarkerresetregion(PyObject *self, PyObject *args)
+likwid_nvmon_getShortInfoOfGroup(PyObject *self, PyObject *args)
 {
-    const char *regiontag;
-    int ret;
-    if (!PyArg_ParseTuple(args, "s", &regiontag))
-        return NULL;
-
-    ret = likwid_gpuMarkerResetRegion(regiontag);
-    return Py_BuildValue("i", ret);
+    if (nvmon_initialized == 0)
+    {
+        return 0;
+    }
+    int groupId;
+    PyArg_ParseTuple(args, "i", &groupId);
+    return PYSTR(nvmon_getGroupInfoShort(groupId));
 }
 
-
 static PyObject *
-likwid_gpumarkerclose(PyObject *self, PyObject *args)
+likwid_nvmon_getLongInfoOfGroup(PyObject *self, PyObject *args)
 {
-    likwid_gpuMarkerClose();
-    Py_RETURN_NONE;
+    if (nvmon_initialized == 0)
+    {
+        return 0;
+    }
+    int groupId;
+    PyArg_ParseTuple(args, "i", &groupId);
+    return PYSTR(nvmon_getGroupInfoLong(groupId));
 }
 
-
-/*
-################################################################################
-# Nvmon related functions
-################################################################################
-*/
-
 static PyObject *
-likwid_nvmon_init(PyObject *self, PyObject *args)
+likwid_nvmon_getGroups(PyObject *self, PyObject *args)
 {
-    int ret, i;
-    int nrGpus = 0;
-    PyObject * pyList;
-
+#if LIKWID_RELEASE >= 1
+    // Since 5.1.0, nvmon_getGroups takes the the gpu id as first argument.
+    int gpuId, i, ret;
+    if (!PyArg_ParseTuple(args, "i", &gpuId))
+    {
+        Py_RETURN_NONE;
+    }
+#else
+    int i, ret;
+#endif
+    char** tmp, **infos, **longs;
+    PyObject *l;
     if (gpuTopology_initialized == 0)
     {
         topology_gpu_init();
         gpuTopology_initialized = 1;
-        gputopo = get_gpuTopology();
     }
-    if ((gpuTopology_initialized) && (gputopo == NULL))
+    if (gpuTopology_initialized && gputopo == NULL)
     {
         gputopo = get_gpuTopology();
     }
-
-    PyArg_ParseTuple(args, "O!", &PyList_Type, &pyList);
-    if (pyList == NULL)
+#if LIKWID_RELEASE >= 1
+    ret = nvmon_getGroups(gpuId, &tmp, &infos, &longs);
+#else
+    ret = nvmon_getGroups(&tmp, &infos, &longs);
+#endif
+    if (ret > 0)
     {
-        printf("No function argument\n");
-        return PYINT(1);
+        l = PyList_New(ret);
+        for(i=0;i<ret;i++)
+        {
+            PyObject *d = PyDict_New();
+            pydict_set(d, "Name", PYSTR(tmp[i]));
+            pydict_set(d, "Info", PYSTR(infos[i]));
+            pydict_set(d, "Long", PYSTR(longs[i]));
+            PyList_SET_ITEM(l, (Py_ssize_t)i, d);
+        }
+        nvmon_returnGroups(ret, tmp, infos, longs);
     }
-    if (!PyList_Check(pyList))
+    else
     {
-        printf("Function argument is no list\n");
-        return PYINT(1);
+        l = PyList_New(0);
     }
-    nrGpus = PyList_Size(pyList);
-    int * gpulist = malloc(nrGpus * sizeof(int));
-    if (!gpulist)
+    return l;
+}
+
+static PyObject *
+likwid_nvmon_setverbosity(PyObject *self, PyObject *args)
+{
+    int verbosity;
+    if (!PyArg_ParseTuple(args, "i", &verbosity))
+        return NULL;
+    if (verbosity >= DEBUGLEV_ONLY_ERROR && verbosity <= DEBUGLEV_DEVELOP)
     {
-        printf("Cannot allocate space for gpu list\n");
-        return PYINT(1);
+        nvmon_setVerbosity(verbosity);
+        return Py_BuildValue("i", verbosity);
     }
-    for (i=0; i<nrGpus; i++)
+    return Py_BuildValue("i", -1);
+}
+
+static PyObject *
+likwid_nvmon_getEventsOfGpu(PyObject *self, PyObject *args)
+{
+    int g;
+    if (!PyArg_ParseTuple(args, "i", &g))
+        Py_RETURN_NONE;
+    if (gpuTopology_initialized == 0)
     {
-        int size = 0;
-#if (PY_MAJOR_VERSION == 2)
-        size = (int)PyInt_AsSsize_t(PyList_GetItem(pyList, i));
-#endif
-#if (PY_MAJOR_VERSION == 3)
-        size = (int)PyLong_AsSsize_t(PyList_GetItem(pyList, i));
-#endif
-        gpulist[i] = size;
+        topology_gpu_init();
+        gpuTopology_initialized = 1;
     }
-    if (nvmon_initialized == 0)
+    if (gpuTopology_initialized && gputopo == NULL)
     {
-        ret = nvmon_init(nrGpus, &(gpulist[0]));
-        if (ret != 0)
+        gputopo = get_gpuTopology();
+    }
+    if (g < 0 || g >= gputopo->numDevices)
+        Py_RETURN_NONE;
+    NvmonEventList_t l = NULL;
+
+    int num_events = nvmon_getEventsOfGpu(g, &l);
+    if (num_events > 0)
+    {
+        PyObject *o = PyList_New(l->numEvents);
+
+        for (int i = 0; i < l->numEvents; i++)
         {
-            free(gpulist);
-            printf("Initialization of PerfMon module failed.\n");
-            return PYINT(1);
+            PyObject *d = PyDict_New();
+            pydict_set(d, "name", PYSTR(l->events[i].name));
+            pydict_set(d, "desc", PYSTR(l->events[i].desc));
+            pydict_set(d, "limit", PYSTR(l->events[i].limit));
+            PyList_SET_ITEM(o, (Py_ssize_t)i, d);
         }
-        nvmon_initialized = 1;
+        nvmon_returnEventsOfGpu(l);
+        return o;
     }
-    free(gpulist);
-    return PYINT(0);
+    Py_RETURN_NONE;
 }
 
-static PyObject *
-likwid_nvmon_addEventSet(PyObject *self, PyObject *args)
+#endif
+
+/*
+################################################################################
+# Record/replay of API calls
+################################################################################
+*/
+
+#define TRACE_MAGIC "PYLWTRC"
+#define TRACE_VERSION 1
+#define TRACE_MARSHAL_VERSION 2
+
+#define TRACE_OFF 0
+#define TRACE_RECORD 1
+#define TRACE_REPLAY 2
+
+/* Flags of the traced functions */
+#define TRACE_MUTATING (1<<0)   /* changes state, replayed in recorded order */
+#define TRACE_RESULTS (1<<1)    /* record all results of the group afterwards */
+#define TRACE_GROUPINFO (1<<2)  /* record the group metadata afterwards */
+#define TRACE_REGION (1<<3)     /* record the region results afterwards */
+#define TRACE_MARKERFILE (1<<4) /* record the marker file contents afterwards */
+
+typedef PyObject* (*TraceBundleFunc)(PyObject *bundle, PyObject *args);
+
+typedef struct {
+    const char* name;
+    int flags;
+    int bundle;
+    TraceBundleFunc frombundle;
+    PyCFunction func;
+} TraceFunc;
+
+typedef struct {
+    int name;
+    int mutating;
+    uint32_t tid;
+    double time;
+    PyObject *key;
+    PyObject *result;
+} TraceRecord;
+
+static int trace_mode = TRACE_OFF;
+static FILE* trace_file = NULL;
+static long trace_count = 0;
+static double trace_start = 0;
+static TraceRecord* trace_records = NULL;
+static long trace_numrecords = 0;
+static long* trace_mutating = NULL;
+static long trace_nummutating = 0;
+static long trace_pos = -1;
+static PyObject *trace_index = NULL;
+
+static PyObject *trace_bundle_result(PyObject *bundle, PyObject *args);
+static PyObject *trace_bundle_lastresult(PyObject *bundle, PyObject *args);
+static PyObject *trace_bundle_metric(PyObject *bundle, PyObject *args);
+static PyObject *trace_bundle_lastmetric(PyObject *bundle, PyObject *args);
+static PyObject *trace_bundle_time(PyObject *bundle, PyObject *args);
+static PyObject *trace_bundle_numregions(PyObject *bundle, PyObject *args);
+static PyObject *trace_bundle_regionfield(PyObject *bundle, PyObject *args);
+static PyObject *trace_bundle_regionthread(PyObject *bundle, PyObject *args);
+static PyObject *trace_bundle_regionmatrix(PyObject *bundle, PyObject *args);
+static PyObject *trace_bundle_regionenergy(PyObject *bundle, PyObject *args);
+
+enum {
+    BUNDLE_NONE = -1,
+    BUNDLE_RESULTS = 0,
+    BUNDLE_MARKERFILE = 1,
+};
+
+/* The first entries are the pseudo functions of the bundles. The order
+ * defines the name index in trace files, the names are stored in the file
+ * header, so entries can be added later on. */
+static TraceFunc trace_funcs[] = {
+    {"@results", 0, BUNDLE_NONE, NULL, NULL},
+    {"@markerfile", 0, BUNDLE_NONE, NULL, NULL},
+    {"inittopology", TRACE_MUTATING, BUNDLE_NONE, NULL, NULL},
+    {"finalizetopology", TRACE_MUTATING, BUNDLE_NONE, NULL, NULL},
+    {"getcputopology", 0, BUNDLE_NONE, NULL, NULL},
+    {"getcpuinfo", 0, BUNDLE_NONE, NULL, NULL},
+    {"initnuma", 0, BUNDLE_NONE, NULL, NULL},
+    {"finalizenuma", TRACE_MUTATING, BUNDLE_NONE, NULL, NULL},
+    {"initaffinity", 0, BUNDLE_NONE, NULL, NULL},
+    {"finalizeaffinity", TRACE_MUTATING, BUNDLE_NONE, NULL, NULL},
+    {"cpustr_to_cpulist", 0, BUNDLE_NONE, NULL, NULL},
+    {"getprocessorid", 0, BUNDLE_NONE, NULL, NULL},
+    {"markerinit", TRACE_MUTATING, BUNDLE_NONE, NULL, NULL},
+    {"markerthreadinit", TRACE_MUTATING, BUNDLE_NONE, NULL, NULL},
+    {"markerregisterregion", TRACE_MUTATING, BUNDLE_NONE, NULL, NULL},
+    {"markerstartregion", TRACE_MUTATING, BUNDLE_NONE, NULL, NULL},
+    {"markerstopregion", TRACE_MUTATING|TRACE_REGION, BUNDLE_NONE, NULL, NULL},
+    {"markergetregion", 0, BUNDLE_NONE, NULL, NULL},
+    {"markernextgroup", TRACE_MUTATING, BUNDLE_NONE, NULL, NULL},
+    {"markerreset", TRACE_MUTATING, BUNDLE_NONE, NULL, NULL},
+    {"markerclose", TRACE_MUTATING, BUNDLE_NONE, NULL, NULL},
+    {"init", TRACE_MUTATING, BUNDLE_NONE, NULL, NULL},
+    {"addeventset", TRACE_MUTATING|TRACE_GROUPINFO, BUNDLE_NONE, NULL, NULL},
+    {"getgid", 0, BUNDLE_NONE, NULL, NULL},
+    {"setup", TRACE_MUTATING, BUNDLE_NONE, NULL, NULL},
+    {"start", TRACE_MUTATING, BUNDLE_NONE, NULL, NULL},
+    {"stop", TRACE_MUTATING|TRACE_RESULTS, BUNDLE_NONE, NULL, NULL},
+    {"read", TRACE_MUTATING|TRACE_RESULTS, BUNDLE_NONE, NULL, NULL},
+    {"readcpu", TRACE_MUTATING|TRACE_RESULTS, BUNDLE_NONE, NULL, NULL},
+    {"readgroup", TRACE_MUTATING|TRACE_RESULTS, BUNDLE_NONE, NULL, NULL},
+    {"readgroupthread", TRACE_MUTATING|TRACE_RESULTS, BUNDLE_NONE, NULL, NULL},
+    {"switch", TRACE_MUTATING|TRACE_RESULTS, BUNDLE_NONE, NULL, NULL},
+    {"finalize", TRACE_MUTATING, BUNDLE_NONE, NULL, NULL},
+    {"getresult", 0, BUNDLE_RESULTS, trace_bundle_result, NULL},
+    {"getlastresult", 0, BUNDLE_RESULTS, trace_bundle_lastresult, NULL},
+    {"getmetric", 0, BUNDLE_RESULTS, trace_bundle_metric, NULL},
+    {"getlastmetric", 0, BUNDLE_RESULTS, trace_bundle_lastmetric, NULL},
+    {"gettimeofgroup", 0, BUNDLE_RESULTS, trace_bundle_time, NULL},
+    {"getnumberofgroups", 0, BUNDLE_NONE, NULL, NULL},
+    {"getnumberofevents", 0, BUNDLE_NONE, NULL, NULL},
+    {"getnumberofmetrics", 0, BUNDLE_NONE, NULL, NULL},
+    {"getnumberofthreads", 0, BUNDLE_NONE, NULL, NULL},
+    {"getidofactivegroup", 0, BUNDLE_NONE, NULL, NULL},
+    {"getgroups", 0, BUNDLE_NONE, NULL, NULL},
+    {"getnameofevent", 0, BUNDLE_NONE, NULL, NULL},
+    {"getnameofcounter", 0, BUNDLE_NONE, NULL, NULL},
+    {"getnameofmetric", 0, BUNDLE_NONE, NULL, NULL},
+    {"getnameofgroup", 0, BUNDLE_NONE, NULL, NULL},
+    {"getshortinfoofgroup", 0, BUNDLE_NONE, NULL, NULL},
+    {"getlonginfoofgroup", 0, BUNDLE_NONE, NULL, NULL},
+    {"markerreadfile", TRACE_MUTATING|TRACE_MARKERFILE, BUNDLE_NONE, NULL, NULL},
+    {"markernumregions", 0, BUNDLE_MARKERFILE, trace_bundle_numregions, NULL},
+    {"markerregiongroup", 0, BUNDLE_MARKERFILE, trace_bundle_regionfield, NULL},
+    {"markerregionevents", 0, BUNDLE_MARKERFILE, trace_bundle_regionfield, NULL},
+    {"markerregiontag", 0, BUNDLE_MARKERFILE, trace_bundle_regionfield, NULL},
+    {"markerregionthreads", 0, BUNDLE_MARKERFILE, trace_bundle_regionfield, NULL},
+    {"markerregioncpulist", 0, BUNDLE_MARKERFILE, trace_bundle_regionfield, NULL},
+    {"markerregiontime", 0, BUNDLE_MARKERFILE, trace_bundle_regionthread, NULL},
+    {"markerregioncount", 0, BUNDLE_MARKERFILE, trace_bundle_regionthread, NULL},
+    {"markerregionresult", 0, BUNDLE_MARKERFILE, trace_bundle_regionmatrix, NULL},
+    {"markerregionmetric", 0, BUNDLE_MARKERFILE, trace_bundle_regionmatrix, NULL},
+    {"markerregionenergy", 0, BUNDLE_MARKERFILE, trace_bundle_regionenergy, NULL},
+};
+#define NUM_TRACE_FUNCS ((int)(sizeof(trace_funcs)/sizeof(TraceFunc)))
+
+static int
+trace_funcindex(const char* name)
 {
-    if (nvmon_initialized == 0)
+    int i;
+    for (i = 0; i < NUM_TRACE_FUNCS; i++)
     {
-        PYINT(-1);
+        if (strcmp(trace_funcs[i].name, name) == 0)
+            return i;
     }
-    const char* tmpString;
-    int groupId;
-    PyArg_ParseTuple(args, "s", &tmpString);
-    groupId = nvmon_addEventSet((char*)tmpString);
-    return PYINT(groupId);
+    return -1;
 }
 
+static double
+trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1E-9;
+}
+
+/* Marshal an object. Objects that cannot be marshalled (e.g. ranges) are
+ * stored by their repr, which is good enough for argument matching. Format
+ * version 2 does not depend on reference counts, so equal arguments always
+ * give equal keys. */
 static PyObject *
-likwid_nvmon_setupCounters(PyObject *self, PyObject *args)
+trace_dumps(PyObject *obj)
 {
-    if (nvmon_initialized == 0)
+    PyObject *s = PyMarshal_WriteObjectToString(obj, TRACE_MARSHAL_VERSION);
+    if (s == NULL && PyErr_ExceptionMatches(PyExc_ValueError))
     {
-        PYINT(-1);
+        PyObject *r;
+        PyErr_Clear();
+        r = PyObject_Repr(obj);
+        if (r == NULL)
+            return NULL;
+        s = PyMarshal_WriteObjectToString(r, TRACE_MARSHAL_VERSION);
+        Py_DECREF(r);
     }
-    int groupId, ret = 0;
-    PyArg_ParseTuple(args, "i", &groupId);
-    ret = nvmon_setupCounters(groupId);
-    return PYINT(ret);
+    return s;
 }
 
-static PyObject *
-likwid_nvmon_startCounters(PyObject *self, PyObject *args)
+static int
+trace_write(int name, PyObject *args, PyObject *result)
+{
+    uint16_t n = (uint16_t)name;
+    uint32_t tid = (uint32_t)syscall(SYS_gettid);
+    double ts = trace_now() - trace_start;
+    uint32_t alen, rlen;
+    PyObject *a = trace_dumps(args);
+    PyObject *r = (a ? trace_dumps(result) : NULL);
+    if (a == NULL || r == NULL)
+    {
+        Py_XDECREF(a);
+        return -1;
+    }
+    alen = (uint32_t)PyBytes_GET_SIZE(a);
+    rlen = (uint32_t)PyBytes_GET_SIZE(r);
+    fwrite(&n, sizeof(n), 1, trace_file);
+    fwrite(&tid, sizeof(tid), 1, trace_file);
+    fwrite(&ts, sizeof(ts), 1, trace_file);
+    fwrite(&alen, sizeof(alen), 1, trace_file);
+    fwrite(PyBytes_AS_STRING(a), 1, alen, trace_file);
+    fwrite(&rlen, sizeof(rlen), 1, trace_file);
+    fwrite(PyBytes_AS_STRING(r), 1, rlen, trace_file);
+    Py_DECREF(a);
+    Py_DECREF(r);
+    trace_count++;
+    if (ferror(trace_file))
+    {
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+    return 0;
+}
+
+/* Call the original function of a traced entry and record the result */
+static int
+trace_record_call(const char* name, PyObject *args)
 {
+    int idx = trace_funcindex(name);
+    PyObject *res;
     int ret;
-    if (nvmon_initialized == 0)
+    if (idx < 0 || trace_funcs[idx].func == NULL)
+        return 0;
+    res = trace_funcs[idx].func(NULL, args);
+    if (res == NULL)
     {
-        PYINT(-1);
+        PyErr_Clear();
+        return 0;
     }
-    ret = nvmon_startCounters();
-    return PYINT(ret);
+    ret = trace_write(idx, args, res);
+    Py_DECREF(res);
+    return ret;
 }
 
-static PyObject *
-likwid_nvmon_stopCounters(PyObject *self, PyObject *args)
+static int
+trace_record_callf(const char* name, const char* fmt, ...)
 {
+    va_list va;
+    PyObject *args;
     int ret;
-    if (nvmon_initialized == 0)
+    va_start(va, fmt);
+    args = Py_VaBuildValue(fmt, va);
+    va_end(va);
+    if (args == NULL)
+        return -1;
+    if (!PyTuple_Check(args))
     {
-        PYINT(-1);
+        PyObject *t = PyTuple_Pack(1, args);
+        Py_DECREF(args);
+        if (t == NULL)
+            return -1;
+        args = t;
     }
-    ret = nvmon_stopCounters();
-    return PYINT(ret);
+    ret = trace_record_call(name, args);
+    Py_DECREF(args);
+    return ret;
 }
 
 static PyObject *
-likwid_nvmon_readCounters(PyObject *self, PyObject *args)
+trace_matrix(int gid, int rows, int nthreads, double (*getter)(int, int, int))
+{
+    int i, t;
+    PyObject *l = PyList_New(rows);
+    for (i = 0; i < rows; i++)
+    {
+        PyObject *row = PyList_New(nthreads);
+        for (t = 0; t < nthreads; t++)
+            PyList_SET_ITEM(row, t, Py_BuildValue("d", getter(gid, i, t)));
+        PyList_SET_ITEM(l, i, row);
+    }
+    return l;
+}
+
+static int
+trace_record_results(int gid)
 {
     int ret;
-    if (nvmon_initialized == 0)
+    int nevents, nmetrics, nthreads;
+    PyObject *args, *bundle;
+    if (gid < 0 || perfmon_initialized == 0)
+        return 0;
+    nevents = perfmon_getNumberOfEvents(gid);
+    nmetrics = perfmon_getNumberOfMetrics(gid);
+    nthreads = perfmon_getNumberOfThreads();
+    if (nevents < 0 || nthreads < 0)
+        return 0;
+    if (nmetrics < 0)
+        nmetrics = 0;
+    bundle = Py_BuildValue("{s:d,s:N,s:N,s:N,s:N}",
+                           "time", perfmon_getTimeOfGroup(gid),
+                           "result", trace_matrix(gid, nevents, nthreads, perfmon_getResult),
+                           "lastresult", trace_matrix(gid, nevents, nthreads, perfmon_getLastResult),
+                           "metric", trace_matrix(gid, nmetrics, nthreads, perfmon_getMetric),
+                           "lastmetric", trace_matrix(gid, nmetrics, nthreads, perfmon_getLastMetric));
+    args = Py_BuildValue("(i)", gid);
+    if (bundle == NULL || args == NULL)
+    {
+        Py_XDECREF(bundle);
+        Py_XDECREF(args);
+        return -1;
+    }
+    ret = trace_write(BUNDLE_RESULTS, args, bundle);
+    Py_DECREF(args);
+    Py_DECREF(bundle);
+    return ret;
+}
+
+static int
+trace_record_groupinfo(int gid)
+{
+    int e, m;
+    if (gid < 0 || perfmon_initialized == 0)
+        return 0;
+    if (trace_record_callf("getnameofgroup", "(i)", gid) < 0 ||
+        trace_record_callf("getshortinfoofgroup", "(i)", gid) < 0 ||
+        trace_record_callf("getlonginfoofgroup", "(i)", gid) < 0 ||
+        trace_record_callf("getnumberofevents", "(i)", gid) < 0 ||
+        trace_record_callf("getnumberofmetrics", "(i)", gid) < 0 ||
+        trace_record_callf("getnumberofgroups", "()") < 0 ||
+        trace_record_callf("getnumberofthreads", "()") < 0)
+        return -1;
+    for (e = 0; e < perfmon_getNumberOfEvents(gid); e++)
+    {
+        if (trace_record_callf("getnameofevent", "(ii)", gid, e) < 0 ||
+            trace_record_callf("getnameofcounter", "(ii)", gid, e) < 0)
+            return -1;
+    }
+    for (m = 0; m < perfmon_getNumberOfMetrics(gid); m++)
+    {
+        if (trace_record_callf("getnameofmetric", "(ii)", gid, m) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int
+trace_record_markerfile(void)
+{
+    int r, t, i, ret;
+    int nregions = perfmon_getNumberOfRegions();
+    PyObject *l, *args;
+    if (nregions < 0)
+        nregions = 0;
+    l = PyList_New(nregions);
+    for (r = 0; r < nregions; r++)
+    {
+        int nthreads = perfmon_getThreadsOfRegion(r);
+        int nevents = perfmon_getEventsOfRegion(r);
+        int nmetrics = perfmon_getMetricsOfRegion(r);
+        char* tag = perfmon_getTagOfRegion(r);
+        int *cpus = malloc((nthreads > 0 ? nthreads : 1) * sizeof(int));
+        int ncpus = 0;
+        PyObject *cpulist, *times, *counts, *results, *metrics;
+        if (cpus)
+            ncpus = perfmon_getCpulistOfRegion(r, nthreads, cpus);
+        if (ncpus < 0)
+            ncpus = 0;
+        if (nthreads < 0)
+            nthreads = 0;
+        if (nevents < 0)
+            nevents = 0;
+        if (nmetrics < 0)
+            nmetrics = 0;
+        cpulist = PyList_New(ncpus);
+        for (i = 0; i < ncpus; i++)
+            PyList_SET_ITEM(cpulist, i, PYINT(cpus[i]));
+        free(cpus);
+        times = PyList_New(nthreads);
+        counts = PyList_New(nthreads);
+        for (t = 0; t < nthreads; t++)
+        {
+            PyList_SET_ITEM(times, t, Py_BuildValue("d", perfmon_getTimeOfRegion(r, t)));
+            PyList_SET_ITEM(counts, t, PYINT(perfmon_getCountOfRegion(r, t)));
+        }
+        results = trace_matrix(r, nevents, nthreads, perfmon_getResultOfRegionThread);
+        metrics = trace_matrix(r, nmetrics, nthreads, perfmon_getMetricOfRegionThread);
+        PyList_SET_ITEM(l, r, Py_BuildValue("{s:s,s:i,s:i,s:i,s:N,s:N,s:N,s:N,s:N,s:N}",
+                                            "markerregiontag", tag,
+                                            "markerregiongroup", perfmon_getGroupOfRegion(r),
+                                            "markerregionevents", nevents,
+                                            "markerregionthreads", nthreads,
+                                            "markerregioncpulist", cpulist,
+                                            "markerregiontime", times,
+                                            "markerregioncount", counts,
+                                            "markerregionresult", results,
+                                            "markerregionmetric", metrics,
+                                            "markerregionenergy", markerfile_regionenergy(r)));
+    }
+    args = PyTuple_New(0);
+    ret = trace_write(BUNDLE_MARKERFILE, args, l);
+    Py_DECREF(args);
+    Py_DECREF(l);
+    return ret;
+}
+
+/* Called after the original function returned successfully in record mode */
+static int
+trace_record_extras(TraceFunc *tf, PyObject *args, PyObject *result)
+{
+    if (tf->flags & TRACE_RESULTS)
+    {
+        int gid = perfmon_getIdOfActiveGroup();
+        if (PyTuple_Size(args) > 0 && (strcmp(tf->name, "readgroup") == 0 ||
+                                       strcmp(tf->name, "readgroupthread") == 0))
+        {
+            gid = (int)PyLong_AsLong(PyTuple_GetItem(args, 0));
+        }
+        if (trace_record_results(gid) < 0)
+            return -1;
+    }
+    if ((tf->flags & TRACE_GROUPINFO) && PyLong_Check(result))
     {
-        PYINT(-1);
+        if (trace_record_groupinfo((int)PyLong_AsLong(result)) < 0)
+            return -1;
     }
-    ret = nvmon_readCounters();
-    return PYINT(ret);
+    if ((tf->flags & TRACE_REGION) && PyTuple_Size(args) > 0)
+    {
+        if (trace_record_call("markergetregion", args) < 0)
+            return -1;
+    }
+    if (tf->flags & TRACE_MARKERFILE)
+    {
+        if (trace_record_markerfile() < 0)
+            return -1;
+    }
+    return 0;
 }
 
-static PyObject *
-likwid_nvmon_switchGroup(PyObject *self, PyObject *args)
+/* Returns the index of the record that answers the call in replay mode or
+ * -1 if the trace has no matching record. State-changing calls take the next
+ * matching record after the current position. Queries take the most recent
+ * record before the next state-changing record, so they see the state of the
+ * current position independent of how often they are called. */
+static long
+trace_find(int name, PyObject *key, int mutating, int *inwindow)
 {
-    int ret = 0, newgroup;
-    if (nvmon_initialized == 0)
+    PyObject *k, *l;
+    Py_ssize_t i, n;
+    long bound = trace_numrecords, best = -1, lo = 0, hi = trace_nummutating;
+
+    k = Py_BuildValue("(iO)", name, key);
+    if (k == NULL)
+        return -1;
+    l = PyDict_GetItem(trace_index, k);
+    Py_DECREF(k);
+    if (l == NULL)
+        return -1;
+    n = PyList_GET_SIZE(l);
+    if (mutating)
     {
-        PYINT(-1);
+        for (i = 0; i < n; i++)
+        {
+            long rec = PyLong_AsLong(PyList_GET_ITEM(l, i));
+            if (rec > trace_pos)
+                return rec;
+        }
+        return -1;
     }
-    PyArg_ParseTuple(args, "i", &newgroup);
-    if (newgroup >= nvmon_getNumberOfGroups())
+    while (lo < hi)
     {
-        newgroup = 0;
+        long mid = (lo + hi) / 2;
+        if (trace_mutating[mid] <= trace_pos)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
-    if (newgroup == nvmon_getIdOfActiveGroup())
+    if (lo < trace_nummutating)
+        bound = trace_mutating[lo];
+    *inwindow = 1;
+    for (i = n - 1; i >= 0; i--)
     {
-        return PYINT(-1);
+        long rec = PyLong_AsLong(PyList_GET_ITEM(l, i));
+        if (rec < bound)
+            return rec;
+        best = rec;
     }
-    ret = nvmon_switchActiveGroup(newgroup);
-    return PYINT(ret);
+    *inwindow = 0;
+    return best;
 }
 
 static PyObject *
-likwid_nvmon_finalize(PyObject *self, PyObject *args)
+trace_replay_call(int name, PyObject *args)
 {
-    if (nvmon_initialized == 1)
-    {
-        nvmon_finalize();
-        nvmon_initialized = 0;
+    TraceFunc *tf = &trace_funcs[name];
+    int mutating = (tf->flags & TRACE_MUTATING) != 0;
+    int inwindow = 0, binwindow = 0;
+    long rec = -1, brec = -1;
+    PyObject *key = trace_dumps(args);
+    if (key == NULL)
+        return NULL;
+    rec = trace_find(name, key, mutating, &inwindow);
+    Py_DECREF(key);
+    if (!mutating && tf->bundle != BUNDLE_NONE)
+    {
+        PyObject *bargs = (tf->bundle == BUNDLE_RESULTS && PyTuple_Size(args) > 0 ?
+                           PyTuple_GetSlice(args, 0, 1) : PyTuple_New(0));
+        PyObject *bkey = (bargs ? trace_dumps(bargs) : NULL);
+        Py_XDECREF(bargs);
+        if (bkey == NULL)
+            return NULL;
+        brec = trace_find(tf->bundle, bkey, 0, &binwindow);
+        Py_DECREF(bkey);
+        if (brec >= 0 && (rec < 0 || (binwindow && !inwindow) ||
+                          (binwindow == inwindow && (inwindow ? brec > rec : brec < rec))))
+        {
+            PyObject *bundle, *res;
+            TraceRecord *r = &trace_records[brec];
+            bundle = PyMarshal_ReadObjectFromString(PyBytes_AS_STRING(r->result),
+                                                    PyBytes_GET_SIZE(r->result));
+            if (bundle == NULL)
+                return NULL;
+            /* The bundle functions find their field by the function name */
+            res = tf->frombundle(bundle, Py_BuildValue("(sO)", tf->name, args));
+            Py_DECREF(bundle);
+            return res;
+        }
     }
-    if (gpuTopology_initialized == 1)
+    if (rec < 0)
     {
-        topology_gpu_finalize();
-        gpuTopology_initialized = 0;
-        gputopo = NULL;
+        PyObject *r = PyObject_Repr(args);
+        PyErr_Format(PyExc_LookupError, "Call %s%s not found in trace", tf->name,
+                     (r ? PyUnicode_AsUTF8(r) : "(...)"));
+        Py_XDECREF(r);
+        return NULL;
     }
-    return PYINT(0);
+    if (mutating)
+        trace_pos = rec;
+    return PyMarshal_ReadObjectFromString(PyBytes_AS_STRING(trace_records[rec].result),
+                                          PyBytes_GET_SIZE(trace_records[rec].result));
 }
 
 static PyObject *
-likwid_nvmon_getResult(PyObject *self, PyObject *args)
+trace_bundle_get(PyObject *bundle, const char* field, PyObject *args, int first, int nidx)
 {
-    int g, e, t;
-    double result;
-    PyArg_ParseTuple(args, "iii", &g, &e, &t);
-    result = nvmon_getResult(g, e, t);
-    return Py_BuildValue("d", result);
+    /* Index the bundle field with nidx integer arguments starting at args[first] */
+    PyObject *o = PyDict_GetItemString(bundle, field);
+    int i;
+    if (o == NULL)
+        return NULL;
+    for (i = 0; i < nidx; i++)
+    {
+        Py_ssize_t idx = PyLong_AsSsize_t(PyTuple_GetItem(args, first + i));
+        if (idx == -1 && PyErr_Occurred())
+            return NULL;
+        if (!PyList_Check(o) || idx < 0 || idx >= PyList_GET_SIZE(o))
+            return NULL;
+        o = PyList_GET_ITEM(o, idx);
+    }
+    Py_INCREF(o);
+    return o;
 }
 
+/* args of the bundle functions: (function name, original args) */
 static PyObject *
-likwid_nvmon_getLastResult(PyObject *self, PyObject *args)
+trace_bundle_groupmatrix(PyObject *bundle, PyObject *args, const char* field)
 {
-    int g, e, t;
-    double result;
-    PyArg_ParseTuple(args, "iii", &g, &e, &t);
-    result = nvmon_getLastResult(g, e, t);
-    return Py_BuildValue("d", result);
+    PyObject *fargs = PyTuple_GetItem(args, 1);
+    /* original args (gid, idx, thread) */
+    PyObject *res = (PyTuple_Size(fargs) == 3 ? trace_bundle_get(bundle, field, fargs, 1, 2) : NULL);
+    Py_DECREF(args);
+    if (res == NULL && !PyErr_Occurred())
+        return Py_BuildValue("d", NAN);
+    return res;
 }
 
 static PyObject *
-likwid_nvmon_getMetric(PyObject *self, PyObject *args)
+trace_bundle_result(PyObject *bundle, PyObject *args)
 {
-    int g, m, t;
-    double result;
-    PyArg_ParseTuple(args, "iii", &g, &m, &t);
-    result = nvmon_getMetric(g, m, t);
-    return Py_BuildValue("d", result);
+    return trace_bundle_groupmatrix(bundle, args, "result");
 }
 
 static PyObject *
-likwid_nvmon_getLastMetric(PyObject *self, PyObject *args)
+trace_bundle_lastresult(PyObject *bundle, PyObject *args)
 {
-    int g, m, t;
-    double result = 0.0;
-    PyArg_ParseTuple(args, "iii", &g, &m, &t);
-    result = nvmon_getLastMetric(g, m, t);
-    return Py_BuildValue("d", result);
+    return trace_bundle_groupmatrix(bundle, args, "lastresult");
 }
 
 static PyObject *
-likwid_nvmon_getNumberOfGroups(PyObject *self, PyObject *args)
+trace_bundle_metric(PyObject *bundle, PyObject *args)
 {
-    if (nvmon_initialized == 0)
-    {
-        return 0;
-    }
-    return PYINT(nvmon_getNumberOfGroups());
+    return trace_bundle_groupmatrix(bundle, args, "metric");
 }
 
 static PyObject *
-likwid_nvmon_getIdOfActiveGroup(PyObject *self, PyObject *args)
+trace_bundle_lastmetric(PyObject *bundle, PyObject *args)
 {
-    if (nvmon_initialized == 0)
-    {
-        return 0;
-    }
-    return PYINT(nvmon_getIdOfActiveGroup());
+    return trace_bundle_groupmatrix(bundle, args, "lastmetric");
 }
 
 static PyObject *
-likwid_nvmon_getNumberOfGpus(PyObject *self, PyObject *args)
+trace_bundle_time(PyObject *bundle, PyObject *args)
 {
-    if (nvmon_initialized == 0)
-    {
-        return 0;
-    }
-    return PYINT(nvmon_getNumberOfGPUs());
+    PyObject *res = trace_bundle_get(bundle, "time", PyTuple_GetItem(args, 1), 0, 0);
+    Py_DECREF(args);
+    if (res == NULL && !PyErr_Occurred())
+        return Py_BuildValue("d", 0.0);
+    return res;
 }
 
 static PyObject *
-likwid_nvmon_getTimeOfGroup(PyObject *self, PyObject *args)
+trace_bundle_numregions(PyObject *bundle, PyObject *args)
 {
-    if (nvmon_initialized == 0)
-    {
-        return 0;
-    }
-    int groupId;
-    PyArg_ParseTuple(args, "i", &groupId);
-    return Py_BuildValue("d", nvmon_getTimeOfGroup(groupId));
+    Py_DECREF(args);
+    return PYINT((int)PyList_Size(bundle));
 }
 
 static PyObject *
-likwid_nvmon_getNumberOfEvents(PyObject *self, PyObject *args)
+trace_bundle_region(PyObject *bundle, PyObject *args, int nidx, PyObject *dflt)
 {
-    if (nvmon_initialized == 0)
+    const char* field = PyUnicode_AsUTF8(PyTuple_GetItem(args, 0));
+    PyObject *fargs = PyTuple_GetItem(args, 1);
+    PyObject *res = NULL;
+    Py_ssize_t r = PyLong_AsSsize_t(PyTuple_GetItem(fargs, 0));
+    if (r >= 0 && r < PyList_Size(bundle) && PyTuple_Size(fargs) == nidx + 1)
     {
-        return 0;
+        res = trace_bundle_get(PyList_GET_ITEM(bundle, r), field, fargs, 1, nidx);
     }
-    int groupId;
-    PyArg_ParseTuple(args, "i", &groupId);
-    return PYINT(nvmon_getNumberOfEvents(groupId));
+    Py_DECREF(args);
+    if (res == NULL && !PyErr_Occurred())
+        return dflt;
+    Py_DECREF(dflt);
+    return res;
 }
 
 static PyObject *
-likwid_nvmon_getNumberOfMetrics(PyObject *self, PyObject *args)
+trace_bundle_regionfield(PyObject *bundle, PyObject *args)
 {
-    if (nvmon_initialized == 0)
-    {
-        return 0;
-    }
-    int groupId;
-    PyArg_ParseTuple(args, "i", &groupId);
-    return PYINT(nvmon_getNumberOfMetrics(groupId));
+    return trace_bundle_region(bundle, args, 0, PYINT(-1));
 }
 
 static PyObject *
-likwid_nvmon_getNameOfEvent(PyObject *self, PyObject *args)
+trace_bundle_regionthread(PyObject *bundle, PyObject *args)
 {
-    if (nvmon_initialized == 0)
-    {
-        return 0;
-    }
-    int g, e;
-    PyArg_ParseTuple(args, "ii", &g, &e);
-    return PYSTR(nvmon_getEventName(g,e));
+    return trace_bundle_region(bundle, args, 1, PYINT(0));
 }
 
 static PyObject *
-likwid_nvmon_getNameOfCounter(PyObject *self, PyObject *args)
+trace_bundle_regionmatrix(PyObject *bundle, PyObject *args)
 {
-    if (nvmon_initialized == 0)
-    {
-        return 0;
-    }
-    int g, c;
-    PyArg_ParseTuple(args, "ii", &g, &c);
-    return PYSTR(nvmon_getCounterName(g,c));
+    return trace_bundle_region(bundle, args, 2, Py_BuildValue("d", 0.0));
 }
 
 static PyObject *
-likwid_nvmon_getNameOfMetric(PyObject *self, PyObject *args)
+trace_bundle_regionenergy(PyObject *bundle, PyObject *args)
 {
-    if (nvmon_initialized == 0)
-    {
-        return 0;
-    }
-    int g, m;
-    PyArg_ParseTuple(args, "ii", &g, &m);
-    return PYSTR(nvmon_getMetricName(g,m));
+    return trace_bundle_region(bundle, args, 0, pynone());
 }
 
+/* Entry point of all traced functions. self is a capsule with the TraceFunc */
 static PyObject *
-likwid_nvmon_getNameOfGroup(PyObject *self, PyObject *args)
+likwid_tracecall(PyObject *self, PyObject *args)
 {
-    if (nvmon_initialized == 0)
+    TraceFunc *tf = (TraceFunc *)PyCapsule_GetPointer(self, NULL);
+    PyObject *res;
+    if (tf == NULL)
+        return NULL;
+    if (trace_mode == TRACE_REPLAY)
     {
-        return 0;
+        return trace_replay_call((int)(tf - trace_funcs), args);
     }
-    int groupId;
-    PyArg_ParseTuple(args, "i", &groupId);
-    return PYSTR(nvmon_getGroupName(groupId));
-}
-
-static PyObject *
-likwid_nvmon_getShortInfoOfGroup(PyObject *self, PyObject *args)
-{
-    if (nvmon_initialized == 0)
+    res = tf->func(NULL, args);
+    if (res != NULL && trace_mode == TRACE_RECORD)
     {
-        return 0;
+        if (trace_write((int)(tf - trace_funcs), args, res) < 0 ||
+            trace_record_extras(tf, args, res) < 0)
+        {
+            Py_DECREF(res);
+            return NULL;
+        }
     }
-    int groupId;
-    PyArg_ParseTuple(args, "i", &groupId);
-    return PYSTR(nvmon_getGroupInfoShort(groupId));
+    return res;
 }
 
-static PyObject *
-likwid_nvmon_getLongInfoOfGroup(PyObject *self, PyObject *args)
+static void
+trace_free_replay(void)
 {
-    if (nvmon_initialized == 0)
+    long i;
+    for (i = 0; i < trace_numrecords; i++)
     {
-        return 0;
+        Py_XDECREF(trace_records[i].key);
+        Py_XDECREF(trace_records[i].result);
     }
-    int groupId;
-    PyArg_ParseTuple(args, "i", &groupId);
-    return PYSTR(nvmon_getGroupInfoLong(groupId));
+    free(trace_records);
+    free(trace_mutating);
+    trace_records = NULL;
+    trace_mutating = NULL;
+    trace_numrecords = 0;
+    trace_nummutating = 0;
+    trace_pos = -1;
+    Py_CLEAR(trace_index);
 }
 
-static PyObject *
-likwid_nvmon_getGroups(PyObject *self, PyObject *args)
+/* Read a whole trace file. The name indices in the records are translated to
+ * the indices of trace_funcs (-1 for unknown names). */
+static int
+trace_load(const char* path, TraceRecord **records, long *numrecords)
 {
-#if LIKWID_RELEASE >= 1
-    // Since 5.1.0, nvmon_getGroups takes the the gpu id as first argument.
-    int gpuId, i, ret;
-    if (!PyArg_ParseTuple(args, "i", &gpuId))
+    FILE* fp = fopen(path, "rb");
+    char magic[8];
+    uint32_t version = 0, nnames = 0, i;
+    int *map = NULL;
+    long cap = 1024, n = 0;
+    TraceRecord *recs = NULL;
+
+    if (fp == NULL)
     {
-        Py_RETURN_NONE;
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+        return -1;
     }
-#else
-    int i, ret;
-#endif
-    char** tmp, **infos, **longs;
-    PyObject *l;
-    if (gpuTopology_initialized == 0)
+    if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, TRACE_MAGIC, 8) != 0 ||
+        fread(&version, sizeof(version), 1, fp) != 1 || version != TRACE_VERSION ||
+        fread(&nnames, sizeof(nnames), 1, fp) != 1)
     {
-        topology_gpu_init();
-        gpuTopology_initialized = 1;
+        fclose(fp);
+        PyErr_Format(PyExc_ValueError, "%s is not a pylikwid trace file (version %d)", path, TRACE_VERSION);
+        return -1;
     }
-    if (gpuTopology_initialized && gputopo == NULL)
+    map = malloc((nnames > 0 ? nnames : 1) * sizeof(int));
+    recs = malloc(cap * sizeof(TraceRecord));
+    if (!map || !recs)
     {
-        gputopo = get_gpuTopology();
+        free(map);
+        free(recs);
+        fclose(fp);
+        PyErr_NoMemory();
+        return -1;
     }
-#if LIKWID_RELEASE >= 1
-    ret = nvmon_getGroups(gpuId, &tmp, &infos, &longs);
-#else
-    ret = nvmon_getGroups(&tmp, &infos, &longs);
-#endif
-    if (ret > 0)
+    for (i = 0; i < nnames; i++)
     {
-        l = PyList_New(ret);
-        for(i=0;i<ret;i++)
+        unsigned char len = 0;
+        char name[256];
+        if (fread(&len, 1, 1, fp) != 1 || fread(name, 1, len, fp) != len)
+            goto truncated;
+        name[len] = '\0';
+        map[i] = trace_funcindex(name);
+    }
+    while (1)
+    {
+        uint16_t name;
+        uint32_t alen, rlen;
+        TraceRecord *r;
+        if (fread(&name, sizeof(name), 1, fp) != 1)
+            break;
+        if (n == cap)
         {
-            PyObject *d = PyDict_New();
-            PyDict_SetItem(d, PYSTR("Name"), PYSTR(tmp[i]));
-            PyDict_SetItem(d, PYSTR("Info"), PYSTR(infos[i]));
-            PyDict_SetItem(d, PYSTR("Long"), PYSTR(longs[i]));
-            PyList_SET_ITEM(l, (Py_ssize_t)i, d);
+            TraceRecord *tmp = realloc(recs, 2 * cap * sizeof(TraceRecord));
+            if (!tmp)
+            {
+                PyErr_NoMemory();
+                goto error;
+            }
+            recs = tmp;
+            cap *= 2;
         }
-        nvmon_returnGroups(ret, tmp, infos, longs);
+        r = &recs[n];
+        r->key = NULL;
+        r->result = NULL;
+        if (name >= nnames ||
+            fread(&r->tid, sizeof(r->tid), 1, fp) != 1 ||
+            fread(&r->time, sizeof(r->time), 1, fp) != 1 ||
+            fread(&alen, sizeof(alen), 1, fp) != 1)
+            goto truncated;
+        r->name = map[name];
+        r->mutating = (r->name >= 0 && (trace_funcs[r->name].flags & TRACE_MUTATING));
+        r->key = PyBytes_FromStringAndSize(NULL, alen);
+        if (r->key == NULL || fread(PyBytes_AS_STRING(r->key), 1, alen, fp) != alen ||
+            fread(&rlen, sizeof(rlen), 1, fp) != 1)
+        {
+            Py_XDECREF(r->key);
+            goto truncated;
+        }
+        r->result = PyBytes_FromStringAndSize(NULL, rlen);
+        if (r->result == NULL || fread(PyBytes_AS_STRING(r->result), 1, rlen, fp) != rlen)
+        {
+            Py_XDECREF(r->key);
+            Py_XDECREF(r->result);
+            goto truncated;
+        }
+        n++;
     }
-    else
+    free(map);
+    fclose(fp);
+    *records = recs;
+    *numrecords = n;
+    return 0;
+truncated:
+    if (!PyErr_Occurred())
+        PyErr_Format(PyExc_ValueError, "Trace file %s is truncated", path);
+error:
+    for (i = 0; i < n; i++)
     {
-        l = PyList_New(0);
+        Py_DECREF(recs[i].key);
+        Py_DECREF(recs[i].result);
     }
-    return l;
+    free(recs);
+    free(map);
+    fclose(fp);
+    return -1;
 }
 
 static PyObject *
-likwid_nvmon_setverbosity(PyObject *self, PyObject *args)
+likwid_tracerecord(PyObject *self, PyObject *args)
 {
-    int verbosity;
-    if (!PyArg_ParseTuple(args, "i", &verbosity))
+    const char* path;
+    uint32_t version = TRACE_VERSION, nnames = NUM_TRACE_FUNCS;
+    int i;
+    PyObject *empty;
+    if (!PyArg_ParseTuple(args, "s", &path))
         return NULL;
-    if (verbosity >= DEBUGLEV_ONLY_ERROR && verbosity <= DEBUGLEV_DEVELOP)
+    if (trace_mode != TRACE_OFF)
     {
-        nvmon_setVerbosity(verbosity);
-        return Py_BuildValue("i", verbosity);
+        PyErr_SetString(PyExc_RuntimeError, "Trace recording or replay already active");
+        return NULL;
     }
-    return Py_BuildValue("i", -1);
+    trace_file = fopen(path, "wb");
+    if (trace_file == NULL)
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+    fwrite(TRACE_MAGIC, 1, 8, trace_file);
+    fwrite(&version, sizeof(version), 1, trace_file);
+    fwrite(&nnames, sizeof(nnames), 1, trace_file);
+    for (i = 0; i < NUM_TRACE_FUNCS; i++)
+    {
+        unsigned char len = (unsigned char)strlen(trace_funcs[i].name);
+        fwrite(&len, 1, 1, trace_file);
+        fwrite(trace_funcs[i].name, 1, len, trace_file);
+    }
+    trace_mode = TRACE_RECORD;
+    trace_count = 0;
+    trace_start = trace_now();
+    /* Snapshot of the system topology */
+    empty = PyTuple_New(0);
+    if (trace_record_call("getcpuinfo", empty) < 0 ||
+        trace_record_call("getcputopology", empty) < 0 ||
+        trace_record_call("initnuma", empty) < 0 ||
+        trace_record_call("initaffinity", empty) < 0)
+    {
+        Py_DECREF(empty);
+        fclose(trace_file);
+        trace_file = NULL;
+        trace_mode = TRACE_OFF;
+        return NULL;
+    }
+    Py_DECREF(empty);
+    Py_RETURN_NONE;
 }
 
 static PyObject *
-likwid_nvmon_getEventsOfGpu(PyObject *self, PyObject *args)
+likwid_tracereplay(PyObject *self, PyObject *args)
 {
-    int g;
-    if (!PyArg_ParseTuple(args, "i", &g))
-        Py_RETURN_NONE;
-    if (gpuTopology_initialized == 0)
+    const char* path;
+    long i;
+    if (!PyArg_ParseTuple(args, "s", &path))
+        return NULL;
+    if (trace_mode != TRACE_OFF)
     {
-        topology_gpu_init();
-        gpuTopology_initialized = 1;
+        PyErr_SetString(PyExc_RuntimeError, "Trace recording or replay already active");
+        return NULL;
     }
-    if (gpuTopology_initialized && gputopo == NULL)
+    if (trace_load(path, &trace_records, &trace_numrecords) < 0)
+        return NULL;
+    trace_index = PyDict_New();
+    trace_mutating = malloc((trace_numrecords > 0 ? trace_numrecords : 1) * sizeof(long));
+    if (trace_index == NULL || trace_mutating == NULL)
+    {
+        trace_free_replay();
+        return PyErr_NoMemory();
+    }
+    for (i = 0; i < trace_numrecords; i++)
+    {
+        TraceRecord *r = &trace_records[i];
+        PyObject *k, *l, *pos;
+        if (r->name < 0)
+            continue;
+        if (r->mutating)
+            trace_mutating[trace_nummutating++] = i;
+        k = Py_BuildValue("(iO)", r->name, r->key);
+        l = (k ? PyDict_GetItem(trace_index, k) : NULL);
+        if (k != NULL && l == NULL)
+        {
+            l = PyList_New(0);
+            if (l != NULL && PyDict_SetItem(trace_index, k, l) == 0)
+                Py_DECREF(l);
+            else
+                Py_CLEAR(l);
+        }
+        pos = PyLong_FromLong(i);
+        if (l == NULL || pos == NULL || PyList_Append(l, pos) < 0)
+        {
+            Py_XDECREF(k);
+            Py_XDECREF(pos);
+            trace_free_replay();
+            return NULL;
+        }
+        Py_DECREF(pos);
+        Py_DECREF(k);
+    }
+    trace_mode = TRACE_REPLAY;
+    return PyLong_FromLong(trace_numrecords);
+}
+
+static PyObject *
+likwid_tracestop(PyObject *self, PyObject *args)
+{
+    long count = 0;
+    if (trace_mode == TRACE_RECORD)
     {
-        gputopo = get_gpuTopology();
+        count = trace_count;
+        if (fclose(trace_file) != 0)
+        {
+            trace_file = NULL;
+            trace_mode = TRACE_OFF;
+            return PyErr_SetFromErrno(PyExc_OSError);
+        }
+        trace_file = NULL;
     }
-    if (g < 0 || g >= gputopo->numDevices)
-        Py_RETURN_NONE;
-    NvmonEventList_t l = NULL;
+    else if (trace_mode == TRACE_REPLAY)
+    {
+        count = trace_numrecords;
+        trace_free_replay();
+    }
+    trace_mode = TRACE_OFF;
+    return PyLong_FromLong(count);
+}
 
-    int num_events = nvmon_getEventsOfGpu(g, &l);
-    if (num_events > 0)
+static PyObject *
+likwid_tracemode(PyObject *self, PyObject *args)
+{
+    switch (trace_mode)
     {
-        PyObject *o = PyList_New(l->numEvents);
+        case TRACE_RECORD:
+            return PYSTR("record");
+        case TRACE_REPLAY:
+            return PYSTR("replay");
+    }
+    return PYSTR("off");
+}
 
-        for (int i = 0; i < l->numEvents; i++)
+static PyObject *
+likwid_readtrace(PyObject *self, PyObject *args)
+{
+    const char* path;
+    TraceRecord *recs = NULL;
+    long n = 0, i;
+    PyObject *l;
+    if (!PyArg_ParseTuple(args, "s", &path))
+        return NULL;
+    if (trace_load(path, &recs, &n) < 0)
+        return NULL;
+    l = PyList_New(n);
+    for (i = 0; l != NULL && i < n; i++)
+    {
+        PyObject *a = PyMarshal_ReadObjectFromString(PyBytes_AS_STRING(recs[i].key), PyBytes_GET_SIZE(recs[i].key));
+        PyObject *r = PyMarshal_ReadObjectFromString(PyBytes_AS_STRING(recs[i].result), PyBytes_GET_SIZE(recs[i].result));
+        if (a == NULL || r == NULL)
         {
-            PyObject *d = PyDict_New();
-            PyDict_SetItem(d, PYSTR("name"), PYSTR(l->events[i].name));
-            PyDict_SetItem(d, PYSTR("desc"), PYSTR(l->events[i].desc));
-            PyDict_SetItem(d, PYSTR("limit"), PYSTR(l->events[i].limit));
-            PyList_SET_ITEM(o, (Py_ssize_t)i, d);
+            Py_XDECREF(a);
+            Py_XDECREF(r);
+            Py_CLEAR(l);
+            break;
         }
-        nvmon_returnEventsOfGpu(l);
-        return o;
+        PyList_SET_ITEM(l, i, Py_BuildValue("(sNNdI)",
+                        (recs[i].name >= 0 ? trace_funcs[recs[i].name].name : "?"),
+                        a, r, recs[i].time, recs[i].tid));
     }
-    Py_RETURN_NONE;
+    for (i = 0; i < n; i++)
+    {
+        Py_DECREF(recs[i].key);
+        Py_DECREF(recs[i].result);
+    }
+    free(recs);
+    return l;
 }
 
-#endif
+/* Replace the module functions listed in trace_funcs with traced versions */
+static int
+trace_wrap_methods(PyObject *module, PyMethodDef *methods)
+{
+    static PyMethodDef traced_defs[NUM_TRACE_FUNCS];
+    PyMethodDef *def;
+    PyObject *modname = PyModule_GetNameObject(module);
+    if (modname == NULL)
+        return -1;
+    for (def = methods; def->ml_name != NULL; def++)
+    {
+        int idx = trace_funcindex(def->ml_name);
+        PyObject *capsule, *func;
+        if (idx < 0)
+            continue;
+        trace_funcs[idx].func = def->ml_meth;
+        traced_defs[idx] = *def;
+        traced_defs[idx].ml_meth = likwid_tracecall;
+        traced_defs[idx].ml_flags = METH_VARARGS;
+        capsule = PyCapsule_New(&trace_funcs[idx], NULL, NULL);
+        if (capsule == NULL)
+            goto error;
+        func = PyCFunction_NewEx(&traced_defs[idx], capsule, modname);
+        Py_DECREF(capsule);
+        if (func == NULL || PyModule_AddObject(module, def->ml_name, func) < 0)
+        {
+            Py_XDECREF(func);
+            goto error;
+        }
+    }
+    Py_DECREF(modname);
+    return 0;
+error:
+    Py_DECREF(modname);
+    return -1;
+}
 
 static PyMethodDef LikwidMethods[] = {
     {"likwidversion", likwid_lversion, METH_VARARGS, "Get the likwid version numbers."},
@@ -2584,6 +10433,24 @@ static PyMethodDef LikwidMethods[] = {
     {"markerstopregion", likwid_markerstopregion, METH_VARARGS, "Stop a code region."},
     {"markergetregion", likwid_markergetregion, METH_VARARGS, "Get the current results for a code region."},
     {"markernextgroup", likwid_markernextgroup, METH_VARARGS, "Switch to next event set."},
+    {"markershmcreate", (PyCFunction)(void(*)(void))likwid_markershmcreate, METH_VARARGS|METH_KEYWORDS, "Create a shared-memory segment for the aggregation of marker region results."},
+    {"markershmunlink", likwid_markershmunlink, METH_VARARGS, "Remove a marker shared-memory segment."},
+    {"markershmattach", likwid_markershmattach, METH_VARARGS, "Publish the marker region results of this process to a shared-memory segment."},
+    {"markershmdetach", likwid_markershmdetach, METH_VARARGS, "Stop publishing marker region results."},
+    {"markershmpublish", likwid_markershmpublish, METH_VARARGS, "Publish the current results of a region."},
+    {"markershmread", likwid_markershmread, METH_VARARGS, "Read the merged marker region results of all processes."},
+    {"markertracestart", (PyCFunction)(void(*)(void))likwid_markertracestart, METH_VARARGS|METH_KEYWORDS, "Start recording a timeline of all marker region calls."},
+    {"markertracestop", likwid_markertracestop, METH_VARARGS, "Stop recording the marker region timeline."},
+    {"markertracewrite", likwid_markertracewrite, METH_VARARGS, "Write the marker region timeline as Chrome trace JSON."},
+    {"markerenergy", (PyCFunction)(void(*)(void))likwid_markerenergy, METH_VARARGS|METH_KEYWORDS, "Enable the recording of RAPL energy per marker region."},
+    {"markergetregionenergy", likwid_markergetregionenergy, METH_VARARGS, "Get the energy and average power of a code region."},
+    {"samplerstart", (PyCFunction)(void(*)(void))likwid_samplerstart, METH_VARARGS|METH_KEYWORDS, "Start sampling the Python stacks weighted by counter values."},
+    {"samplerstop", likwid_samplerstop, METH_VARARGS, "Stop the stack sampler."},
+    {"samplerstacks", likwid_samplerstacks, METH_VARARGS, "Get the folded stacks and their weights."},
+    {"samplerwrite", likwid_samplerwrite, METH_VARARGS, "Write the folded stacks for flame graph tools."},
+    {"triggerstart", (PyCFunction)(void(*)(void))likwid_triggerstart, METH_VARARGS|METH_KEYWORDS, "Start a capture triggered by a metric threshold."},
+    {"triggerstop", likwid_triggerstop, METH_VARARGS, "Stop the triggered capture."},
+    {"triggercaptures", likwid_triggercaptures, METH_VARARGS, "Get and clear the list of completed captures."},
     {"markerclose", likwid_markerclose, METH_VARARGS, "Close the Marker API and write results to file."},
     {"markerreset", likwid_markerresetregion, METH_VARARGS, "Reset the values of the code region to 0"},
     {"getprocessorid", likwid_getprocessorid, METH_VARARGS, "Returns the current CPU ID."},
@@ -2591,6 +10458,7 @@ static PyMethodDef LikwidMethods[] = {
     {"pinthread", likwid_pinthread, METH_VARARGS, "Pins the current thread to the given CPU."},
     /* misc functions */
     {"setverbosity", likwid_setverbosity, METH_VARARGS, "Set the verbosity for the LIKWID library."},
+    {"getinittimes", likwid_getinittimes, METH_VARARGS, "Return the initialization state, time and call count of the lazily initialized subsystems."},
     /* configuration functions */
     {"initconfiguration", likwid_initconfiguration, METH_VARARGS, "Initialize the configuration module."},
     {"destroyconfiguration", likwid_destroyconfiguration, METH_VARARGS, "Finalize the configuration module."},
@@ -2607,13 +10475,18 @@ static PyMethodDef LikwidMethods[] = {
     {"getcputopology", likwid_getcputopology, METH_VARARGS, "Get the topology information for the current system."},
     {"getcpuinfo", likwid_getcpuinfo, METH_VARARGS, "Get the system information for the current system."},
     {"printsupportedcpus", likwid_printsupportedcpus, METH_VARARGS, "Print all CPU variants supported by current version of LIKWID."},
+    {"save_topology", likwid_savetopology, METH_VARARGS, "Write a snapshot of the topology, NUMA and affinity information to a file."},
+    {"load_topology", likwid_loadtopology, METH_VARARGS, "Use a topology snapshot if it matches the current system."},
     /* numa functions */
     {"initnuma", likwid_initnuma, METH_VARARGS, "Initialize the NUMA module."},
     {"finalizenuma", likwid_finalizenuma, METH_VARARGS, "Finalize the NUMA module."},
+    {"numa_alloc", (PyCFunction)(void(*)(void))likwid_numaalloc, METH_VARARGS|METH_KEYWORDS, "Allocate a buffer bound to a NUMA node."},
     /* affinity functions */
     {"initaffinity", likwid_initaffinity, METH_VARARGS, "Initialize the affinity module."},
     {"finalizeaffinity", likwid_finalizeaffinity, METH_VARARGS, "Finalize the affinity module."},
     {"cpustr_to_cpulist", likwid_cpustr_to_cpulist, METH_VARARGS, "Translate cpu string to list of cpus."},
+    {"plan_placement", (PyCFunction)(void(*)(void))likwid_planplacement, METH_VARARGS|METH_KEYWORDS, "Return CPU lists for N workers according to a placement policy."},
+    {"cacheblocking", (PyCFunction)(void(*)(void))likwid_cacheblocking, METH_VARARGS|METH_KEYWORDS, "Suggest cache blocking tile sizes for all data cache levels."},
     /* timing functions */
     {"getcpuclock", likwid_getCpuClock, METH_VARARGS, "Return the clock frequency of the current system."},
     {"startclock", likwid_startClock, METH_VARARGS, "Start a time measurement."},
@@ -2629,9 +10502,13 @@ static PyMethodDef LikwidMethods[] = {
     {"startpower", likwid_startPower, METH_VARARGS, "Start a power measurement."},
     {"stoppower", likwid_stopPower, METH_VARARGS, "Stop a power measurement."},
     {"getpower", likwid_getPower, METH_VARARGS, "Get the energy information from a power measurement."},
+    {"getpowerlimit", (PyCFunction)(void(*)(void))likwid_getpowerlimit, METH_VARARGS|METH_KEYWORDS, "Get the power limit of a socket."},
+    {"setpowerlimit", (PyCFunction)(void(*)(void))likwid_setpowerlimit, METH_VARARGS|METH_KEYWORDS, "Set and activate the power limit of a socket."},
+    {"restorepowerlimits", likwid_restorepowerlimits, METH_VARARGS, "Restore the power limits changed by setpowerlimit."},
     /* perfmon functions */
     {"init", likwid_init, METH_VARARGS, "Initialize the whole Likwid system including Performance Monitoring module."},
     {"addeventset", likwid_addEventSet, METH_VARARGS, "Add an event set to LIKWID."},
+    {"getgid", likwid_getgid, METH_VARARGS, "Return the group ID of an added event set or -1."},
     {"setup", likwid_setupCounters, METH_VARARGS, "Setup measuring an event set with LIKWID."},
     {"start", likwid_startCounters, METH_VARARGS, "Start measuring an event set with LIKWID."},
     {"stop", likwid_stopCounters, METH_VARARGS, "Stop measuring an event set with LIKWID."},
@@ -2645,6 +10522,7 @@ static PyMethodDef LikwidMethods[] = {
     {"getlastresult", likwid_getLastResult, METH_VARARGS, "Get the result of the last measurement cycle."},
     {"getmetric", likwid_getMetric, METH_VARARGS, "Get the current result of a derived metric."},
     {"getlastmetric", likwid_getLastMetric, METH_VARARGS, "Get the current result of a derived metric with values from the last measurement cycle."},
+    {"aggregate", (PyCFunction)(void(*)(void))likwid_aggregate, METH_VARARGS|METH_KEYWORDS, "Aggregate per-thread results by core, socket, NUMA domain or cache domain."},
     {"getnumberofgroups", likwid_getNumberOfGroups, METH_VARARGS, "Get the amount of currently configured groups."},
     {"getnumberofevents", likwid_getNumberOfEvents, METH_VARARGS, "Get the amount of events in a groups."},
     {"getnumberofmetrics", likwid_getNumberOfMetrics, METH_VARARGS, "Get the amount of events in a groups."},
@@ -2652,12 +10530,19 @@ static PyMethodDef LikwidMethods[] = {
     {"getidofactivegroup", likwid_getIdOfActiveGroup, METH_VARARGS, "Get the ID of currently active group."},
     {"gettimeofgroup", likwid_getTimeOfGroup, METH_VARARGS, "Get the runtime of a group."},
     {"getgroups", likwid_getGroups, METH_VARARGS, "Get a list of all available performance groups."},
+    {"getgroupcatalog", likwid_getgroupcatalog, METH_VARARGS, "Return the cached catalog of all performance groups with events and metric formulas."},
     {"getnameofevent", likwid_getNameOfEvent, METH_VARARGS, "Return the name of an event in a group."},
     {"getnameofcounter", likwid_getNameOfCounter, METH_VARARGS, "Return the name of a counter in a group."},
     {"getnameofmetric", likwid_getNameOfMetric, METH_VARARGS, "Return the name of a metric in a group."},
     {"getnameofgroup", likwid_getNameOfGroup, METH_VARARGS, "Return the name of a group."},
     {"getshortinfoofgroup", likwid_getShortInfoOfGroup, METH_VARARGS, "Return the short description of a group."},
     {"getlonginfoofgroup", likwid_getLongInfoOfGroup, METH_VARARGS, "Return the long description of a group."},
+    /* record/replay functions */
+    {"tracerecord", likwid_tracerecord, METH_VARARGS, "Record all results of the perfmon, marker and topology functions to a trace file."},
+    {"tracereplay", likwid_tracereplay, METH_VARARGS, "Serve the perfmon, marker and topology functions from a trace file."},
+    {"tracestop", likwid_tracestop, METH_VARARGS, "Stop recording or replaying a trace."},
+    {"tracemode", likwid_tracemode, METH_VARARGS, "Return the current trace mode (off, record or replay)."},
+    {"readtrace", likwid_readtrace, METH_VARARGS, "Return the records of a trace file as list."},
     /* perfmon markerAPI functions */
     {"markerreadfile", likwid_readMarkerFile, METH_VARARGS, "Read in the results from a Marker API run."},
     {"markernumregions", likwid_markerNumRegions, METH_VARARGS, "Return the number of regions from a Marker API run."},
@@ -2670,6 +10555,8 @@ static PyMethodDef LikwidMethods[] = {
     {"markerregioncount", likwid_markerRegionCount, METH_VARARGS, "Return the call count of a region for a thread from a Marker API run."},
     {"markerregionresult", likwid_markerRegionResult, METH_VARARGS, "Return the result of a region for a event/thread combination from a Marker API run."},
     {"markerregionmetric", likwid_markerRegionMetric, METH_VARARGS, "Return the metric value of a region for a metric/thread combination from a Marker API run."},
+    {"markerregionenergy", likwid_markerRegionEnergy, METH_VARARGS, "Return the energy of a region from a Marker API run or None."},
+    {"markerfileiter", (PyCFunction)(void(*)(void))likwid_markerfileiter, METH_VARARGS|METH_KEYWORDS, "Iterate lazily over the regions of a Marker API result file."},
     /* CPU frequency functions */
     {"getcpuclockcurrent", likwid_freqGetCpuClockCurrent, METH_VARARGS, "Returns the current CPU frequency (in Hz) of the given CPU."},
     {"getcpuclockmax", likwid_freqGetCpuClockMax, METH_VARARGS, "Returns the maximal CPU frequency (in Hz) of the given CPU."},
@@ -2681,9 +10568,16 @@ static PyMethodDef LikwidMethods[] = {
     {"setgovernor", likwid_freqSetGovernor, METH_VARARGS, "Sets the CPU frequency govneror of the given CPU."},
     {"getavailfreqs", likwid_freqGetAvailFreq, METH_VARARGS, "Returns the available CPU frequency steps (in GHz, returns string)."},
     {"getavailgovs", likwid_freqGetAvailGovs, METH_VARARGS, "Returns the available CPU frequency governors (returns string)."},
-#if 0
-    {"getuncoreclockcurrent", likwid_freqGetUncoreClockCurrent, METH_VARARGS, "Returns the current Uncore frequency of the given CPU socket."},
+#if (LIKWID_MAJOR == 5)
+    {"getuncoreclockcurrent", likwid_freqGetUncoreClockCurrent, METH_VARARGS, "Get the current Uncore clock of a socket."},
+    {"freqtimelinestart", (PyCFunction)(void(*)(void))likwid_freqtimelinestart, METH_VARARGS|METH_KEYWORDS, "Start sampling core and Uncore clocks and group metrics."},
+    {"freqtimelinestop", likwid_freqtimelinestop, METH_VARARGS, "Stop the frequency timeline."},
+    {"freqtimeline", likwid_freqtimeline, METH_VARARGS, "Get the frequency timeline."},
+    {"freqtimelinewrite", likwid_freqtimelinewrite, METH_VARARGS, "Write the frequency timeline as Chrome trace JSON."},
 #endif
+    {"throttlestart", (PyCFunction)(void(*)(void))likwid_throttlestart, METH_VARARGS|METH_KEYWORDS, "Start the thermal throttling monitor."},
+    {"throttlestop", likwid_throttlestop, METH_VARARGS, "Stop the throttling monitor."},
+    {"throttlereport", likwid_throttlereport, METH_VARARGS, "Get the clock drop intervals and their marker regions."},
     {"getuncoreclockmax", likwid_freqGetUncoreClockMax, METH_VARARGS, "Returns the maximal Uncore frequency (in Hz) of the given CPU socket."},
     {"getuncoreclockmin", likwid_freqGetUncoreClockMin, METH_VARARGS, "Returns the minimal Uncore frequency (in Hz) of the given CPU socket."},
     {"setuncoreclockmax", likwid_freqSetUncoreClockMax, METH_VARARGS, "Sets the maximal Uncore frequency (in Hz) of the given CPU socket."},
@@ -2747,10 +10641,31 @@ static PyMethodDef LikwidMethods[] = {
 PyMODINIT_FUNC
 initpylikwid(void)
 {
-    (void) Py_InitModule("pylikwid", LikwidMethods);
+    PyObject *m;
+    if (PyType_Ready(&NumaBufferType) < 0 || PyType_Ready(&MarkerFileType) < 0)
+        return;
+    PyStructSequence_InitType(&MarkerRegionType, &markerregion_desc);
+    m = Py_InitModule("pylikwid", LikwidMethods);
+    if (m == NULL)
+        return;
+    Py_INCREF(&NumaBufferType);
+    PyModule_AddObject(m, "NumaBuffer", (PyObject *)&NumaBufferType);
+    Py_INCREF(&MarkerFileType);
+    PyModule_AddObject(m, "MarkerFile", (PyObject *)&MarkerFileType);
+    Py_INCREF(&MarkerRegionType);
+    PyModule_AddObject(m, "MarkerRegion", (PyObject *)&MarkerRegionType);
 }
 #endif
 
+static PylikwidAPI pylikwid_api = {
+    need_native_topology,
+    need_numa,
+    need_affinity,
+    &cputopo,
+    &numainfo,
+    &affinity,
+};
+
 #if (PY_MAJOR_VERSION == 3)
 static struct PyModuleDef pylikwidmodule = {
     PyModuleDef_HEAD_INIT,
@@ -2763,6 +10678,47 @@ static struct PyModuleDef pylikwidmodule = {
 PyMODINIT_FUNC
 PyInit_pylikwid(void)
 {
-        return PyModule_Create(&pylikwidmodule);
+        PyObject *m, *api;
+        if (PyType_Ready(&NumaBufferType) < 0 || PyType_Ready(&MarkerFileType) < 0)
+            return NULL;
+        if (MarkerRegionType.tp_name == NULL && PyStructSequence_InitType2(&MarkerRegionType, &markerregion_desc) < 0)
+            return NULL;
+        m = PyModule_Create(&pylikwidmodule);
+        if (m == NULL)
+            return NULL;
+        if (trace_wrap_methods(m, LikwidMethods) < 0)
+        {
+            Py_DECREF(m);
+            return NULL;
+        }
+        Py_INCREF(&NumaBufferType);
+        if (PyModule_AddObject(m, "NumaBuffer", (PyObject *)&NumaBufferType) < 0)
+        {
+            Py_DECREF(&NumaBufferType);
+            Py_DECREF(m);
+            return NULL;
+        }
+        Py_INCREF(&MarkerFileType);
+        if (PyModule_AddObject(m, "MarkerFile", (PyObject *)&MarkerFileType) < 0)
+        {
+            Py_DECREF(&MarkerFileType);
+            Py_DECREF(m);
+            return NULL;
+        }
+        Py_INCREF(&MarkerRegionType);
+        if (PyModule_AddObject(m, "MarkerRegion", (PyObject *)&MarkerRegionType) < 0)
+        {
+            Py_DECREF(&MarkerRegionType);
+            Py_DECREF(m);
+            return NULL;
+        }
+        api = PyCapsule_New(&pylikwid_api, PYLIKWID_API_NAME, NULL);
+        if (api == NULL || PyModule_AddObject(m, "_C_API", api) < 0)
+        {
+            Py_XDECREF(api);
+            Py_DECREF(m);
+            return NULL;
+        }
+        return m;
 }
 #endif
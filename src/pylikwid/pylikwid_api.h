@@ -0,0 +1,21 @@
+#ifndef PYLIKWID_API_H
+#define PYLIKWID_API_H
+
+/* Functions and state of pylikwid.pylikwid used by the other extension
+ * modules of the package, exported as capsule PYLIKWID_API_NAME. The
+ * extensions share the LIKWID library state, so they must also share the
+ * initialization state of its modules. The topology pointers are reset when
+ * the modules are finalized, read them after each need_* call. */
+
+#define PYLIKWID_API_NAME "pylikwid.pylikwid._C_API"
+
+typedef struct {
+    int (*need_native_topology)(void);
+    int (*need_numa)(void);
+    int (*need_affinity)(void);
+    CpuTopology_t* cputopo;
+    NumaTopology_t* numainfo;
+    AffinityDomains_t* affinity;
+} PylikwidAPI;
+
+#endif
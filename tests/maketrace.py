@@ -0,0 +1,79 @@
+#!/usr/bin/env python
+
+# Writes synthetic.trace, a trace of a perfmon session on a made-up system
+# with two hardware threads. testtrace.py replays it, so the replay path is
+# tested without hardware counter access. Run it again if the values change.
+
+import os, sys, struct, marshal
+
+MAGIC = b"PYLWTRC\0"
+VERSION = 1
+MARSHAL_VERSION = 2
+
+GROUP = "INSTR_RETIRED_ANY:FIXC0,CPU_CLK_UNHALTED_CORE:FIXC1"
+
+topology = {
+    "numHWThreads": 2, "activeHWThreads": 2, "numSockets": 1,
+    "numCoresPerSocket": 2, "numThreadsPerCore": 1, "numCacheLevels": 0,
+    "threadPool": {t: {"threadId": 0, "coreId": t, "packageId": 0, "apicId": t,
+                       "inCpuSet": 1} for t in range(2)},
+    "cacheLevels": {},
+}
+cpuinfo = {"family": 6, "model": 85, "stepping": 4, "clock": 2000000000,
+           "turbo": False, "isIntel": True, "supportUncore": False,
+           "osname": "Synthetic CPU @ 2.00GHz", "name": "Synthetic",
+           "short_name": "synthetic", "features": "", "perf_version": 4}
+
+def results(time, instr, cycles, last):
+    """Result bundle as stored after stop/read, CPI as the only metric"""
+    return {"time": time,
+            "result": [instr, cycles],
+            "lastresult": [last[0], last[1]],
+            "metric": [[c / i for i, c in zip(instr, cycles)]],
+            "lastmetric": [[c / i for i, c in zip(*last)]]}
+
+records = [
+    ("getcpuinfo", (), cpuinfo),
+    ("getcputopology", (), topology),
+    ("cpustr_to_cpulist", ("S0:0-1",), [0, 1]),
+    ("init", ([0, 1],), 0),
+    ("addeventset", (GROUP,), 0),
+    ("getnameofgroup", (0,), "Custom"),
+    ("getnumberofevents", (0,), 2),
+    ("getnumberofmetrics", (0,), 1),
+    ("getnumberofthreads", (), 2),
+    ("getnameofevent", (0, 0), "INSTR_RETIRED_ANY"),
+    ("getnameofcounter", (0, 0), "FIXC0"),
+    ("getnameofevent", (0, 1), "CPU_CLK_UNHALTED_CORE"),
+    ("getnameofcounter", (0, 1), "FIXC1"),
+    ("getnameofmetric", (0, 0), "CPI"),
+    ("setup", (0,), 0),
+    ("start", (), 0),
+    ("read", (), 0),
+    ("@results", (0,), results(0.5, [1000.0, 2000.0], [1500.0, 1000.0],
+                               ([1000.0, 2000.0], [1500.0, 1000.0]))),
+    ("stop", (), 0),
+    ("@results", (0,), results(1.0, [3000.0, 6000.0], [4500.0, 3000.0],
+                               ([2000.0, 4000.0], [3000.0, 2000.0]))),
+    ("finalize", (), 0),
+]
+
+def main(path):
+    # Only the used names in the header, replay maps them by name
+    names = []
+    for name, _, _ in records:
+        if name not in names:
+            names.append(name)
+    with open(path, "wb") as f:
+        f.write(MAGIC + struct.pack("<II", VERSION, len(names)))
+        for name in names:
+            f.write(struct.pack("<B", len(name)) + name.encode())
+        for i, (name, args, result) in enumerate(records):
+            a = marshal.dumps(args, MARSHAL_VERSION)
+            r = marshal.dumps(result, MARSHAL_VERSION)
+            f.write(struct.pack("<HIdI", names.index(name), 1, i * 1e-3, len(a)) + a)
+            f.write(struct.pack("<I", len(r)) + r)
+
+if __name__ == "__main__":
+    main(sys.argv[1] if len(sys.argv) > 1 else
+         os.path.join(os.path.dirname(os.path.abspath(__file__)), "synthetic.trace"))
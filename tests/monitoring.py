@@ -18,7 +18,6 @@ if sleeptime <= 0:
     sys.exit(1)
 
 
-gids = {}
 cpus = []
 
 ret = pylikwid.hpminit()
@@ -38,9 +37,10 @@ for t in topo["threadPool"].keys():
     cpus.append(topo["threadPool"][t]["apicId"])
 
 
-ret = pylikwid.init(cpus)
-if ret != 0:
-    print('Failed to initialize LIKWID perfmon module')
+try:
+    pylikwid.init(cpus)
+except RuntimeError as e:
+    print(f'Failed to initialize LIKWID perfmon module: {e}')
     sys.exit(1)
 os.environ["LIKWID_FORCE"] = "1"
 
@@ -53,14 +53,12 @@ run = True
 try:
     while run:
         for grp in groups:
-            if grp not in gids:
-                gid = pylikwid.addeventset(grp)
-                if gid < 0:
-                    print(f'Failed to add group {grp} to LIKWID perfmon module')
-                    groups.remove(grp)
-                    continue
-                gids[grp] = gid
-            gid = gids[grp]
+            # addeventset returns the existing group ID for known groups
+            gid = pylikwid.addeventset(grp)
+            if gid < 0:
+                print(f'Failed to add group {grp} to LIKWID perfmon module')
+                groups.remove(grp)
+                continue
             timestamp = time.time()
             pylikwid.setup(gid)
             pylikwid.start()
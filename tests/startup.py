@@ -0,0 +1,46 @@
+#!/usr/bin/env python
+
+import os, sys, subprocess, json
+
+# Each accessor is measured in a fresh interpreter, so the time includes
+# the initialization of all subsystems the accessor depends on.
+accessors = ["getconfiguration", "getcpuinfo", "getcputopology", "initnuma",
+             "initaffinity", "cacheblocking", "getgroups"]
+repeat = 5
+
+child = r"""
+import sys, time, json
+t0 = time.perf_counter()
+import pylikwid
+t1 = time.perf_counter()
+name = sys.argv[1]
+if name != "import":
+    getattr(pylikwid, name)()
+t2 = time.perf_counter()
+print(json.dumps({"import": t1 - t0, "call": t2 - t1, "subsystems": pylikwid.getinittimes()}))
+"""
+
+
+def measure(name):
+    out = subprocess.run([sys.executable, "-c", child, name], check=True,
+                         stdout=subprocess.PIPE, universal_newlines=True).stdout
+    return json.loads(out.strip().splitlines()[-1])
+
+
+try:
+    import pylikwid
+except ImportError:
+    print("Cannot load LIKWID python module")
+    sys.exit(1)
+
+subsystems = list(pylikwid.getinittimes().keys())
+print("Accessor\tImport [ms]\tFirst call [ms]\t" + "\t".join(f"{s} [ms]" for s in subsystems))
+for name in ["import"] + accessors:
+    runs = [measure(name) for i in range(repeat)]
+    best = min(runs, key=lambda r: r["call"])
+    imp = min(r["import"] for r in runs)
+    cols = []
+    for s in subsystems:
+        sub = best["subsystems"][s]
+        cols.append(f"{sub['time'] * 1E3:.3f}" if sub["initialized"] else "-")
+    print(f"{name}\t{imp * 1E3:.3f}\t{best['call'] * 1E3:.3f}\t" + "\t".join(cols))
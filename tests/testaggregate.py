@@ -0,0 +1,130 @@
+import math
+import os
+
+import pytest
+import pylikwid
+
+
+@pytest.fixture(scope="module")
+def topology():
+    topo = pylikwid.getcputopology()
+    cpus = sorted(entry["apicId"] for entry in topo["threadPool"].values())
+    yield topo, cpus
+
+
+def expected(topo, cpus, values, key):
+    """Per-thread aggregation in Python as every consumer did before"""
+    threads = {e["apicId"]: e for e in topo["threadPool"].values()}
+    sums = {}
+    for cpu, value in zip(cpus, values):
+        k = key(threads[cpu])
+        sums[k] = sums.get(k, 0.0) + value
+    return sums
+
+
+def test_aggregate_core(topology):
+    topo, cpus = topology
+    values = [float(cpu) for cpu in cpus]
+    result = pylikwid.aggregate(values, "core", cpus=cpus)
+    assert result == expected(topo, cpus, values, lambda e: (e["packageId"], e["coreId"]))
+    for k in result:
+        print(f"Core {k}: {result[k]}")
+
+
+def test_aggregate_socket_ops(topology):
+    topo, cpus = topology
+    values = [float(cpu) for cpu in cpus]
+    sums = expected(topo, cpus, values, lambda e: e["packageId"])
+    counts = expected(topo, cpus, [1.0] * len(cpus), lambda e: e["packageId"])
+    assert pylikwid.aggregate(values, "socket", "sum", cpus=cpus) == sums
+    mean = pylikwid.aggregate(values, "socket", "mean", cpus=cpus)
+    assert mean == {s: sums[s] / counts[s] for s in sums}
+    maxima = pylikwid.aggregate(values, "socket", "max", cpus=cpus)
+    threads = {e["apicId"]: e["packageId"] for e in topo["threadPool"].values()}
+    assert maxima == {s: max(c for c in cpus if threads[c] == s) for s in sums}
+
+
+def test_aggregate_numa_cache(topology):
+    _, cpus = topology
+    numa = pylikwid.initnuma()
+    result = pylikwid.aggregate([1.0] * len(cpus), "numa", cpus=cpus)
+    assert result == {n["id"]: float(len(n["processors"])) for n in numa["nodes"].values()}
+    affinity = pylikwid.initaffinity()
+    result = pylikwid.aggregate([1.0] * len(cpus), "cache", cpus=cpus)
+    caches = [d for d in affinity["domains"].values() if d["tag"].startswith("C")]
+    assert sorted(result.values()) == sorted(float(d["numberOfProcessors"]) for d in caches)
+    print(result)
+
+
+def test_aggregate_uncore(topology):
+    topo, cpus = topology
+    threads = {e["apicId"]: e["packageId"] for e in topo["threadPool"].values()}
+    # Uncore counters are read by one thread per socket, the others report 0
+    first = {}
+    for cpu in cpus:
+        first.setdefault(threads[cpu], cpu)
+    row = [100.0 if cpu in first.values() else 0.0 for cpu in cpus]
+    copies = [100.0] * len(cpus)
+    for values in (row, copies):
+        result = pylikwid.aggregate([values, [1.0] * len(cpus)], "socket", cpus=cpus,
+                                    uncore=[True, False])
+        for socket in result:
+            assert result[socket][0] == 100.0
+        total = pylikwid.aggregate([values], "core", cpus=cpus, uncore=True)
+        assert sum(v[0] for v in total.values()) == 100.0 * len(first)
+        mean = pylikwid.aggregate(values, "core", "mean", cpus=cpus, uncore=True)
+        assert sum(1 for v in mean.values() if not math.isnan(v)) == len(first)
+
+
+def test_aggregate_uncore_scope(topology):
+    _, cpus = topology
+    numa = pylikwid.initnuma()
+    affinity = pylikwid.initaffinity()
+    caches = [d for d in affinity["domains"].values() if d["tag"].startswith("C")]
+    # Each unit reports 10 on all of its CPUs, counted once per unit
+    for scope, units in (("numa", [n["processors"] for n in numa["nodes"].values()]),
+                         ("cache", [d["processorList"] for d in caches])):
+        units = [u for u in units if any(c in cpus for c in u)]
+        result = pylikwid.aggregate([10.0] * len(cpus), "socket", cpus=cpus, uncore=scope)
+        assert sum(result.values()) == 10.0 * len(units)
+        result = pylikwid.aggregate([[10.0] * len(cpus)] * 2, "socket", cpus=cpus,
+                                    uncore=[scope, False])
+        assert sum(v[0] for v in result.values()) == 10.0 * len(units)
+        assert sum(v[1] for v in result.values()) == 10.0 * len(cpus)
+    with pytest.raises(ValueError):
+        pylikwid.aggregate([1.0] * len(cpus), "socket", cpus=cpus, uncore="rack")
+
+
+def test_aggregate_invalid(topology):
+    _, cpus = topology
+    with pytest.raises(ValueError):
+        pylikwid.aggregate([1.0], "rack", cpus=cpus[:1])
+    with pytest.raises(ValueError):
+        pylikwid.aggregate([1.0], "socket", "median", cpus=cpus[:1])
+    with pytest.raises(ValueError):
+        pylikwid.aggregate([1.0, 2.0], "socket", cpus=cpus[:1])
+    with pytest.raises(ValueError):
+        pylikwid.aggregate([1.0], "socket", cpus=[max(cpus) + 1])
+
+
+@pytest.mark.skipif(not os.path.exists("/dev/cpu/0/msr"), reason="MSR device not available")
+def test_aggregate_results(topology):
+    _, cpus = topology
+    try:
+        pylikwid.init(cpus)
+    except RuntimeError as e:
+        pytest.skip(f"LIKWID perfmon init failed ({e})")
+    try:
+        gid = pylikwid.addeventset("INSTR_RETIRED_ANY:FIXC0")
+        if gid < 0:
+            pytest.skip("Event set not supported on this architecture")
+        pylikwid.setup(gid)
+        pylikwid.start()
+        pylikwid.stop()
+        # Columns and values default to the perfmon CPUs and results of gid
+        result = pylikwid.aggregate(gid=gid, level="socket")
+        matrix = [[pylikwid.getresult(gid, 0, t) for t in range(len(cpus))]]
+        assert result == pylikwid.aggregate(matrix, "socket", cpus=cpus)
+        print(result)
+    finally:
+        pylikwid.finalize()
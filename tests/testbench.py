@@ -0,0 +1,79 @@
+import pytest
+import pylikwid
+from pylikwid import bench
+
+
+def test_kernels():
+    assert set(bench.kernels()) == {"load", "store", "copy", "triad"}
+
+
+@pytest.mark.parametrize("kernel", ["load", "store", "copy", "triad"])
+def test_stream(kernel):
+    res = bench.stream(kernel, 1 << 20, mintime=0.01)
+    assert res["kernel"] == kernel
+    assert res["threads"] == 1
+    assert res["bandwidth"] > 0
+    print(f"{kernel}: {res['bandwidth']:.0f} MB/s")
+
+
+def test_stream_multiple_cpus():
+    pylikwid.inittopology()
+    topo = pylikwid.getcputopology()
+    cpus = [topo["threadPool"][t]["apicId"] for t in topo["threadPool"]][:2]
+    res = bench.stream("copy", 1 << 20, cpus, mintime=0.01)
+    assert res["threads"] == len(cpus)
+
+
+def test_stream_after_finalizetopology():
+    # bench uses the topology state of pylikwid and initializes it again
+    pylikwid.inittopology()
+    pylikwid.finalizetopology()
+    res = bench.stream("load", 1 << 20, "0", mintime=0.01)
+    assert res["threads"] == 1
+    assert res["bandwidth"] > 0
+
+
+def test_latency():
+    small = bench.latency(16 * 1024, steps=100000)
+    assert small > 0
+    print(f"Latency 16 kB: {small:.2f} ns")
+
+
+def test_cachelevels():
+    levels = bench.cachelevels(mintime=0.01, latency=False)
+    assert levels[-1]["level"] == "MEM"
+    for entry in levels:
+        assert set(entry["bandwidth"]) == set(bench.kernels())
+        print(entry)
+
+
+def test_invalid_arguments():
+    with pytest.raises(ValueError):
+        bench.stream("scale", 1 << 20)
+    with pytest.raises(ValueError):
+        bench.stream("copy", 0)
+
+
+def test_invalid_node():
+    # The data cannot be bound to nodes that do not exist
+    for node in (1000, 100000):
+        with pytest.raises(OSError):
+            bench.stream("load", 1 << 20, node=node, mintime=0.01)
+        with pytest.raises(OSError):
+            bench.latency(16 * 1024, node=node, steps=1000)
+
+
+def test_transpose():
+    res = bench.transpose(256, tile=32, mintime=0.01)
+    assert res["n"] == 256 and res["ld"] == 256
+    assert res["time"] > 0 and res["bandwidth"] > 0
+    print(res)
+
+
+def test_tiling():
+    res = bench.tiling(256, ld=264, mintime=0.01)
+    sources = [r["source"] for r in res["results"]]
+    assert [f"L{a['level']}" for a in res["advice"]] == sources[:len(res["advice"])]
+    assert "fixed" in sources
+    for r in res["results"]:
+        print(f"{r['source']:>5} tile {r['tile']:4d}: {r['bandwidth']:.0f} MB/s")
@@ -0,0 +1,62 @@
+import pytest
+import pylikwid
+
+
+@pytest.fixture(scope="module")
+def topology():
+    pylikwid.inittopology()
+    topo = pylikwid.getcputopology()
+    yield topo
+    pylikwid.finalizetopology()
+
+
+def _all_cpus(topology):
+    return [topology["threadPool"][t]["apicId"] for t in topology["threadPool"]]
+
+
+@pytest.mark.parametrize("policy", ["compact", "scatter", "per-numa"])
+def test_workers_are_pinned(topology, policy):
+    cpus = _all_cpus(topology)
+    with pylikwid.PinnedExecutor(cpus, policy=policy) as ex:
+        assert sorted(ex.cpus) == sorted(cpus)
+        results = list(ex.map(lambda _: (pylikwid.current_placement()["cpu"],
+                                         pylikwid.getprocessorid()),
+                              range(4 * len(cpus))))
+    for assigned, running in results:
+        assert assigned == running
+    print(f"{policy}: {ex.cpus}")
+
+
+def test_compact_uses_physical_cores_first(topology):
+    cpus = _all_cpus(topology)
+    with pylikwid.PinnedExecutor(cpus, policy="compact") as ex:
+        threads = {topology["threadPool"][t]["apicId"]: topology["threadPool"][t]
+                   for t in topology["threadPool"]}
+        first_socket = [c for c in ex.cpus
+                        if threads[c]["packageId"] == threads[ex.cpus[0]]["packageId"]]
+        tids = [threads[c]["threadId"] for c in first_socket]
+        assert tids == sorted(tids)
+
+
+def test_scatter_alternates_sockets(topology):
+    if topology["numSockets"] < 2:
+        pytest.skip("Requires at least two sockets")
+    threads = {topology["threadPool"][t]["apicId"]: topology["threadPool"][t]
+               for t in topology["threadPool"]}
+    with pylikwid.PinnedExecutor(_all_cpus(topology), policy="scatter",
+                                 max_workers=2) as ex:
+        sockets = {threads[c]["packageId"] for c in ex.cpus}
+    assert len(sockets) == 2
+
+
+def test_placement_domains(topology):
+    with pylikwid.PinnedExecutor(_all_cpus(topology)[:1]) as ex:
+        placement = ex.placement[0]
+    assert "N" in placement["domains"]
+
+
+def test_invalid_arguments(topology):
+    with pytest.raises(ValueError):
+        pylikwid.PinnedExecutor(policy="random")
+    with pytest.raises(ValueError):
+        pylikwid.PinnedExecutor(_all_cpus(topology)[:1], max_workers=2)
@@ -1,4 +1,10 @@
+import json
 import os
+import signal
+import subprocess
+import sys
+import textwrap
+import time
 
 import pytest
 import pylikwid
@@ -50,19 +56,17 @@ def test_getgovernor(topology):
 
 
 def test_set_and_reset_frequency(topology):
-    minfreq = int(float(pylikwid.getcpuclockmin(1)) / 1e3)
-    maxfreq = int(float(pylikwid.getcpuclockmax(1)) / 1e3)
+    minfreq = pylikwid.getcpuclockmin(1)
+    maxfreq = pylikwid.getcpuclockmax(1)
 
-    print(f"\nSet frequency of CPU 1 to minimum {int(minfreq / 1e3)} MHz:")
-    pylikwid.setcpuclockmin(1, minfreq)
-    pylikwid.setcpuclockmax(1, minfreq)
-    assert int(float(pylikwid.getcpuclockmin(1)) / 1e3) == minfreq
-    print(f"CPU 1 : {pylikwid.getcpuclockcurrent(1)} Hz (min: {pylikwid.getcpuclockmin(1)}, max: {pylikwid.getcpuclockmax(1)}, gov: {pylikwid.getgovernor(1)})")
+    print(f"\nSet frequency of CPU 1 to minimum {int(minfreq / 1e6)} MHz:")
+    with pylikwid.apply_frequency_profile({1: {"min": minfreq, "max": minfreq}}):
+        assert pylikwid.getcpuclockmin(1) == minfreq
+        assert pylikwid.getcpuclockmax(1) == minfreq
+        print(f"CPU 1 : {pylikwid.getcpuclockcurrent(1)} Hz (min: {pylikwid.getcpuclockmin(1)}, max: {pylikwid.getcpuclockmax(1)}, gov: {pylikwid.getgovernor(1)})")
 
     print("\nReset frequency of CPU 1:")
-    pylikwid.setcpuclockmin(1, minfreq)
-    pylikwid.setcpuclockmax(1, maxfreq)
-    assert int(float(pylikwid.getcpuclockmax(1)) / 1e3) == maxfreq
+    assert pylikwid.getcpuclockmax(1) == maxfreq
     print(f"CPU 1 : {pylikwid.getcpuclockcurrent(1)} Hz (min: {pylikwid.getcpuclockmin(1)}, max: {pylikwid.getcpuclockmax(1)}, gov: {pylikwid.getgovernor(1)})")
 
 
@@ -74,12 +78,11 @@ def test_set_and_reset_governor(topology):
         pytest.skip("Only one governor available")
 
     print(f"\nSet governor of CPU 1 to {other_gov}:")
-    pylikwid.setgovernor(1, other_gov)
-    assert pylikwid.getgovernor(1) == other_gov
-    print(f"CPU 1 : {pylikwid.getcpuclockcurrent(1)} Hz (min: {pylikwid.getcpuclockmin(1)}, max: {pylikwid.getcpuclockmax(1)}, gov: {pylikwid.getgovernor(1)})")
+    with pylikwid.apply_frequency_profile({1: {"governor": other_gov}}):
+        assert pylikwid.getgovernor(1) == other_gov
+        print(f"CPU 1 : {pylikwid.getcpuclockcurrent(1)} Hz (min: {pylikwid.getcpuclockmin(1)}, max: {pylikwid.getcpuclockmax(1)}, gov: {pylikwid.getgovernor(1)})")
 
     print(f"\nReset governor of CPU 1 to {current_gov}:")
-    pylikwid.setgovernor(1, current_gov)
     assert pylikwid.getgovernor(1) == current_gov
     print(f"CPU 1 : {pylikwid.getcpuclockcurrent(1)} Hz (min: {pylikwid.getcpuclockmin(1)}, max: {pylikwid.getcpuclockmax(1)}, gov: {pylikwid.getgovernor(1)})")
 
@@ -91,4 +94,224 @@ def test_uncore_frequencies(topology):
         maxunc = pylikwid.getuncoreclockmax(socket)
         assert minunc > 0
         assert maxunc >= minunc
-        print(f"Socket {socket} : min: {minunc} MHz, max: {maxunc} MHz")
+        # 0 if neither the status register nor UNCORE_CLOCK is readable
+        curunc = pylikwid.getuncoreclockcurrent(socket)
+        assert curunc >= 0
+        print(f"Socket {socket} : min: {minunc} MHz, max: {maxunc} MHz, current: {curunc} Hz")
+
+
+def settings(cpus, sockets=()):
+    return ([(pylikwid.getcpuclockmin(c), pylikwid.getcpuclockmax(c), pylikwid.getgovernor(c))
+             for c in cpus] +
+            [(pylikwid.getuncoreclockmin(s), pylikwid.getuncoreclockmax(s)) for s in sockets])
+
+
+def test_frequency_profile(topology):
+    freqs = sorted(int(float(f) * 1e9) for f in pylikwid.getavailfreqs(0).split())
+    before = settings([0, 1, 2], range(topology["numSockets"]))
+    umin = pylikwid.getuncoreclockmin(0)
+    profile = pylikwid.FrequencyProfile({
+        "0,1": {"min": freqs[0], "max": freqs[0]},
+        2: {"max": freqs[-1]},
+        "uncore": {"min": umin, "max": umin},
+    })
+    with profile:
+        assert profile.applied
+        assert [pylikwid.getcpuclockmax(c) for c in (0, 1)] == [freqs[0]] * 2
+        assert pylikwid.getuncoreclockmax(0) == umin
+        with pytest.raises(RuntimeError):
+            profile.apply()
+    assert not profile.applied
+    assert settings([0, 1, 2], range(topology["numSockets"])) == before
+    with pytest.raises(ValueError):
+        pylikwid.FrequencyProfile({0: {"min": freqs[-1], "max": freqs[0]}})
+    with pytest.raises(ValueError):
+        pylikwid.FrequencyProfile({0: {"turbo": True}})
+
+
+def test_frequency_profile_rollback_on_failure(topology, monkeypatch):
+    freq = int(float(pylikwid.getavailfreqs(0).split()[0]) * 1e9)
+    before = settings([0, 1, 2, 3])
+    setmax = pylikwid.setcpuclockmax
+    # The third CPU fails, the first two are rolled back
+    monkeypatch.setattr(pylikwid.pylikwid, "setcpuclockmax", lambda c, f: 0 if c == 2 else setmax(c, f))
+    with pytest.raises(RuntimeError, match="CPU 2"):
+        pylikwid.apply_frequency_profile({"0-3": {"min": freq, "max": freq, "governor": "powersave"}})
+    monkeypatch.undo()
+    assert settings([0, 1, 2, 3]) == before
+
+
+def test_frequency_profile_signal(topology):
+    # SIGTERM rolls back the profile and calls the previous handler
+    script = textwrap.dedent("""
+        import os, signal
+        import pylikwid
+        before = pylikwid.getcpuclockmax(0)
+        freq = int(float(pylikwid.getavailfreqs(0).split()[0]) * 1e9)
+        signal.signal(signal.SIGTERM, lambda *a: print(pylikwid.getcpuclockmax(0) == before))
+        pylikwid.apply_frequency_profile({0: {"min": freq, "max": freq}})
+        print(pylikwid.getcpuclockmax(0) == freq)
+        os.kill(os.getpid(), signal.SIGTERM)
+    """)
+    res = subprocess.run([sys.executable, "-c", script], capture_output=True, text=True,
+                         env=os.environ)
+    assert res.returncode == 0, res.stderr
+    assert res.stdout.split() == ["True", "True"]
+    # Without a previous handler, the process is terminated by the signal
+    script = textwrap.dedent("""
+        import os, signal
+        import pylikwid
+        pylikwid.apply_frequency_profile({0: {"governor": pylikwid.getgovernor(0)}})
+        os.kill(os.getpid(), signal.SIGTERM)
+        print("not reached")
+    """)
+    res = subprocess.run([sys.executable, "-c", script], capture_output=True, text=True,
+                         env=os.environ)
+    assert res.returncode == -signal.SIGTERM and res.stdout == ""
+
+
+def test_freqtimeline(topology, tmp_path):
+    with pytest.raises(ValueError):
+        pylikwid.freqtimelinestart(interval=0)
+    with pytest.raises(RuntimeError):
+        # Metrics need the perfmon module
+        pylikwid.freqtimelinestart(metrics=["Memory bandwidth [MBytes/s]"])
+    pylikwid.freqtimelinestart(interval=0.01)
+    with pytest.raises(RuntimeError):
+        pylikwid.freqtimelinestart()
+    with pytest.raises(RuntimeError):
+        pylikwid.freqtimeline()
+    time.sleep(0.1)
+    n = pylikwid.freqtimelinestop()
+    assert n >= 3
+    assert pylikwid.freqtimelinestop() == n
+    res = pylikwid.freqtimeline()
+    assert len(res["time"]) == len(res["core"]) == len(res["uncore"]) == n
+    assert res["time"] == sorted(res["time"])
+    assert len(res["cpus"]) == topology["numHWThreads"]
+    assert res["sockets"] == list(range(topology["numSockets"]))
+    assert all(len(c) == len(res["cpus"]) for c in res["core"])
+    assert all(len(u) == len(res["sockets"]) for u in res["uncore"])
+    assert res["metrics"] == {}
+
+    path = tmp_path / "freq.json"
+    assert pylikwid.freqtimelinewrite(str(path)) == n
+    with open(path) as f:
+        events = json.load(f)["traceEvents"]
+    counters = [e for e in events if e["ph"] == "C"]
+    assert len(counters) == 2 * n
+    assert {e["name"] for e in counters} == {"Core clock [MHz]", "Uncore clock [MHz]"}
+
+    # Only the last maxsamples samples are kept
+    with pytest.raises(ValueError):
+        pylikwid.freqtimelinestart(maxsamples=0)
+    pylikwid.freqtimelinestart(interval=0.01, maxsamples=2)
+    time.sleep(0.1)
+    assert pylikwid.freqtimelinestop() == 2
+    res = pylikwid.freqtimeline()
+    assert len(res["time"]) == 2
+    assert res["time"][0] < res["time"][1]
+    assert res["time"][0] > 0.02
+
+
+@pytest.fixture
+def perfmon(topology):
+    if not os.path.exists("/dev/cpu/0/msr"):
+        pytest.skip("MSR device not available")
+    cpus = sorted(entry["apicId"] for entry in topology["threadPool"].values())
+    try:
+        pylikwid.init(cpus)
+    except RuntimeError as e:
+        pytest.skip(f"LIKWID perfmon init failed ({e})")
+    yield cpus
+    pylikwid.freqtimelinestop()
+    pylikwid.finalize()
+
+
+def start_eventset(eventset):
+    gid = pylikwid.addeventset(eventset)
+    if gid < 0:
+        pytest.skip(f"Event set {eventset!r} not supported on this architecture")
+    pylikwid.setup(gid)
+    pylikwid.start()
+    return gid
+
+
+def test_freqtimeline_bandwidth(perfmon):
+    gid = start_eventset("MEM")
+    pylikwid.freqtimelinestart(interval=0.01)
+    time.sleep(0.1)
+    n = pylikwid.freqtimelinestop()
+    pylikwid.stop()
+    res = pylikwid.freqtimeline()
+    assert res["cpus"] == perfmon
+    # Default: the bandwidth metrics of the group
+    names = [pylikwid.getnameofmetric(gid, m) for m in range(pylikwid.getnumberofmetrics(gid))]
+    assert sorted(res["metrics"]) == sorted(m for m in names if "andwidth" in m)
+    assert res["metrics"]
+    for values in res["metrics"].values():
+        assert len(values) == n
+        assert all(v >= 0 for v in values)
+    with pytest.raises(ValueError):
+        pylikwid.freqtimelinestart(metrics=["No such metric"])
+
+
+def test_freqtimeline_uncore_clock(perfmon, topology):
+    # The Uncore clock falls back to UNCORE_CLOCK if the status register is
+    # not readable, it is known after the first read of the group
+    start_eventset("UNCORE_CLOCK:UBOXFIX")
+    pylikwid.freqtimelinestart(interval=0.01)
+    time.sleep(0.1)
+    n = pylikwid.freqtimelinestop()
+    pylikwid.stop()
+    res = pylikwid.freqtimeline()
+    assert n >= 3
+    assert all(len(u) == topology["numSockets"] for u in res["uncore"])
+    assert all(u > 0 for sample in res["uncore"][1:] for u in sample)
+
+
+def test_throttle_monitor(topology):
+    freqs = sorted(int(float(f) * 1e9) for f in pylikwid.getavailfreqs(0).split())
+    nominal = pylikwid.getcpuclockmax(0)
+    if freqs[0] >= 0.9 * nominal:
+        pytest.skip("No frequency low enough to provoke a clock drop")
+    with pytest.raises(ValueError):
+        pylikwid.throttlestart(tolerance=1)
+    with pytest.raises(ValueError):
+        pylikwid.throttlestart(cpus=[-1])
+    # Regions are tracked if the Marker API is active
+    marker = "LIKWID_MODE" in os.environ
+    if marker:
+        pylikwid.markerinit()
+        pylikwid.markerthreadinit()
+    # Without cycle counters only on request
+    with pytest.raises(RuntimeError):
+        pylikwid.throttlestart(cpus=[0])
+    pylikwid.throttlestart(interval=0.01, cpus=[0], nominal=nominal, frequency=True)
+    with pytest.raises(RuntimeError):
+        pylikwid.throttlereport()
+    time.sleep(0.05)
+    with pylikwid.apply_frequency_profile({0: {"min": freqs[0], "max": freqs[0]}}):
+        if marker:
+            pylikwid.markerstartregion("slow")
+        time.sleep(0.1)
+        if marker:
+            pylikwid.markerstopregion("slow")
+    time.sleep(0.05)
+    assert pylikwid.throttlestop() >= 1
+    if marker:
+        pylikwid.markerclose()
+    res = pylikwid.throttlereport()
+    assert res["nominal"] == nominal
+    assert res["source"] == "frequency"
+    assert res["samples"] >= 10
+    assert list(res["maxtemp"]) == [0]
+    iv = res["intervals"][0]
+    assert iv["cpu"] == 0
+    assert 0.04 <= iv["start"] < iv["end"]
+    assert iv["minclock"] <= iv["meanclock"] < 0.95 * nominal
+    if marker:
+        assert iv["regions"] == ["slow"]
+        assert res["regions"]["slow"]["intervals"] >= 1
+    else:
+        assert res["regions"] == {}
@@ -0,0 +1,80 @@
+import pytest
+import pylikwid
+
+L3 = """SHORT  L3 cache bandwidth in MBytes/s
+
+EVENTSET
+FIXC0 INSTR_RETIRED_ANY
+FIXC1 CPU_CLK_UNHALTED_CORE
+PMC0  L2_LINES_IN_ALL
+
+METRICS
+Runtime (RDTSC) [s] time
+CPI  FIXC1/FIXC0
+L3 load bandwidth [MBytes/s]  1.0E-06*PMC0*64.0/time
+
+LONG
+Formulas:
+L3 load bandwidth [MBytes/s] = 1.0E-06*L2_LINES_IN_ALL*64.0/time
+-
+Bandwidth between L2 and L3.
+"""
+
+
+@pytest.fixture
+def groupdir(tmp_path, monkeypatch):
+    arch = pylikwid.getcpuinfo()["short_name"]
+    oldpath = pylikwid.getconfiguration()["groupPath"]
+    archdir = tmp_path / "groups" / arch
+    archdir.mkdir(parents=True)
+    (archdir / "L3.txt").write_text(L3)
+    monkeypatch.setenv("HOME", str(tmp_path / "home"))
+    assert pylikwid.setgrouppath(str(tmp_path / "groups"))
+    yield archdir
+    pylikwid.setgrouppath(oldpath)
+
+
+def test_catalog(groupdir):
+    catalog = pylikwid.getgroupcatalog()
+    assert list(catalog) == ["L3"]
+    g = catalog["L3"]
+    assert g["Info"] == "L3 cache bandwidth in MBytes/s"
+    assert g["Events"] == (("FIXC0", "INSTR_RETIRED_ANY"),
+                           ("FIXC1", "CPU_CLK_UNHALTED_CORE"),
+                           ("PMC0", "L2_LINES_IN_ALL"))
+    assert g["Metrics"][0] == ("Runtime (RDTSC) [s]", "time")
+    assert g["Metrics"][2] == ("L3 load bandwidth [MBytes/s]", "1.0E-06*PMC0*64.0/time")
+    assert g["Long"].startswith("Formulas:")
+    assert g["Long"].endswith("Bandwidth between L2 and L3.")
+    assert not g["User"]
+    with pytest.raises(TypeError):
+        catalog["MEM"] = g
+    with pytest.raises(TypeError):
+        g["Info"] = ""
+    # Unchanged files: the cached catalog is returned
+    assert pylikwid.getgroupcatalog() is catalog
+    groups = pylikwid.getgroups()
+    assert groups == [{"Name": "L3", "Info": g["Info"], "Long": g["Long"]}]
+
+
+def test_catalog_invalidation(groupdir, tmp_path):
+    catalog = pylikwid.getgroupcatalog()
+    (groupdir / "L3.txt").write_text(L3.replace("L3 cache", "Last level cache"))
+    changed = pylikwid.getgroupcatalog()
+    assert changed is not catalog
+    assert changed["L3"]["Info"] == "Last level cache bandwidth in MBytes/s"
+    (groupdir / "MEM.txt").write_text("SHORT Memory\n\nEVENTSET\nMBOX0C0 CAS_COUNT_RD\n")
+    assert list(pylikwid.getgroupcatalog()) == ["L3", "MEM"]
+
+    # User groups in ~/.likwid/groups override system groups
+    userdir = tmp_path / "home" / ".likwid" / "groups" / groupdir.name
+    userdir.mkdir(parents=True)
+    (userdir / "MEM.txt").write_text("SHORT My memory group\n\nEVENTSET\nPMC0 EVENT\n")
+    mem = pylikwid.getgroupcatalog()["MEM"]
+    assert mem["User"] and mem["Info"] == "My memory group"
+
+    # A different group path is a different catalog
+    other = tmp_path / "other"
+    (other / groupdir.name).mkdir(parents=True)
+    pylikwid.setgrouppath(str(other))
+    assert list(pylikwid.getgroupcatalog()) == ["MEM"]
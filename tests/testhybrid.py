@@ -0,0 +1,74 @@
+import pytest
+import pylikwid
+
+
+@pytest.fixture
+def hybrid(tmp_path, monkeypatch):
+    """Synthetic sysfs tree: the first half of the hardware threads are
+    performance cores, the second half efficiency cores"""
+    topo = pylikwid.getcputopology()
+    cpus = sorted(entry["apicId"] for entry in topo["threadPool"].values())
+    half = len(cpus) // 2
+    pcores, ecores = cpus[:half], cpus[half:]
+    for pmu, l in (("cpu_core", pcores), ("cpu_atom", ecores)):
+        (tmp_path / "devices" / pmu).mkdir(parents=True)
+        (tmp_path / "devices" / pmu / "cpus").write_text(",".join(str(c) for c in l) + "\n")
+    monkeypatch.setenv("PYLIKWID_SYSFS_ROOT", str(tmp_path))
+    yield cpus, pcores, ecores
+
+
+def test_topology_coretype(hybrid):
+    cpus, pcores, ecores = hybrid
+    topo = pylikwid.getcputopology()
+    for entry in topo["threadPool"].values():
+        expected = "performance" if entry["apicId"] in pcores else "efficiency"
+        assert entry["coreType"] == expected
+        print(f"{entry['apicId']}\t{entry['coreType']}")
+
+
+def test_topology_not_hybrid(tmp_path, monkeypatch):
+    monkeypatch.setenv("PYLIKWID_SYSFS_ROOT", str(tmp_path))
+    topo = pylikwid.getcputopology()
+    assert all(entry["coreType"] is None for entry in topo["threadPool"].values())
+
+
+def test_cpulist_ranges(tmp_path, monkeypatch):
+    (tmp_path / "devices" / "cpu_core").mkdir(parents=True)
+    (tmp_path / "devices" / "cpu_core" / "cpus").write_text("0-1,3\n")
+    monkeypatch.setenv("PYLIKWID_SYSFS_ROOT", str(tmp_path))
+    topo = pylikwid.getcputopology()
+    types = {e["apicId"]: e["coreType"] for e in topo["threadPool"].values()}
+    assert [c for c in sorted(types) if types[c] == "performance"] == [0, 1, 3]
+
+
+def test_placement_coretype(hybrid):
+    cpus, pcores, ecores = hybrid
+    plan = pylikwid.plan_placement(2, "compact", avoid_smt=False, core_type="efficiency")
+    assert all(w[0] in ecores for w in plan)
+    plan = pylikwid.plan_placement(2, "scatter", avoid_smt=False, core_type="performance")
+    assert all(w[0] in pcores for w in plan)
+    with pytest.raises(ValueError):
+        pylikwid.plan_placement(1, core_type="turbo")
+
+
+def test_placement_coretype_synthetic():
+    # 2 performance cores with SMT and 4 efficiency cores on one socket
+    pool = {}
+    for cpu, (core, thread, ctype) in enumerate([(0, 0, "performance"), (1, 0, "performance"),
+                                                  (0, 1, "performance"), (1, 1, "performance"),
+                                                  (2, 0, "efficiency"), (3, 0, "efficiency"),
+                                                  (4, 0, "efficiency"), (5, 0, "efficiency")]):
+        pool[cpu] = {"apicId": cpu, "coreId": core, "threadId": thread, "packageId": 0,
+                     "coreType": ctype}
+    topo = {"threadPool": pool}
+    # Performance cores first, then efficiency cores, SMT siblings last
+    plan = pylikwid.plan_placement(8, avoid_smt=False, topology=topo)
+    assert [w[0] for w in plan] == [0, 1, 4, 5, 6, 7, 2, 3]
+    plan = pylikwid.plan_placement(2, core_type="performance", topology=topo)
+    assert plan == [[0], [1]]
+
+
+def test_aggregate_coretype(hybrid):
+    cpus, pcores, ecores = hybrid
+    result = pylikwid.aggregate([1.0] * len(cpus), "coretype", cpus=cpus)
+    assert result == {"performance": float(len(pcores)), "efficiency": float(len(ecores))}
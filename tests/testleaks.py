@@ -0,0 +1,63 @@
+import gc
+import os
+import tracemalloc
+
+import pytest
+import pylikwid
+
+LOOPS = 2000
+
+
+def rss():
+    """Resident set size of the process in bytes"""
+    with open("/proc/self/statm") as f:
+        return int(f.read().split()[1]) * os.sysconf("SC_PAGE_SIZE")
+
+
+BUILDERS = {
+    "getconfiguration": lambda: pylikwid.getconfiguration(),
+    "getcputopology": lambda: pylikwid.getcputopology(),
+    "getcpuinfo": lambda: pylikwid.getcpuinfo(),
+    "initnuma": lambda: pylikwid.initnuma(),
+    "initaffinity": lambda: pylikwid.initaffinity(),
+    "getpowerinfo": lambda: pylikwid.getpowerinfo(),
+    "markergetregion": lambda: pylikwid.markergetregion("leak"),
+}
+
+
+@pytest.mark.parametrize("name", sorted(BUILDERS))
+def test_builder_no_leak(name):
+    func = BUILDERS[name]
+    # Warm up: lazy initialization, interned keys and caches
+    for _ in range(10):
+        func()
+    gc.collect()
+    objects = len(gc.get_objects())
+    tracemalloc.start()
+    try:
+        base, _ = tracemalloc.get_traced_memory()
+        for _ in range(LOOPS):
+            func()
+        gc.collect()
+        grown = tracemalloc.get_traced_memory()[0] - base
+    finally:
+        tracemalloc.stop()
+    # One leaked object per call would already exceed this
+    assert grown < LOOPS * 16, f"{name} leaked {grown} bytes in {LOOPS} calls"
+    assert len(gc.get_objects()) - objects < LOOPS // 10
+
+
+def test_monitor_loop_rss():
+    """A long running monitor polling all builders keeps a flat RSS"""
+    def poll(n):
+        for _ in range(n):
+            for func in BUILDERS.values():
+                func()
+    poll(100)
+    gc.collect()
+    before = rss()
+    poll(5 * LOOPS)
+    gc.collect()
+    grown = rss() - before
+    print(f"RSS growth after {5 * LOOPS} polls: {grown} bytes")
+    assert grown < 4 * 1024 * 1024
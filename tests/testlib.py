@@ -1,3 +1,4 @@
+import array
 import os
 
 import pytest
@@ -14,10 +15,11 @@ EVENTSET = "INSTR_RETIRED_ANY:FIXC0"
 
 @pytest.fixture(scope="module")
 def perfmon():
-    err = pylikwid.init(CPUS)
-    if err != 0:
+    try:
+        pylikwid.init(CPUS)
+    except RuntimeError as e:
         pytest.skip(
-            f"LIKWID perfmon init failed (err={err}); "
+            f"LIKWID perfmon init failed ({e}); "
             "requires root or likwid-accessD with appropriate permissions"
         )
     yield
@@ -31,6 +33,18 @@ def test_addeventset(perfmon):
     print(f"Eventset {EVENTSET} added with ID {gid}")
 
 
+def test_addeventset_registry(perfmon):
+    gid = pylikwid.addeventset(EVENTSET)
+    if gid < 0:
+        pytest.skip(f"Event set {EVENTSET!r} not supported on this architecture")
+    ngroups = pylikwid.getnumberofgroups()
+    assert pylikwid.addeventset(EVENTSET) == gid
+    assert pylikwid.addeventset(" " + EVENTSET.replace(":", " : ") + "\n") == gid
+    assert pylikwid.getnumberofgroups() == ngroups
+    assert pylikwid.getgid(EVENTSET) == gid
+    assert pylikwid.getgid("UNKNOWN_EVENT:PMC0") == -1
+
+
 def test_measurement_cycle(perfmon):
     gid = pylikwid.addeventset(EVENTSET)
     if gid < 0:
@@ -47,3 +61,49 @@ def test_measurement_cycle(perfmon):
         val = pylikwid.getresult(gid, 0, thread)
         assert val >= 0
         print(f"Result CPU {CPUS[thread]} : {val}")
+
+
+@pytest.mark.parametrize("cpus", [
+    range(len(CPUS)),
+    tuple(CPUS),
+    array.array("i", CPUS),
+    array.array("q", CPUS),
+    # Strided slices, the skipped items are no valid CPUs
+    memoryview(array.array("i", [x for c in CPUS for x in (c, -1)]))[::2],
+    memoryview(array.array("q", [x for c in CPUS for x in (c, -1)]))[::2],
+    ",".join(str(c) for c in CPUS),
+])
+def test_init_cpu_types(cpus):
+    pylikwid.finalize()
+    try:
+        assert pylikwid.init(cpus) == 0
+    except RuntimeError as e:
+        pytest.skip(f"LIKWID perfmon init failed ({e})")
+    assert pylikwid.getnumberofthreads() == len(CPUS)
+    pylikwid.finalize()
+
+
+def test_init_invalid():
+    with pytest.raises(TypeError):
+        pylikwid.init(1)
+    with pytest.raises(TypeError):
+        pylikwid.init(array.array("d", [0.0]))
+    with pytest.raises(ValueError):
+        pylikwid.init([-1])
+    with pytest.raises(ValueError):
+        pylikwid.init(array.array("i", [-1]))
+    with pytest.raises(ValueError):
+        pylikwid.init(array.array("i", [1 << 30]))
+    with pytest.raises(ValueError):
+        pylikwid.init(memoryview(array.array("i", [0, 0, -1]))[::2])
+    with pytest.raises(ValueError):
+        pylikwid.init([1 << 30])
+    with pytest.raises(TypeError):
+        pylikwid.init(array.array("I", [0]))
+    with pytest.raises(TypeError):
+        # Zero-dimensional buffer
+        pylikwid.init(memoryview(bytes(4)).cast("i", shape=[]))
+    with pytest.raises(ValueError):
+        pylikwid.init([])
+    with pytest.raises(ValueError):
+        pylikwid.init("X:foo")
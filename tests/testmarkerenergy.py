@@ -0,0 +1,100 @@
+import os
+import threading
+import time
+
+import pytest
+import pylikwid
+
+from testmarkerfile import write_markerfile
+
+pytestmark = pytest.mark.skipif(
+    "LIKWID_MODE" not in os.environ,
+    reason="Marker API requires running under likwid-perfctr (LIKWID_MODE not set)",
+)
+
+
+@pytest.fixture
+def energy():
+    if pylikwid.getpowerinfo() is None:
+        pytest.skip("No RAPL support")
+    pylikwid.markerinit()
+    pylikwid.markerthreadinit()
+    domains = pylikwid.markerenergy()
+    if not domains:
+        pytest.skip("Neither PKG nor DRAM energy supported")
+    yield domains
+    pylikwid.markerenergy(None)
+    pylikwid.markerclose()
+
+
+def test_markerenergy_region(energy, tmp_path, monkeypatch):
+    assert pylikwid.markergetregionenergy("compute") is None
+    for _ in range(2):
+        pylikwid.markerstartregion("compute")
+        time.sleep(0.05)
+        pylikwid.markerstopregion("compute")
+
+    def worker():
+        pylikwid.markerthreadinit()
+        pylikwid.markerstartregion("compute")
+        time.sleep(0.05)
+        pylikwid.markerstopregion("compute")
+
+    t = threading.Thread(target=worker)
+    t.start()
+    t.join()
+    res = pylikwid.markergetregionenergy("compute")
+    assert set(res) == {"seconds", "joules", "watts"}
+    assert 0.15 <= res["seconds"] < 1.0
+    assert sorted(res["joules"]) == sorted(energy)
+    for domain in energy:
+        assert res["joules"][domain] > 0
+        assert res["watts"][domain] == pytest.approx(res["joules"][domain] / res["seconds"])
+
+    # Written next to the result file by markerclose()
+    path = tmp_path / "marker.txt"
+    monkeypatch.setenv("LIKWID_FILEPATH", str(path))
+    pylikwid.markerclose()
+    with open(f"{path}.energy") as f:
+        lines = [line.rstrip("\n").split("\t") for line in f if not line.startswith("#")]
+    assert sorted(line[1] for line in lines) == sorted(energy)
+    assert {line[4] for line in lines} == {"compute"}
+    group = int(lines[0][0])
+    if group >= 0:
+        with open(path, "w") as f:
+            f.write(f"1 2 1\n0:compute-{group}\n1:other-{group}\n")
+            f.write(f"0 {group} 0 3 0.15 1 1.0\n1 {group} 0 1 0.1 1 1.0\n")
+        compute, other = pylikwid.markerfileiter(str(path))
+        assert compute.energy["seconds"] == pytest.approx(res["seconds"])
+        assert compute.energy["joules"] == pytest.approx(res["joules"])
+        assert other.energy is None
+        assert len(tuple(compute)) == 7
+    pylikwid.markerreadfile(str(path))
+    assert pylikwid.markerregionenergy(pylikwid.markernumregions()) is None
+
+
+def test_markerenergy_file(tmp_path):
+    path = tmp_path / "marker.txt"
+    write_markerfile(path, ["init", "compute"], 2)
+    with open(f"{path}.energy", "w") as f:
+        f.write("# pylikwid marker energy 1: group domain joules seconds tag\n")
+        f.write("1\tPKG\t20.0\t0.5\tcompute\n")
+        f.write("1\tDRAM\t5\t0.5\tcompute\n")
+    regions = list(pylikwid.markerfileiter(str(path)))
+    assert regions[0].energy is None
+    assert regions[1].energy == {"seconds": 0.5, "joules": {"PKG": 20.0, "DRAM": 5.0},
+                                 "watts": {"PKG": 40.0, "DRAM": 10.0}}
+    with open(f"{path}.energy", "a") as f:
+        f.write("not an energy line\n")
+    with pytest.raises(ValueError):
+        pylikwid.markerfileiter(str(path))
+
+
+def test_markerenergy_domains(energy):
+    with pytest.raises(ValueError):
+        pylikwid.markerenergy(["NO_SUCH_DOMAIN"])
+    assert pylikwid.markerenergy("PKG") == ["PKG"]
+    assert pylikwid.markerenergy(()) == []
+    pylikwid.markerstartregion("off")
+    pylikwid.markerstopregion("off")
+    assert pylikwid.markergetregionenergy("off") is None
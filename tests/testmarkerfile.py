@@ -0,0 +1,68 @@
+import pytest
+import pylikwid
+
+
+def write_markerfile(path, tags, threads, nevents=(2, 1)):
+    """Marker API result file in the format written by likwid_markerClose.
+    Region i belongs to group i % 2."""
+    with open(path, "w") as f:
+        f.write(f"{threads} {len(tags)} 2\n")
+        for i, tag in enumerate(tags):
+            f.write(f"{i}:{tag}-{i % 2}\n")
+        for i in range(len(tags)):
+            for t in range(threads):
+                events = " ".join(f"{float(i * 100 + t * 10 + e):e}" for e in range(nevents[i % 2]))
+                f.write(f"{i} {i % 2} {t} {i + 1} {float(t):e} {nevents[i % 2]} {events} \n")
+
+
+def test_markerfile_regions(tmp_path):
+    path = tmp_path / "marker.txt"
+    write_markerfile(path, ["init", "compute-phase", "compute-phase"], 4)
+    with pylikwid.markerfileiter(str(path)) as f:
+        assert (f.threads, f.regions, f.groups) == (4, 3, 2)
+        assert f.tags == ["init", "compute-phase", "compute-phase"]
+        regions = list(f)
+    assert [r.id for r in regions] == [0, 1, 2]
+    assert [r.group for r in regions] == [0, 1, 0]
+    r = regions[2]
+    assert r.tag == "compute-phase"
+    assert r.cpus == [0, 1, 2, 3]
+    assert r.counts == [3] * 4
+    assert r.times == [0.0, 1.0, 2.0, 3.0]
+    assert r.events[1] == [210.0, 211.0]
+    assert regions[1].events[0] == [100.0]
+    for r in regions:
+        print(r)
+
+
+def test_markerfile_filter(tmp_path):
+    path = tmp_path / "marker.txt"
+    tags = [f"region{i % 50}" for i in range(1000)]
+    write_markerfile(path, tags, 16)
+    ids = [r.id for r in pylikwid.markerfileiter(str(path), tags="region7")]
+    assert ids == [i for i in range(1000) if i % 50 == 7]
+    ids = [r.id for r in pylikwid.markerfileiter(str(path), tags=["region1", "region2"], groups=1)]
+    assert ids == [i for i in range(1000) if i % 50 in (1, 2) and i % 2 == 1]
+    assert list(pylikwid.markerfileiter(str(path), groups=[])) == []
+
+
+def test_markerfile_invalid(tmp_path):
+    path = tmp_path / "marker.txt"
+    with pytest.raises(OSError):
+        pylikwid.markerfileiter(str(path))
+    path.write_text("1 1 1\n0:a-0\n0 0 0 x 1.0 0\n")
+    with pytest.raises(ValueError):
+        list(pylikwid.markerfileiter(str(path)))
+    path.write_text("1 2 1\n0:a-0\n")
+    with pytest.raises(ValueError):
+        pylikwid.markerfileiter(str(path))
+    # Malformed or missing event values of a later thread
+    path.write_text("2 1 1\n0:a-0\n0 0 0 1 1.0 2 1.0 2.0\n0 0 1 1 1.0 2 1.0 nan?\n")
+    with pytest.raises(ValueError, match="line 4"):
+        list(pylikwid.markerfileiter(str(path)))
+    path.write_text("2 1 1\n0:a-0\n0 0 0 1 1.0 2 1.0\n0 0 1 1 1.0 2 1.0 2.0\n")
+    with pytest.raises(ValueError, match="line 3"):
+        list(pylikwid.markerfileiter(str(path)))
+    path.write_text("1 1 1\n0:a-0\n0 0 0 1 1.0 4000000000 1.0\n")
+    with pytest.raises(ValueError, match="line 3"):
+        list(pylikwid.markerfileiter(str(path)))
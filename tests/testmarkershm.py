@@ -0,0 +1,86 @@
+import multiprocessing
+import os
+
+import pytest
+import pylikwid
+
+pytestmark = pytest.mark.skipif(
+    "LIKWID_MODE" not in os.environ,
+    reason="Marker API requires running under likwid-perfctr (LIKWID_MODE not set)",
+)
+
+NAME = f"pylikwid-test-{os.getpid()}"
+
+
+@pytest.fixture
+def segment():
+    pylikwid.markershmcreate(NAME, slots=8, regions=4, events=8)
+    yield NAME
+    pylikwid.markershmunlink(NAME)
+
+
+def worker(name, calls, started, finish):
+    pylikwid.markerinit()
+    pylikwid.markerthreadinit()
+    pylikwid.markershmattach(name)
+    for _ in range(calls):
+        pylikwid.markerstartregion("work")
+        sum(range(10000))
+        pylikwid.markerstopregion("work")
+    started.set()
+    finish.wait(10)
+    pylikwid.markershmdetach()
+    pylikwid.markerclose()
+
+
+def test_markershm_aggregate(segment):
+    ctx = multiprocessing.get_context("fork")
+    started = [ctx.Event() for _ in range(2)]
+    finish = ctx.Event()
+    procs = [ctx.Process(target=worker, args=(segment, 3 + i, started[i], finish))
+             for i in range(2)]
+    for p in procs:
+        p.start()
+    try:
+        for e in started:
+            assert e.wait(10)
+        # Read while the workers are still running
+        view = pylikwid.markershmread(segment)
+        print(view)
+        assert len(view["processes"]) == 2
+        assert all(p["alive"] for p in view["processes"])
+        assert len(view["regions"]) == 1
+        (tag, group), region = next(iter(view["regions"].items()))
+        assert tag == "work" and region["group"] == group
+        assert region["count"] == 7
+        assert region["threads"] == 2
+        assert len(region["processes"]) == 2
+        assert region["time"] >= region["maxtime"] > 0
+        per_proc = [p["regions"][0]["events"] for p in view["processes"]]
+        assert region["events"] == [sum(v) for v in zip(*per_proc)]
+    finally:
+        finish.set()
+        for p in procs:
+            p.join(10)
+    view = pylikwid.markershmread(segment)
+    assert not any(p["alive"] for p in view["processes"])
+    assert view["regions"][("work", group)]["count"] == 7
+
+
+def test_markershm_slots(segment):
+    assert pylikwid.markershmattach(segment) == 0
+    with pytest.raises(RuntimeError):
+        pylikwid.markershmattach(segment)
+    pylikwid.markershmdetach(True)
+    assert pylikwid.markershmread(segment)["processes"] == []
+
+
+def test_markershm_invalid(segment):
+    with pytest.raises(OSError):
+        pylikwid.markershmcreate(segment)
+    with pytest.raises(OSError):
+        pylikwid.markershmread(segment + "-missing")
+    with pytest.raises(ValueError):
+        pylikwid.markershmcreate("a/b")
+    with pytest.raises(RuntimeError):
+        pylikwid.markershmpublish("work")
@@ -0,0 +1,107 @@
+import json
+import os
+import threading
+
+import pytest
+import pylikwid
+
+pytestmark = pytest.mark.skipif(
+    "LIKWID_MODE" not in os.environ,
+    reason="Marker API requires running under likwid-perfctr (LIKWID_MODE not set)",
+)
+
+
+def regions(trace, phase):
+    return [e for e in trace["traceEvents"] if e["ph"] == phase]
+
+
+def test_markertrace_regions(tmp_path):
+    pylikwid.markerinit()
+    pylikwid.markerthreadinit()
+    pylikwid.markertracestart(counters=False)
+    for _ in range(3):
+        pylikwid.markerstartregion("outer")
+        pylikwid.markerstartregion("inner \"quoted\"")
+        sum(range(10000))
+        pylikwid.markerstopregion("inner \"quoted\"")
+        pylikwid.markerstopregion("outer")
+
+    def worker():
+        pylikwid.markerthreadinit()
+        pylikwid.markerstartregion("worker")
+        pylikwid.markerstopregion("worker")
+
+    t = threading.Thread(target=worker)
+    t.start()
+    t.join()
+    stats = pylikwid.markertracestop()
+    assert stats == {"threads": 2, "records": 14, "dropped": 0}
+    # Not recorded after stop
+    pylikwid.markerstartregion("outer")
+    pylikwid.markerstopregion("outer")
+
+    path = tmp_path / "trace.json"
+    assert pylikwid.markertracewrite(str(path)) == 14
+    trace = json.loads(path.read_text())
+    begins, ends = regions(trace, "B"), regions(trace, "E")
+    assert len(begins) == len(ends) == 7
+    assert sorted({e["name"] for e in begins}) == ["inner \"quoted\"", "outer", "worker"]
+    assert len({e["tid"] for e in begins}) == 2
+    main = [e for e in trace["traceEvents"] if e["ph"] in "BE" and e["name"] != "worker"]
+    assert [e["ts"] for e in main] == sorted(e["ts"] for e in main)
+    assert [e["ph"] for e in main[:4]] == ["B", "B", "E", "E"]
+    assert not regions(trace, "C")
+    pylikwid.markerclose()
+
+
+def test_markertrace_dropped(tmp_path):
+    pylikwid.markerinit()
+    pylikwid.markertracestart(records=4)
+    for _ in range(5):
+        pylikwid.markerstartregion("r")
+        pylikwid.markerstopregion("r")
+    assert pylikwid.markertracestop() == {"threads": 1, "records": 4, "dropped": 6}
+    path = tmp_path / "trace.json"
+    pylikwid.markertracewrite(str(path))
+    assert json.loads(path.read_text())["otherData"]["dropped"] == 6
+    with pytest.raises(ValueError):
+        pylikwid.markertracestart(records=0)
+    with pytest.raises(OSError):
+        pylikwid.markertracewrite(str(tmp_path / "missing" / "trace.json"))
+    pylikwid.markerclose()
+
+
+@pytest.mark.skipif(not os.path.exists("/dev/cpu/0/msr"), reason="MSR device not available")
+def test_markertrace_counters(tmp_path):
+    try:
+        pylikwid.init([0])
+    except RuntimeError as e:
+        pytest.skip(f"LIKWID perfmon init failed ({e})")
+    try:
+        gid = pylikwid.addeventset("INSTR_RETIRED_ANY:FIXC0,CPU_CLK_UNHALTED_CORE:FIXC1")
+        if gid < 0:
+            pytest.skip("Event set not supported on this architecture")
+        pylikwid.setup(gid)
+        pylikwid.markerinit()
+        # Calls before the start must not show up in the first sample
+        pylikwid.markerstartregion("work")
+        pylikwid.markerstopregion("work")
+        pylikwid.markertracestart()
+        for _ in range(3):
+            pylikwid.markerstartregion("work")
+            sum(range(10000))
+            pylikwid.markerstopregion("work")
+        pylikwid.markertracestop()
+        path = tmp_path / "trace.json"
+        pylikwid.markertracewrite(str(path))
+        counters = regions(json.loads(path.read_text()), "C")
+        # Values of each call at the region start, zero at its end
+        assert len(counters) == 6
+        for start, end in zip(counters[::2], counters[1::2]):
+            assert start["name"] == "work" and start["ts"] < end["ts"]
+            assert set(start["args"]) == {"INSTR_RETIRED_ANY", "CPU_CLK_UNHALTED_CORE"}
+            assert all(v > 0 for v in start["args"].values())
+            assert all(v == 0 for v in end["args"].values())
+        pylikwid.markerclose()
+    finally:
+        pylikwid.finalize()
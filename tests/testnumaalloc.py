@@ -0,0 +1,62 @@
+import threading
+
+import pytest
+import pylikwid
+
+
+@pytest.fixture(scope="module")
+def numa():
+    info = pylikwid.initnuma()
+    yield info
+    pylikwid.finalizenuma()
+
+
+@pytest.mark.parametrize("hugepages", [False, True])
+def test_numa_alloc(numa, hugepages):
+    node = numa["nodes"][0]["id"]
+    buf = pylikwid.numa_alloc(1 << 20, node=node, hugepages=hugepages)
+    assert len(buf) == 1 << 20
+    assert buf.node == node
+    view = memoryview(buf)
+    assert not view.readonly
+    view[0] = 42
+    view[-1] = 43
+    assert bytes(view[:1]) == b"\x2a"
+    view.release()
+    buf.close()
+    assert len(buf) == 0
+    print(buf)
+
+
+def test_numa_alloc_local_node(numa):
+    # Pin a worker thread only, the affinity of the test process stays
+    res = []
+
+    def worker():
+        pylikwid.pinthread(numa["nodes"][0]["processors"][0])
+        res.append(pylikwid.numa_alloc(4096).node)
+
+    t = threading.Thread(target=worker)
+    t.start()
+    t.join()
+    assert res == [numa["nodes"][0]["id"]]
+
+
+def test_numa_alloc_close_with_views(numa):
+    buf = pylikwid.numa_alloc(4096, node=numa["nodes"][0]["id"])
+    view = memoryview(buf)
+    with pytest.raises(BufferError):
+        buf.close()
+    view.release()
+    buf.close()
+    with pytest.raises(ValueError):
+        memoryview(buf)
+
+
+def test_numa_alloc_invalid(numa):
+    with pytest.raises(ValueError):
+        pylikwid.numa_alloc(0)
+    with pytest.raises(ValueError):
+        pylikwid.numa_alloc(4096, node=max(n["id"] for n in numa["nodes"].values()) + 1)
+    with pytest.raises(ValueError):
+        pylikwid.numa_alloc(4096, node=numa["nodes"][0]["id"], hugepages="gigantic")
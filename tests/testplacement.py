@@ -0,0 +1,87 @@
+import pytest
+import pylikwid
+
+
+def synthetic(sockets, cores, smt, numa_per_socket=1):
+    """Topology dict like getcputopology() with Linux-style numbering:
+    first all physical cores, then the SMT siblings. Returns the topology
+    and an initnuma()-style dict."""
+    pool = {}
+    nodes = {}
+    ncores = sockets * cores
+    for t in range(smt):
+        for s in range(sockets):
+            for c in range(cores):
+                cpu = t * ncores + s * cores + c
+                pool[cpu] = {"apicId": cpu, "coreId": c, "threadId": t, "packageId": s}
+                node = s * numa_per_socket + c * numa_per_socket // cores
+                nodes.setdefault(node, {"id": node, "processors": []})
+                nodes[node]["processors"].append(cpu)
+    return {"threadPool": pool}, {"nodes": nodes}
+
+
+def socket_of(topo, cpu):
+    return topo["threadPool"][cpu]["packageId"]
+
+
+def test_compact():
+    topo, numa = synthetic(2, 4, 2)
+    plan = pylikwid.plan_placement(6, "compact", topology=topo, numa=numa)
+    assert plan == [[0], [1], [2], [3], [4], [5]]
+
+
+def test_compact_smt():
+    topo, numa = synthetic(2, 4, 2)
+    plan = pylikwid.plan_placement(6, "compact", avoid_smt=False, topology=topo, numa=numa)
+    # physical cores of socket 0, then their siblings
+    assert plan == [[0], [1], [2], [3], [8], [9]]
+
+
+def test_scatter():
+    topo, numa = synthetic(2, 4, 2)
+    plan = pylikwid.plan_placement(4, "scatter", topology=topo, numa=numa)
+    assert plan == [[0], [4], [1], [5]]
+    assert [socket_of(topo, w[0]) for w in plan] == [0, 1, 0, 1]
+
+
+def test_per_numa():
+    topo, numa = synthetic(2, 4, 2, numa_per_socket=2)
+    plan = pylikwid.plan_placement(4, "per-numa", topology=topo, numa=numa)
+    assert plan == [[0], [2], [4], [6]]
+
+
+def test_cpus_per_worker():
+    topo, numa = synthetic(2, 4, 2)
+    plan = pylikwid.plan_placement(2, "scatter", cpus_per_worker=4, topology=topo, numa=numa)
+    assert plan == [[0, 1, 2, 3], [4, 5, 6, 7]]
+    plan = pylikwid.plan_placement(2, "compact", avoid_smt=False, cpus_per_worker=4,
+                                   topology=topo, numa=numa)
+    assert plan == [[0, 1, 2, 3], [8, 9, 10, 11]]
+
+
+def test_reserve():
+    topo, numa = synthetic(2, 4, 2)
+    # reserve the first core with its sibling for the OS
+    plan = pylikwid.plan_placement(3, "compact", avoid_smt=False, reserve=1, topology=topo, numa=numa)
+    assert plan == [[1], [2], [3]]
+    plan = pylikwid.plan_placement(2, "scatter", reserve=[0, 4], topology=topo, numa=numa)
+    assert plan == [[1], [5]]
+
+
+def test_not_enough_cpus():
+    topo, numa = synthetic(1, 4, 2)
+    with pytest.raises(ValueError):
+        pylikwid.plan_placement(5, "compact", topology=topo, numa=numa)
+    assert len(pylikwid.plan_placement(8, "compact", avoid_smt=False, topology=topo)) == 8
+    with pytest.raises(ValueError):
+        pylikwid.plan_placement(1, "random", topology=topo)
+    with pytest.raises(ValueError):
+        pylikwid.plan_placement(1, topology={"threads": {}})
+
+
+def test_system():
+    topo = pylikwid.getcputopology()
+    plan = pylikwid.plan_placement(1, "scatter")
+    assert len(plan) == 1
+    assert plan[0][0] in [t["apicId"] for t in topo["threadPool"].values()]
+    print(plan)
@@ -0,0 +1,113 @@
+import os
+import subprocess
+import sys
+import textwrap
+import time
+
+import pytest
+import pylikwid
+
+
+@pytest.fixture
+def rapl():
+    info = pylikwid.getpowerinfo()
+    if info is None:
+        pytest.skip("No RAPL support")
+    if not info["domains"]["PKG"]["supportLimit"]:
+        pytest.skip("PKG domain does not support power limits")
+    yield info
+    pylikwid.restorepowerlimits()
+
+
+def test_powerlimit_set_restore(rapl):
+    before = pylikwid.getpowerlimit(0, "PKG")
+    assert set(before) == {"watts", "window", "active"}
+    pylikwid.setpowerlimit(0, "PKG", before["watts"] - 10)
+    pylikwid.setpowerlimit(0, "PKG", before["watts"] - 20, 0.02)
+    now = pylikwid.getpowerlimit(0)
+    assert now["watts"] == pytest.approx(before["watts"] - 20)
+    assert now["window"] == pytest.approx(0.02)
+    assert now["active"]
+    # The limit before the first change is restored
+    assert pylikwid.restorepowerlimits() == 1
+    assert pylikwid.getpowerlimit(0, "PKG") == before
+    assert pylikwid.restorepowerlimits() == 0
+
+
+def test_powerlimit_restore_all(rapl):
+    domains = [name for name, d in rapl["domains"].items() if d["supportLimit"]]
+    sockets = pylikwid.getcputopology()["numSockets"]
+    before = {(s, d): pylikwid.getpowerlimit(s, d) for s in range(sockets) for d in domains}
+    for (s, d), limit in before.items():
+        pylikwid.setpowerlimit(s, d, limit["watts"] / 2, limit["window"] / 2)
+        assert pylikwid.getpowerlimit(s, d)["active"]
+    assert pylikwid.restorepowerlimits() == len(before)
+    assert {key: pylikwid.getpowerlimit(*key) for key in before} == before
+
+
+def test_powerlimit_arguments(rapl):
+    with pytest.raises(ValueError):
+        pylikwid.setpowerlimit(0, "NO_SUCH_DOMAIN", 100)
+    with pytest.raises(ValueError):
+        pylikwid.setpowerlimit(1 << 20, "PKG", 100)
+    with pytest.raises(ValueError):
+        pylikwid.setpowerlimit(0, "PKG", -1)
+    with pytest.raises(ValueError):
+        pylikwid.getpowerlimit(-1)
+
+
+def test_powerlimit_restore_at_exit(rapl):
+    # Exit handlers run in reverse order, the one registered before the
+    # first setpowerlimit() sees the restored limit
+    script = textwrap.dedent("""
+        import atexit
+        import pylikwid
+        before = pylikwid.getpowerlimit(0)["watts"]
+        atexit.register(lambda: print(pylikwid.getpowerlimit(0)["watts"] == before))
+        pylikwid.setpowerlimit(0, "PKG", before / 2)
+        print(pylikwid.getpowerlimit(0)["watts"] == before / 2)
+    """)
+    out = subprocess.run([sys.executable, "-c", script], capture_output=True,
+                         text=True, env=os.environ, check=True).stdout
+    assert out.split() == ["True", "True"]
+
+
+def test_controller_converges():
+    backend = pylikwid.SimulatedPowerBackend(sockets=2, scale=1e9, limit=150.0)
+    # work/J = 1e9 / sqrt(W), the target is reached at 100 W
+    controller = pylikwid.PowerCapController(backend, target=1e8, gain=0.5, maxstep=10.0)
+    for _ in range(50):
+        limits = controller.step()
+    assert limits == {0: pytest.approx(100.0, rel=0.05), 1: pytest.approx(100.0, rel=0.05)}
+    assert controller.efficiency[0] == pytest.approx(1e8, rel=0.02)
+    # Steps are bounded by maxstep
+    watts = [150.0] + [w for s, w in backend.history if s == 0]
+    assert all(abs(b - a) <= 10.0 + 1e-9 for a, b in zip(watts, watts[1:]))
+    controller.stop()
+    assert backend.limit == {0: 150.0, 1: 150.0}
+
+
+def test_controller_bounds():
+    backend = pylikwid.SimulatedPowerBackend(sockets=1, limit=100.0)
+    # Unreachable target, the limit runs into the lower bound
+    controller = pylikwid.PowerCapController(backend, target=1e12, minwatts=60.0)
+    for _ in range(20):
+        controller.step()
+    assert backend.limit[0] == 60.0
+    controller = pylikwid.PowerCapController(backend, target=1.0, maxwatts=120.0)
+    for _ in range(20):
+        controller.step()
+    assert backend.limit[0] == 120.0
+    with pytest.raises(ValueError):
+        pylikwid.PowerCapController(backend, target=0)
+
+
+def test_controller_thread():
+    backend = pylikwid.SimulatedPowerBackend(sockets=1, limit=150.0)
+    with pylikwid.PowerCapController(backend, target=1e8, interval=0.01) as controller:
+        with pytest.raises(RuntimeError):
+            controller.start()
+        while len(backend.history) < 5:
+            time.sleep(0.01)
+    assert backend.history[0][1] < 150.0
+    assert backend.limit[0] == 150.0
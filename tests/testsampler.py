@@ -0,0 +1,91 @@
+import os
+import threading
+import time
+
+import pytest
+import pylikwid
+
+
+def busy(seconds):
+    end = time.perf_counter() + seconds
+    x = 0
+    while time.perf_counter() < end:
+        x += 1
+    return x
+
+
+def other_busy():
+    busy(0.3)
+
+
+def test_sampler_runtime(tmp_path):
+    pylikwid.samplerstart(interval=0.005)
+    with pytest.raises(RuntimeError):
+        pylikwid.samplerstart()
+    t = threading.Thread(target=other_busy)
+    t.start()
+    busy(0.3)
+    t.join()
+    stats = pylikwid.samplerstop()
+    assert stats["samples"] > 10
+    stacks = pylikwid.samplerstacks()
+    assert stats["stacks"] == len(stacks)
+    main = [s for s in stacks if s.endswith(f"busy ({__file__})") and "other_busy" not in s]
+    other = [s for s in stacks if "other_busy" in s]
+    assert main and other
+    # Runtime weights in ns
+    assert sum(stacks[s] for s in main) > 0.05e9
+    for stack in stacks:
+        frames = stack.split(";")
+        assert all(f.endswith(")") for f in frames)
+    path = tmp_path / "stacks.folded"
+    n = pylikwid.samplerwrite(str(path))
+    lines = path.read_text().splitlines()
+    assert len(lines) == n and n > 0
+    assert lines == sorted(lines)
+    for line in lines:
+        stack, weight = line.rsplit(" ", 1)
+        assert stack in stacks and int(weight) > 0
+
+
+def test_sampler_lines():
+    pylikwid.samplerstart(interval=0.005, lines=True)
+    busy(0.1)
+    pylikwid.samplerstop()
+    stacks = pylikwid.samplerstacks()
+    assert any(f"busy ({__file__}:" in s for s in stacks)
+    with pytest.raises(ValueError):
+        pylikwid.samplerstart(interval=0)
+    with pytest.raises(RuntimeError):
+        pylikwid.samplerstart(event=0)
+
+
+@pytest.mark.skipif(not os.path.exists("/dev/cpu/0/msr"), reason="MSR device not available")
+def test_sampler_counters(tmp_path):
+    topo = pylikwid.getcputopology()
+    cpus = sorted(entry["apicId"] for entry in topo["threadPool"].values())
+    try:
+        pylikwid.init(cpus)
+    except RuntimeError as e:
+        pytest.skip(f"LIKWID perfmon init failed ({e})")
+    try:
+        gid = pylikwid.addeventset("INSTR_RETIRED_ANY:FIXC0,CPU_CLK_UNHALTED_CORE:FIXC1")
+        if gid < 0:
+            pytest.skip("Event set not supported on this architecture")
+        pylikwid.setup(gid)
+        pylikwid.start()
+        with pytest.raises(ValueError):
+            pylikwid.samplerstart(event="NO_SUCH_EVENT")
+        pylikwid.samplerstart(interval=0.005, event="CPU_CLK_UNHALTED_CORE")
+        busy(0.3)
+        stats = pylikwid.samplerstop()
+        pylikwid.stop()
+        stacks = pylikwid.samplerstacks()
+        assert stats["samples"] > 10
+        assert any(s.endswith(f"busy ({__file__})") for s in stacks)
+        assert all(w >= 0 for w in stacks.values())
+        # finalize() stops a running counter-weighted sampler
+        pylikwid.samplerstart(interval=0.005, event=0)
+    finally:
+        pylikwid.finalize()
+    assert pylikwid.samplerstop()["samples"] >= 0
@@ -0,0 +1,73 @@
+import os
+
+import pytest
+import pylikwid
+
+pytestmark = pytest.mark.skipif(
+    os.geteuid() != 0,
+    reason="Frequency tests require root privileges",
+)
+
+
+def work(n=200000):
+    return sum(i * i for i in range(n))
+
+
+def test_sweep_frequencies():
+    freqs = sorted(int(float(f) * 1e9) for f in pylikwid.getavailfreqs(0).split())[:2]
+    cpus = [0, 1]
+    saved = [(pylikwid.getcpuclockmin(c), pylikwid.getcpuclockmax(c)) for c in cpus]
+    affinity = os.sched_getaffinity(0)
+    res = pylikwid.sweep_frequencies(work, "0,1", freqs=freqs[::-1], repeats=2,
+                                     args=(1000,))
+    points = res["points"]
+    assert [p["freq"] for p in points] == freqs
+    assert all(len(p["runtimes"]) == 2 and p["uncore"] is None for p in points)
+    if pylikwid.getpowerinfo() is not None:
+        assert all(p["energy"] > 0 and p["power"] > 0 for p in points)
+        assert res["energy_optimal"]["energy"] == min(p["energy"] for p in points)
+        assert res["edp_optimal"]["edp"] == min(p["edp"] for p in points)
+        for p in points:
+            assert p["edp"] == pytest.approx(p["energy"] * p["runtime"])
+    assert res["energy_optimal"] in points and res["edp_optimal"] in points
+    # Original settings restored
+    assert [(pylikwid.getcpuclockmin(c), pylikwid.getcpuclockmax(c)) for c in cpus] == saved
+    assert os.sched_getaffinity(0) == affinity
+
+
+def test_sweep_pinned_and_uncore():
+    cpus = []
+    umin, umax = pylikwid.getuncoreclockmin(0), pylikwid.getuncoreclockmax(0)
+    if umax == 0:
+        pytest.skip("No Uncore frequency control")
+    res = pylikwid.sweep_frequencies(lambda: cpus.append(os.sched_getaffinity(0)), [0],
+                                     freqs=[int(float(pylikwid.getavailfreqs(0).split()[0]) * 1e9)],
+                                     uncore=[umin, umax], repeats=1)
+    assert [p["uncore"] for p in res["points"]] == [umin, umax]
+    assert cpus == [{0}, {0}]
+    assert (pylikwid.getuncoreclockmin(0), pylikwid.getuncoreclockmax(0)) == (umin, umax)
+    with pytest.raises(ValueError):
+        pylikwid.sweep_frequencies(work, [0], repeats=0)
+
+
+def test_sweep_failure_restores():
+    saved = pylikwid.getcpuclockmax(0)
+
+    def fail():
+        raise KeyError("workload failed")
+
+    with pytest.raises(KeyError):
+        pylikwid.sweep_frequencies(fail, [0], freqs=[int(saved) // 2])
+    assert pylikwid.getcpuclockmax(0) == saved
+
+
+@pytest.mark.skipif(not os.path.exists("/dev/cpu/0/msr"), reason="MSR device not available")
+def test_sweep_group():
+    freq = int(float(pylikwid.getavailfreqs(0).split()[-1]) * 1e9)
+    try:
+        res = pylikwid.sweep_frequencies(work, [0, 1], freqs=[freq], repeats=1, group="L3")
+    except (RuntimeError, ValueError) as e:
+        pytest.skip(f"Group L3 not available ({e})")
+    point = res["points"][0]
+    assert point["events"] and point["metrics"]
+    assert all(isinstance(v, float) for v in point["metrics"].values())
@@ -1,3 +1,8 @@
+import json
+import math
+import subprocess
+import sys
+
 import pytest
 import pylikwid
 
@@ -40,3 +45,92 @@ def test_threadpool_entries(topology):
         assert "threadId" in entry
         assert "packageId" in entry
         print(f"{entry['apicId']}\t{entry['coreId']}\t{entry['threadId']}\t{entry['packageId']}")
+
+
+def test_cacheblocking(topology):
+    advice = pylikwid.cacheblocking(elemsize=8, streams=2)
+    levels = [c["level"] for c in topology["cacheLevels"].values()
+              if c.get("type") in ("data", "unified")]
+    assert [a["level"] for a in advice] == levels
+    for a in advice:
+        line = a["lineSize"] // 8
+        assert a["tile"] >= line and a["tile"] % line == 0
+        assert a["tileBytes"] * 2 <= a["capacity"] or a["tile"] == line
+        print(f"L{a['level']}: {a['sharers']} sharers, tile {a['tile']}x{a['tile']}")
+
+
+def test_cacheblocking_ld(topology):
+    # A power-of-two row stride maps the rows of a tile to few sets
+    advice = pylikwid.cacheblocking(ld=4096, threads=1)
+    for a in advice:
+        assert a["paddedLd"] >= 4096
+        if not a["conflicts"]:
+            assert a["paddedLd"] == 4096
+            continue
+        # Either a conflict-free padding or, if none is found for this cache
+        # geometry, a row stride coprime to the number of sets
+        padded = pylikwid.cacheblocking(ld=a["paddedLd"], threads=1)
+        stride = a["paddedLd"] * 8 // a["lineSize"]
+        assert (not [p for p in padded if p["level"] == a["level"]][0]["conflicts"] or
+                math.gcd(stride, a["sets"]) == 1)
+        print(f"L{a['level']}: ld 4096 conflicts {a['conflicts']}, padded ld {a['paddedLd']}")
+    with pytest.raises(ValueError):
+        pylikwid.cacheblocking(elemsize=0)
+
+
+def test_getinittimes_lazy():
+    # Fresh interpreter, other tests may already have initialized NUMA
+    code = "import json, pylikwid; pylikwid.getcputopology(); print(json.dumps(pylikwid.getinittimes()))"
+    out = subprocess.run([sys.executable, "-c", code], check=True,
+                         stdout=subprocess.PIPE, universal_newlines=True).stdout
+    times = json.loads(out.strip().splitlines()[-1])
+    assert times["topology"]["initialized"]
+    assert times["topology"]["calls"] == 1
+    assert not times["numa"]["initialized"]
+    assert not times["affinity"]["initialized"]
+    for name in times:
+        print(f"{name}: {times[name]}")
+
+
+SNAPSHOT_CHILD = """
+import json, sys, pylikwid
+if sys.argv[1] == "save":
+    print(json.dumps(pylikwid.save_topology(sys.argv[2])))
+else:
+    print(json.dumps(pylikwid.load_topology(sys.argv[2])))
+print(json.dumps([pylikwid.getcpuinfo(), pylikwid.getcputopology(),
+                  pylikwid.initnuma(), pylikwid.initaffinity(),
+                  pylikwid.getinittimes()["topology"]]))
+"""
+
+
+def run_snapshot_child(mode, path):
+    out = subprocess.run([sys.executable, "-c", SNAPSHOT_CHILD, mode, str(path)], check=True,
+                         stdout=subprocess.PIPE, universal_newlines=True).stdout
+    return [json.loads(line) for line in out.strip().splitlines()[-2:]]
+
+
+def test_topology_snapshot(tmp_path):
+    path = tmp_path / "topo.snap"
+    _, saved = run_snapshot_child("save", path)
+    loaded, restored = run_snapshot_child("load", path)
+    assert loaded is True
+    assert restored[:4] == saved[:4]
+    assert restored[4]["snapshot"]
+    print(f"probe: {saved[4]['time'] * 1E6:.1f} us, snapshot: {restored[4]['time'] * 1E6:.1f} us")
+
+
+def test_topology_snapshot_stale(tmp_path):
+    path = tmp_path / "topo.snap"
+    run_snapshot_child("save", path)
+    data = bytearray(path.read_bytes())
+    # CPU model of the fingerprint
+    data[56:64] = b"Unknown\0"
+    path.write_bytes(bytes(data))
+    loaded, restored = run_snapshot_child("load", path)
+    assert loaded is False
+    assert not restored[4]["snapshot"]
+    data[0:8] = b"NOTATOPO"
+    path.write_bytes(bytes(data))
+    with pytest.raises(subprocess.CalledProcessError):
+        run_snapshot_child("load", path)
@@ -0,0 +1,114 @@
+import os
+
+import pytest
+import pylikwid
+
+CPUS = [0]
+EVENTSET = "INSTR_RETIRED_ANY:FIXC0"
+
+
+@pytest.fixture
+def tracefile(tmp_path):
+    path = str(tmp_path / "session.trace")
+    yield path
+    pylikwid.tracestop()
+
+
+def test_trace_topology(tracefile):
+    pylikwid.tracerecord(tracefile)
+    assert pylikwid.tracemode() == "record"
+    topo = pylikwid.getcputopology()
+    cpus = pylikwid.cpustr_to_cpulist("N:0")
+    assert pylikwid.tracestop() > 0
+    assert pylikwid.tracemode() == "off"
+
+    records = pylikwid.readtrace(tracefile)
+    names = [r[0] for r in records]
+    assert "getcpuinfo" in names
+    assert "cpustr_to_cpulist" in names
+    print(f"{len(records)} records in {tracefile}")
+
+    assert pylikwid.tracereplay(tracefile) == len(records)
+    assert pylikwid.tracemode() == "replay"
+    assert pylikwid.getcputopology() == topo
+    assert pylikwid.cpustr_to_cpulist("N:0") == cpus
+    assert pylikwid.initaffinity() == records[names.index("initaffinity")][2]
+    with pytest.raises(LookupError):
+        pylikwid.cpustr_to_cpulist("S0:0-1")
+
+
+def test_trace_perfmon(tracefile):
+    pylikwid.tracerecord(tracefile)
+    try:
+        pylikwid.init(CPUS)
+    except RuntimeError as e:
+        pylikwid.tracestop()
+        pytest.skip(f"LIKWID perfmon init failed ({e})")
+    gid = pylikwid.addeventset(EVENTSET)
+    if gid < 0:
+        pylikwid.finalize()
+        pytest.skip(f"Event set {EVENTSET!r} not supported on this architecture")
+    pylikwid.setup(gid)
+    pylikwid.start()
+    sum(range(100000))
+    pylikwid.stop()
+    recorded = pylikwid.getresult(gid, 0, 0)
+    event = pylikwid.getnameofevent(gid, 0)
+    pylikwid.finalize()
+    pylikwid.tracestop()
+
+    pylikwid.tracereplay(tracefile)
+    assert pylikwid.init(CPUS) == 0
+    assert pylikwid.addeventset(EVENTSET) == gid
+    assert pylikwid.getnameofevent(gid, 0) == event
+    pylikwid.setup(gid)
+    pylikwid.start()
+    pylikwid.stop()
+    # Not recorded explicitly, served from the results recorded after stop
+    assert pylikwid.getlastresult(gid, 0, 0) >= 0
+    assert pylikwid.getresult(gid, 0, 0) == recorded
+    assert pylikwid.gettimeofgroup(gid) >= 0
+    pylikwid.finalize()
+    print(f"Replayed {event}: {recorded}")
+
+
+def test_trace_invalid(tracefile, tmp_path):
+    with pytest.raises(OSError):
+        pylikwid.tracereplay(str(tmp_path / "missing.trace"))
+    bad = tmp_path / "bad.trace"
+    bad.write_bytes(b"no trace")
+    with pytest.raises(ValueError):
+        pylikwid.readtrace(str(bad))
+    pylikwid.tracerecord(tracefile)
+    with pytest.raises(RuntimeError):
+        pylikwid.tracereplay(tracefile)
+
+
+def test_trace_synthetic():
+    # Checked-in trace written by maketrace.py, replayed without counter access
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "synthetic.trace")
+    assert pylikwid.tracereplay(path) == 21
+    try:
+        assert pylikwid.getcputopology()["numHWThreads"] == 2
+        assert pylikwid.cpustr_to_cpulist("S0:0-1") == [0, 1]
+        assert pylikwid.init([0, 1]) == 0
+        gid = pylikwid.addeventset("INSTR_RETIRED_ANY:FIXC0,CPU_CLK_UNHALTED_CORE:FIXC1")
+        assert gid == 0
+        assert pylikwid.getnameofevent(gid, 1) == "CPU_CLK_UNHALTED_CORE"
+        assert pylikwid.getnameofmetric(gid, 0) == "CPI"
+        assert pylikwid.setup(gid) == 0
+        assert pylikwid.start() == 0
+        assert pylikwid.read() == 0
+        assert pylikwid.getresult(gid, 0, 1) == 2000.0
+        assert pylikwid.getmetric(gid, 0, 0) == 1.5
+        # Queries see the results of the current position
+        assert pylikwid.stop() == 0
+        assert pylikwid.getresult(gid, 0, 1) == 6000.0
+        assert pylikwid.getlastresult(gid, 1, 0) == 3000.0
+        assert pylikwid.getlastmetric(gid, 0, 1) == 0.5
+        assert pylikwid.gettimeofgroup(gid) == 1.0
+        with pytest.raises(LookupError):
+            pylikwid.start()
+        assert pylikwid.finalize() == 0
+    finally:
+        pylikwid.tracestop()
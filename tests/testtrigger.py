@@ -0,0 +1,89 @@
+import os
+import time
+
+import pytest
+import pylikwid
+
+pytestmark = pytest.mark.skipif(not os.path.exists("/dev/cpu/0/msr"),
+                                reason="MSR device not available")
+
+
+@pytest.fixture
+def group():
+    topo = pylikwid.getcputopology()
+    cpus = sorted(entry["apicId"] for entry in topo["threadPool"].values())
+    try:
+        pylikwid.init(cpus)
+    except RuntimeError as e:
+        pytest.skip(f"LIKWID perfmon init failed ({e})")
+    try:
+        gid = pylikwid.addeventset("L3")
+        if gid < 0 or pylikwid.getnumberofmetrics(gid) == 0:
+            pytest.skip("Performance group L3 not supported on this architecture")
+        pylikwid.setup(gid)
+        pylikwid.start()
+        yield gid, cpus
+        pylikwid.triggerstop()
+        pylikwid.stop()
+    finally:
+        pylikwid.finalize()
+    pylikwid.triggercaptures()
+
+
+def test_trigger_capture(group):
+    gid, cpus = group
+    metric = pylikwid.getnameofmetric(gid, 0)
+    pylikwid.triggerstart(metric, -1e30, interval=0.1, capture_interval=0.01,
+                          pre=0.05, post=0.05, op="max")
+    with pytest.raises(RuntimeError):
+        pylikwid.triggerstart(0, 0.0)
+    time.sleep(0.5)
+    stats = pylikwid.triggerstop()
+    assert stats["triggers"] >= 1
+    captures = pylikwid.triggercaptures()
+    assert len(captures) >= 1 and pylikwid.triggercaptures() == []
+    capture = captures[0]
+    assert capture["metric"] == metric and capture["gid"] == gid
+    assert capture["cpus"] == cpus
+    assert len(capture["metrics"]) == pylikwid.getnumberofmetrics(gid)
+    times = [t for t, _ in capture["samples"]]
+    assert times == sorted(times)
+    # Data from the pre-trigger ring buffer and after the trigger
+    assert times[0] < capture["time"] < times[-1]
+    assert capture["time"] - times[0] <= 0.05 + 1e-6
+    assert times[-1] - capture["time"] >= 0.05
+    for _, values in capture["samples"]:
+        assert len(values) == len(capture["metrics"])
+        assert all(len(v) == len(cpus) for v in values)
+
+
+def test_trigger_callback_low_rate(group):
+    gid, _ = group
+    captures = []
+    pylikwid.triggerstart(0, -1e30, above=True, interval=0.05, capture_interval=0.01,
+                          post=0.02, callback=captures.append)
+    time.sleep(0.3)
+    pylikwid.triggerstop()
+    assert captures and pylikwid.triggercaptures() == []
+    # No pre-trigger data: the first sample is the one that fired
+    for capture in captures:
+        assert capture["samples"][0][0] >= capture["time"] - 0.05
+
+
+def test_trigger_not_fired(group):
+    pylikwid.triggerstart(0, 1e30, interval=0.02, capture_interval=0.01, pre=0.05)
+    time.sleep(0.2)
+    stats = pylikwid.triggerstop()
+    assert stats["triggers"] == 0 and stats["samples"] > 5
+    assert pylikwid.triggercaptures() == []
+
+
+def test_trigger_arguments(group):
+    with pytest.raises(ValueError):
+        pylikwid.triggerstart("NO_SUCH_METRIC", 0.0)
+    with pytest.raises(ValueError):
+        pylikwid.triggerstart(0, 0.0, op="median")
+    with pytest.raises(ValueError):
+        pylikwid.triggerstart(0, 0.0, interval=0.01, capture_interval=0.1)
+    with pytest.raises(TypeError):
+        pylikwid.triggerstart(0, 0.0, callback=1)